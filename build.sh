@@ -20,13 +20,13 @@ mkdir -p $BUILDDIR $BINDIR $OBJDIR $SHADERBIN
 
 # Main project settings
 CFLAGS=(
-    -std=c17 -I$RESINCLUDE
+    -std=c17 -I$RESINCLUDE -pthread
     -Wall -Wextra -Wpedantic
     $(pkg-config --cflags glfw3)
     $(pkg-config --cflags vulkan)
 )
 LDFLAGS=(
-    -lc
+    -lc -lm -pthread
     $(pkg-config --libs glfw3)
     $(pkg-config --libs vulkan)
 )
@@ -58,6 +58,12 @@ TARGET=$BUILDDIR/bin/vulkan-c
 FILES=(
     main.c engine.c device_api.c vkalloc.c mesh.c
     device_utils.c window.c swapchain.c app.c
+    render_queue.c frustum.c gpu_scene.c cpu_cull.c bench.c
+    render_graph.c frame_pacer.c deletion_queue.c readback.c
+    pipeline_cache.c thread_pool.c pipeline_service.c pipeline_registry.c
+    shader_variant.c shader_watcher.c spirv_reflect.c layout_cache.c
+    blas.c blas_builder.c tlas.c sbt.c cpu_bvh.c deferred_join.c
+    cpu_trace.c
 )
 
 OBJFILES=${FILES[@]/#/$OBJDIR\/}
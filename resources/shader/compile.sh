@@ -6,12 +6,21 @@ echo "Compiling shaders."
 
 $GLSLC main.vert -o $SHADERBIN/main.vert.spv
 $GLSLC main.frag -o $SHADERBIN/main.frag.spv
-$GLSLC ray.rgen -o $SHADERBIN/ray.rgen.spv
+$GLSLC --target-env=vulkan1.2 ray.rgen -o $SHADERBIN/ray.rgen.spv
+$GLSLC --target-env=vulkan1.2 ray.rmiss -o $SHADERBIN/ray.rmiss.spv
+$GLSLC --target-env=vulkan1.2 ray.rchit -o $SHADERBIN/ray.rchit.spv
+$GLSLC --target-env=vulkan1.2 cull.comp -o $SHADERBIN/cull.comp.spv
 
 $BINDIR/embedder $SHADERBIN/main.vert.spv -o main.vert.h
 $BINDIR/embedder $SHADERBIN/main.frag.spv -o main.frag.h
 $BINDIR/embedder $SHADERBIN/ray.rgen.spv -o ray.rgen.h
+$BINDIR/embedder $SHADERBIN/ray.rmiss.spv -o ray.rmiss.h
+$BINDIR/embedder $SHADERBIN/ray.rchit.spv -o ray.rchit.h
+$BINDIR/embedder $SHADERBIN/cull.comp.spv -o cull.comp.h
 
 mv main.vert.h $RESINCLUDE/main.vert.h
 mv main.frag.h $RESINCLUDE/main.frag.h
 mv ray.rgen.h $RESINCLUDE/ray.rgen.h
+mv ray.rmiss.h $RESINCLUDE/ray.rmiss.h
+mv ray.rchit.h $RESINCLUDE/ray.rchit.h
+mv cull.comp.h $RESINCLUDE/cull.comp.h
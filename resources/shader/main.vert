@@ -2,10 +2,11 @@
 
 layout(location = 0) in vec3 vPos;
 layout(location = 1) in vec3 vColor;
+layout(location = 2) in mat4 iTransform;
 
 layout(location = 0) out vec3 fragColor;
 
 void main() {
-    gl_Position = vec4(vPos, 1.0);
+    gl_Position = iTransform * vec4(vPos, 1.0);
     fragColor = vColor;
 }
@@ -1,9 +1,29 @@
 #include "app.h"
 #include "arrays.h"
+#include "blas.h"
+#include "blas_builder.h"
+#include "cpu_cull.h"
+#include "cpu_trace.h"
+#include "deletion_queue.h"
 #include "device_api.h"
 #include "engine.h"
+#include "frame_pacer.h"
+#include "frustum.h"
+#include "gpu_scene.h"
+#include "layout_cache.h"
 #include "mesh.h"
+#include "pipeline_cache.h"
+#include "pipeline_registry.h"
+#include "pipeline_service.h"
+#include "readback.h"
+#include "render_graph.h"
+#include "render_queue.h"
+#include "sbt.h"
+#include "shader_watcher.h"
+#include "spirv_reflect.h"
 #include "swapchain.h"
+#include "thread_pool.h"
+#include "tlas.h"
 #include "vkalloc.h"
 #include "window.h"
 
@@ -21,7 +41,34 @@
 #define VK_EXT_METAL_SURFACE_EXTENSION_NAME "VK_EXT_metal_surface"
 #define VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME "VK_KHR_portability_subset"
 
-#define FRAMES_IN_FLIGHT 2
+// Quads per row of the instanced demo grid
+#define DEMO_GRID_SIZE 32
+// Bounding sphere radius over the half extent of a demo quad. The quad is square, its corners
+// lie sqrt(2) out from the center, rounded up so they stay inside the sphere.
+#define DEMO_QUAD_CORNER_RADIUS 1.4143f
+// Upper bound for the present wait limiter, a present that never completes must not hang the app
+#define PRESENT_WAIT_TIMEOUT 100000000ull
+// Scratch one batch of BLAS builds may use, larger builds get a batch of their own
+#define BLAS_SCRATCH_BUDGET (32ull * 1024 * 1024)
+// Refit the TLAS until an instance moved a tenth of the grid or after this many refits
+#define TLAS_REBUILD_MOTION 0.1f
+#define TLAS_MAX_REFITS 64
+// Ray traced image, scaled onto the swapchain image by the blit
+#define RAY_IMAGE_WIDTH 1024
+#define RAY_IMAGE_HEIGHT 1024
+// Same view traced on the CPU when the device can't, smaller to keep it interactive
+#define CPU_RAY_IMAGE_WIDTH 256
+#define CPU_RAY_IMAGE_HEIGHT 256
+// Color of rays that hit nothing, for both views
+#define RAY_BACKGROUND {0.05f, 0.05f, 0.1f, 1.0f}
+// Shader groups of the ray tracing pipeline, in the order BuildRayTracingPipeline creates them
+#define RAY_GROUP_RAYGEN 0
+#define RAY_GROUP_MISS 1
+#define RAY_GROUP_HIT 2
+#define RAY_GROUP_COUNT 3
+// Only the raygen shader traces, hit and miss shaders don't trace further or call callables
+#define RAY_RECURSION_DEPTH 1
+#define RAY_CALLABLE_DEPTH 0
 
 typedef struct VKSTATE {
     VkInstance instance;
@@ -39,24 +86,91 @@ typedef struct VKSTATE {
 
     VkCommandBuffer *commandBuffers;
     VkSemaphore *imageAvailableSemas, *renderFinishedSemas;
-    VkFence *inFlightFences;
+    FramePacer pacer;
+    uint32_t framesInFlight;
+    PresentPolicy presentPolicy;
+    VkBool32 headless;
+    // Frame capture, only valid when capturing is set
+    Readback readback;
+    VkBool32 capturing;
+    // Objects retired while frames in flight may still use them
+    DeletionQueue deletionQueue;
+    // Saved back on destroy when set
+    const char *pipelineCachePath;
+    // Shader hot reload, only valid when watchingShaders is set
+    ShaderWatcher shaderWatcher;
+    VkBool32 watchingShaders;
 
     VkAlloc *allocator;
 
-    VkPipelineLayout layout;
-    VkPipeline graphicsPipeline;
-    VkPipeline rayTracingPipeline;
+    // Pipelines are built on the workers, only the graphics one is waited for at startup
+    ThreadPool threadPool;
+    PipelineService pipelineService;
+    PipelineRegistry pipelineRegistry;
+    // Pipeline layouts derived from the shaders, shared by the registry and the ray tracing pipeline
+    LayoutCache layoutCache;
+    uint32_t mainPipeline;
+    VkPipelineLayout rayTracingLayout;
+    AsyncPipeline rayTracingPipeline;
+    // Set by the worker building the pipeline, valid once it is ready
+    uint32_t rayStackSize;
     AccelerationStructure blas;
+    // Only valid with ray tracing, its scratch pool is shared by every BLAS build
+    BlasBuilder blasBuilder;
+    // One instance of the BLAS per demo object, rebuilt in the frame after one moves
+    Tlas tlas;
+    // Ray traced view, traced into rayImage with one hit record per instance
+    ShaderBindingTable sbt;
+    Image rayImage;
+    VkExtent2D rayExtent;
+    VkImageView rayImageView;
+    VkDescriptorPool rayDescriptorPool;
+    VkDescriptorSet rayDescriptorSet;
+    // Without ray tracing: traced into the mapped upload buffer of the frame, copied into rayImage
+    CpuTracer cpuTracer;
+    Buffer rayUploads[FRAME_PACER_MAX_FRAMES];
+    uint8_t *rayUploadsMapped[FRAME_PACER_MAX_FRAMES];
+    // Show the ray traced view instead of rasterizing once its pipeline is ready, right away
+    // when it is traced on the CPU
+    VkBool32 rayTraced;
     Mesh mesh;
 
+    RenderGraph renderGraph;
+    RenderQueue renderQueue;
+    GpuScene gpuScene;
+    // Bounds of the demo objects for the CPU path, indexed like the grid
+    CullSet cullSet;
+    uint32_t *visibleObjects;
+    // Cull and issue draws on the GPU instead of through renderQueue
+    VkBool32 gpuDriven;
+
     VkBool32 portability;
     VkBool32 framebufferResized;
     uint32_t currentFrame;
 } VulkanState;
 
-void CreateGraphicsPipeline(VulkanState *state);
-void CreateRayTracingPipeline(VulkanState *state);
+void RequestGraphicsPipelines(VulkanState *state);
+void CreateRayTracingLayout(VulkanState *state);
+VkResult BuildRayTracingPipeline(PipelineService *service, void *userData, VkPipeline *pipeline);
 void CopyBuffer(VulkanState *state, Buffer *dst, Buffer *src);
+void BuildBlas(VulkanState *state);
+void BuildBlasOnHost(
+    VulkanState *state,
+    const Vertex *vertices,
+    uint32_t vertexCount,
+    const uint32_t *indices,
+    uint32_t indexCount
+);
+void CreateTlas(VulkanState *state);
+void CreateRayTracingView(VulkanState *state);
+void CreateCpuTracedView(
+    VulkanState *state,
+    const Vertex *vertices,
+    uint32_t vertexCount,
+    const uint32_t *indices,
+    uint32_t indexCount
+);
+VkBool32 PrepareRayTracing(VulkanState *state);
 Mesh CreateMesh(
     VulkanState *state,
     const Vertex *vertices,
@@ -66,18 +180,62 @@ Mesh CreateMesh(
 );
 void DestroyMesh(VulkanState *state, Mesh *mesh);
 Buffer CreateBufferGQueue(VulkanState *state, VkDeviceSize bufferSize, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryFlags);
+void CreateGpuScene(VulkanState *state);
+void CreateCullSet(VulkanState *state);
+Matrix4f DemoGridTransform(uint32_t index, Vector4f *sphere);
+Vector4f DemoGridColor(uint32_t index);
+void DestroyRetiredSwapchain(Device *device, void *userData);
+void SwapScenePipeline(VkPipeline oldPipeline, VkPipeline newPipeline, void *userData);
+void ReloadShader(const char *name, uint32_t *code, size_t codeSize, void *userData);
+void TlasPass(VkCommandBuffer cmdBuffer, void *userData);
+void SbtPass(VkCommandBuffer cmdBuffer, void *userData);
+void TracePass(VkCommandBuffer cmdBuffer, void *userData);
+void UploadPass(VkCommandBuffer cmdBuffer, void *userData);
+void BlitPass(VkCommandBuffer cmdBuffer, void *userData);
+void CullPass(VkCommandBuffer cmdBuffer, void *userData);
+void MainPass(VkCommandBuffer cmdBuffer, void *userData);
+void ReadbackPass(VkCommandBuffer cmdBuffer, void *userData);
+
+// Shader record data, mirrors the shaderRecordEXT blocks in resources/shader/ray.*
+typedef struct {
+    Vector4f background;
+} RayMissRecord;
+
+typedef struct {
+    Vector4f color;
+} RayHitRecord;
+
+// Passed to every render graph pass of a frame
+typedef struct {
+    VulkanState *state;
+    uint32_t imageIndex;
+    Frustum frustum;
+} FrameContext;
 
-VulkanState *initVulkanState(Window *window, VkBool32 debugging) {
+VulkanState *initVulkanState(Window *window, const AppConfig *config) {
     StringArray extensions = StringArrayNew(1000);
     StringArray layers = StringArrayNew(1000);
 
     VulkanState *state = calloc(1, sizeof(VulkanState));
+    VkBool32 debugging = config->debugging;
+
+    state->framesInFlight = config->framesInFlight;
+    state->presentPolicy = config->presentPolicy;
+    state->headless = config->headless;
+    state->rayTraced = config->rayTraced;
+    state->pipelineCachePath = config->pipelineCachePath;
+    if(state->framesInFlight == 0 || state->framesInFlight > FRAME_PACER_MAX_FRAMES) {
+        fprintf(stderr, "Frames in flight must be between 1 and %d.\n", FRAME_PACER_MAX_FRAMES);
+        exit(1);
+    }
 
-    uint32_t glfwRequiredExtensionCount = 0;
-    const char **glfwRequiredExtensions = glfwGetRequiredInstanceExtensions(&glfwRequiredExtensionCount);
-    assert(glfwRequiredExtensionCount != 0);
-    
-    StringArrayAppendConstArray(&extensions, glfwRequiredExtensions, glfwRequiredExtensionCount);
+    if(!state->headless) {
+        uint32_t glfwRequiredExtensionCount = 0;
+        const char **glfwRequiredExtensions = glfwGetRequiredInstanceExtensions(&glfwRequiredExtensionCount);
+        assert(glfwRequiredExtensionCount != 0);
+
+        StringArrayAppendConstArray(&extensions, glfwRequiredExtensions, glfwRequiredExtensionCount);
+    }
 
     if(debugging) {
         StringArrayAddElement(&layers, VK_KHR_VALIDATION_LAYER_NAME);
@@ -95,7 +253,7 @@ VulkanState *initVulkanState(Window *window, VkBool32 debugging) {
 
     state->portability = portability;
 
-    if(portability) {
+    if(portability && !state->headless) {
         StringArrayAddElement(&extensions, VK_EXT_METAL_SURFACE_EXTENSION_NAME);
     }
 
@@ -118,10 +276,12 @@ VulkanState *initVulkanState(Window *window, VkBool32 debugging) {
         }
     }
 
-    result = createSurface(window, state->instance, &state->surface);
-    if(result != VK_SUCCESS) {
-        fprintf(stderr, "Failed to create surface: %s.\n", string_VkResult(result));
-        exit(1);
+    if(!state->headless) {
+        result = createSurface(window, state->instance, &state->surface);
+        if(result != VK_SUCCESS) {
+            fprintf(stderr, "Failed to create surface: %s.\n", string_VkResult(result));
+            exit(1);
+        }
     }
 
     StringArray deviceExtensions = StringArrayNew(1000);
@@ -130,23 +290,123 @@ VulkanState *initVulkanState(Window *window, VkBool32 debugging) {
     if(portability) {
         StringArrayAddElement(&deviceExtensions, VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME);
     }
-    StringArrayAddElement(&deviceExtensions, VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    if(!state->headless) {
+        StringArrayAddElement(&deviceExtensions, VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
     StringArrayAddElement(&deviceExtensions, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
 
     if(debugging) {
         StringArrayAddElement(&deviceLayers, VK_KHR_VALIDATION_LAYER_NAME);
     }
 
-    // Add ray support
-    StringArrayAddElement(&deviceExtensions, VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME);
-    StringArrayAddElement(&deviceExtensions, VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME);
-    StringArrayAddElement(&deviceExtensions, VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME);
+    result = pickDevice(state->instance, state->surface, deviceExtensions, &state->device);
+    if(result != VK_SUCCESS) {
+        fprintf(stderr, "Failed to pick device: %s.\n", string_VkResult(result));
+        exit(1);
+    }
+
+    // Optional extensions
+    // Add ray support, CPU implementations like lavapipe have none
+    if(deviceExtensionSupported(&state->device, VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME) &&
+        deviceExtensionSupported(&state->device, VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME) &&
+        deviceExtensionSupported(&state->device, VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME))
+    {
+        StringArrayAddElement(&deviceExtensions, VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME);
+        StringArrayAddElement(&deviceExtensions, VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME);
+        StringArrayAddElement(&deviceExtensions, VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME);
+        state->device.enabled.rayTracing = VK_TRUE;
+    }
+    // Host builds are slower per structure but leave the queue free, only used when asked for
+    VkPhysicalDeviceAccelerationStructureFeaturesKHR hostCommands = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR,
+    };
+    if(config->hostBlasBuilds && state->device.enabled.rayTracing) {
+        VkPhysicalDeviceFeatures2 supported = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+            .pNext = &hostCommands,
+        };
+        getPhysicalDeviceFeatures2(&state->device, &supported);
+        state->device.enabled.accelerationStructureHostCommands = hostCommands.accelerationStructureHostCommands;
+        if(!hostCommands.accelerationStructureHostCommands) {
+            fprintf(stderr, "Host acceleration structure builds are not supported, building on the GPU.\n");
+        }
+    }
+    if(deviceExtensionSupported(&state->device, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME)) {
+        StringArrayAddElement(&deviceExtensions, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+        state->device.enabled.synchronization2 = VK_TRUE;
+    }
+    if(!state->headless &&
+        deviceExtensionSupported(&state->device, VK_KHR_PRESENT_ID_EXTENSION_NAME) &&
+        deviceExtensionSupported(&state->device, VK_KHR_PRESENT_WAIT_EXTENSION_NAME))
+    {
+        StringArrayAddElement(&deviceExtensions, VK_KHR_PRESENT_ID_EXTENSION_NAME);
+        StringArrayAddElement(&deviceExtensions, VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+        state->device.enabled.presentWait = VK_TRUE;
+    }
+    // Pipelines are linked from cached parts, the extension alone doesn't promise the feature
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT pipelineLibrary = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT,
+    };
+    if(deviceExtensionSupported(&state->device, VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) &&
+        deviceExtensionSupported(&state->device, VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME))
+    {
+        VkPhysicalDeviceFeatures2 supported = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+            .pNext = &pipelineLibrary,
+        };
+        getPhysicalDeviceFeatures2(&state->device, &supported);
+        if(pipelineLibrary.graphicsPipelineLibrary) {
+            StringArrayAddElement(&deviceExtensions, VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+            StringArrayAddElement(&deviceExtensions, VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+            state->device.enabled.graphicsPipelineLibrary = VK_TRUE;
+        }
+    }
 
     {
         // device creation
+        void *optionalFeatures = NULL;
+
+        VkPhysicalDeviceSynchronization2FeaturesKHR sync2 = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR,
+            .synchronization2 = VK_TRUE,
+        };
+        if(state->device.enabled.synchronization2) {
+            sync2.pNext = optionalFeatures;
+            optionalFeatures = &sync2;
+        }
+
+        VkPhysicalDevicePresentIdFeaturesKHR presentId = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR,
+            .presentId = VK_TRUE,
+        };
+        VkPhysicalDevicePresentWaitFeaturesKHR presentWait = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR,
+            .presentWait = VK_TRUE,
+            .pNext = &presentId,
+        };
+        if(state->device.enabled.presentWait) {
+            presentId.pNext = optionalFeatures;
+            optionalFeatures = &presentWait;
+        }
+
+        // Only the graphicsPipelineLibrary member is set after the query
+        if(state->device.enabled.graphicsPipelineLibrary) {
+            pipelineLibrary.pNext = optionalFeatures;
+            optionalFeatures = &pipelineLibrary;
+        }
+
+        VkPhysicalDeviceVulkan12Features vulkan12 = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+            .bufferDeviceAddress = VK_TRUE,
+            .drawIndirectCount = VK_TRUE,
+            .timelineSemaphore = VK_TRUE,
+            .pNext = optionalFeatures,
+        };
         VkPhysicalDeviceAccelerationStructureFeaturesKHR accelStruc = {
             .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR,
             .accelerationStructure = VK_TRUE,
+            .accelerationStructureHostCommands = state->device.enabled.accelerationStructureHostCommands,
+            .pNext = &vulkan12,
         };
         VkPhysicalDeviceRayTracingPipelineFeaturesKHR raytrace = {
             .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_FEATURES_KHR,
@@ -156,21 +416,22 @@ VulkanState *initVulkanState(Window *window, VkBool32 debugging) {
         VkPhysicalDeviceDynamicRenderingFeaturesKHR dynrendering = {
             .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR,
             .dynamicRendering = VK_TRUE,
-            .pNext = &raytrace,
+            .pNext = state->device.enabled.rayTracing ? (void*)&raytrace : (void*)&vulkan12,
         };
         VkPhysicalDeviceFeatures2 features = {
             .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
-            .features = {0},
+            .features = {
+                .multiDrawIndirect = VK_TRUE,
+                .drawIndirectFirstInstance = VK_TRUE,
+            },
             .pNext = &dynrendering,
         };
         
         result = createDevice(
-            state->instance,
-            state->surface,
+            &state->device,
             &features,
             deviceLayers,
-            deviceExtensions,
-            &state->device
+            deviceExtensions
         );
     }
     StringArrayDestroy(&deviceExtensions);
@@ -184,13 +445,59 @@ VulkanState *initVulkanState(Window *window, VkBool32 debugging) {
     retrieveQueue(&state->device, state->device.queueFamilies.graphics, &state->graphicsQueue);
     retrieveQueue(&state->device, state->device.queueFamilies.present, &state->presentQueue);
 
-    result = createSwapChain(&state->device, window, state->surface, &state->swapchain);
+    if(state->pipelineCachePath != NULL) {
+        PipelineCacheStats cacheStats;
+        result = loadPipelineCache(&state->device, state->pipelineCachePath, &cacheStats);
+        if(result != VK_SUCCESS) {
+            fprintf(stderr, "Failed to create pipeline cache: %s.\n", string_VkResult(result));
+            exit(1);
+        }
+        if(debugging) {
+            fprintf(stderr, "Pipeline cache: %zu bytes loaded from %s.\n", cacheStats.loadedSize, state->pipelineCachePath);
+        }
+    }
+
+    state->allocator = createAllocator(&state->device);
+
+    result = createThreadPool(config->workerThreads, &state->threadPool);
+    if(result != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create thread pool: %s.\n", string_VkResult(result));
+        exit(1);
+    }
+    createPipelineService(&state->device, &state->threadPool, &state->pipelineService);
+    createLayoutCache(&state->device, &state->layoutCache);
+    createPipelineRegistry(&state->device, &state->pipelineService, &state->layoutCache, &state->pipelineRegistry);
+
+    if(state->headless) {
+        // One image per frame in flight, a frame never waits on another's image
+        result = createOffscreenSwapChain(
+            state->allocator,
+            config->headlessExtent,
+            state->framesInFlight,
+            &state->swapchain
+        );
+    } else {
+        result = createSwapChain(
+            &state->device,
+            window,
+            state->surface,
+            state->presentPolicy,
+            VK_NULL_HANDLE,
+            &state->swapchain
+        );
+    }
     if(result != VK_SUCCESS) {
         fprintf(stderr, "Failed to create swapchain: %s.\n", string_VkResult(result));
         exit(1);
     }
 
-    CreateGraphicsPipeline(state);
+    RequestGraphicsPipelines(state);
+    if(state->device.enabled.rayTracing) {
+        // The cache isn't thread safe, the layout is resolved before the worker picks the build up
+        CreateRayTracingLayout(state);
+        // Nothing draws with it yet, the first frame does not wait for it
+        pipelineServiceSubmit(&state->pipelineService, "ray", BuildRayTracingPipeline, state, &state->rayTracingPipeline);
+    }
 
     result = createCommandPool(
         &state->device,
@@ -207,7 +514,7 @@ VulkanState *initVulkanState(Window *window, VkBool32 debugging) {
         &state->device,
         state->commandPool,
         VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        FRAMES_IN_FLIGHT,
+        state->framesInFlight,
         &state->commandBuffers
     );
     if(result != VK_SUCCESS) {
@@ -215,19 +522,64 @@ VulkanState *initVulkanState(Window *window, VkBool32 debugging) {
         exit(1);
     }
 
-    state->imageAvailableSemas = (VkSemaphore*)calloc(FRAMES_IN_FLIGHT, sizeof(VkSemaphore));
-    state->renderFinishedSemas = (VkSemaphore*)calloc(FRAMES_IN_FLIGHT, sizeof(VkSemaphore));
-    state->inFlightFences = (VkFence*)calloc(FRAMES_IN_FLIGHT, sizeof(VkFence));
+    state->imageAvailableSemas = (VkSemaphore*)calloc(state->framesInFlight, sizeof(VkSemaphore));
+    state->renderFinishedSemas = (VkSemaphore*)calloc(state->framesInFlight, sizeof(VkSemaphore));
     state->framebufferResized = VK_FALSE;
     state->currentFrame = 0;
 
-    for(size_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+    for(size_t i = 0; i < state->framesInFlight; i++) {
         assert(createSemaphore(&state->device, &state->imageAvailableSemas[i]) == VK_SUCCESS);
         assert(createSemaphore(&state->device, &state->renderFinishedSemas[i]) == VK_SUCCESS);
-        assert(createFence(&state->device, VK_TRUE, &state->inFlightFences[i]) == VK_SUCCESS);
     }
 
-    state->allocator = createAllocator(&state->device);
+    result = createFramePacer(
+        &state->device,
+        state->device.queueFamilies.graphics,
+        state->framesInFlight,
+        &state->pacer
+    );
+    if(result != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create frame pacer: %s.\n", string_VkResult(result));
+        exit(1);
+    }
+
+    createDeletionQueue(&state->device, &state->deletionQueue);
+
+    createRenderGraph(&state->device, &state->renderGraph);
+
+    if(config->capturePath != NULL) {
+        if(!(state->swapchain.usage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT)) {
+            fprintf(stderr, "Surface images can't be copied, capture is not available.\n");
+            exit(1);
+        }
+
+        // Sized for the initial extent, frames of any other size are dropped
+        result = createReadback(
+            state->allocator,
+            state->framesInFlight,
+            state->swapchain.extent,
+            state->swapchain.format,
+            config->capturePath,
+            config->captureFormat,
+            &state->readback
+        );
+        if(result != VK_SUCCESS) {
+            fprintf(stderr, "Failed to create readback: %s.\n", string_VkResult(result));
+            exit(1);
+        }
+        state->capturing = VK_TRUE;
+    }
+
+    result = createRenderQueue(
+        state->allocator,
+        state->framesInFlight,
+        DEMO_GRID_SIZE * DEMO_GRID_SIZE,
+        &state->renderQueue
+    );
+    if(result != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create render queue: %s.\n", string_VkResult(result));
+        exit(1);
+    }
 
     // Game logic starts here :)
     const Vertex vertices[] = {
@@ -247,13 +599,49 @@ VulkanState *initVulkanState(Window *window, VkBool32 debugging) {
         indices, sizeof(indices) / sizeof(uint32_t)
     );
 
-    result = createBlas(state->allocator, state->mesh.vertexBuffer.memorySize, &state->blas);
+    // Everything above overlapped with the build, the GPU scene records the handle
+    result = pipelineRegistryWait(&state->pipelineRegistry, state->mainPipeline);
     if(result != VK_SUCCESS) {
-        fprintf(stderr, "Failed to create acceleration structure: %s.\n", string_VkResult(result));
+        fprintf(stderr, "Failed to create graphics pipeline: %s.\n", string_VkResult(result));
         exit(1);
     }
 
-    CreateRayTracingPipeline(state);
+    CreateGpuScene(state);
+    CreateCullSet(state);
+
+    if(state->device.enabled.rayTracing) {
+        result = createBlasBuilder(&state->device, state->allocator, BLAS_SCRATCH_BUDGET, &state->blasBuilder);
+        if(result != VK_SUCCESS) {
+            fprintf(stderr, "Failed to create BLAS builder: %s.\n", string_VkResult(result));
+            exit(1);
+        }
+        if(state->device.enabled.accelerationStructureHostCommands) {
+            BuildBlasOnHost(
+                state,
+                vertices, sizeof(vertices) / sizeof(Vertex),
+                indices, sizeof(indices) / sizeof(uint32_t)
+            );
+        } else {
+            BuildBlas(state);
+        }
+        CreateTlas(state);
+        CreateRayTracingView(state);
+    } else {
+        CreateCpuTracedView(
+            state,
+            vertices, sizeof(vertices) / sizeof(Vertex),
+            indices, sizeof(indices) / sizeof(uint32_t)
+        );
+    }
+
+    if(config->shaderSourceDir != NULL) {
+        result = createShaderWatcher(config->shaderSourceDir, &state->shaderWatcher);
+        if(result != VK_SUCCESS) {
+            fprintf(stderr, "Failed to watch shaders: %s.\n", string_VkResult(result));
+            exit(1);
+        }
+        state->watchingShaders = VK_TRUE;
+    }
 
     return state;
 }
@@ -261,35 +649,77 @@ VulkanState *initVulkanState(Window *window, VkBool32 debugging) {
 void destroyVulkanState(VulkanState *vulkanState) {
     assert(waitIdle(&vulkanState->device) == VK_SUCCESS);
 
+    if(vulkanState->watchingShaders) {
+        destroyShaderWatcher(&vulkanState->shaderWatcher);
+    }
+    // Builds still running would otherwise race the device teardown
+    destroyPipelineRegistry(&vulkanState->pipelineRegistry);
+    destroyLayoutCache(&vulkanState->layoutCache);
+    destroyPipelineService(&vulkanState->pipelineService);
+    destroyThreadPool(&vulkanState->threadPool);
+
+    if(vulkanState->capturing) {
+        for(uint32_t i = 0; i < vulkanState->framesInFlight; i++) {
+            readbackCollect(&vulkanState->readback, i);
+        }
+        destroyReadback(&vulkanState->readback);
+    }
+
+    destroyCullSet(&vulkanState->cullSet);
+    free(vulkanState->visibleObjects);
+    destroyGpuScene(&vulkanState->gpuScene);
+    destroyRenderQueue(&vulkanState->renderQueue);
     DestroyMesh(vulkanState, &vulkanState->mesh);
-    destroyAccelerationStructure(vulkanState->allocator, &vulkanState->blas);
+    if(vulkanState->device.enabled.rayTracing) {
+        destroyDescriptorPool(&vulkanState->device, vulkanState->rayDescriptorPool);
+        destroyImageView(&vulkanState->device, vulkanState->rayImageView);
+        destroyDeallocateImage(vulkanState->allocator, &vulkanState->rayImage);
+        destroyShaderBindingTable(&vulkanState->sbt);
+        destroyTlas(&vulkanState->tlas);
+        destroyAccelerationStructure(vulkanState->allocator, &vulkanState->blas);
+        destroyBlasBuilder(&vulkanState->blasBuilder);
+    } else {
+        for(uint32_t i = 0; i < vulkanState->framesInFlight; i++) {
+            unmapBufferMemory(vulkanState->allocator, &vulkanState->rayUploads[i]);
+            destroyDeallocateBuffer(vulkanState->allocator, &vulkanState->rayUploads[i]);
+        }
+        destroyDeallocateImage(vulkanState->allocator, &vulkanState->rayImage);
+        destroyCpuTracer(&vulkanState->cpuTracer);
+    }
+    destroyDeletionQueue(&vulkanState->deletionQueue);
+    destroySwapChain(&vulkanState->device, &vulkanState->swapchain);
     destroyAllocator(vulkanState->allocator);
 
-    for(size_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+    for(size_t i = 0; i < vulkanState->framesInFlight; i++) {
         destroySemaphore(&vulkanState->device, vulkanState->imageAvailableSemas[i]);
         destroySemaphore(&vulkanState->device, vulkanState->renderFinishedSemas[i]);
-        destroyFence(&vulkanState->device, vulkanState->inFlightFences[i]);
     } 
+    destroyFramePacer(&vulkanState->pacer);
 
     free(vulkanState->imageAvailableSemas);
     free(vulkanState->renderFinishedSemas);
-    free(vulkanState->inFlightFences);
 
     destroyCommandPool(&vulkanState->device, vulkanState->commandPool);
     free(vulkanState->commandBuffers);
 
-    destroyPipeline(&vulkanState->device, vulkanState->rayTracingPipeline);
-    destroyPipeline(&vulkanState->device, vulkanState->graphicsPipeline);
-    destroyPipelineLayout(&vulkanState->device, vulkanState->layout);
+    destroyPipeline(&vulkanState->device, vulkanState->rayTracingPipeline.pipeline);
+
+    if(vulkanState->pipelineCachePath != NULL) {
+        PipelineCacheStats cacheStats;
+        // A failed save only costs the next startup its warm cache
+        savePipelineCache(&vulkanState->device, vulkanState->pipelineCachePath, &cacheStats);
+        unloadPipelineCache(&vulkanState->device);
+    }
 
-    destroySwapChain(&vulkanState->device, &vulkanState->swapchain);
     destroyDevice(&vulkanState->device);
 
     if(vulkanState->debugMessenger != VK_NULL_HANDLE) {
         destroyDebugMessenger(vulkanState->instance, vulkanState->debugMessenger);
     }
 
-    destroySurface(vulkanState->instance, vulkanState->surface);
+    if(vulkanState->surface != VK_NULL_HANDLE) {
+        destroySurface(vulkanState->instance, vulkanState->surface);
+    }
     destroyInstance(vulkanState->instance);
 
     free(vulkanState);
@@ -300,12 +730,253 @@ void recordCommandBuffer(VulkanState *vulkanState, uint32_t imageIndex) {
 
     assert(resetCommandBuffer(cmdBuffer) == VK_SUCCESS);
     assert(beginSimpleCommandBuffer(cmdBuffer) == VK_SUCCESS);
+    framePacerCmdBegin(&vulkanState->pacer, cmdBuffer);
+
+    FrameContext frame = {
+        .state = vulkanState,
+        .imageIndex = imageIndex,
+        .frustum = frustumFromMatrix(matrix4fIdentity()),
+    };
 
-    transitionImageLayout(cmdBuffer, vulkanState->swapchain.images[imageIndex],
-        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-        VK_ACCESS_NONE, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT,
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT
+    RenderGraph *graph = &vulkanState->renderGraph;
+    renderGraphReset(graph);
+
+    // The acquire semaphore is waited on at color output, the buffers may still be
+    // read by the previous frame's indirect draws
+    uint32_t swapchainImage = renderGraphImportImage(
+        graph,
+        vulkanState->swapchain.images[imageIndex],
+        VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT
     );
+    uint32_t drawBuffer = renderGraphImportBuffer(
+        graph,
+        vulkanState->gpuScene.drawBuffer.buffer,
+        VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT
+    );
+    uint32_t countBuffer = renderGraphImportBuffer(
+        graph,
+        vulkanState->gpuScene.countBuffer.buffer,
+        VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT
+    );
+    // Offscreen images are left ready to be copied out
+    renderGraphSetOutput(
+        graph,
+        swapchainImage,
+        vulkanState->headless ? RESOURCE_ACCESS_TRANSFER_READ : RESOURCE_ACCESS_PRESENT
+    );
+
+    // Traced instead of rasterized once the pipeline finished building
+    VkBool32 tracing = vulkanState->rayTraced && PrepareRayTracing(vulkanState);
+    // Devices without ray tracing get the same view traced on the CPU
+    VkBool32 cpuTracing = vulkanState->rayTraced && !vulkanState->device.enabled.rayTracing &&
+        (vulkanState->swapchain.usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+
+    // Only built in frames after an instance changed, left ready to be traced
+    VkBool32 buildTlas = vulkanState->device.enabled.rayTracing && tlasChanged(&vulkanState->tlas);
+    uint32_t tlasBuffer = 0;
+    if(buildTlas || tracing) {
+        tlasBuffer = renderGraphImportBuffer(
+            graph,
+            vulkanState->tlas.structure.buffer.buffer,
+            VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR | VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR
+        );
+    }
+    if(buildTlas) {
+        uint32_t tlasScratch = renderGraphImportBuffer(
+            graph,
+            vulkanState->tlas.scratch.buffer,
+            VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR
+        );
+        renderGraphSetOutput(graph, tlasBuffer, RESOURCE_ACCESS_RAY_TRACING_READ);
+
+        uint32_t tlasPass = renderGraphAddPass(graph, "tlas", RENDER_GRAPH_QUEUE_COMPUTE, TlasPass, &frame);
+        renderGraphUse(graph, tlasPass, tlasBuffer, RESOURCE_ACCESS_ACCELERATION_STRUCTURE_BUILD);
+        renderGraphUse(graph, tlasPass, tlasScratch, RESOURCE_ACCESS_ACCELERATION_STRUCTURE_BUILD);
+    }
+
+    if(tracing || cpuTracing) {
+        // Earlier frames may still blit from the image
+        uint32_t rayImage = renderGraphImportImage(
+            graph,
+            vulkanState->rayImage.image,
+            VK_IMAGE_ASPECT_COLOR_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_PIPELINE_STAGE_2_TRANSFER_BIT
+        );
+
+        if(tracing) {
+            // Earlier frames may still trace with the table
+            uint32_t sbtBuffer = renderGraphImportBuffer(
+                graph,
+                vulkanState->sbt.buffer.buffer,
+                VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR
+            );
+
+            if(sbtChanged(&vulkanState->sbt)) {
+                uint32_t sbtPass = renderGraphAddPass(graph, "sbt", RENDER_GRAPH_QUEUE_GRAPHICS, SbtPass, &frame);
+                renderGraphUse(graph, sbtPass, sbtBuffer, RESOURCE_ACCESS_TRANSFER_WRITE);
+            }
+
+            uint32_t tracePass = renderGraphAddPass(graph, "trace", RENDER_GRAPH_QUEUE_COMPUTE, TracePass, &frame);
+            renderGraphUse(graph, tracePass, tlasBuffer, RESOURCE_ACCESS_RAY_TRACING_READ);
+            renderGraphUse(graph, tracePass, sbtBuffer, RESOURCE_ACCESS_SHADER_BINDING_TABLE_READ);
+            renderGraphUse(graph, tracePass, rayImage, RESOURCE_ACCESS_RAY_TRACING_STORAGE_WRITE);
+        } else {
+            // The pacer already waited for the slot's last copy, host writes made before the
+            // submit are visible to this one
+            cpuTrace(&vulkanState->cpuTracer, vulkanState->rayUploadsMapped[vulkanState->currentFrame]);
+            uint32_t uploadBuffer = renderGraphImportBuffer(
+                graph,
+                vulkanState->rayUploads[vulkanState->currentFrame].buffer,
+                VK_PIPELINE_STAGE_2_HOST_BIT
+            );
+
+            uint32_t uploadPass = renderGraphAddPass(graph, "upload", RENDER_GRAPH_QUEUE_GRAPHICS, UploadPass, &frame);
+            renderGraphUse(graph, uploadPass, uploadBuffer, RESOURCE_ACCESS_TRANSFER_READ);
+            renderGraphUse(graph, uploadPass, rayImage, RESOURCE_ACCESS_TRANSFER_WRITE);
+        }
+
+        uint32_t blitPass = renderGraphAddPass(graph, "blit", RENDER_GRAPH_QUEUE_GRAPHICS, BlitPass, &frame);
+        renderGraphUse(graph, blitPass, rayImage, RESOURCE_ACCESS_TRANSFER_READ);
+        renderGraphUse(graph, blitPass, swapchainImage, RESOURCE_ACCESS_TRANSFER_WRITE);
+    } else {
+        // Culled by the graph when the main pass takes the CPU path
+        uint32_t cullPass = renderGraphAddPass(graph, "cull", RENDER_GRAPH_QUEUE_COMPUTE, CullPass, &frame);
+        renderGraphUse(graph, cullPass, countBuffer, RESOURCE_ACCESS_TRANSFER_WRITE);
+        renderGraphUse(graph, cullPass, countBuffer, RESOURCE_ACCESS_COMPUTE_STORAGE_WRITE);
+        renderGraphUse(graph, cullPass, drawBuffer, RESOURCE_ACCESS_COMPUTE_STORAGE_WRITE);
+
+        uint32_t mainPass = renderGraphAddPass(graph, "main", RENDER_GRAPH_QUEUE_GRAPHICS, MainPass, &frame);
+        renderGraphUse(graph, mainPass, swapchainImage, RESOURCE_ACCESS_COLOR_ATTACHMENT_WRITE);
+        if(vulkanState->gpuDriven) {
+            renderGraphUse(graph, mainPass, drawBuffer, RESOURCE_ACCESS_INDIRECT_READ);
+            renderGraphUse(graph, mainPass, countBuffer, RESOURCE_ACCESS_INDIRECT_READ);
+        }
+    }
+
+    if(vulkanState->capturing) {
+        // Read on the CPU framesInFlight frames later, once the slot comes around again
+        uint32_t readbackBuffer = renderGraphImportBuffer(
+            graph,
+            readbackSlotBuffer(&vulkanState->readback, vulkanState->currentFrame),
+            VK_PIPELINE_STAGE_2_HOST_BIT
+        );
+        renderGraphSetOutput(graph, readbackBuffer, RESOURCE_ACCESS_HOST_READ);
+
+        uint32_t readbackPass = renderGraphAddPass(graph, "readback", RENDER_GRAPH_QUEUE_GRAPHICS, ReadbackPass, &frame);
+        renderGraphUse(graph, readbackPass, swapchainImage, RESOURCE_ACCESS_TRANSFER_READ);
+        renderGraphUse(graph, readbackPass, readbackBuffer, RESOURCE_ACCESS_TRANSFER_WRITE);
+    }
+
+    renderGraphExecute(graph, cmdBuffer);
+
+    framePacerCmdEnd(&vulkanState->pacer, cmdBuffer);
+    assert(endCommandBuffer(cmdBuffer) == VK_SUCCESS);
+}
+
+void TlasPass(VkCommandBuffer cmdBuffer, void *userData) {
+    FrameContext *frame = userData;
+
+    cmdTlasBuild(&frame->state->tlas, cmdBuffer, frame->state->currentFrame);
+}
+
+void SbtPass(VkCommandBuffer cmdBuffer, void *userData) {
+    FrameContext *frame = userData;
+
+    cmdSbtUpload(&frame->state->sbt, cmdBuffer);
+}
+
+void TracePass(VkCommandBuffer cmdBuffer, void *userData) {
+    FrameContext *frame = userData;
+    VulkanState *vulkanState = frame->state;
+    ShaderBindingTable *sbt = &vulkanState->sbt;
+
+    cmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, vulkanState->rayTracingPipeline.pipeline);
+    // Dynamic state, sized for the depths used instead of the worst case the driver assumes
+    cmdSetRayTracingPipelineStackSizeKHR(&vulkanState->device, cmdBuffer, vulkanState->rayStackSize);
+    cmdBindDescriptorSet(
+        cmdBuffer,
+        VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR,
+        vulkanState->rayTracingLayout,
+        0, vulkanState->rayDescriptorSet
+    );
+
+    VkStridedDeviceAddressRegionKHR raygen = sbtRegion(sbt, SBT_REGION_RAYGEN);
+    VkStridedDeviceAddressRegionKHR miss = sbtRegion(sbt, SBT_REGION_MISS);
+    VkStridedDeviceAddressRegionKHR hit = sbtRegion(sbt, SBT_REGION_HIT);
+    VkStridedDeviceAddressRegionKHR callable = sbtRegion(sbt, SBT_REGION_CALLABLE);
+    cmdTraceRaysKHR(
+        &vulkanState->device,
+        cmdBuffer,
+        &raygen, &miss, &hit, &callable,
+        RAY_IMAGE_WIDTH, RAY_IMAGE_HEIGHT, 1
+    );
+}
+
+void UploadPass(VkCommandBuffer cmdBuffer, void *userData) {
+    FrameContext *frame = userData;
+    VulkanState *vulkanState = frame->state;
+
+    // Tightly packed rows
+    VkBufferImageCopy region = {
+        .imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+        .imageExtent = {vulkanState->rayExtent.width, vulkanState->rayExtent.height, 1},
+    };
+    cmdCopyBufferToImage(
+        cmdBuffer,
+        vulkanState->rayUploads[vulkanState->currentFrame].buffer,
+        vulkanState->rayImage.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        1, &region
+    );
+}
+
+// Scales the traced image onto the whole swapchain image
+void BlitPass(VkCommandBuffer cmdBuffer, void *userData) {
+    FrameContext *frame = userData;
+    VulkanState *vulkanState = frame->state;
+    VkExtent2D extent = vulkanState->swapchain.extent;
+    VkExtent2D rayExtent = vulkanState->rayExtent;
+
+    VkImageBlit region = {
+        .srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+        .srcOffsets = {{0, 0, 0}, {(int32_t)rayExtent.width, (int32_t)rayExtent.height, 1}},
+        .dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+        .dstOffsets = {{0, 0, 0}, {(int32_t)extent.width, (int32_t)extent.height, 1}},
+    };
+    cmdBlitImage(
+        cmdBuffer,
+        vulkanState->rayImage.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        vulkanState->swapchain.images[frame->imageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        1, &region,
+        VK_FILTER_LINEAR
+    );
+}
+
+void CullPass(VkCommandBuffer cmdBuffer, void *userData) {
+    FrameContext *frame = userData;
+
+    gpuSceneCull(&frame->state->gpuScene, cmdBuffer, &frame->frustum);
+}
+
+void ReadbackPass(VkCommandBuffer cmdBuffer, void *userData) {
+    FrameContext *frame = userData;
+    VulkanState *vulkanState = frame->state;
+
+    readbackRecord(
+        &vulkanState->readback,
+        cmdBuffer,
+        vulkanState->currentFrame,
+        vulkanState->swapchain.images[frame->imageIndex],
+        vulkanState->swapchain.extent,
+        vulkanState->pacer.frame
+    );
+}
+
+void MainPass(VkCommandBuffer cmdBuffer, void *userData) {
+    FrameContext *frame = userData;
+    VulkanState *vulkanState = frame->state;
 
     VkClearValue clearValue = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
     VkRenderingAttachmentInfoKHR attachment = {
@@ -313,7 +984,7 @@ void recordCommandBuffer(VulkanState *vulkanState, uint32_t imageIndex) {
         .clearValue = clearValue,
         .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
         .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-        .imageView = vulkanState->swapchain.imageViews[imageIndex],
+        .imageView = vulkanState->swapchain.imageViews[frame->imageIndex],
         .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
         .resolveImageLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
         .resolveMode = VK_RESOLVE_MODE_NONE,
@@ -334,8 +1005,6 @@ void recordCommandBuffer(VulkanState *vulkanState, uint32_t imageIndex) {
     };
     cmdBeginRenderingKHR(&vulkanState->device, cmdBuffer, &renderInfo);
     {
-        cmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkanState->graphicsPipeline);
-
         VkViewport viewport = {
             .x = 0.0f, .y = 0.0f,
             .width = (float)vulkanState->swapchain.extent.width,
@@ -351,40 +1020,73 @@ void recordCommandBuffer(VulkanState *vulkanState, uint32_t imageIndex) {
         };
         cmdSetScissor(cmdBuffer, scissor);
 
-        VkBuffer vertexBuffers[] = {vulkanState->mesh.vertexBuffer.buffer};
-        VkDeviceSize offsets[] = {0};
-        cmdBindVertexBuffers(
-            cmdBuffer,
-            (UInt32Range){0, 1},
-            vertexBuffers,
-            offsets
-        );
-        cmdBindIndexBuffer(
-            cmdBuffer,
-            vulkanState->mesh.indexBuffer.buffer,
-            0,
-            VK_INDEX_TYPE_UINT32
-        );
-        cmdDrawIndexed(
-            cmdBuffer,
-            (UInt32Range){0, vulkanState->mesh.indexCount},
-            (UInt32Range){0, 1},
-            0
-        );
+        if(vulkanState->gpuDriven) {
+            gpuSceneDraw(&vulkanState->gpuScene, cmdBuffer);
+        } else {
+            renderQueueReset(&vulkanState->renderQueue);
+
+            uint32_t visibleCount = cullSetTest(
+                &vulkanState->cullSet,
+                &frame->frustum,
+                vulkanState->visibleObjects
+            );
+
+            // Every copy shares mesh and pipeline, so the grid collapses into one draw
+            for(uint32_t i = 0; i < visibleCount; i++) {
+                Vector4f sphere;
+                RenderItem item = {
+                    .mesh = &vulkanState->mesh,
+                    .pipeline = pipelineRegistryPipeline(&vulkanState->pipelineRegistry, vulkanState->mainPipeline),
+                    .material = 0,
+                    .transform = DemoGridTransform(vulkanState->visibleObjects[i], &sphere),
+                };
+                VkResult result = renderQueueSubmit(&vulkanState->renderQueue, &item);
+                if(result != VK_SUCCESS) {
+                    fprintf(stderr, "Failed to submit render item: %s.\n", string_VkResult(result));
+                    exit(1);
+                }
+            }
+
+            renderQueueFlush(&vulkanState->renderQueue, cmdBuffer, vulkanState->currentFrame);
+        }
     }
     cmdEndRenderingKHR(&vulkanState->device, cmdBuffer);
-
-    transitionImageLayout(cmdBuffer, vulkanState->swapchain.images[imageIndex],
-        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-        VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_NONE,
-        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT
-    );
-
-    assert(endCommandBuffer(cmdBuffer) == VK_SUCCESS);
 }
 
 VkBool32 getImage(VulkanState *vulkanState, Window *window, uint32_t *image) {
-    assert(waitForFence(&vulkanState->device, vulkanState->inFlightFences[vulkanState->currentFrame], UINT64_MAX) == VK_SUCCESS);
+    // Start the frame only once the previous one is on screen, so input is sampled
+    // as late as possible instead of queueing frames behind the display
+    Swapchain *swapchain = &vulkanState->swapchain;
+    if(vulkanState->device.enabled.presentWait &&
+        swapchain->policy != PRESENT_POLICY_THROUGHPUT_FIRST &&
+        swapchain->lastPresentId != 0)
+    {
+        // Timeouts and out of date swapchains are handled by the acquire below
+        waitForPresent(&vulkanState->device, swapchain, swapchain->lastPresentId, PRESENT_WAIT_TIMEOUT);
+    }
+
+    vulkanState->currentFrame = framePacerBeginFrame(&vulkanState->pacer);
+    deletionQueueFlush(&vulkanState->deletionQueue, framePacerCompletedValue(&vulkanState->pacer));
+    // Frames already submitted may still use a fast linked pipeline
+    pipelineRegistryPromote(
+        &vulkanState->pipelineRegistry,
+        &vulkanState->deletionQueue,
+        framePacerSubmittedValue(&vulkanState->pacer),
+        SwapScenePipeline,
+        vulkanState
+    );
+    if(vulkanState->watchingShaders) {
+        shaderWatcherPoll(&vulkanState->shaderWatcher, ReloadShader, vulkanState);
+    }
+    if(vulkanState->capturing) {
+        readbackCollect(&vulkanState->readback, vulkanState->currentFrame);
+    }
+
+    // Offscreen images belong to frame slots, the pacer wait already made this one free
+    if(vulkanState->headless) {
+        *image = vulkanState->currentFrame;
+        return VK_TRUE;
+    }
 
     uint32_t imageIndex;
     VkResult getImageResult = acquireNextImage(
@@ -408,8 +1110,6 @@ VkBool32 getImage(VulkanState *vulkanState, Window *window, uint32_t *image) {
         return VK_FALSE;
     }
 
-    assert(resetFence(&vulkanState->device, vulkanState->inFlightFences[vulkanState->currentFrame]) == VK_SUCCESS);
-
     *image = imageIndex;
     return VK_TRUE;
 }
@@ -417,36 +1117,68 @@ VkBool32 getImage(VulkanState *vulkanState, Window *window, uint32_t *image) {
 void renderAndPresent(VulkanState *vulkanState, Window *window, uint32_t imageIndex) {
     VkSemaphore waitSemaphores[] = {vulkanState->imageAvailableSemas[vulkanState->currentFrame]};
     VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    VkSemaphore signalSemaphores[] = {vulkanState->renderFinishedSemas[vulkanState->currentFrame]};
+    VkSemaphore presentSemaphores[] = {vulkanState->renderFinishedSemas[vulkanState->currentFrame]};
+    VkSemaphore signalSemaphores[] = {presentSemaphores[0], vulkanState->pacer.timeline};
+    // Headless frames neither acquire nor present, only the timeline is signaled
+    uint32_t skippedSignals = vulkanState->headless ? 1 : 0;
+
+    // Binary semaphores ignore their value
+    uint64_t waitValues[] = {0};
+    uint64_t signalValues[] = {0, framePacerSignalValue(&vulkanState->pacer)};
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .waitSemaphoreValueCount = vulkanState->headless ? 0 : sizeof(waitValues) / sizeof(uint64_t),
+        .pWaitSemaphoreValues = waitValues,
+        .signalSemaphoreValueCount = sizeof(signalValues) / sizeof(uint64_t) - skippedSignals,
+        .pSignalSemaphoreValues = signalValues + skippedSignals,
+    };
 
     VkSubmitInfo submitInfo = {
         .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .waitSemaphoreCount = sizeof(waitSemaphores) / sizeof(VkSemaphore),
+        .pNext = &timelineInfo,
+        .waitSemaphoreCount = vulkanState->headless ? 0 : sizeof(waitSemaphores) / sizeof(VkSemaphore),
         .pWaitSemaphores = waitSemaphores,
         .pWaitDstStageMask = waitStages,
         .pCommandBuffers = &vulkanState->commandBuffers[vulkanState->currentFrame],
         .commandBufferCount = 1,
-        .pSignalSemaphores = signalSemaphores,
-        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = signalSemaphores + skippedSignals,
+        .signalSemaphoreCount = sizeof(signalSemaphores) / sizeof(VkSemaphore) - skippedSignals,
     };
 
     VkResult result;
-    result = queueSubmit(vulkanState->graphicsQueue, 1, &submitInfo, vulkanState->inFlightFences[vulkanState->currentFrame]);
+    result = queueSubmit(vulkanState->graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
     if(result != VK_SUCCESS) {
         fprintf(stderr, "Failed to submit draw to queue: %s.\n", string_VkResult(result));
         return;
     }
+    framePacerEndFrame(&vulkanState->pacer);
+
+    if(vulkanState->headless) {
+        return;
+    }
+
+    // Frame values increase across swapchains, so they double as present ids
+    uint64_t presentIdValue = framePacerSubmittedValue(&vulkanState->pacer);
+    VkPresentIdKHR presentId = {
+        .sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR,
+        .swapchainCount = 1,
+        .pPresentIds = &presentIdValue,
+    };
 
     VkPresentInfoKHR presentInfo = {
         .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-        .waitSemaphoreCount = sizeof(signalSemaphores) / sizeof(VkSemaphore),
-        .pWaitSemaphores = signalSemaphores,
+        .pNext = vulkanState->device.enabled.presentWait ? &presentId : NULL,
+        .waitSemaphoreCount = sizeof(presentSemaphores) / sizeof(VkSemaphore),
+        .pWaitSemaphores = presentSemaphores,
         .swapchainCount = 1,
         .pSwapchains = &vulkanState->swapchain.swapchain,
         .pImageIndices = &imageIndex,
     };
 
     result = queuePresent(vulkanState->presentQueue, &presentInfo);
+    if(vulkanState->device.enabled.presentWait) {
+        vulkanState->swapchain.lastPresentId = presentIdValue;
+    }
     if(result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || vulkanState->framebufferResized) {
         recreateSwapChain(vulkanState, window);
         vulkanState->framebufferResized = VK_FALSE;
@@ -454,8 +1186,6 @@ void renderAndPresent(VulkanState *vulkanState, Window *window, uint32_t imageIn
         fprintf(stderr, "Failed to queue present: %s.\n", string_VkResult(result));
         return;
     }
-
-    vulkanState->currentFrame = (vulkanState->currentFrame + 1) % FRAMES_IN_FLIGHT;
 }
 
 void recreateSwapChain(VulkanState *vulkanState, Window *window) {
@@ -466,193 +1196,325 @@ void recreateSwapChain(VulkanState *vulkanState, Window *window) {
         glfwWaitEvents();
     }
 
-    waitIdle(&vulkanState->device);
-    
-    destroySwapChain(&vulkanState->device, &vulkanState->swapchain);
+    Swapchain old = vulkanState->swapchain;
     assert(createSwapChain(
         &vulkanState->device,
         window,
         vulkanState->surface,
+        vulkanState->presentPolicy,
+        old.swapchain,
         &vulkanState->swapchain
     ) == VK_SUCCESS);
+
+    // Frames in flight keep presenting from the old swapchain, it is destroyed once
+    // the last frame submitted so far has finished
+    Swapchain *retired = (Swapchain*)malloc(sizeof(Swapchain));
+    if(retired == NULL) {
+        // Nowhere to keep it until then, wait for those frames and destroy it right away
+        VkResult result = framePacerWaitIdle(&vulkanState->pacer);
+        if(result != VK_SUCCESS) {
+            fprintf(stderr, "Failed to wait for frames in flight: %s.\n", string_VkResult(result));
+            exit(1);
+        }
+        destroySwapChain(&vulkanState->device, &old);
+        return;
+    }
+    *retired = old;
+
+    deletionQueuePush(
+        &vulkanState->deletionQueue,
+        framePacerSubmittedValue(&vulkanState->pacer),
+        DestroyRetiredSwapchain,
+        retired
+    );
+}
+
+void DestroyRetiredSwapchain(Device *device, void *userData) {
+    Swapchain *swapchain = (Swapchain*)userData;
+
+    destroySwapChain(device, swapchain);
+    free(swapchain);
+}
+
+// MainPass asks the registry each frame, only the scene keeps handles of its own
+void SwapScenePipeline(VkPipeline oldPipeline, VkPipeline newPipeline, void *userData) {
+    VulkanState *state = (VulkanState*)userData;
+
+    gpuSceneReplacePipeline(&state->gpuScene, oldPipeline, newPipeline);
+}
+
+// Between frames, the rebuilt pipelines are used from the frame being started
+void ReloadShader(const char *name, uint32_t *code, size_t codeSize, void *userData) {
+    VulkanState *state = (VulkanState*)userData;
+
+    uint32_t swapped = pipelineRegistryReloadShader(
+        &state->pipelineRegistry,
+        name,
+        code, codeSize,
+        &state->deletionQueue,
+        framePacerSubmittedValue(&state->pacer),
+        SwapScenePipeline,
+        state
+    );
+    fprintf(stderr, "Reloaded %s, %u pipelines rebuilt.\n", name, swapped);
 }
 
 void framebufferResized(VulkanState *vulkanState) {
     vulkanState->framebufferResized = VK_TRUE;
 }
 
+void toggleRayTraced(VulkanState *vulkanState) {
+    vulkanState->rayTraced = !vulkanState->rayTraced;
+    fprintf(
+        stderr,
+        "Ray traced view: %s%s.\n",
+        vulkanState->rayTraced ? "on" : "off",
+        vulkanState->device.enabled.rayTracing ? "" : ", traced on the CPU"
+    );
+}
+
+void toggleGpuDriven(VulkanState *vulkanState) {
+    vulkanState->gpuDriven = !vulkanState->gpuDriven;
+    fprintf(stderr, "GPU driven rendering: %s.\n", vulkanState->gpuDriven ? "on" : "off");
+}
+
+FramePacerStats getFrameStats(VulkanState *vulkanState) {
+    return framePacerStats(&vulkanState->pacer);
+}
+
+PipelineRegistryStats getPipelineStats(VulkanState *vulkanState) {
+    return pipelineRegistryStats(&vulkanState->pipelineRegistry);
+}
+
+LayoutCacheStats getLayoutStats(VulkanState *vulkanState) {
+    return layoutCacheStats(&vulkanState->layoutCache);
+}
+
+RenderQueueStats getRenderQueueStats(VulkanState *vulkanState) {
+    return renderQueueStats(&vulkanState->renderQueue);
+}
+
+TlasStats getTlasStats(VulkanState *vulkanState) {
+    if(!vulkanState->device.enabled.rayTracing) {
+        return (TlasStats){0};
+    }
+    return tlasStats(&vulkanState->tlas);
+}
+
+ReadbackStats getCaptureStats(VulkanState *vulkanState) {
+    if(!vulkanState->capturing) {
+        return (ReadbackStats){0};
+    }
+    return readbackStats(&vulkanState->readback);
+}
+
+void finishFrames(VulkanState *vulkanState) {
+    assert(framePacerWaitIdle(&vulkanState->pacer) == VK_SUCCESS);
+}
+
 #include <main.frag.h>
 #include <main.vert.h>
 
-void CreateGraphicsPipeline(VulkanState *state) {
+void RequestGraphicsPipelines(VulkanState *state) {
     VkResult result;
 
-    VkShaderModule vertex, fragment;
-    result = createShaderModule(&state->device, (const uint32_t*)main_vert_h, sizeof(main_vert_h), &vertex);
+    result = pipelineRegistryAddShader(
+        &state->pipelineRegistry,
+        "main.vert",
+        VK_SHADER_STAGE_VERTEX_BIT,
+        (const uint32_t*)main_vert_h,
+        sizeof(main_vert_h)
+    );
     if(result != VK_SUCCESS) {
         fprintf(stderr, "Failed to create vertex shader module: %s\n",
             string_VkResult(result));
         exit(1);
     }
 
-    result = createShaderModule(&state->device, (const uint32_t*)main_frag_h, sizeof(main_frag_h), &fragment);
+    result = pipelineRegistryAddShader(
+        &state->pipelineRegistry,
+        "main.frag",
+        VK_SHADER_STAGE_FRAGMENT_BIT,
+        (const uint32_t*)main_frag_h,
+        sizeof(main_frag_h)
+    );
     if(result != VK_SUCCESS) {
         fprintf(stderr, "Failed to create fragment shader module: %s\n",
             string_VkResult(result));
         exit(1);
     }
 
-    VkPipelineShaderStageCreateInfo vertexStage = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-        .stage = VK_SHADER_STAGE_VERTEX_BIT,
-        .module = vertex,
-        .pName = "main",
+    GraphicsPipelineDesc desc = {
+        .vertexShader = "main.vert",
+        .fragmentShader = "main.frag",
+        .vertexInput = vertexDescription(),
+        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+        .polygonMode = VK_POLYGON_MODE_FILL,
+        .cullMode = VK_CULL_MODE_BACK_BIT,
+        .frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+        .blendEnable = VK_FALSE,
+        .depthTest = VK_FALSE,
+        .depthWrite = VK_FALSE,
+        .depthCompare = VK_COMPARE_OP_ALWAYS,
+        .colorFormat = state->swapchain.format,
+        .depthFormat = VK_FORMAT_UNDEFINED,
+        // Derived from the shaders, vertexInput is checked against what main.vert reads
+        .layout = VK_NULL_HANDLE,
     };
 
-    VkPipelineShaderStageCreateInfo fragmentStage = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-        .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
-        .module = fragment,
-        .pName = "main",
-    };
+    state->mainPipeline = pipelineRegistryRequest(&state->pipelineRegistry, &desc);
+    if(state->mainPipeline == PIPELINE_REGISTRY_INVALID) {
+        fprintf(stderr, "Failed to request graphics pipeline.\n");
+        exit(1);
+    }
+}
 
-    VkPipelineShaderStageCreateInfo shaderStages[] = {vertexStage, fragmentStage};
+#include <cull.comp.h>
 
-    VkDynamicState dynamicStates[] = {
-        VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR
-    };
+void CreateGpuScene(VulkanState *state) {
+    VkResult result;
 
-    VkPipelineDynamicStateCreateInfo dynamicStateInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
-        .pDynamicStates = dynamicStates,
-        .dynamicStateCount = sizeof(dynamicStates) / sizeof(VkDynamicState),
-    };
+    result = createGpuScene(
+        &state->device,
+        state->allocator,
+        (const uint32_t*)cull_comp_h,
+        sizeof(cull_comp_h),
+        DEMO_GRID_SIZE * DEMO_GRID_SIZE,
+        &state->gpuScene
+    );
+    if(result != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create GPU scene: %s.\n", string_VkResult(result));
+        exit(1);
+    }
 
-    VertexInputDescription desc = vertexDescription();
+    uint32_t bucket = gpuSceneAddBucket(
+        &state->gpuScene,
+        pipelineRegistryPipeline(&state->pipelineRegistry, state->mainPipeline),
+        &state->mesh
+    );
+    for(uint32_t i = 0; i < DEMO_GRID_SIZE * DEMO_GRID_SIZE; i++) {
+        Vector4f sphere;
+        Matrix4f transform = DemoGridTransform(i, &sphere);
+        gpuSceneAddObject(&state->gpuScene, bucket, sphere, transform);
+    }
+    gpuSceneCommit(&state->gpuScene);
 
-    VkPipelineVertexInputStateCreateInfo inputStateInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-        .pVertexBindingDescriptions = desc.bindings,
-        .vertexBindingDescriptionCount = sizeof(desc.bindings) / sizeof(VkVertexInputBindingDescription),
-        .pVertexAttributeDescriptions = desc.attributes,
-        .vertexAttributeDescriptionCount = sizeof(desc.attributes) / sizeof(VkVertexInputAttributeDescription),
-    };
+    state->gpuDriven = VK_TRUE;
+}
 
-    VkPipelineInputAssemblyStateCreateInfo assemblyInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-        .primitiveRestartEnable = VK_FALSE,
-    };
+void CreateCullSet(VulkanState *state) {
+    const uint32_t objectCount = DEMO_GRID_SIZE * DEMO_GRID_SIZE;
 
-    VkPipelineViewportStateCreateInfo viewportState = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
-        .viewportCount = 1,
-        .scissorCount = 1,
-    };
+    VkResult result = createCullSet(objectCount, &state->cullSet);
+    if(result != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create cull set: %s.\n", string_VkResult(result));
+        exit(1);
+    }
 
-    VkPipelineRasterizationStateCreateInfo rasterizationState = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
-        .depthClampEnable = VK_FALSE,
-        .rasterizerDiscardEnable = VK_FALSE,
-        .polygonMode = VK_POLYGON_MODE_FILL,
-        .lineWidth = 1.0f,
-        .cullMode = VK_CULL_MODE_BACK_BIT,
-        .frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
-        .depthBiasEnable = VK_FALSE,
-    };
+    state->visibleObjects = (uint32_t*)calloc(objectCount, sizeof(uint32_t));
 
-    VkPipelineMultisampleStateCreateInfo multisampleState = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-        .sampleShadingEnable = VK_FALSE,
-        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
-    };
+    for(uint32_t i = 0; i < objectCount; i++) {
+        Vector4f sphere;
+        DemoGridTransform(i, &sphere);
 
-    VkPipelineColorBlendAttachmentState colorBlendAttachment = {
-        .colorWriteMask = VK_COLOR_COMPONENT_A_BIT |
-            VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_G_BIT |
-            VK_COLOR_COMPONENT_R_BIT,
-        .blendEnable = VK_FALSE,
-    };
+        // Quads are flat, the box is tighter than the sphere along z
+        float extent = sphere.w / DEMO_QUAD_CORNER_RADIUS;
+        cullSetAdd(
+            &state->cullSet,
+            sphere,
+            (Vector3f){sphere.x - extent, sphere.y - extent, sphere.z},
+            (Vector3f){sphere.x + extent, sphere.y + extent, sphere.z}
+        );
+    }
+}
 
-    VkPipelineColorBlendStateCreateInfo colorBlendState = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
-        .logicOpEnable = VK_FALSE,
-        .pAttachments = &colorBlendAttachment,
-        .attachmentCount = 1,
-    };
+Matrix4f DemoGridTransform(uint32_t index, Vector4f *sphere) {
+    const float cell = 2.0f / DEMO_GRID_SIZE;
+    const float scale = cell * 0.5f;
 
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-        .setLayoutCount = 0,
-        .pushConstantRangeCount = 0,
+    Vector3f position = {
+        -1.0f + cell * (index % DEMO_GRID_SIZE + 0.5f),
+        -1.0f + cell * (index / DEMO_GRID_SIZE + 0.5f),
+        0.0f,
     };
 
-    result = createPipelineLayout(&state->device, &pipelineLayoutInfo, &state->layout);
-    if(result != VK_SUCCESS) {
-        fprintf(stderr, "Failed to create pipeline layout: %s.\n", string_VkResult(result));
-        exit(1);
-    }
+    // Demo quad spans [-0.8, 0.8], the sphere encloses its corners
+    *sphere = (Vector4f){position.x, position.y, position.z, 0.8f * DEMO_QUAD_CORNER_RADIUS * scale};
 
-    VkPipelineRenderingCreateInfoKHR pipelineRendering = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR,
-        .colorAttachmentCount = 1,
-        .pColorAttachmentFormats = &state->swapchain.format,
-        .stencilAttachmentFormat = VK_FORMAT_UNDEFINED,
-        .depthAttachmentFormat = VK_FORMAT_UNDEFINED,
-        .viewMask = 0,
+    return matrix4fTranslateScale(position, scale);
+}
+
+// Hit color of a grid object in the ray traced view
+Vector4f DemoGridColor(uint32_t index) {
+    return (Vector4f){
+        (float)(index % DEMO_GRID_SIZE) / DEMO_GRID_SIZE,
+        (float)(index / DEMO_GRID_SIZE) / DEMO_GRID_SIZE,
+        0.5f,
+        1.0f,
     };
+}
 
-    VkGraphicsPipelineCreateInfo pipelineInfo = {
-        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-        .pStages = shaderStages,
-        .stageCount = sizeof(shaderStages) / sizeof(VkPipelineShaderStageCreateInfo),
-        .pVertexInputState = &inputStateInfo,
-        .pInputAssemblyState = &assemblyInfo,
-        .pViewportState = &viewportState,
-        .pRasterizationState = &rasterizationState,
-        .pMultisampleState = &multisampleState,
-        .pDepthStencilState = NULL,
-        .pColorBlendState = &colorBlendState,
-        .pDynamicState = &dynamicStateInfo,
-        .layout = state->layout,
-        .renderPass = VK_NULL_HANDLE,
-        .subpass = 0,
-        .basePipelineHandle = VK_NULL_HANDLE,
-        .basePipelineIndex = -1,
-        .pNext = &pipelineRendering
-    };
-    result = createGraphicsPipeline(&state->device, &pipelineInfo, &state->graphicsPipeline);
+#include <ray.rgen.h>
+#include <ray.rmiss.h>
+#include <ray.rchit.h>
+
+void CreateRayTracingLayout(VulkanState *state) {
+    ShaderReflection raygen, miss, hit;
+    VkResult result = reflectShader((const uint32_t*)ray_rgen_h, sizeof(ray_rgen_h), &raygen);
+    if(result == VK_SUCCESS) {
+        result = reflectShader((const uint32_t*)ray_rmiss_h, sizeof(ray_rmiss_h), &miss);
+    }
+    if(result == VK_SUCCESS) {
+        result = reflectShader((const uint32_t*)ray_rchit_h, sizeof(ray_rchit_h), &hit);
+    }
+    if(result == VK_SUCCESS) {
+        const ShaderReflection *reflections[] = {&raygen, &miss, &hit};
+        result = layoutCacheGet(&state->layoutCache, reflections, 3, &state->rayTracingLayout);
+    }
     if(result != VK_SUCCESS) {
-        fprintf(stderr, "Failed to create graphics pipeline: %s.\n", string_VkResult(result));
+        fprintf(stderr, "Failed to create ray tracing pipeline layout: %s.\n", string_VkResult(result));
         exit(1);
     }
-
-    destroyShaderModule(&state->device, fragment);
-    destroyShaderModule(&state->device, vertex);
 }
 
-#include <ray.rgen.h>
-
-void CreateRayTracingPipeline(VulkanState *state) {
+// Worker thread, the driver may spread the compile over idle workers
+VkResult BuildRayTracingPipeline(PipelineService *service, void *userData, VkPipeline *pipeline) {
+    VulkanState *state = (VulkanState*)userData;
     VkResult result;
 
-    VkShaderModule raygen;
-    result = createShaderModule(
-        &state->device,
+    const uint32_t *codes[] = {
         (const uint32_t*)ray_rgen_h,
-        sizeof(ray_rgen_h),
-        &raygen
-    );
-
-    VkPipelineShaderStageCreateInfo raygenStage = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-        .stage = VK_SHADER_STAGE_RAYGEN_BIT_KHR,
-        .module = raygen,
-        .pName = "main",
+        (const uint32_t*)ray_rmiss_h,
+        (const uint32_t*)ray_rchit_h,
+    };
+    const size_t codeSizes[] = {sizeof(ray_rgen_h), sizeof(ray_rmiss_h), sizeof(ray_rchit_h)};
+    const VkShaderStageFlagBits stages[] = {
+        VK_SHADER_STAGE_RAYGEN_BIT_KHR,
+        VK_SHADER_STAGE_MISS_BIT_KHR,
+        VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR,
     };
+    const uint32_t stageCount = sizeof(stages) / sizeof(VkShaderStageFlagBits);
 
+    VkShaderModule modules[3] = {VK_NULL_HANDLE};
     PipelineStageArray array = PipelineStageArrayNew(100);
-    PipelineStageArrayAddElement(&array, raygenStage);
+    for(uint32_t i = 0; i < stageCount; i++) {
+        result = createShaderModule(&state->device, codes[i], codeSizes[i], &modules[i]);
+        if(result != VK_SUCCESS) {
+            for(uint32_t j = 0; j < i; j++) {
+                destroyShaderModule(&state->device, modules[j]);
+            }
+            PipelineStageArrayDestroy(&array);
+            return result;
+        }
+
+        VkPipelineShaderStageCreateInfo stage = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = stages[i],
+            .module = modules[i],
+            .pName = "main",
+        };
+        PipelineStageArrayAddElement(&array, stage);
+    }
 
     VkDynamicState dynamicStates[] = {
         VK_DYNAMIC_STATE_RAY_TRACING_PIPELINE_STACK_SIZE_KHR,
@@ -664,30 +1526,55 @@ void CreateRayTracingPipeline(VulkanState *state) {
         .dynamicStateCount = sizeof(dynamicStates) / sizeof(VkDynamicState),
     };
 
-    VkRayTracingShaderGroupCreateInfoKHR shaderGroup = {
-        .sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR,
-        .generalShader = 0,
-        .anyHitShader = VK_SHADER_UNUSED_KHR,
-        .closestHitShader = VK_SHADER_UNUSED_KHR,
-        .intersectionShader = VK_SHADER_UNUSED_KHR,
-        .type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR,
+    // Indexed by RAY_GROUP_*, the stage indices follow stages above
+    VkRayTracingShaderGroupCreateInfoKHR shaderGroups[RAY_GROUP_COUNT] = {
+        [RAY_GROUP_RAYGEN] = {
+            .sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR,
+            .type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR,
+            .generalShader = 0,
+            .closestHitShader = VK_SHADER_UNUSED_KHR,
+            .anyHitShader = VK_SHADER_UNUSED_KHR,
+            .intersectionShader = VK_SHADER_UNUSED_KHR,
+        },
+        [RAY_GROUP_MISS] = {
+            .sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR,
+            .type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR,
+            .generalShader = 1,
+            .closestHitShader = VK_SHADER_UNUSED_KHR,
+            .anyHitShader = VK_SHADER_UNUSED_KHR,
+            .intersectionShader = VK_SHADER_UNUSED_KHR,
+        },
+        [RAY_GROUP_HIT] = {
+            .sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR,
+            .type = VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR,
+            .generalShader = VK_SHADER_UNUSED_KHR,
+            .closestHitShader = 2,
+            .anyHitShader = VK_SHADER_UNUSED_KHR,
+            .intersectionShader = VK_SHADER_UNUSED_KHR,
+        },
     };
 
-    result = createRayTracingPipelineKHR(
-        &state->device,
-        state->layout,
-        &dynamicStateInfo,
-        &shaderGroup,
-        array,
-        &state->rayTracingPipeline
-    );
-    PipelineStageArrayDestroy(&array);
-    destroyShaderModule(&state->device, raygen);
+    VkRayTracingPipelineCreateInfoKHR pipelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR,
+        .layout = state->rayTracingLayout,
+        .pGroups = shaderGroups,
+        .groupCount = RAY_GROUP_COUNT,
+        .pStages = array.elements,
+        .stageCount = array.elementCount,
+        .maxPipelineRayRecursionDepth = RAY_RECURSION_DEPTH,
+        .pDynamicState = &dynamicStateInfo,
+    };
 
-    if(result != VK_SUCCESS) {
-        fprintf(stderr, "Failed to create ray tracing pipeline: %s.\n", string_VkResult(result));
-        exit(1);
+    result = pipelineServiceCreateRayTracing(service, &pipelineInfo, pipeline);
+    if(result == VK_SUCCESS) {
+        state->rayStackSize = rayTracingPipelineStackSize(&state->device, *pipeline, &pipelineInfo, RAY_CALLABLE_DEPTH);
+    }
+    PipelineStageArrayDestroy(&array);
+    for(uint32_t i = 0; i < stageCount; i++) {
+        destroyShaderModule(&state->device, modules[i]);
     }
+
+    return result;
 }
 
 void CopyBuffer(VulkanState *state, Buffer *dst, Buffer *src) {
@@ -730,16 +1617,23 @@ Mesh CreateMesh(
 ) {
     Mesh mesh;
 
+    // Acceleration structure builds read the geometry through device addresses
+    VkBufferUsageFlags buildInputUsage = 0;
+    if(state->device.enabled.rayTracing) {
+        buildInputUsage = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
+            VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR;
+    }
+
     mesh.vertexBuffer = CreateBufferGQueue(
         state,
         sizeof(Vertex) * vertexCount,
-        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | buildInputUsage,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
     );
     mesh.indexBuffer = CreateBufferGQueue(
         state,
         sizeof(uint32_t) * indexCount,
-        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | buildInputUsage,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
     );
 
@@ -773,11 +1667,413 @@ Mesh CreateMesh(
     destroyDeallocateBuffer(state->allocator, &vertexStaging);
     destroyDeallocateBuffer(state->allocator, &indexStaging);
 
+    mesh.vertexCount = vertexCount;
     mesh.indexCount = indexCount;
 
     return mesh;
 }
 
+// The demo mesh never changes, so it is built once for trace speed and compacted. Blocks
+// until both are done, the builder's scratch pool is free again afterwards.
+void BuildBlas(VulkanState *state) {
+    BlasGeometry geometry = blasGeometryFromMesh(&state->device, &state->mesh);
+    BlasBuild build;
+    VkResult result = createBlas(state->allocator, &geometry, BLAS_USAGE_STATIC, &state->blas, &build);
+    if(result == VK_SUCCESS) {
+        result = blasBuilderAdd(&state->blasBuilder, &build, &state->blas);
+    }
+    if(result != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create acceleration structure: %s.\n", string_VkResult(result));
+        exit(1);
+    }
+
+    VkCommandBuffer buildBuffer;
+    assert(allocateCommandBuffer(
+        &state->device,
+        state->commandPool,
+        VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        &buildBuffer
+    ) == VK_SUCCESS);
+
+    assert(beginOneTimeCommandBuffer(buildBuffer) == VK_SUCCESS);
+    result = cmdBlasBuilderFlush(&state->blasBuilder, buildBuffer);
+    if(result != VK_SUCCESS) {
+        fprintf(stderr, "Failed to build acceleration structures: %s.\n", string_VkResult(result));
+        exit(1);
+    }
+    assert(endCommandBuffer(buildBuffer) == VK_SUCCESS);
+
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pCommandBuffers = &buildBuffer,
+        .commandBufferCount = 1,
+    };
+    assert(queueSubmit(state->graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) == VK_SUCCESS);
+    assert(queueWaitIdle(state->graphicsQueue) == VK_SUCCESS);
+
+    // The compacted size is only known once the build completed
+    VkDeviceSize builtSize = state->blas.buffer.memorySize;
+    assert(resetCommandBuffer(buildBuffer) == VK_SUCCESS);
+    assert(beginOneTimeCommandBuffer(buildBuffer) == VK_SUCCESS);
+    // Waited for below, the original is already unused by the first frame
+    result = cmdBlasBuilderCompact(
+        &state->blasBuilder,
+        buildBuffer,
+        &state->deletionQueue,
+        framePacerSubmittedValue(&state->pacer)
+    );
+    assert(endCommandBuffer(buildBuffer) == VK_SUCCESS);
+    // Copies recorded before a failure already replaced their structures
+    assert(queueSubmit(state->graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) == VK_SUCCESS);
+    assert(queueWaitIdle(state->graphicsQueue) == VK_SUCCESS);
+    if(result == VK_SUCCESS) {
+        fprintf(
+            stderr,
+            "Compacted BLAS from %llu to %llu bytes\n",
+            (unsigned long long)builtSize, (unsigned long long)state->blas.buffer.memorySize
+        );
+    } else {
+        // Still traceable at its built size
+        fprintf(stderr, "Failed to compact BLAS: %s.\n", string_VkResult(result));
+    }
+
+    freeCommandBuffers(&state->device, state->commandPool, &buildBuffer, 1);
+}
+
+// Same structure as BuildBlas, built on the CPU from the data the mesh was created from by
+// pool workers joining one deferred operation. Only the compacting copy into device local
+// memory runs on the queue, the host visible original is freed once it completed.
+void BuildBlasOnHost(
+    VulkanState *state,
+    const Vertex *vertices,
+    uint32_t vertexCount,
+    const uint32_t *indices,
+    uint32_t indexCount
+) {
+    BlasGeometry geometry = blasGeometryFromHost(vertices, vertexCount, indices, indexCount);
+    AccelerationStructure hostBlas;
+    BlasBuild build;
+    VkResult result = createBlas(state->allocator, &geometry, BLAS_USAGE_STATIC, &hostBlas, &build);
+    if(result == VK_SUCCESS) {
+        result = buildBlasOnHost(&state->device, &state->threadPool, &build, 1);
+    }
+    if(result != VK_SUCCESS) {
+        fprintf(stderr, "Failed to build acceleration structure on the host: %s.\n", string_VkResult(result));
+        exit(1);
+    }
+
+    VkDeviceSize compactedSize;
+    result = writeAccelerationStructuresPropertiesKHR(
+        &state->device,
+        1, &hostBlas.structure,
+        VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR,
+        sizeof(VkDeviceSize), &compactedSize,
+        sizeof(VkDeviceSize)
+    );
+    if(result == VK_SUCCESS) {
+        result = createAccelerationStructure(
+            state->allocator,
+            VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+            compactedSize,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            &state->blas
+        );
+    }
+    if(result != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create acceleration structure: %s.\n", string_VkResult(result));
+        exit(1);
+    }
+
+    VkCommandBuffer copyBuffer;
+    assert(allocateCommandBuffer(
+        &state->device,
+        state->commandPool,
+        VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        &copyBuffer
+    ) == VK_SUCCESS);
+
+    assert(beginOneTimeCommandBuffer(copyBuffer) == VK_SUCCESS);
+    VkCopyAccelerationStructureInfoKHR copyInfo = {
+        .sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR,
+        .src = hostBlas.structure,
+        .dst = state->blas.structure,
+        .mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR,
+    };
+    cmdCopyAccelerationStructureKHR(&state->device, copyBuffer, &copyInfo);
+    assert(endCommandBuffer(copyBuffer) == VK_SUCCESS);
+
+    // Host writes made before the submit are visible to it
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pCommandBuffers = &copyBuffer,
+        .commandBufferCount = 1,
+    };
+    assert(queueSubmit(state->graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) == VK_SUCCESS);
+    assert(queueWaitIdle(state->graphicsQueue) == VK_SUCCESS);
+
+    // Only the compacted copy stays allocated
+    VkDeviceSize builtSize = hostBlas.buffer.memorySize;
+    destroyAccelerationStructure(state->allocator, &hostBlas);
+    fprintf(
+        stderr,
+        "Built BLAS on the host, compacted from %llu to %llu bytes\n",
+        (unsigned long long)builtSize, (unsigned long long)state->blas.buffer.memorySize
+    );
+
+    freeCommandBuffers(&state->device, state->commandPool, &copyBuffer, 1);
+}
+
+// Built by the first frame, the compacted BLAS address is final by now
+void CreateTlas(VulkanState *state) {
+    TlasPolicy policy = {
+        .rebuildMotion = TLAS_REBUILD_MOTION,
+        .maxRefits = TLAS_MAX_REFITS,
+    };
+    VkResult result = createTlas(
+        &state->device,
+        state->allocator,
+        DEMO_GRID_SIZE * DEMO_GRID_SIZE,
+        state->framesInFlight,
+        policy,
+        &state->tlas
+    );
+    if(result != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create TLAS: %s.\n", string_VkResult(result));
+        exit(1);
+    }
+
+    VkDeviceAddress blas = getAccelerationStructureDeviceAddressKHR(&state->device, state->blas.structure);
+    for(uint32_t i = 0; i < DEMO_GRID_SIZE * DEMO_GRID_SIZE; i++) {
+        Vector4f sphere;
+        Matrix4f transform = DemoGridTransform(i, &sphere);
+        assert(tlasSetInstance(&state->tlas, i, &transform, blas, i, i) == VK_SUCCESS);
+    }
+}
+
+// Records are set up front, their handles arrive with the pipeline in PrepareRayTracing
+void CreateRayTracingView(VulkanState *state) {
+    SbtRegionLayout layouts[SBT_REGION_COUNT] = {
+        [SBT_REGION_RAYGEN] = {1, 0},
+        [SBT_REGION_MISS] = {1, sizeof(RayMissRecord)},
+        [SBT_REGION_HIT] = {DEMO_GRID_SIZE * DEMO_GRID_SIZE, sizeof(RayHitRecord)},
+        [SBT_REGION_CALLABLE] = {0, 0},
+    };
+    VkResult result = createShaderBindingTable(&state->device, state->allocator, layouts, &state->sbt);
+    if(result != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create shader binding table: %s.\n", string_VkResult(result));
+        exit(1);
+    }
+
+    RayMissRecord miss = {
+        .background = RAY_BACKGROUND,
+    };
+    assert(sbtSetRecord(&state->sbt, SBT_REGION_RAYGEN, 0, RAY_GROUP_RAYGEN, NULL, 0) == VK_SUCCESS);
+    assert(sbtSetRecord(&state->sbt, SBT_REGION_MISS, 0, RAY_GROUP_MISS, &miss, sizeof(miss)) == VK_SUCCESS);
+    // Instance i uses hit record i, see CreateTlas
+    for(uint32_t i = 0; i < DEMO_GRID_SIZE * DEMO_GRID_SIZE; i++) {
+        RayHitRecord hit = {
+            .color = DemoGridColor(i),
+        };
+        assert(sbtSetRecord(&state->sbt, SBT_REGION_HIT, i, RAY_GROUP_HIT, &hit, sizeof(hit)) == VK_SUCCESS);
+    }
+
+    state->rayExtent = (VkExtent2D){RAY_IMAGE_WIDTH, RAY_IMAGE_HEIGHT};
+    VkImageCreateInfo imageInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = VK_FORMAT_R8G8B8A8_UNORM,
+        .extent = {RAY_IMAGE_WIDTH, RAY_IMAGE_HEIGHT, 1},
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+    result = createAllocateImage(state->allocator, &imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &state->rayImage);
+    if(result == VK_SUCCESS) {
+        VkImageViewCreateInfo viewInfo = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = state->rayImage.image,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = imageInfo.format,
+            .subresourceRange = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1,
+            },
+        };
+        result = createImageView(&state->device, &viewInfo, &state->rayImageView);
+    }
+    if(result != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create ray traced image: %s.\n", string_VkResult(result));
+        exit(1);
+    }
+
+    // Written once, the TLAS is rebuilt in place and the image never changes
+    VkDescriptorPoolSize poolSizes[] = {
+        {VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1},
+    };
+    VkDescriptorPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets = 1,
+        .poolSizeCount = sizeof(poolSizes) / sizeof(VkDescriptorPoolSize),
+        .pPoolSizes = poolSizes,
+    };
+    result = createDescriptorPool(&state->device, &poolInfo, &state->rayDescriptorPool);
+    if(result == VK_SUCCESS) {
+        result = allocateDescriptorSet(
+            &state->device,
+            state->rayDescriptorPool,
+            layoutCacheSetLayout(&state->layoutCache, state->rayTracingLayout, 0),
+            &state->rayDescriptorSet
+        );
+    }
+    if(result != VK_SUCCESS) {
+        fprintf(stderr, "Failed to allocate ray tracing descriptors: %s.\n", string_VkResult(result));
+        exit(1);
+    }
+
+    VkWriteDescriptorSetAccelerationStructureKHR sceneInfo = {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR,
+        .accelerationStructureCount = 1,
+        .pAccelerationStructures = &state->tlas.structure.structure,
+    };
+    VkDescriptorImageInfo imageDescriptor = {
+        .imageView = state->rayImageView,
+        .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+    };
+    VkWriteDescriptorSet writes[] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .pNext = &sceneInfo,
+            .dstSet = state->rayDescriptorSet,
+            .dstBinding = 0,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR,
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = state->rayDescriptorSet,
+            .dstBinding = 1,
+            .descriptorCount = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            .pImageInfo = &imageDescriptor,
+        },
+    };
+    updateDescriptorSets(&state->device, sizeof(writes) / sizeof(VkWriteDescriptorSet), writes);
+}
+
+// Traced from the data the mesh was created from, placed and colored like the TLAS instances
+// and hit records of the GPU view
+void CreateCpuTracedView(
+    VulkanState *state,
+    const Vertex *vertices,
+    uint32_t vertexCount,
+    const uint32_t *indices,
+    uint32_t indexCount
+) {
+    const uint32_t objectCount = DEMO_GRID_SIZE * DEMO_GRID_SIZE;
+    Matrix4f *transforms = (Matrix4f*)malloc(objectCount * sizeof(Matrix4f));
+    Vector4f *colors = (Vector4f*)malloc(objectCount * sizeof(Vector4f));
+    if(transforms == NULL || colors == NULL) {
+        fprintf(stderr, "Failed to allocate the CPU traced scene.\n");
+        exit(1);
+    }
+    for(uint32_t i = 0; i < objectCount; i++) {
+        Vector4f sphere;
+        transforms[i] = DemoGridTransform(i, &sphere);
+        colors[i] = DemoGridColor(i);
+    }
+
+    state->rayExtent = (VkExtent2D){CPU_RAY_IMAGE_WIDTH, CPU_RAY_IMAGE_HEIGHT};
+    VkResult result = createCpuTracer(
+        vertices, vertexCount,
+        indices, indexCount,
+        transforms, colors, objectCount,
+        (Vector4f)RAY_BACKGROUND,
+        state->rayExtent.width, state->rayExtent.height,
+        &state->threadPool,
+        &state->cpuTracer
+    );
+    free(transforms);
+    free(colors);
+    if(result != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create CPU tracer: %s.\n", string_VkResult(result));
+        exit(1);
+    }
+
+    VkImageCreateInfo imageInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = VK_FORMAT_R8G8B8A8_UNORM,
+        .extent = {state->rayExtent.width, state->rayExtent.height, 1},
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+    result = createAllocateImage(state->allocator, &imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &state->rayImage);
+    if(result != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create ray traced image: %s.\n", string_VkResult(result));
+        exit(1);
+    }
+
+    // Stay mapped, one per frame in flight so tracing never waits on an earlier copy
+    VkBufferCreateInfo uploadInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = (VkDeviceSize)state->rayExtent.width * state->rayExtent.height * 4,
+        .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+    for(uint32_t i = 0; i < state->framesInFlight; i++) {
+        result = createAllocateBuffer(
+            state->allocator,
+            &uploadInfo,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            &state->rayUploads[i]
+        );
+        if(result != VK_SUCCESS) {
+            fprintf(stderr, "Failed to create ray traced upload buffer: %s.\n", string_VkResult(result));
+            exit(1);
+        }
+
+        state->rayUploadsMapped[i] = (uint8_t*)mapBufferMemory(state->allocator, &state->rayUploads[i]);
+        if(state->rayUploadsMapped[i] == NULL) {
+            exit(1);
+        }
+    }
+}
+
+// False while the pipeline is still building or the surface can't be blitted to. Hands the
+// group handles to the table the first time it is seen, the frame uploads the records then.
+VkBool32 PrepareRayTracing(VulkanState *state) {
+    AsyncPipeline *pipeline = &state->rayTracingPipeline;
+    if(!state->device.enabled.rayTracing ||
+        !(state->swapchain.usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT) ||
+        !asyncPipelineReady(pipeline))
+    {
+        return VK_FALSE;
+    }
+
+    if(state->sbt.pipeline != pipeline->pipeline) {
+        VkResult result = sbtSetPipeline(&state->sbt, pipeline->pipeline, RAY_GROUP_COUNT);
+        if(result != VK_SUCCESS) {
+            fprintf(stderr, "Failed to get shader group handles: %s.\n", string_VkResult(result));
+            return VK_FALSE;
+        }
+    }
+
+    return VK_TRUE;
+}
+
 void DestroyMesh(VulkanState *state, Mesh *mesh) {
     destroyDeallocateBuffer(state->allocator, &mesh->vertexBuffer);
     destroyDeallocateBuffer(state->allocator, &mesh->indexBuffer);
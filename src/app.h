@@ -7,14 +7,60 @@
 #include "device_api.h"
 #include "swapchain.h"
 
+#include "frame_pacer.h"
+#include "pipeline_registry.h"
+#include "readback.h"
+#include "render_queue.h"
+#include "tlas.h"
+
+#define APP_DEFAULT_FRAMES_IN_FLIGHT 2
+#define APP_DEFAULT_PIPELINE_CACHE "pipeline.cache"
+
 typedef struct VKSTATE VulkanState;
 
-VulkanState *initVulkanState(Window *window, VkBool32 debugging);
+// Startup settings, fixed for the lifetime of the state
+typedef struct {
+    VkBool32 debugging;
+    // 1 for the lowest latency, 3 for throughput, at most FRAME_PACER_MAX_FRAMES
+    uint32_t framesInFlight;
+    PresentPolicy presentPolicy;
+    // Render into offscreen images without a window, initVulkanState takes a NULL window
+    VkBool32 headless;
+    VkExtent2D headlessExtent;
+    // Copies every frame out to capturePath when set, see ReadbackFormat
+    const char *capturePath;
+    ReadbackFormat captureFormat;
+    // Pipeline cache file reused across runs, NULL disables the cache
+    const char *pipelineCachePath;
+    // Background threads for pipeline builds, 0 for one per core
+    uint32_t workerThreads;
+    // GLSL sources recompiled and reloaded when they change, NULL keeps the embedded shaders
+    const char *shaderSourceDir;
+    // Start in the ray traced view where ray tracing is supported
+    VkBool32 rayTraced;
+    // Build BLASes on the CPU where the device supports host acceleration structure commands
+    VkBool32 hostBlasBuilds;
+} AppConfig;
+
+VulkanState *initVulkanState(Window *window, const AppConfig *config);
 void destroyVulkanState(VulkanState *vulkanState);
 void recordCommandBuffer(VulkanState *vulkanState, uint32_t imageIndex);
 VkBool32 getImage(VulkanState *vulkanState, Window *window, uint32_t *image);
 void renderAndPresent(VulkanState *vulkanState, Window *window, uint32_t imageIndex);
 void recreateSwapChain(VulkanState *vulkanState, Window *window);
 void framebufferResized(VulkanState *vulkanState);
+void toggleGpuDriven(VulkanState *vulkanState);
+void toggleRayTraced(VulkanState *vulkanState);
+FramePacerStats getFrameStats(VulkanState *vulkanState);
+PipelineRegistryStats getPipelineStats(VulkanState *vulkanState);
+LayoutCacheStats getLayoutStats(VulkanState *vulkanState);
+// Of the last frame drawn through the render queue, zeroed if every frame was GPU driven
+RenderQueueStats getRenderQueueStats(VulkanState *vulkanState);
+// Zeroed without ray tracing
+TlasStats getTlasStats(VulkanState *vulkanState);
+// Zeroed when capture is off
+ReadbackStats getCaptureStats(VulkanState *vulkanState);
+// Blocks until every submitted frame has finished on the GPU
+void finishFrames(VulkanState *vulkanState);
 
 #endif
@@ -6,6 +6,7 @@
 
 DEFINE_ARRAY(String, const char *)
 DEFINE_ARRAY(DeviceMemory, VkDeviceMemory)
+DEFINE_ARRAY(MemorySlot, uint32_t)
 DEFINE_ARRAY(PipelineStage, VkPipelineShaderStageCreateInfo)
 
 #endif
@@ -0,0 +1,256 @@
+#include "bench.h"
+#include "cpu_bvh.h"
+#include "cpu_cull.h"
+#include "frustum.h"
+#include "mesh.h"
+#include "thread_pool.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCH_ITERATIONS 20
+#define BENCH_BVH_RAYS 65536
+// Rays also traced against every triangle
+#define BENCH_BVH_ORACLE_RAYS 256
+// Triangles spaced exponentially along x, far enough to overflow float range and defeat the
+// binned splits
+#define BENCH_BVH_DEGENERATE_TRIANGLES 3000
+// Rays are aimed at the ones below this, 1.05^1700 is still well inside float range
+#define BENCH_BVH_DEGENERATE_TARGETS 1700
+
+uint32_t benchBvhDegenerate(void);
+double benchNow(void);
+float benchRandom(uint32_t *seed, float min, float max);
+
+int benchCulling(uint32_t objectCount) {
+    CullSet set;
+    if(createCullSet(objectCount, &set) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create cull set.\n");
+        return 1;
+    }
+
+    // Objects spread over a volume four times the size of the clip volume
+    uint32_t seed = 1;
+    for(uint32_t i = 0; i < objectCount; i++) {
+        Vector3f center = {
+            benchRandom(&seed, -4.0f, 4.0f),
+            benchRandom(&seed, -4.0f, 4.0f),
+            benchRandom(&seed, -4.0f, 4.0f),
+        };
+        float radius = benchRandom(&seed, 0.01f, 0.1f);
+
+        cullSetAdd(
+            &set,
+            (Vector4f){center.x, center.y, center.z, radius},
+            (Vector3f){center.x - radius, center.y - radius, center.z - radius},
+            (Vector3f){center.x + radius, center.y + radius, center.z + radius}
+        );
+    }
+
+    uint32_t *visible = (uint32_t*)malloc(objectCount * sizeof(uint32_t));
+    Frustum frustum = frustumFromMatrix(matrix4fIdentity());
+
+    uint32_t visibleCount = 0;
+    double best = 1e9, total = 0.0;
+    for(int i = 0; i < BENCH_ITERATIONS; i++) {
+        double start = benchNow();
+        visibleCount = cullSetTest(&set, &frustum, visible);
+        double elapsed = benchNow() - start;
+
+        total += elapsed;
+        if(elapsed < best) best = elapsed;
+    }
+
+    printf("Culled %u objects (%u visible, %u lanes): best %.3f ms, average %.3f ms\n",
+        objectCount, visibleCount, cullSetLanes(), best * 1e3, total / BENCH_ITERATIONS * 1e3);
+
+    free(visible);
+    destroyCullSet(&set);
+
+    return 0;
+}
+
+int benchBvh(uint32_t triangleCount) {
+    // Small triangles spread over the same volume as the culling objects
+    uint32_t seed = 1;
+    Vertex *vertices = (Vertex*)malloc(triangleCount * 3 * sizeof(Vertex));
+    uint32_t *indices = (uint32_t*)malloc(triangleCount * 3 * sizeof(uint32_t));
+    for(uint32_t i = 0; i < triangleCount; i++) {
+        Vector3f center = {
+            benchRandom(&seed, -4.0f, 4.0f),
+            benchRandom(&seed, -4.0f, 4.0f),
+            benchRandom(&seed, -4.0f, 4.0f),
+        };
+        for(uint32_t corner = 0; corner < 3; corner++) {
+            vertices[i * 3 + corner] = (Vertex){
+                .position = {
+                    center.x + benchRandom(&seed, -0.02f, 0.02f),
+                    center.y + benchRandom(&seed, -0.02f, 0.02f),
+                    center.z + benchRandom(&seed, -0.02f, 0.02f),
+                },
+            };
+            indices[i * 3 + corner] = i * 3 + corner;
+        }
+    }
+
+    ThreadPool pool;
+    if(createThreadPool(0, &pool) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create thread pool.\n");
+        return 1;
+    }
+
+    CpuBvh bvh;
+    double start = benchNow();
+    if(buildCpuBvh(vertices, indices, triangleCount * 3, NULL, &bvh) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to build BVH.\n");
+        return 1;
+    }
+    double serial = benchNow() - start;
+    destroyCpuBvh(&bvh);
+
+    start = benchNow();
+    if(buildCpuBvh(vertices, indices, triangleCount * 3, &pool, &bvh) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to build BVH.\n");
+        return 1;
+    }
+    double parallel = benchNow() - start;
+
+    CpuBvhStats stats = cpuBvhStats(&bvh);
+    printf("Built BVH over %u triangles (%u nodes, %u leaves): %.3f ms serial, %.3f ms on %u workers\n",
+        stats.triangles, stats.nodes, stats.leaves, serial * 1e3, parallel * 1e3, threadPoolWorkerCount(&pool));
+
+    // Rays from around the volume through points inside it
+    CpuRay *rays = (CpuRay*)malloc(BENCH_BVH_RAYS * sizeof(CpuRay));
+    for(uint32_t i = 0; i < BENCH_BVH_RAYS; i++) {
+        Vector3f origin = {
+            benchRandom(&seed, -6.0f, 6.0f),
+            benchRandom(&seed, -6.0f, 6.0f),
+            benchRandom(&seed, -6.0f, 6.0f),
+        };
+        Vector3f target = {
+            benchRandom(&seed, -4.0f, 4.0f),
+            benchRandom(&seed, -4.0f, 4.0f),
+            benchRandom(&seed, -4.0f, 4.0f),
+        };
+        rays[i] = (CpuRay){
+            .origin = origin,
+            .direction = {target.x - origin.x, target.y - origin.y, target.z - origin.z},
+            .tMax = INFINITY,
+        };
+    }
+
+    uint32_t hitCount = 0;
+    double best = 1e9, total = 0.0;
+    for(int i = 0; i < BENCH_ITERATIONS; i++) {
+        hitCount = 0;
+        start = benchNow();
+        for(uint32_t r = 0; r < BENCH_BVH_RAYS; r++) {
+            CpuHit hit;
+            hitCount += cpuBvhIntersect(&bvh, &rays[r], &hit);
+        }
+        double elapsed = benchNow() - start;
+
+        total += elapsed;
+        if(elapsed < best) best = elapsed;
+    }
+
+    printf("Traced %u rays (%u hit): best %.2f Mrays/s, average %.2f Mrays/s\n",
+        BENCH_BVH_RAYS, hitCount, BENCH_BVH_RAYS / best * 1e-6, BENCH_BVH_RAYS * BENCH_ITERATIONS / total * 1e-6);
+
+    // Ties between triangles at the same distance may resolve either way, distances have to agree
+    uint32_t oracleRays = BENCH_BVH_ORACLE_RAYS < BENCH_BVH_RAYS ? BENCH_BVH_ORACLE_RAYS : BENCH_BVH_RAYS;
+    uint32_t mismatches = 0;
+    for(uint32_t r = 0; r < oracleRays; r++) {
+        CpuHit hit, expected;
+        VkBool32 hitSomething = cpuBvhIntersect(&bvh, &rays[r], &hit);
+        VkBool32 expectedSomething = cpuBvhIntersectBruteForce(&bvh, &rays[r], &expected);
+        if(hitSomething != expectedSomething || (hitSomething && fabsf(hit.t - expected.t) > 1e-5f * expected.t)) {
+            mismatches++;
+        }
+    }
+    printf("Checked %u rays against every triangle: %u mismatches\n", oracleRays, mismatches);
+
+    mismatches += benchBvhDegenerate();
+
+    free(rays);
+    destroyCpuBvh(&bvh);
+    destroyThreadPool(&pool);
+    free(vertices);
+    free(indices);
+
+    return mismatches > 0 ? 1 : 0;
+}
+
+// Builds without a pool over a mesh whose splits are lopsided or impossible, returns the rays
+// the tree and brute force disagree on
+uint32_t benchBvhDegenerate(void) {
+    const uint32_t triangleCount = BENCH_BVH_DEGENERATE_TRIANGLES;
+    Vertex *vertices = (Vertex*)calloc(triangleCount * 3, sizeof(Vertex));
+    uint32_t *indices = (uint32_t*)malloc(triangleCount * 3 * sizeof(uint32_t));
+    if(vertices == NULL || indices == NULL) {
+        fprintf(stderr, "Failed to allocate degenerate mesh.\n");
+        free(vertices);
+        free(indices);
+        return 1;
+    }
+    for(uint32_t i = 0; i < triangleCount; i++) {
+        float x = powf(1.05f, (float)i);
+        vertices[i * 3 + 0].position = (Vector3f){x, 0.0f, 0.0f};
+        vertices[i * 3 + 1].position = (Vector3f){x * 1.001f, 0.0f, 0.0f};
+        vertices[i * 3 + 2].position = (Vector3f){x, 0.001f * x, 0.0f};
+        for(uint32_t corner = 0; corner < 3; corner++) {
+            indices[i * 3 + corner] = i * 3 + corner;
+        }
+    }
+
+    CpuBvh bvh;
+    if(buildCpuBvh(vertices, indices, triangleCount * 3, NULL, &bvh) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to build degenerate BVH.\n");
+        free(vertices);
+        free(indices);
+        return 1;
+    }
+
+    // Along z through a point inside a random triangle, or just beside it
+    uint32_t seed = 1;
+    uint32_t mismatches = 0;
+    for(uint32_t r = 0; r < BENCH_BVH_ORACLE_RAYS; r++) {
+        uint32_t triangle = (uint32_t)benchRandom(&seed, 0.0f, BENCH_BVH_DEGENERATE_TARGETS);
+        float x = powf(1.05f, (float)triangle);
+        CpuRay ray = {
+            .origin = {x * benchRandom(&seed, 0.9998f, 1.0006f), x * benchRandom(&seed, 0.0f, 0.0004f), -1.0f},
+            .direction = {0.0f, 0.0f, 1.0f},
+            .tMax = INFINITY,
+        };
+
+        CpuHit hit, expected;
+        VkBool32 hitSomething = cpuBvhIntersect(&bvh, &ray, &hit);
+        VkBool32 expectedSomething = cpuBvhIntersectBruteForce(&bvh, &ray, &expected);
+        if(hitSomething != expectedSomething || (hitSomething && hit.t != expected.t)) {
+            mismatches++;
+        }
+    }
+
+    CpuBvhStats stats = cpuBvhStats(&bvh);
+    printf("Checked %u rays against a degenerate BVH over %u triangles (%u nodes, %u leaves): %u mismatches\n",
+        BENCH_BVH_ORACLE_RAYS, stats.triangles, stats.nodes, stats.leaves, mismatches);
+
+    destroyCpuBvh(&bvh);
+    free(vertices);
+    free(indices);
+
+    return mismatches;
+}
+
+double benchNow(void) {
+    struct timespec time;
+    timespec_get(&time, TIME_UTC);
+    return (double)time.tv_sec + (double)time.tv_nsec * 1e-9;
+}
+
+float benchRandom(uint32_t *seed, float min, float max) {
+    *seed = *seed * 1664525u + 1013904223u;
+    return min + (max - min) * (float)(*seed >> 8) / 16777216.0f;
+}
@@ -0,0 +1,11 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stdint.h>
+
+// CPU-only micro benchmarks, run from the command line without a window or device
+int benchCulling(uint32_t objectCount);
+// Fails when the tree and brute force disagree on a ray
+int benchBvh(uint32_t triangleCount);
+
+#endif
@@ -0,0 +1,199 @@
+#include "blas.h"
+#include "deferred_join.h"
+#include "device_api.h"
+#include "thread_pool.h"
+#include "vkalloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vulkan/vk_enum_string_helper.h>
+#include <vulkan/vulkan_core.h>
+
+BlasGeometry blasGeometryFromMesh(Device *device, Mesh *mesh) {
+    return (BlasGeometry){
+        .vertexAddress = getBufferAddress(device, &mesh->vertexBuffer),
+        .vertexStride = sizeof(Vertex),
+        .vertexCount = mesh->vertexCount,
+        .indexAddress = getBufferAddress(device, &mesh->indexBuffer),
+        .indexCount = mesh->indexCount,
+    };
+}
+
+BlasGeometry blasGeometryFromHost(
+    const Vertex *vertices,
+    uint32_t vertexCount,
+    const uint32_t *indices,
+    uint32_t indexCount
+) {
+    return (BlasGeometry){
+        .vertexStride = sizeof(Vertex),
+        .vertexCount = vertexCount,
+        .indexCount = indexCount,
+        .vertexHost = vertices,
+        .indexHost = indices,
+    };
+}
+
+VkBuildAccelerationStructureFlagsKHR blasBuildFlags(BlasUsage usage) {
+    switch(usage) {
+        case BLAS_USAGE_DYNAMIC:
+        return VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR |
+            VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+        case BLAS_USAGE_STATIC:
+        default:
+        return VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR |
+            VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+    }
+}
+
+VkDeviceSize blasScratchAlignment(Device *device) {
+    VkPhysicalDeviceAccelerationStructurePropertiesKHR accelProps = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR,
+    };
+    VkPhysicalDeviceProperties2 props = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &accelProps,
+    };
+    getPhysicalDeviceProperties2(device, &props);
+
+    return accelProps.minAccelerationStructureScratchOffsetAlignment;
+}
+
+VkResult createBlas(
+    VkAlloc *alloc,
+    const BlasGeometry *geometry,
+    BlasUsage usage,
+    AccelerationStructure *structure,
+    BlasBuild *build
+) {
+    VkBool32 host = geometry->vertexHost != NULL;
+    VkDeviceOrHostAddressConstKHR vertexData = {.deviceAddress = geometry->vertexAddress};
+    VkDeviceOrHostAddressConstKHR indexData = {.deviceAddress = geometry->indexAddress};
+    if(host) {
+        vertexData.hostAddress = geometry->vertexHost;
+        indexData.hostAddress = geometry->indexHost;
+    }
+
+    *build = (BlasBuild){
+        .geometry = {
+            .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+            .geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR,
+            .geometry.triangles = {
+                .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR,
+                .vertexFormat = VK_FORMAT_R32G32B32_SFLOAT,
+                .vertexData = vertexData,
+                .vertexStride = geometry->vertexStride,
+                .maxVertex = geometry->vertexCount - 1,
+                .indexType = VK_INDEX_TYPE_UINT32,
+                .indexData = indexData,
+            },
+            // No any hit shaders, opaque geometry skips invoking them
+            .flags = VK_GEOMETRY_OPAQUE_BIT_KHR,
+        },
+        .range = {
+            .primitiveCount = geometry->indexCount / 3,
+            .primitiveOffset = 0,
+            .firstVertex = 0,
+            .transformOffset = 0,
+        },
+        .flags = blasBuildFlags(usage),
+        .host = host,
+    };
+
+    VkAccelerationStructureBuildGeometryInfoKHR buildInfo = blasBuildInfo(build);
+    VkAccelerationStructureBuildSizesInfoKHR sizes = {
+        .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR,
+    };
+    getAccelerationStructureBuildSizesKHR(
+        alloc->device,
+        host ? VK_ACCELERATION_STRUCTURE_BUILD_TYPE_HOST_KHR : VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
+        &buildInfo,
+        &build->range.primitiveCount,
+        &sizes
+    );
+    build->scratchSize = sizes.buildScratchSize;
+
+    VkResult result = createAccelerationStructure(
+        alloc,
+        VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+        sizes.accelerationStructureSize,
+        host ? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT :
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        structure
+    );
+    if(result != VK_SUCCESS) {
+        return result;
+    }
+
+    build->structure = structure->structure;
+
+    return VK_SUCCESS;
+}
+
+void cmdBuildBlas(Device *device, VkCommandBuffer buffer, const BlasBuild *build, VkDeviceAddress scratch) {
+    VkAccelerationStructureBuildGeometryInfoKHR buildInfo = blasBuildInfo(build);
+    buildInfo.scratchData.deviceAddress = scratch;
+
+    const VkAccelerationStructureBuildRangeInfoKHR *range = &build->range;
+    cmdBuildAccelerationStructuresKHR(device, buffer, 1, &buildInfo, &range);
+}
+
+VkResult buildBlasOnHost(Device *device, ThreadPool *pool, const BlasBuild *builds, uint32_t buildCount) {
+    if(buildCount == 0) {
+        return VK_SUCCESS;
+    }
+
+    VkAccelerationStructureBuildGeometryInfoKHR *infos = (VkAccelerationStructureBuildGeometryInfoKHR*)malloc(
+        buildCount * sizeof(VkAccelerationStructureBuildGeometryInfoKHR)
+    );
+    const VkAccelerationStructureBuildRangeInfoKHR **ranges = (const VkAccelerationStructureBuildRangeInfoKHR**)malloc(
+        buildCount * sizeof(VkAccelerationStructureBuildRangeInfoKHR*)
+    );
+    void **scratch = (void**)calloc(buildCount, sizeof(void*));
+    VkResult result = infos != NULL && ranges != NULL && scratch != NULL ? VK_SUCCESS : VK_ERROR_OUT_OF_HOST_MEMORY;
+
+    for(uint32_t i = 0; i < buildCount && result == VK_SUCCESS; i++) {
+        scratch[i] = malloc(builds[i].scratchSize);
+        if(scratch[i] == NULL) {
+            result = VK_ERROR_OUT_OF_HOST_MEMORY;
+            break;
+        }
+        infos[i] = blasBuildInfo(&builds[i]);
+        infos[i].scratchData.hostAddress = scratch[i];
+        ranges[i] = &builds[i].range;
+    }
+
+    if(result == VK_SUCCESS) {
+        // Without an operation the builds still run, on this thread alone
+        DeferredJoin *join;
+        if(createDeferredJoin(device, &join) == VK_SUCCESS) {
+            result = buildAccelerationStructuresKHR(device, join->operation, buildCount, infos, ranges);
+            result = deferredJoinComplete(join, pool, result);
+        } else {
+            result = buildAccelerationStructuresKHR(device, VK_NULL_HANDLE, buildCount, infos, ranges);
+        }
+    }
+
+    if(scratch != NULL) {
+        for(uint32_t i = 0; i < buildCount; i++) {
+            free(scratch[i]);
+        }
+    }
+    free(scratch);
+    free(ranges);
+    free(infos);
+
+    return result;
+}
+
+VkAccelerationStructureBuildGeometryInfoKHR blasBuildInfo(const BlasBuild *build) {
+    return (VkAccelerationStructureBuildGeometryInfoKHR){
+        .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+        .type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+        .flags = build->flags,
+        .mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+        .dstAccelerationStructure = build->structure,
+        .geometryCount = 1,
+        .pGeometries = &build->geometry,
+    };
+}
@@ -0,0 +1,74 @@
+#ifndef BLAS_H_
+#define BLAS_H_
+
+#include <vulkan/vulkan.h>
+
+#include "device_api.h"
+#include "mesh.h"
+#include "thread_pool.h"
+#include "vkalloc.h"
+
+typedef enum {
+    // Built once and traced every frame, trace speed wins and it can be compacted
+    BLAS_USAGE_STATIC,
+    // Rebuilt or refit often, e.g. deforming geometry, build speed wins
+    BLAS_USAGE_DYNAMIC,
+} BlasUsage;
+
+// Indexed triangles, positions are three floats. Device builds read them through buffer
+// addresses, host builds straight from memory.
+typedef struct {
+    VkDeviceAddress vertexAddress;
+    VkDeviceSize vertexStride;
+    uint32_t vertexCount;
+    VkDeviceAddress indexAddress;
+    uint32_t indexCount;
+    // Set instead of the addresses for a build on the host, read until the build ran
+    const void *vertexHost;
+    const uint32_t *indexHost;
+} BlasGeometry;
+
+// Inputs of a build recorded with cmdBuildBlas, filled by createBlas
+typedef struct {
+    VkAccelerationStructureGeometryKHR geometry;
+    VkAccelerationStructureBuildRangeInfoKHR range;
+    VkBuildAccelerationStructureFlagsKHR flags;
+    VkAccelerationStructureKHR structure;
+    VkDeviceSize scratchSize;
+    // Geometry and storage are on the host side, run with buildBlasOnHost instead
+    VkBool32 host;
+} BlasBuild;
+
+// The mesh buffers need shader device address and acceleration structure build input usage
+BlasGeometry blasGeometryFromMesh(Device *device, Mesh *mesh);
+// The data a mesh is created from, for builds on the host
+BlasGeometry blasGeometryFromHost(
+    const Vertex *vertices,
+    uint32_t vertexCount,
+    const uint32_t *indices,
+    uint32_t indexCount
+);
+VkBuildAccelerationStructureFlagsKHR blasBuildFlags(BlasUsage usage);
+// Required alignment of scratch addresses handed to cmdBuildBlas
+VkDeviceSize blasScratchAlignment(Device *device);
+
+// Queries the build sizes and creates storage of exactly that size, host visible for host
+// geometry. The structure stays empty until build is recorded and executed.
+VkResult createBlas(
+    VkAlloc *alloc,
+    const BlasGeometry *geometry,
+    BlasUsage usage,
+    AccelerationStructure *structure,
+    BlasBuild *build
+);
+// Points into build, which has to stay put while the info is used. The scratch address
+// is left for the caller.
+VkAccelerationStructureBuildGeometryInfoKHR blasBuildInfo(const BlasBuild *build);
+// scratch holds build->scratchSize bytes and is aligned to blasScratchAlignment. Tracing or
+// building on top of the structure needs an acceleration structure build barrier first.
+void cmdBuildBlas(Device *device, VkCommandBuffer buffer, const BlasBuild *build, VkDeviceAddress scratch);
+// Runs host builds on the CPU as one deferred operation that pool's idle workers join, blocks
+// until all are done. Needs the accelerationStructureHostCommands feature.
+VkResult buildBlasOnHost(Device *device, ThreadPool *pool, const BlasBuild *builds, uint32_t buildCount);
+
+#endif
@@ -0,0 +1,289 @@
+#include "blas_builder.h"
+#include "blas.h"
+#include "device_api.h"
+#include "vkalloc.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vulkan/vk_enum_string_helper.h>
+#include <vulkan/vulkan_core.h>
+
+// A compacted original waiting for the frames still reading it
+typedef struct {
+    VkAlloc *alloc;
+    AccelerationStructure structure;
+} RetiredBlas;
+
+VkDeviceSize alignScratch(BlasBuilder *builder, VkDeviceSize size);
+VkResult reserveScratch(BlasBuilder *builder, VkDeviceSize size);
+void cmdBuildBarrier(VkCommandBuffer buffer);
+void destroyRetiredBlas(Device *device, void *userData);
+
+VkResult createBlasBuilder(Device *device, VkAlloc *alloc, VkDeviceSize scratchBudget, BlasBuilder *builder) {
+    memset(builder, 0, sizeof(BlasBuilder));
+    builder->device = device;
+    builder->alloc = alloc;
+    builder->scratchBudget = scratchBudget;
+    builder->scratchAlignment = blasScratchAlignment(device);
+
+    return createQueryPool(
+        device,
+        VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR,
+        BLAS_BUILDER_MAX_BUILDS,
+        &builder->compactedSizes
+    );
+}
+
+void destroyBlasBuilder(BlasBuilder *builder) {
+    destroyQueryPool(builder->device, builder->compactedSizes);
+    if(builder->scratchSize > 0) {
+        destroyDeallocateBuffer(builder->alloc, &builder->scratch);
+    }
+}
+
+VkResult blasBuilderAdd(BlasBuilder *builder, const BlasBuild *build, AccelerationStructure *structure) {
+    if(builder->pendingCount == BLAS_BUILDER_MAX_BUILDS) {
+        return VK_ERROR_TOO_MANY_OBJECTS;
+    }
+
+    builder->pending[builder->pendingCount++] = (BlasBuilderEntry){
+        .build = *build,
+        .structure = structure,
+    };
+    return VK_SUCCESS;
+}
+
+VkResult cmdBlasBuilderFlush(BlasBuilder *builder, VkCommandBuffer buffer) {
+    if(builder->pendingCount == 0) {
+        return VK_SUCCESS;
+    }
+
+    // Enough for everything at once when that fits the budget, never less than the largest build
+    VkDeviceSize total = 0, largest = 0;
+    uint32_t compactable = 0;
+    for(uint32_t i = 0; i < builder->pendingCount; i++) {
+        VkDeviceSize size = alignScratch(builder, builder->pending[i].build.scratchSize);
+        total += size;
+        if(size > largest) {
+            largest = size;
+        }
+        if(builder->pending[i].build.flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR) {
+            compactable++;
+        }
+    }
+    if(builder->compactingCount + compactable > BLAS_BUILDER_MAX_BUILDS) {
+        return VK_ERROR_TOO_MANY_OBJECTS;
+    }
+    VkDeviceSize poolSize = total < builder->scratchBudget ? total : builder->scratchBudget;
+    if(poolSize < largest) {
+        poolSize = largest;
+    }
+
+    // Growing frees the old pool at once. That is only safe because flushes may not overlap
+    // (see cmdBlasBuilderFlush), so no earlier build can still be using it on the GPU.
+    VkResult result = reserveScratch(builder, poolSize);
+    if(result != VK_SUCCESS) {
+        return result;
+    }
+
+    VkAccelerationStructureBuildGeometryInfoKHR infos[BLAS_BUILDER_MAX_BUILDS];
+    const VkAccelerationStructureBuildRangeInfoKHR *ranges[BLAS_BUILDER_MAX_BUILDS];
+
+    uint32_t first = 0;
+    while(first < builder->pendingCount) {
+        VkDeviceSize offset = 0;
+        uint32_t count = 0;
+        while(first + count < builder->pendingCount) {
+            const BlasBuild *build = &builder->pending[first + count].build;
+            VkDeviceSize size = alignScratch(builder, build->scratchSize);
+            if(offset + size > builder->scratchSize) {
+                break;
+            }
+
+            infos[count] = blasBuildInfo(build);
+            infos[count].scratchData.deviceAddress = builder->scratchAddress + offset;
+            ranges[count] = &build->range;
+            offset += size;
+            count++;
+        }
+
+        // The only dependency between batches is the scratch they share
+        if(first > 0) {
+            cmdBuildBarrier(buffer);
+        }
+        cmdBuildAccelerationStructuresKHR(builder->device, buffer, count, infos, ranges);
+
+        builder->stats.builds += count;
+        builder->stats.batches++;
+        first += count;
+    }
+
+    if(compactable > 0) {
+        VkAccelerationStructureKHR structures[BLAS_BUILDER_MAX_BUILDS];
+        uint32_t firstQuery = builder->compactingCount;
+        for(uint32_t i = 0; i < builder->pendingCount; i++) {
+            BlasBuilderEntry *entry = &builder->pending[i];
+            if(entry->build.flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR) {
+                structures[builder->compactingCount - firstQuery] = entry->build.structure;
+                builder->compacting[builder->compactingCount++] = entry->structure;
+            }
+        }
+
+        // Sizes are only known once the builds wrote the structures
+        cmdBuildBarrier(buffer);
+        cmdResetQueryPool(buffer, builder->compactedSizes, firstQuery, compactable);
+        cmdWriteAccelerationStructuresPropertiesKHR(
+            builder->device,
+            buffer,
+            compactable,
+            structures,
+            VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR,
+            builder->compactedSizes,
+            firstQuery
+        );
+    }
+
+    builder->pendingCount = 0;
+
+    return VK_SUCCESS;
+}
+
+VkResult cmdBlasBuilderCompact(
+    BlasBuilder *builder,
+    VkCommandBuffer buffer,
+    DeletionQueue *queue,
+    uint64_t retireValue
+) {
+    if(builder->compactingCount == 0) {
+        return VK_SUCCESS;
+    }
+
+    uint64_t sizes[BLAS_BUILDER_MAX_BUILDS];
+    VkResult result = getQueryPoolResults(
+        builder->device,
+        builder->compactedSizes,
+        0, builder->compactingCount,
+        builder->compactingCount * sizeof(uint64_t), sizes,
+        sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT
+    );
+    if(result != VK_SUCCESS) {
+        return result;
+    }
+
+    for(uint32_t i = 0; i < builder->compactingCount; i++) {
+        AccelerationStructure *structure = builder->compacting[i];
+
+        AccelerationStructure compacted;
+        result = createAccelerationStructure(
+            builder->alloc,
+            VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+            sizes[i],
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            &compacted
+        );
+        if(result != VK_SUCCESS) {
+            // The rest keep their original storage, they are still usable as they are
+            builder->compactingCount = 0;
+            return result;
+        }
+
+        VkCopyAccelerationStructureInfoKHR copyInfo = {
+            .sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR,
+            .src = structure->structure,
+            .dst = compacted.structure,
+            .mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR,
+        };
+        cmdCopyAccelerationStructureKHR(builder->device, buffer, &copyInfo);
+
+        builder->stats.compacted++;
+        builder->stats.compactedFrom += structure->buffer.memorySize;
+        builder->stats.compactedTo += compacted.buffer.memorySize;
+
+        RetiredBlas *retired = (RetiredBlas*)malloc(sizeof(RetiredBlas));
+        assert(retired != NULL);
+        *retired = (RetiredBlas){
+            .alloc = builder->alloc,
+            .structure = *structure,
+        };
+        deletionQueuePush(queue, retireValue, destroyRetiredBlas, retired);
+
+        *structure = compacted;
+    }
+
+    builder->compactingCount = 0;
+
+    return VK_SUCCESS;
+}
+
+BlasBuilderStats blasBuilderStats(BlasBuilder *builder) {
+    return builder->stats;
+}
+
+VkDeviceSize alignScratch(BlasBuilder *builder, VkDeviceSize size) {
+    VkDeviceSize alignment = builder->scratchAlignment;
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+// Grows the pool to at least size. The old pool and its memory are freed right away.
+VkResult reserveScratch(BlasBuilder *builder, VkDeviceSize size) {
+    if(size <= builder->scratchSize) {
+        return VK_SUCCESS;
+    }
+
+    if(builder->scratchSize > 0) {
+        destroyDeallocateBuffer(builder->alloc, &builder->scratch);
+        builder->scratchSize = 0;
+    }
+
+    // Buffer alignment does not cover the scratch alignment, the address is rounded up inside
+    VkBufferCreateInfo bufferInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pQueueFamilyIndices = &builder->device->queueFamilies.graphics,
+        .queueFamilyIndexCount = 1,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .size = size + builder->scratchAlignment,
+        .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+    };
+    VkResult result = createAllocateBuffer(
+        builder->alloc,
+        &bufferInfo,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        &builder->scratch
+    );
+    if(result != VK_SUCCESS) {
+        fprintf(stderr, "Failed to allocate acceleration structure scratch: %s.\n", string_VkResult(result));
+        return result;
+    }
+
+    VkDeviceAddress address = getBufferAddress(builder->device, &builder->scratch);
+    builder->scratchAddress = (VkDeviceAddress)alignScratch(builder, address);
+    builder->scratchSize = size;
+    builder->stats.scratchSize = size;
+
+    return VK_SUCCESS;
+}
+
+// Build and copy commands writing a structure or the scratch before the next one reads them
+void cmdBuildBarrier(VkCommandBuffer buffer) {
+    VkMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+        .dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR |
+            VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+    };
+    cmdPipelineBarrier(
+        buffer,
+        VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+        VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+        0, 1, &barrier, 0, NULL, 0, NULL
+    );
+}
+
+void destroyRetiredBlas(Device *device, void *userData) {
+    RetiredBlas *retired = (RetiredBlas*)userData;
+
+    destroyAccelerationStructure(retired->alloc, &retired->structure);
+    free(retired);
+}
@@ -0,0 +1,77 @@
+#ifndef BLAS_BUILDER_H_
+#define BLAS_BUILDER_H_
+
+#include <vulkan/vulkan.h>
+
+#include "blas.h"
+#include "deletion_queue.h"
+#include "device_api.h"
+#include "vkalloc.h"
+
+#define BLAS_BUILDER_MAX_BUILDS 64
+
+typedef struct {
+    uint32_t builds;
+    // vkCmdBuildAccelerationStructuresKHR calls, one per batch
+    uint32_t batches;
+    // Size of the scratch pool, what one-by-one builds would need is their sum
+    VkDeviceSize scratchSize;
+    // Structures copied into storage of their compacted size
+    uint32_t compacted;
+    VkDeviceSize compactedFrom;
+    VkDeviceSize compactedTo;
+} BlasBuilderStats;
+
+typedef struct {
+    BlasBuild build;
+    AccelerationStructure *structure;
+} BlasBuilderEntry;
+
+// Packs queued BLAS builds into as few build commands as the scratch budget allows.
+// Every batch carves its scratch out of one pool that is reused by the next batch.
+typedef struct {
+    Device *device;
+    VkAlloc *alloc;
+    VkDeviceSize scratchBudget;
+    VkDeviceSize scratchAlignment;
+
+    // Created on the first flush, grown when a single build does not fit
+    Buffer scratch;
+    VkDeviceAddress scratchAddress;
+    VkDeviceSize scratchSize;
+
+    BlasBuilderEntry pending[BLAS_BUILDER_MAX_BUILDS];
+    uint32_t pendingCount;
+
+    // Built with ALLOW_COMPACTION, their compacted sizes land in the query of the same index
+    VkQueryPool compactedSizes;
+    AccelerationStructure *compacting[BLAS_BUILDER_MAX_BUILDS];
+    uint32_t compactingCount;
+
+    BlasBuilderStats stats;
+} BlasBuilder;
+
+// scratchBudget caps the scratch one batch uses, larger single builds still get their own batch
+VkResult createBlasBuilder(Device *device, VkAlloc *alloc, VkDeviceSize scratchBudget, BlasBuilder *builder);
+void destroyBlasBuilder(BlasBuilder *builder);
+
+// Queues a copy of build for structure, which was created with it. Compactable builds keep
+// a pointer to structure until cmdBlasBuilderCompact replaces its contents.
+VkResult blasBuilderAdd(BlasBuilder *builder, const BlasBuild *build, AccelerationStructure *structure);
+// Records every queued build. Batches reusing the pool wait for the previous one, builds
+// within a batch run concurrently. The pool is reused by the next flush, which must not run
+// before this one completed. Users of the structures need a build barrier afterwards.
+VkResult cmdBlasBuilderFlush(BlasBuilder *builder, VkCommandBuffer buffer);
+// Once the flushes building them completed: copies every compactable structure into storage
+// of its compacted size and swaps it into the caller's AccelerationStructure. The originals
+// and their memory are freed through queue after retireValue, which has to come after buffer
+// completes, so the allocator has to outlive queue.
+VkResult cmdBlasBuilderCompact(
+    BlasBuilder *builder,
+    VkCommandBuffer buffer,
+    DeletionQueue *queue,
+    uint64_t retireValue
+);
+BlasBuilderStats blasBuilderStats(BlasBuilder *builder);
+
+#endif
@@ -0,0 +1,603 @@
+#include "cpu_bvh.h"
+#include "mesh.h"
+#include "thread_pool.h"
+
+#include <assert.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Ranges at least this large are split off to a pool worker
+#define CPU_BVH_PARALLEL_SIZE 4096
+// Children waiting during traversal. A wide node sits at least one binary level below its
+// parent, so there are at most CPU_BVH_MAX_DEPTH + 1 levels each adding CPU_BVH_WIDTH - 1.
+#define CPU_BVH_STACK_SIZE ((CPU_BVH_MAX_DEPTH + 1) * (CPU_BVH_WIDTH - 1) + 1)
+
+typedef struct {
+    Vector3f min, max;
+} CpuBvhBox;
+
+// Binary node of the build, collapsed into wide nodes afterwards
+typedef struct {
+    CpuBvhBox bounds;
+    // First of two adjacent children, or the first reference of a leaf
+    uint32_t first;
+    // References of a leaf, 0 for inner nodes
+    uint32_t count;
+} CpuBvhBuildNode;
+
+typedef struct {
+    // Per triangle
+    CpuBvhBox *boxes;
+    Vector3f *centroids;
+    // Triangle indices, partitioned in place so every node owns a contiguous range
+    uint32_t *references;
+
+    CpuBvhBuildNode *nodes;
+    _Atomic uint32_t nodeCount;
+
+    ThreadPool *pool;
+    pthread_mutex_t mutex;
+    pthread_cond_t done;
+    // Subtrees queued on pool and not finished, guarded by mutex
+    uint32_t pending;
+    uint32_t parallelJobs;
+} CpuBvhBuild;
+
+// Child waiting during traversal, skipped when a closer hit was found since it was pushed
+typedef struct {
+    uint32_t child;
+    uint32_t count;
+    float tNear;
+} CpuBvhStackEntry;
+
+typedef struct {
+    CpuBvhBuild *build;
+    uint32_t node;
+    uint32_t first;
+    uint32_t count;
+    uint32_t depth;
+} CpuBvhJob;
+
+void cpuBvhSubdivide(CpuBvhBuild *build, uint32_t node, uint32_t first, uint32_t count, uint32_t depth);
+void cpuBvhSubdivideJob(void *userData);
+uint32_t cpuBvhCollapse(const CpuBvhBuild *build, CpuBvh *bvh, uint32_t buildNode);
+uint32_t cpuBvhBin(float value, float low, float scale);
+void cpuBvhBoxGrow(CpuBvhBox *box, const CpuBvhBox *other);
+float cpuBvhBoxArea(const CpuBvhBox *box);
+float cpuBvhAxis(Vector3f v, int axis);
+void cpuBvhIntersectTriangle(const CpuBvhTriangle *triangle, uint32_t index, const CpuRay *ray, CpuHit *hit);
+
+VkResult buildCpuBvh(
+    const Vertex *vertices,
+    const uint32_t *indices,
+    uint32_t indexCount,
+    ThreadPool *pool,
+    CpuBvh *bvh
+) {
+    memset(bvh, 0, sizeof(CpuBvh));
+    uint32_t triangleCount = indexCount / 3;
+
+    if(triangleCount == 0) {
+        bvh->nodes = (CpuBvhNode*)aligned_alloc(16, sizeof(CpuBvhNode));
+        if(bvh->nodes == NULL) {
+            return VK_ERROR_OUT_OF_HOST_MEMORY;
+        }
+
+        // A root with only empty children every ray misses
+        CpuBvhNode *root = &bvh->nodes[bvh->nodeCount++];
+        for(int lane = 0; lane < CPU_BVH_WIDTH; lane++) {
+            root->minX[lane] = root->minY[lane] = root->minZ[lane] = INFINITY;
+            root->maxX[lane] = root->maxY[lane] = root->maxZ[lane] = -INFINITY;
+            root->children[lane] = CPU_BVH_INVALID;
+            root->counts[lane] = 0;
+        }
+        bvh->stats.nodes = bvh->nodeCount;
+        return VK_SUCCESS;
+    }
+
+    CpuBvhBuild build = {
+        .boxes = (CpuBvhBox*)malloc(triangleCount * sizeof(CpuBvhBox)),
+        .centroids = (Vector3f*)malloc(triangleCount * sizeof(Vector3f)),
+        .references = (uint32_t*)malloc(triangleCount * sizeof(uint32_t)),
+        // A binary tree over n leaves of one or more triangles never has more than 2n - 1 nodes
+        .nodes = (CpuBvhBuildNode*)malloc(2 * triangleCount * sizeof(CpuBvhBuildNode)),
+        .pool = pool,
+    };
+    bvh->triangles = (CpuBvhTriangle*)malloc(triangleCount * sizeof(CpuBvhTriangle));
+    if(build.boxes == NULL || build.centroids == NULL || build.references == NULL || build.nodes == NULL ||
+        bvh->triangles == NULL) {
+        free(build.boxes);
+        free(build.centroids);
+        free(build.references);
+        free(build.nodes);
+        destroyCpuBvh(bvh);
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+
+    for(uint32_t i = 0; i < triangleCount; i++) {
+        Vector3f p0 = vertices[indices[i * 3 + 0]].position;
+        Vector3f p1 = vertices[indices[i * 3 + 1]].position;
+        Vector3f p2 = vertices[indices[i * 3 + 2]].position;
+
+        build.boxes[i] = (CpuBvhBox){
+            {fminf(p0.x, fminf(p1.x, p2.x)), fminf(p0.y, fminf(p1.y, p2.y)), fminf(p0.z, fminf(p1.z, p2.z))},
+            {fmaxf(p0.x, fmaxf(p1.x, p2.x)), fmaxf(p0.y, fmaxf(p1.y, p2.y)), fmaxf(p0.z, fmaxf(p1.z, p2.z))},
+        };
+        build.centroids[i] = (Vector3f){
+            (p0.x + p1.x + p2.x) / 3.0f,
+            (p0.y + p1.y + p2.y) / 3.0f,
+            (p0.z + p1.z + p2.z) / 3.0f,
+        };
+        build.references[i] = i;
+    }
+
+    atomic_store(&build.nodeCount, 1);
+    pthread_mutex_init(&build.mutex, NULL);
+    pthread_cond_init(&build.done, NULL);
+
+    cpuBvhSubdivide(&build, 0, 0, triangleCount, 0);
+
+    pthread_mutex_lock(&build.mutex);
+    while(build.pending > 0) {
+        pthread_cond_wait(&build.done, &build.mutex);
+    }
+    pthread_mutex_unlock(&build.mutex);
+
+    pthread_cond_destroy(&build.done);
+    pthread_mutex_destroy(&build.mutex);
+
+    // Every wide node opens at least its own inner binary node, plus the root when it is a leaf
+    uint32_t innerCount = (atomic_load(&build.nodeCount) - 1) / 2;
+    bvh->nodes = (CpuBvhNode*)aligned_alloc(16, (innerCount + 1) * sizeof(CpuBvhNode));
+    if(bvh->nodes == NULL) {
+        free(build.boxes);
+        free(build.centroids);
+        free(build.references);
+        free(build.nodes);
+        destroyCpuBvh(bvh);
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+
+    // Triangles in reference order, so every leaf's triangles are adjacent
+    for(uint32_t i = 0; i < triangleCount; i++) {
+        uint32_t primitive = build.references[i];
+        Vector3f p0 = vertices[indices[primitive * 3 + 0]].position;
+        Vector3f p1 = vertices[indices[primitive * 3 + 1]].position;
+        Vector3f p2 = vertices[indices[primitive * 3 + 2]].position;
+
+        bvh->triangles[i] = (CpuBvhTriangle){
+            .v0 = p0,
+            .edge1 = {p1.x - p0.x, p1.y - p0.y, p1.z - p0.z},
+            .edge2 = {p2.x - p0.x, p2.y - p0.y, p2.z - p0.z},
+            .primitive = primitive,
+        };
+    }
+    bvh->triangleCount = triangleCount;
+
+    cpuBvhCollapse(&build, bvh, 0);
+    bvh->stats.triangles = triangleCount;
+    bvh->stats.parallelJobs = build.parallelJobs;
+
+    free(build.boxes);
+    free(build.centroids);
+    free(build.references);
+    free(build.nodes);
+
+    return VK_SUCCESS;
+}
+
+void destroyCpuBvh(CpuBvh *bvh) {
+    free(bvh->nodes);
+    free(bvh->triangles);
+    memset(bvh, 0, sizeof(CpuBvh));
+}
+
+VkBool32 cpuBvhIntersect(const CpuBvh *bvh, const CpuRay *ray, CpuHit *hit) {
+    hit->t = ray->tMax;
+    hit->primitive = CPU_BVH_INVALID;
+
+    // Near zero direction components get a huge inverse instead of infinity and NaN slabs
+    float inverse[3];
+    for(int axis = 0; axis < 3; axis++) {
+        float d = cpuBvhAxis(ray->direction, axis);
+        inverse[axis] = fabsf(d) > 1e-20f ? 1.0f / d : copysignf(1e20f, d);
+    }
+
+#if defined(__SSE2__)
+    __m128 originX = _mm_set1_ps(ray->origin.x);
+    __m128 originY = _mm_set1_ps(ray->origin.y);
+    __m128 originZ = _mm_set1_ps(ray->origin.z);
+    __m128 inverseX = _mm_set1_ps(inverse[0]);
+    __m128 inverseY = _mm_set1_ps(inverse[1]);
+    __m128 inverseZ = _mm_set1_ps(inverse[2]);
+#endif
+
+    CpuBvhStackEntry stack[CPU_BVH_STACK_SIZE];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = (CpuBvhStackEntry){0, 0, 0.0f};
+
+    while(stackSize > 0) {
+        CpuBvhStackEntry entry = stack[--stackSize];
+        if(entry.tNear > hit->t) {
+            continue;
+        }
+
+        if(entry.count > 0) {
+            for(uint32_t i = entry.child; i < entry.child + entry.count; i++) {
+                cpuBvhIntersectTriangle(&bvh->triangles[i], i, ray, hit);
+            }
+            continue;
+        }
+
+        const CpuBvhNode *node = &bvh->nodes[entry.child];
+
+        float tNear[CPU_BVH_WIDTH];
+        int hitMask = 0;
+#if defined(__SSE2__)
+        __m128 x0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node->minX), originX), inverseX);
+        __m128 x1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node->maxX), originX), inverseX);
+        __m128 y0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node->minY), originY), inverseY);
+        __m128 y1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node->maxY), originY), inverseY);
+        __m128 z0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node->minZ), originZ), inverseZ);
+        __m128 z1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node->maxZ), originZ), inverseZ);
+
+        __m128 enter = _mm_max_ps(
+            _mm_max_ps(_mm_min_ps(x0, x1), _mm_min_ps(y0, y1)),
+            _mm_max_ps(_mm_min_ps(z0, z1), _mm_setzero_ps())
+        );
+        __m128 exit = _mm_min_ps(
+            _mm_min_ps(_mm_max_ps(x0, x1), _mm_max_ps(y0, y1)),
+            _mm_min_ps(_mm_max_ps(z0, z1), _mm_set1_ps(hit->t))
+        );
+        hitMask = _mm_movemask_ps(_mm_cmple_ps(enter, exit));
+        _mm_storeu_ps(tNear, enter);
+#else
+        for(int lane = 0; lane < CPU_BVH_WIDTH; lane++) {
+            float x0 = (node->minX[lane] - ray->origin.x) * inverse[0];
+            float x1 = (node->maxX[lane] - ray->origin.x) * inverse[0];
+            float y0 = (node->minY[lane] - ray->origin.y) * inverse[1];
+            float y1 = (node->maxY[lane] - ray->origin.y) * inverse[1];
+            float z0 = (node->minZ[lane] - ray->origin.z) * inverse[2];
+            float z1 = (node->maxZ[lane] - ray->origin.z) * inverse[2];
+
+            float enter = fmaxf(fmaxf(fminf(x0, x1), fminf(y0, y1)), fmaxf(fminf(z0, z1), 0.0f));
+            float exit = fminf(fminf(fmaxf(x0, x1), fmaxf(y0, y1)), fminf(fmaxf(z0, z1), hit->t));
+            tNear[lane] = enter;
+            if(enter <= exit) {
+                hitMask |= 1 << lane;
+            }
+        }
+#endif
+
+        // Children pushed farthest first so the nearest is visited first
+        CpuBvhStackEntry children[CPU_BVH_WIDTH];
+        uint32_t childCount = 0;
+        for(int lane = 0; lane < CPU_BVH_WIDTH; lane++) {
+            if(!(hitMask & (1 << lane)) || node->children[lane] == CPU_BVH_INVALID) {
+                continue;
+            }
+
+            uint32_t slot = childCount++;
+            while(slot > 0 && children[slot - 1].tNear < tNear[lane]) {
+                children[slot] = children[slot - 1];
+                slot--;
+            }
+            children[slot] = (CpuBvhStackEntry){node->children[lane], node->counts[lane], tNear[lane]};
+        }
+
+        for(uint32_t i = 0; i < childCount; i++) {
+            stack[stackSize++] = children[i];
+        }
+    }
+
+    // Triangle indices in leaf order until here
+    if(hit->primitive != CPU_BVH_INVALID) {
+        hit->primitive = bvh->triangles[hit->primitive].primitive;
+        return VK_TRUE;
+    }
+    return VK_FALSE;
+}
+
+VkBool32 cpuBvhIntersectBruteForce(const CpuBvh *bvh, const CpuRay *ray, CpuHit *hit) {
+    hit->t = ray->tMax;
+    hit->primitive = CPU_BVH_INVALID;
+
+    for(uint32_t i = 0; i < bvh->triangleCount; i++) {
+        cpuBvhIntersectTriangle(&bvh->triangles[i], i, ray, hit);
+    }
+
+    if(hit->primitive != CPU_BVH_INVALID) {
+        hit->primitive = bvh->triangles[hit->primitive].primitive;
+        return VK_TRUE;
+    }
+    return VK_FALSE;
+}
+
+CpuBvhStats cpuBvhStats(const CpuBvh *bvh) {
+    return bvh->stats;
+}
+
+// Splits the range at the cheapest of CPU_BVH_BINS positions per axis by the surface area heuristic
+void cpuBvhSubdivide(CpuBvhBuild *build, uint32_t node, uint32_t first, uint32_t count, uint32_t depth) {
+    CpuBvhBox bounds = build->boxes[build->references[first]];
+    CpuBvhBox centroidBounds = {build->centroids[build->references[first]], build->centroids[build->references[first]]};
+    for(uint32_t i = first + 1; i < first + count; i++) {
+        uint32_t reference = build->references[i];
+        cpuBvhBoxGrow(&bounds, &build->boxes[reference]);
+        CpuBvhBox centroid = {build->centroids[reference], build->centroids[reference]};
+        cpuBvhBoxGrow(&centroidBounds, &centroid);
+    }
+    build->nodes[node].bounds = bounds;
+
+    // Lopsided splits of degenerate meshes end in one large leaf instead of an unbounded depth
+    if(count <= CPU_BVH_LEAF_SIZE || depth >= CPU_BVH_MAX_DEPTH) {
+        build->nodes[node].first = first;
+        build->nodes[node].count = count;
+        return;
+    }
+
+    int bestAxis = -1;
+    uint32_t bestBin = 0;
+    float bestCost = INFINITY;
+    for(int axis = 0; axis < 3; axis++) {
+        float low = cpuBvhAxis(centroidBounds.min, axis);
+        float extent = cpuBvhAxis(centroidBounds.max, axis) - low;
+        // Also skips axes of centroids beyond float range, they can't be binned
+        if(!(extent > 0.0f) || isinf(extent)) {
+            continue;
+        }
+        float scale = CPU_BVH_BINS / extent;
+
+        CpuBvhBox binBounds[CPU_BVH_BINS];
+        uint32_t binCounts[CPU_BVH_BINS] = {0};
+        for(uint32_t i = first; i < first + count; i++) {
+            uint32_t reference = build->references[i];
+            uint32_t bin = cpuBvhBin(cpuBvhAxis(build->centroids[reference], axis), low, scale);
+            if(binCounts[bin]++ == 0) {
+                binBounds[bin] = build->boxes[reference];
+            } else {
+                cpuBvhBoxGrow(&binBounds[bin], &build->boxes[reference]);
+            }
+        }
+
+        // Areas and counts left of every split position, then swept back from the right
+        float leftAreas[CPU_BVH_BINS - 1];
+        uint32_t leftCounts[CPU_BVH_BINS - 1];
+        CpuBvhBox side;
+        uint32_t sideCount = 0;
+        for(uint32_t bin = 0; bin < CPU_BVH_BINS - 1; bin++) {
+            if(binCounts[bin] > 0) {
+                if(sideCount == 0) {
+                    side = binBounds[bin];
+                } else {
+                    cpuBvhBoxGrow(&side, &binBounds[bin]);
+                }
+                sideCount += binCounts[bin];
+            }
+            leftAreas[bin] = sideCount > 0 ? cpuBvhBoxArea(&side) : 0.0f;
+            leftCounts[bin] = sideCount;
+        }
+
+        sideCount = 0;
+        for(uint32_t bin = CPU_BVH_BINS - 1; bin > 0; bin--) {
+            if(binCounts[bin] > 0) {
+                if(sideCount == 0) {
+                    side = binBounds[bin];
+                } else {
+                    cpuBvhBoxGrow(&side, &binBounds[bin]);
+                }
+                sideCount += binCounts[bin];
+            }
+
+            uint32_t leftCount = leftCounts[bin - 1];
+            if(leftCount == 0 || sideCount == 0) {
+                continue;
+            }
+            float cost = leftAreas[bin - 1] * leftCount + cpuBvhBoxArea(&side) * sideCount;
+            if(cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = bin;
+            }
+        }
+    }
+
+    uint32_t middle = first;
+    if(bestAxis >= 0) {
+        float low = cpuBvhAxis(centroidBounds.min, bestAxis);
+        float scale = CPU_BVH_BINS / (cpuBvhAxis(centroidBounds.max, bestAxis) - low);
+
+        uint32_t end = first + count;
+        while(middle < end) {
+            uint32_t reference = build->references[middle];
+            uint32_t bin = cpuBvhBin(cpuBvhAxis(build->centroids[reference], bestAxis), low, scale);
+            if(bin < bestBin) {
+                middle++;
+            } else {
+                build->references[middle] = build->references[--end];
+                build->references[end] = reference;
+            }
+        }
+    }
+    // Coincident centroids have no position to split at, halve the range instead
+    if(middle == first || middle == first + count) {
+        middle = first + count / 2;
+    }
+
+    uint32_t children = atomic_fetch_add(&build->nodeCount, 2);
+    build->nodes[node].first = children;
+    build->nodes[node].count = 0;
+
+    uint32_t leftCount = middle - first;
+    uint32_t rightCount = count - leftCount;
+    if(build->pool != NULL && rightCount >= CPU_BVH_PARALLEL_SIZE) {
+        CpuBvhJob *job = (CpuBvhJob*)malloc(sizeof(CpuBvhJob));
+        assert(job != NULL);
+        *job = (CpuBvhJob){build, children + 1, middle, rightCount, depth + 1};
+
+        pthread_mutex_lock(&build->mutex);
+        build->pending++;
+        pthread_mutex_unlock(&build->mutex);
+
+        if(threadPoolSubmit(build->pool, cpuBvhSubdivideJob, job)) {
+            cpuBvhSubdivide(build, children, first, leftCount, depth + 1);
+            return;
+        }
+
+        // A full queue means every worker is busy already, the range is built here
+        pthread_mutex_lock(&build->mutex);
+        build->pending--;
+        pthread_mutex_unlock(&build->mutex);
+        free(job);
+    }
+
+    cpuBvhSubdivide(build, children, first, leftCount, depth + 1);
+    cpuBvhSubdivide(build, children + 1, middle, rightCount, depth + 1);
+}
+
+void cpuBvhSubdivideJob(void *userData) {
+    CpuBvhJob *job = (CpuBvhJob*)userData;
+    CpuBvhBuild *build = job->build;
+
+    cpuBvhSubdivide(build, job->node, job->first, job->count, job->depth);
+    free(job);
+
+    pthread_mutex_lock(&build->mutex);
+    build->parallelJobs++;
+    if(--build->pending == 0) {
+        pthread_cond_signal(&build->done);
+    }
+    pthread_mutex_unlock(&build->mutex);
+}
+
+// Pulls grandchildren up into a wide node until it has CPU_BVH_WIDTH children, opening the
+// largest inner child first. buildNode is always opened, so every wide node consumes at least
+// one inner binary node and recursion follows the binary depth. Returns the wide node's index.
+uint32_t cpuBvhCollapse(const CpuBvhBuild *build, CpuBvh *bvh, uint32_t buildNode) {
+    uint32_t slots[CPU_BVH_WIDTH] = {buildNode};
+    uint32_t slotCount = 1;
+    while(slotCount < CPU_BVH_WIDTH) {
+        int largest = -1;
+        float largestArea = -1.0f;
+        for(uint32_t i = 0; i < slotCount; i++) {
+            const CpuBvhBuildNode *child = &build->nodes[slots[i]];
+            float area = cpuBvhBoxArea(&child->bounds);
+            // Unordered areas of boxes beyond float range still get opened
+            if(child->count == 0 && (largest < 0 || area > largestArea)) {
+                largest = (int)i;
+                largestArea = area;
+            }
+        }
+        if(largest < 0) {
+            break;
+        }
+
+        uint32_t children = build->nodes[slots[largest]].first;
+        slots[largest] = children;
+        slots[slotCount++] = children + 1;
+    }
+
+    uint32_t index = bvh->nodeCount++;
+    CpuBvhNode *node = &bvh->nodes[index];
+    for(uint32_t lane = 0; lane < CPU_BVH_WIDTH; lane++) {
+        if(lane >= slotCount) {
+            // Slabs of inverted bounds still overlap, traversal skips the slot by its child
+            node->minX[lane] = node->minY[lane] = node->minZ[lane] = INFINITY;
+            node->maxX[lane] = node->maxY[lane] = node->maxZ[lane] = -INFINITY;
+            node->children[lane] = CPU_BVH_INVALID;
+            node->counts[lane] = 0;
+            continue;
+        }
+
+        const CpuBvhBuildNode *child = &build->nodes[slots[lane]];
+        node->minX[lane] = child->bounds.min.x;
+        node->minY[lane] = child->bounds.min.y;
+        node->minZ[lane] = child->bounds.min.z;
+        node->maxX[lane] = child->bounds.max.x;
+        node->maxY[lane] = child->bounds.max.y;
+        node->maxZ[lane] = child->bounds.max.z;
+
+        if(child->count > 0) {
+            node->children[lane] = child->first;
+            node->counts[lane] = child->count;
+            bvh->stats.leaves++;
+        } else {
+            node->children[lane] = cpuBvhCollapse(build, bvh, slots[lane]);
+            node->counts[lane] = 0;
+        }
+    }
+    bvh->stats.nodes = bvh->nodeCount;
+
+    return index;
+}
+
+void cpuBvhBoxGrow(CpuBvhBox *box, const CpuBvhBox *other) {
+    box->min.x = fminf(box->min.x, other->min.x);
+    box->min.y = fminf(box->min.y, other->min.y);
+    box->min.z = fminf(box->min.z, other->min.z);
+    box->max.x = fmaxf(box->max.x, other->max.x);
+    box->max.y = fmaxf(box->max.y, other->max.y);
+    box->max.z = fmaxf(box->max.z, other->max.z);
+}
+
+// Half the surface area, the heuristic only compares them
+float cpuBvhBoxArea(const CpuBvhBox *box) {
+    float x = box->max.x - box->min.x;
+    float y = box->max.y - box->min.y;
+    float z = box->max.z - box->min.z;
+    return x * y + y * z + z * x;
+}
+
+// NaN offsets land in the first bin instead of an undefined conversion
+uint32_t cpuBvhBin(float value, float low, float scale) {
+    float offset = (value - low) * scale;
+    if(!(offset > 0.0f)) {
+        return 0;
+    }
+    return offset < CPU_BVH_BINS ? (uint32_t)offset : CPU_BVH_BINS - 1;
+}
+
+float cpuBvhAxis(Vector3f v, int axis) {
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+// Moller-Trumbore, both faces like the opaque geometry of the device acceleration structures
+void cpuBvhIntersectTriangle(const CpuBvhTriangle *triangle, uint32_t index, const CpuRay *ray, CpuHit *hit) {
+    Vector3f d = ray->direction;
+    Vector3f e1 = triangle->edge1;
+    Vector3f e2 = triangle->edge2;
+
+    Vector3f p = {d.y * e2.z - d.z * e2.y, d.z * e2.x - d.x * e2.z, d.x * e2.y - d.y * e2.x};
+    float determinant = e1.x * p.x + e1.y * p.y + e1.z * p.z;
+    if(fabsf(determinant) < 1e-12f) {
+        return;
+    }
+    float inverse = 1.0f / determinant;
+
+    Vector3f s = {ray->origin.x - triangle->v0.x, ray->origin.y - triangle->v0.y, ray->origin.z - triangle->v0.z};
+    float u = (s.x * p.x + s.y * p.y + s.z * p.z) * inverse;
+    if(u < 0.0f || u > 1.0f) {
+        return;
+    }
+
+    Vector3f q = {s.y * e1.z - s.z * e1.y, s.z * e1.x - s.x * e1.z, s.x * e1.y - s.y * e1.x};
+    float v = (d.x * q.x + d.y * q.y + d.z * q.z) * inverse;
+    if(v < 0.0f || u + v > 1.0f) {
+        return;
+    }
+
+    float t = (e2.x * q.x + e2.y * q.y + e2.z * q.z) * inverse;
+    if(t > 0.0f && t < hit->t) {
+        hit->t = t;
+        hit->u = u;
+        hit->v = v;
+        hit->primitive = index;
+    }
+}
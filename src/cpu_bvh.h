@@ -0,0 +1,86 @@
+#ifndef CPU_BVH_H_
+#define CPU_BVH_H_
+
+#include <vulkan/vulkan.h>
+
+#include "mesh.h"
+#include "thread_pool.h"
+
+// Children per node, one SIMD lane each
+#define CPU_BVH_WIDTH 4
+#define CPU_BVH_BINS 16
+// Ranges at most this large become leaves
+#define CPU_BVH_LEAF_SIZE 4
+// Binary levels of the build, ranges still larger at this depth become one leaf
+#define CPU_BVH_MAX_DEPTH 64
+// Nodes left in an empty child slot and the triangle of a missed ray
+#define CPU_BVH_INVALID UINT32_MAX
+
+// Children of a node in structure-of-arrays layout so one node is a single box test
+typedef struct {
+    float minX[CPU_BVH_WIDTH], minY[CPU_BVH_WIDTH], minZ[CPU_BVH_WIDTH];
+    float maxX[CPU_BVH_WIDTH], maxY[CPU_BVH_WIDTH], maxZ[CPU_BVH_WIDTH];
+    // Node index for inner children, first triangle for leaves
+    uint32_t children[CPU_BVH_WIDTH];
+    // Triangles of a leaf child, 0 for inner and empty ones
+    uint32_t counts[CPU_BVH_WIDTH];
+} CpuBvhNode;
+
+// Precomputed for the intersection test, in leaf order
+typedef struct {
+    Vector3f v0, edge1, edge2;
+    // Triangle index in the source index buffer
+    uint32_t primitive;
+} CpuBvhTriangle;
+
+typedef struct {
+    Vector3f origin;
+    Vector3f direction;
+    float tMax;
+} CpuRay;
+
+typedef struct {
+    float t;
+    // Barycentrics of vertices 1 and 2
+    float u, v;
+    // CPU_BVH_INVALID when nothing was hit
+    uint32_t primitive;
+} CpuHit;
+
+typedef struct {
+    uint32_t nodes;
+    uint32_t leaves;
+    uint32_t triangles;
+    // Subtrees built on pool workers
+    uint32_t parallelJobs;
+} CpuBvhStats;
+
+// Reference BVH over the triangles of a mesh on the CPU, traces rays without a device.
+// Built from the same vertex and index data a Mesh is created from.
+typedef struct {
+    CpuBvhNode *nodes;
+    uint32_t nodeCount;
+    CpuBvhTriangle *triangles;
+    uint32_t triangleCount;
+
+    CpuBvhStats stats;
+} CpuBvh;
+
+// Binned SAH build. Subtrees are split off to pool when it is not NULL, the call returns
+// once all of them are done.
+VkResult buildCpuBvh(
+    const Vertex *vertices,
+    const uint32_t *indices,
+    uint32_t indexCount,
+    ThreadPool *pool,
+    CpuBvh *bvh
+);
+void destroyCpuBvh(CpuBvh *bvh);
+
+// Closest hit along the ray within tMax, returns whether there was one
+VkBool32 cpuBvhIntersect(const CpuBvh *bvh, const CpuRay *ray, CpuHit *hit);
+// Tests every triangle, the oracle the tree is checked against
+VkBool32 cpuBvhIntersectBruteForce(const CpuBvh *bvh, const CpuRay *ray, CpuHit *hit);
+CpuBvhStats cpuBvhStats(const CpuBvh *bvh);
+
+#endif
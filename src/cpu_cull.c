@@ -0,0 +1,298 @@
+#include "cpu_cull.h"
+#include "frustum.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The 8 lane path is compiled for AVX2 on its own and picked at runtime, builds stay baseline
+#if defined(__x86_64__) || defined(__i386__)
+#define CULL_SET_AVX2 1
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define CULL_SET_ALIGNMENT 32
+#define CULL_SET_ARRAY_COUNT 10
+
+void cullSetArrays(CullSet *set, float **arrays[CULL_SET_ARRAY_COUNT]);
+void cullSetPad(CullSet *set, uint32_t from, uint32_t to);
+uint32_t emitVisible(uint32_t mask, uint32_t base, uint32_t count, uint32_t *visible);
+#if CULL_SET_AVX2
+uint32_t cullSetTestAvx2(
+    const CullSet *set,
+    const Frustum *frustum,
+    const float *cornerX[FRUSTUM_PLANE_COUNT],
+    const float *cornerY[FRUSTUM_PLANE_COUNT],
+    const float *cornerZ[FRUSTUM_PLANE_COUNT],
+    uint32_t *visible
+);
+#endif
+
+VkResult createCullSet(uint32_t capacity, CullSet *set) {
+    capacity = (capacity + CULL_SET_LANES - 1) / CULL_SET_LANES * CULL_SET_LANES;
+    if(capacity == 0) capacity = CULL_SET_LANES;
+
+    *set = (CullSet){
+        .count = 0,
+        .capacity = capacity,
+    };
+
+    float **arrays[CULL_SET_ARRAY_COUNT];
+    cullSetArrays(set, arrays);
+    for(int i = 0; i < CULL_SET_ARRAY_COUNT; i++) {
+        *arrays[i] = (float*)aligned_alloc(CULL_SET_ALIGNMENT, capacity * sizeof(float));
+        if(*arrays[i] == NULL) {
+            destroyCullSet(set);
+            return VK_ERROR_OUT_OF_HOST_MEMORY;
+        }
+    }
+
+    cullSetPad(set, 0, capacity);
+
+    return VK_SUCCESS;
+}
+
+void destroyCullSet(CullSet *set) {
+    float **arrays[CULL_SET_ARRAY_COUNT];
+    cullSetArrays(set, arrays);
+    for(int i = 0; i < CULL_SET_ARRAY_COUNT; i++) {
+        free(*arrays[i]);
+        *arrays[i] = NULL;
+    }
+
+    set->count = 0;
+    set->capacity = 0;
+}
+
+uint32_t cullSetAdd(CullSet *set, Vector4f sphere, Vector3f aabbMin, Vector3f aabbMax) {
+    if(set->count + 1 > set->capacity) {
+        uint32_t capacity = set->capacity * 2;
+
+        float **arrays[CULL_SET_ARRAY_COUNT];
+        cullSetArrays(set, arrays);
+        for(int i = 0; i < CULL_SET_ARRAY_COUNT; i++) {
+            float *grown = (float*)aligned_alloc(CULL_SET_ALIGNMENT, capacity * sizeof(float));
+            assert(grown != NULL);
+            memcpy(grown, *arrays[i], set->capacity * sizeof(float));
+            free(*arrays[i]);
+            *arrays[i] = grown;
+        }
+
+        cullSetPad(set, set->capacity, capacity);
+        set->capacity = capacity;
+    }
+
+    uint32_t index = set->count++;
+    cullSetUpdate(set, index, sphere, aabbMin, aabbMax);
+
+    return index;
+}
+
+void cullSetUpdate(CullSet *set, uint32_t index, Vector4f sphere, Vector3f aabbMin, Vector3f aabbMax) {
+    assert(index < set->count);
+
+    set->centerX[index] = sphere.x;
+    set->centerY[index] = sphere.y;
+    set->centerZ[index] = sphere.z;
+    set->radius[index] = sphere.w;
+    set->minX[index] = aabbMin.x;
+    set->minY[index] = aabbMin.y;
+    set->minZ[index] = aabbMin.z;
+    set->maxX[index] = aabbMax.x;
+    set->maxY[index] = aabbMax.y;
+    set->maxZ[index] = aabbMax.z;
+}
+
+void cullSetClear(CullSet *set) {
+    cullSetPad(set, 0, set->count);
+    set->count = 0;
+}
+
+uint32_t cullSetTest(const CullSet *set, const Frustum *frustum, uint32_t *visible) {
+    uint32_t visibleCount = 0;
+    const Vector4f *planes = frustum->planes;
+
+    // The AABB corner furthest along each plane normal is the same for every lane
+    const float *cornerX[FRUSTUM_PLANE_COUNT];
+    const float *cornerY[FRUSTUM_PLANE_COUNT];
+    const float *cornerZ[FRUSTUM_PLANE_COUNT];
+    for(int p = 0; p < FRUSTUM_PLANE_COUNT; p++) {
+        cornerX[p] = planes[p].x >= 0.0f ? set->maxX : set->minX;
+        cornerY[p] = planes[p].y >= 0.0f ? set->maxY : set->minY;
+        cornerZ[p] = planes[p].z >= 0.0f ? set->maxZ : set->minZ;
+    }
+
+#if CULL_SET_AVX2
+    if(__builtin_cpu_supports("avx2")) {
+        return cullSetTestAvx2(set, frustum, cornerX, cornerY, cornerZ, visible);
+    }
+#endif
+
+#if defined(__SSE2__)
+    for(uint32_t base = 0; base < set->count; base += 4) {
+        __m128 cx = _mm_load_ps(set->centerX + base);
+        __m128 cy = _mm_load_ps(set->centerY + base);
+        __m128 cz = _mm_load_ps(set->centerZ + base);
+        __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_load_ps(set->radius + base));
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+        for(int p = 0; p < FRUSTUM_PLANE_COUNT; p++) {
+            __m128 nx = _mm_set1_ps(planes[p].x);
+            __m128 ny = _mm_set1_ps(planes[p].y);
+            __m128 nz = _mm_set1_ps(planes[p].z);
+            __m128 d = _mm_set1_ps(planes[p].w);
+
+            __m128 sphereDistance = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+                _mm_add_ps(_mm_mul_ps(nz, cz), d)
+            );
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(sphereDistance, negRadius));
+
+            __m128 boxDistance = _mm_add_ps(
+                _mm_add_ps(
+                    _mm_mul_ps(nx, _mm_load_ps(cornerX[p] + base)),
+                    _mm_mul_ps(ny, _mm_load_ps(cornerY[p] + base))
+                ),
+                _mm_add_ps(_mm_mul_ps(nz, _mm_load_ps(cornerZ[p] + base)), d)
+            );
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(boxDistance, _mm_setzero_ps()));
+        }
+
+        uint32_t mask = (uint32_t)_mm_movemask_ps(inside);
+        visibleCount += emitVisible(mask, base, set->count, visible + visibleCount);
+    }
+#else
+    for(uint32_t i = 0; i < set->count; i++) {
+        VkBool32 inside = VK_TRUE;
+
+        for(int p = 0; p < FRUSTUM_PLANE_COUNT && inside; p++) {
+            float sphereDistance = planes[p].x * set->centerX[i] +
+                planes[p].y * set->centerY[i] +
+                planes[p].z * set->centerZ[i] + planes[p].w;
+            float boxDistance = planes[p].x * cornerX[p][i] +
+                planes[p].y * cornerY[p][i] +
+                planes[p].z * cornerZ[p][i] + planes[p].w;
+
+            inside = sphereDistance >= -set->radius[i] && boxDistance >= 0.0f;
+        }
+
+        if(inside) {
+            visible[visibleCount++] = i;
+        }
+    }
+#endif
+
+    return visibleCount;
+}
+
+uint32_t cullSetLanes(void) {
+#if CULL_SET_AVX2
+    if(__builtin_cpu_supports("avx2")) {
+        return 8;
+    }
+#endif
+#if defined(__SSE2__)
+    return 4;
+#else
+    return 1;
+#endif
+}
+
+#if CULL_SET_AVX2
+__attribute__((target("avx2")))
+uint32_t cullSetTestAvx2(
+    const CullSet *set,
+    const Frustum *frustum,
+    const float *cornerX[FRUSTUM_PLANE_COUNT],
+    const float *cornerY[FRUSTUM_PLANE_COUNT],
+    const float *cornerZ[FRUSTUM_PLANE_COUNT],
+    uint32_t *visible
+) {
+    uint32_t visibleCount = 0;
+    const Vector4f *planes = frustum->planes;
+
+    for(uint32_t base = 0; base < set->count; base += 8) {
+        __m256 cx = _mm256_load_ps(set->centerX + base);
+        __m256 cy = _mm256_load_ps(set->centerY + base);
+        __m256 cz = _mm256_load_ps(set->centerZ + base);
+        __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_load_ps(set->radius + base));
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+        for(int p = 0; p < FRUSTUM_PLANE_COUNT; p++) {
+            __m256 nx = _mm256_set1_ps(planes[p].x);
+            __m256 ny = _mm256_set1_ps(planes[p].y);
+            __m256 nz = _mm256_set1_ps(planes[p].z);
+            __m256 d = _mm256_set1_ps(planes[p].w);
+
+            __m256 sphereDistance = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(nx, cx), _mm256_mul_ps(ny, cy)),
+                _mm256_add_ps(_mm256_mul_ps(nz, cz), d)
+            );
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(sphereDistance, negRadius, _CMP_GE_OQ));
+
+            __m256 boxDistance = _mm256_add_ps(
+                _mm256_add_ps(
+                    _mm256_mul_ps(nx, _mm256_load_ps(cornerX[p] + base)),
+                    _mm256_mul_ps(ny, _mm256_load_ps(cornerY[p] + base))
+                ),
+                _mm256_add_ps(_mm256_mul_ps(nz, _mm256_load_ps(cornerZ[p] + base)), d)
+            );
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(boxDistance, _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+
+        uint32_t mask = (uint32_t)_mm256_movemask_ps(inside);
+        visibleCount += emitVisible(mask, base, set->count, visible + visibleCount);
+    }
+
+    return visibleCount;
+}
+#endif
+
+void cullSetArrays(CullSet *set, float **arrays[CULL_SET_ARRAY_COUNT]) {
+    arrays[0] = &set->centerX;
+    arrays[1] = &set->centerY;
+    arrays[2] = &set->centerZ;
+    arrays[3] = &set->radius;
+    arrays[4] = &set->minX;
+    arrays[5] = &set->minY;
+    arrays[6] = &set->minZ;
+    arrays[7] = &set->maxX;
+    arrays[8] = &set->maxY;
+    arrays[9] = &set->maxZ;
+}
+
+// Unused lanes get volumes that fail every plane test
+void cullSetPad(CullSet *set, uint32_t from, uint32_t to) {
+    for(uint32_t i = from; i < to; i++) {
+        set->centerX[i] = 0.0f;
+        set->centerY[i] = 0.0f;
+        set->centerZ[i] = 0.0f;
+        set->radius[i] = -FLT_MAX;
+        set->minX[i] = NAN;
+        set->minY[i] = NAN;
+        set->minZ[i] = NAN;
+        set->maxX[i] = NAN;
+        set->maxY[i] = NAN;
+        set->maxZ[i] = NAN;
+    }
+}
+
+uint32_t emitVisible(uint32_t mask, uint32_t base, uint32_t count, uint32_t *visible) {
+    uint32_t emitted = 0;
+
+    while(mask != 0) {
+        uint32_t lane = (uint32_t)__builtin_ctz(mask);
+        mask &= mask - 1;
+
+        if(base + lane < count) {
+            visible[emitted++] = base + lane;
+        }
+    }
+
+    return emitted;
+}
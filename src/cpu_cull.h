@@ -0,0 +1,35 @@
+#ifndef CPU_CULL_H_
+#define CPU_CULL_H_
+
+#include <vulkan/vulkan.h>
+
+#include "frustum.h"
+#include "mesh.h"
+
+// Objects are tested in groups of this many lanes, arrays are padded to it
+#define CULL_SET_LANES 8
+
+// Bounding volumes in structure-of-arrays layout so lanes load contiguously
+typedef struct {
+    float *centerX, *centerY, *centerZ, *radius;
+    float *minX, *minY, *minZ;
+    float *maxX, *maxY, *maxZ;
+    uint32_t count;
+    uint32_t capacity;
+} CullSet;
+
+VkResult createCullSet(uint32_t capacity, CullSet *set);
+void destroyCullSet(CullSet *set);
+
+uint32_t cullSetAdd(CullSet *set, Vector4f sphere, Vector3f aabbMin, Vector3f aabbMax);
+void cullSetUpdate(CullSet *set, uint32_t index, Vector4f sphere, Vector3f aabbMin, Vector3f aabbMax);
+void cullSetClear(CullSet *set);
+
+// Writes the indices of objects whose sphere and AABB intersect the frustum into
+// visible (room for set->count entries) in ascending order, returns how many.
+uint32_t cullSetTest(const CullSet *set, const Frustum *frustum, uint32_t *visible);
+
+// Lanes cullSetTest checks at once on this CPU, 8 with AVX2, 4 with SSE2, 1 otherwise
+uint32_t cullSetLanes(void);
+
+#endif
@@ -0,0 +1,227 @@
+#include "cpu_trace.h"
+#include "cpu_bvh.h"
+#include "mesh.h"
+#include "thread_pool.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+// One frame's trace, shared by the calling thread and the pool jobs helping with it
+typedef struct {
+    const CpuTracer *tracer;
+    uint8_t *pixels;
+    uint32_t bandCount;
+    atomic_uint nextBand;
+
+    // Guarded by mutex
+    pthread_mutex_t mutex;
+    pthread_cond_t done;
+    uint32_t bandsDone;
+    // Threads still holding the trace, the last one frees it. Jobs a busy pool starts late
+    // find every band taken and only drop their reference.
+    uint32_t references;
+} CpuTrace;
+
+void cpuTraceRows(const CpuTracer *tracer, uint8_t *pixels, uint32_t firstRow, uint32_t rowCount);
+void cpuTraceBands(CpuTrace *trace);
+void cpuTraceJob(void *userData);
+void cpuTraceRelease(CpuTrace *trace);
+uint8_t cpuTraceUnorm(float value);
+
+VkResult createCpuTracer(
+    const Vertex *vertices,
+    uint32_t vertexCount,
+    const uint32_t *indices,
+    uint32_t indexCount,
+    const Matrix4f *transforms,
+    const Vector4f *colors,
+    uint32_t instanceCount,
+    Vector4f background,
+    uint32_t width,
+    uint32_t height,
+    ThreadPool *pool,
+    CpuTracer *tracer
+) {
+    memset(tracer, 0, sizeof(CpuTracer));
+
+    // Flattened into world space, the BVH copies what it needs out of them
+    Vertex *placed = (Vertex*)malloc((size_t)instanceCount * vertexCount * sizeof(Vertex));
+    uint32_t *placedIndices = (uint32_t*)malloc((size_t)instanceCount * indexCount * sizeof(uint32_t));
+    tracer->colors = (Vector4f*)malloc(instanceCount * sizeof(Vector4f));
+    if(placed == NULL || placedIndices == NULL || tracer->colors == NULL) {
+        free(placed);
+        free(placedIndices);
+        free(tracer->colors);
+        tracer->colors = NULL;
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+
+    for(uint32_t i = 0; i < instanceCount; i++) {
+        const Vector4f *c = transforms[i].columns;
+        for(uint32_t v = 0; v < vertexCount; v++) {
+            Vector3f p = vertices[v].position;
+            placed[i * vertexCount + v] = (Vertex){
+                .position = {
+                    c[0].x * p.x + c[1].x * p.y + c[2].x * p.z + c[3].x,
+                    c[0].y * p.x + c[1].y * p.y + c[2].y * p.z + c[3].y,
+                    c[0].z * p.x + c[1].z * p.y + c[2].z * p.z + c[3].z,
+                },
+                .color = vertices[v].color,
+            };
+        }
+        for(uint32_t n = 0; n < indexCount; n++) {
+            placedIndices[i * indexCount + n] = i * vertexCount + indices[n];
+        }
+    }
+    memcpy(tracer->colors, colors, instanceCount * sizeof(Vector4f));
+
+    VkResult result = buildCpuBvh(placed, placedIndices, instanceCount * indexCount, pool, &tracer->bvh);
+    free(placed);
+    free(placedIndices);
+    if(result != VK_SUCCESS) {
+        free(tracer->colors);
+        tracer->colors = NULL;
+        return result;
+    }
+
+    tracer->instanceTriangles = indexCount / 3;
+    tracer->background = background;
+    tracer->width = width;
+    tracer->height = height;
+    tracer->pool = pool;
+
+    return VK_SUCCESS;
+}
+
+void destroyCpuTracer(CpuTracer *tracer) {
+    destroyCpuBvh(&tracer->bvh);
+    free(tracer->colors);
+    memset(tracer, 0, sizeof(CpuTracer));
+}
+
+void cpuTrace(CpuTracer *tracer, uint8_t *pixels) {
+    uint32_t bandCount = (tracer->height + CPU_TRACE_BAND_ROWS - 1) / CPU_TRACE_BAND_ROWS;
+    if(bandCount == 0) {
+        return;
+    }
+
+    CpuTrace *trace = (CpuTrace*)malloc(sizeof(CpuTrace));
+    if(trace == NULL) {
+        cpuTraceRows(tracer, pixels, 0, tracer->height);
+        return;
+    }
+
+    *trace = (CpuTrace){
+        .tracer = tracer,
+        .pixels = pixels,
+        .bandCount = bandCount,
+        .references = 1,
+    };
+    atomic_init(&trace->nextBand, 0);
+    pthread_mutex_init(&trace->mutex, NULL);
+    pthread_cond_init(&trace->done, NULL);
+
+    // The calling thread takes bands too, one job per worker is enough for the rest
+    uint32_t jobs = threadPoolWorkerCount(tracer->pool);
+    if(jobs > bandCount - 1) {
+        jobs = bandCount - 1;
+    }
+    for(uint32_t i = 0; i < jobs; i++) {
+        pthread_mutex_lock(&trace->mutex);
+        trace->references++;
+        pthread_mutex_unlock(&trace->mutex);
+
+        if(!threadPoolSubmit(tracer->pool, cpuTraceJob, trace)) {
+            // A full queue means every worker is busy already, the bands are traced here
+            pthread_mutex_lock(&trace->mutex);
+            trace->references--;
+            pthread_mutex_unlock(&trace->mutex);
+            break;
+        }
+    }
+
+    cpuTraceBands(trace);
+
+    pthread_mutex_lock(&trace->mutex);
+    while(trace->bandsDone < trace->bandCount) {
+        pthread_cond_wait(&trace->done, &trace->mutex);
+    }
+    pthread_mutex_unlock(&trace->mutex);
+
+    cpuTraceRelease(trace);
+}
+
+// Same rays as resources/shader/ray.rgen, shaded like ray.rchit and ray.rmiss
+void cpuTraceRows(const CpuTracer *tracer, uint8_t *pixels, uint32_t firstRow, uint32_t rowCount) {
+    for(uint32_t y = firstRow; y < firstRow + rowCount; y++) {
+        for(uint32_t x = 0; x < tracer->width; x++) {
+            // The demo grid is drawn straight in clip space, rays go through it along +z
+            float u = ((float)x + 0.5f) / (float)tracer->width;
+            float v = ((float)y + 0.5f) / (float)tracer->height;
+            CpuRay ray = {
+                .origin = {u * 2.0f - 1.0f, v * 2.0f - 1.0f, -1.0f},
+                .direction = {0.0f, 0.0f, 1.0f},
+                .tMax = 2.0f,
+            };
+
+            Vector3f color = {tracer->background.x, tracer->background.y, tracer->background.z};
+            CpuHit hit;
+            if(cpuBvhIntersect(&tracer->bvh, &ray, &hit)) {
+                Vector4f instance = tracer->colors[hit.primitive / tracer->instanceTriangles];
+                float shade = 0.75f + 0.25f * hit.u;
+                color = (Vector3f){instance.x * shade, instance.y * shade, instance.z * shade};
+            }
+
+            uint8_t *pixel = &pixels[((size_t)y * tracer->width + x) * 4];
+            pixel[0] = cpuTraceUnorm(color.x);
+            pixel[1] = cpuTraceUnorm(color.y);
+            pixel[2] = cpuTraceUnorm(color.z);
+            pixel[3] = 255;
+        }
+    }
+}
+
+void cpuTraceBands(CpuTrace *trace) {
+    const CpuTracer *tracer = trace->tracer;
+
+    uint32_t band;
+    while((band = atomic_fetch_add(&trace->nextBand, 1)) < trace->bandCount) {
+        uint32_t firstRow = band * CPU_TRACE_BAND_ROWS;
+        uint32_t rowCount = tracer->height - firstRow < CPU_TRACE_BAND_ROWS ?
+            tracer->height - firstRow : CPU_TRACE_BAND_ROWS;
+        cpuTraceRows(tracer, trace->pixels, firstRow, rowCount);
+
+        pthread_mutex_lock(&trace->mutex);
+        if(++trace->bandsDone == trace->bandCount) {
+            pthread_cond_signal(&trace->done);
+        }
+        pthread_mutex_unlock(&trace->mutex);
+    }
+}
+
+void cpuTraceJob(void *userData) {
+    CpuTrace *trace = (CpuTrace*)userData;
+
+    cpuTraceBands(trace);
+    cpuTraceRelease(trace);
+}
+
+void cpuTraceRelease(CpuTrace *trace) {
+    pthread_mutex_lock(&trace->mutex);
+    uint32_t references = --trace->references;
+    pthread_mutex_unlock(&trace->mutex);
+
+    if(references == 0) {
+        pthread_cond_destroy(&trace->done);
+        pthread_mutex_destroy(&trace->mutex);
+        free(trace);
+    }
+}
+
+uint8_t cpuTraceUnorm(float value) {
+    if(value <= 0.0f) return 0;
+    if(value >= 1.0f) return 255;
+    return (uint8_t)(value * 255.0f + 0.5f);
+}
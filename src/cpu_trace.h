@@ -0,0 +1,49 @@
+#ifndef CPU_TRACE_H_
+#define CPU_TRACE_H_
+
+#include <vulkan/vulkan.h>
+
+#include "cpu_bvh.h"
+#include "mesh.h"
+#include "thread_pool.h"
+
+// Rows of the image traced by one pool job
+#define CPU_TRACE_BAND_ROWS 16
+
+// Ray traced view for devices without ray tracing. Traces the rays of resources/shader/ray.rgen
+// against a CpuBvh over every instance and shades the hits like ray.rchit and ray.rmiss.
+typedef struct {
+    CpuBvh bvh;
+    // Triangles of one instance, hits map back to their instance through it
+    uint32_t instanceTriangles;
+    // One per instance, like the hit records of the GPU view
+    Vector4f *colors;
+    Vector4f background;
+    uint32_t width;
+    uint32_t height;
+    ThreadPool *pool;
+} CpuTracer;
+
+// Places instanceCount copies of the mesh by transforms, both transforms and colors hold one
+// entry per instance. The BVH is built on pool.
+VkResult createCpuTracer(
+    const Vertex *vertices,
+    uint32_t vertexCount,
+    const uint32_t *indices,
+    uint32_t indexCount,
+    const Matrix4f *transforms,
+    const Vector4f *colors,
+    uint32_t instanceCount,
+    Vector4f background,
+    uint32_t width,
+    uint32_t height,
+    ThreadPool *pool,
+    CpuTracer *tracer
+);
+void destroyCpuTracer(CpuTracer *tracer);
+
+// Writes width * height RGBA8 pixels row by row. Bands of rows are traced on pool workers and
+// the calling thread, returns once all of them are done.
+void cpuTrace(CpuTracer *tracer, uint8_t *pixels);
+
+#endif
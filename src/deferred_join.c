@@ -0,0 +1,89 @@
+// sched_yield
+#define _POSIX_C_SOURCE 200809L
+
+#include "deferred_join.h"
+#include "device_api.h"
+#include "thread_pool.h"
+
+#include <sched.h>
+#include <stdlib.h>
+#include <vulkan/vulkan_core.h>
+
+void deferredJoinJob(void *userData);
+void joinDeferredOperation(Device *device, VkDeferredOperationKHR operation);
+void releaseDeferredJoin(DeferredJoin *join);
+
+VkResult createDeferredJoin(Device *device, DeferredJoin **join) {
+    DeferredJoin *created = (DeferredJoin*)malloc(sizeof(DeferredJoin));
+    if(created == NULL) {
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+    created->device = device;
+    atomic_init(&created->references, 1);
+
+    VkResult result = createDeferredOperationKHR(device, &created->operation);
+    if(result != VK_SUCCESS) {
+        free(created);
+        return result;
+    }
+
+    *join = created;
+    return VK_SUCCESS;
+}
+
+VkResult deferredJoinComplete(DeferredJoin *join, ThreadPool *pool, VkResult started) {
+    Device *device = join->device;
+    VkResult result = started;
+
+    if(started == VK_OPERATION_DEFERRED_KHR) {
+        // This thread joins as well, UINT32_MAX means the driver has no limit
+        uint32_t helpers = getDeferredOperationMaxConcurrencyKHR(device, join->operation);
+        helpers = helpers > 0 ? helpers - 1 : 0;
+        if(helpers > threadPoolWorkerCount(pool)) {
+            helpers = threadPoolWorkerCount(pool);
+        }
+
+        for(uint32_t i = 0; i < helpers; i++) {
+            atomic_fetch_add(&join->references, 1);
+            if(!threadPoolSubmit(pool, deferredJoinJob, join)) {
+                atomic_fetch_sub(&join->references, 1);
+                break;
+            }
+        }
+
+        // Helpers that have not started yet are not waited for, they find the operation complete
+        joinDeferredOperation(device, join->operation);
+    }
+
+    if(started == VK_OPERATION_DEFERRED_KHR || started == VK_OPERATION_NOT_DEFERRED_KHR) {
+        // Other threads may still be finishing their part after this one ran out of work
+        while((result = getDeferredOperationResultKHR(device, join->operation)) == VK_NOT_READY) {
+            sched_yield();
+        }
+    }
+
+    releaseDeferredJoin(join);
+
+    return result;
+}
+
+void deferredJoinJob(void *userData) {
+    DeferredJoin *join = (DeferredJoin*)userData;
+
+    joinDeferredOperation(join->device, join->operation);
+    releaseDeferredJoin(join);
+}
+
+// Returns once the operation has no more work for this thread
+void joinDeferredOperation(Device *device, VkDeferredOperationKHR operation) {
+    while(deferredOperationJoinKHR(device, operation) == VK_THREAD_IDLE_KHR) {
+        sched_yield();
+    }
+}
+
+void releaseDeferredJoin(DeferredJoin *join) {
+    if(atomic_fetch_sub(&join->references, 1) == 1) {
+        destroyDeferredOperationKHR(join->device, join->operation);
+        free(join);
+    }
+}
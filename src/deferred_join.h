@@ -0,0 +1,24 @@
+#ifndef DEFERRED_JOIN_H_
+#define DEFERRED_JOIN_H_
+
+#include <stdatomic.h>
+#include <vulkan/vulkan.h>
+
+#include "device_api.h"
+#include "thread_pool.h"
+
+// Deferred host operation shared by the thread that started it and the workers helping
+// it, the last one to let go destroys the operation
+typedef struct {
+    Device *device;
+    VkDeferredOperationKHR operation;
+    _Atomic uint32_t references;
+} DeferredJoin;
+
+// Heap allocated, workers may still hold it after the starting thread is done with it
+VkResult createDeferredJoin(Device *device, DeferredJoin **join);
+// started is what the deferrable command returned for join's operation. Joins it from this
+// thread and as many of pool's workers as it can use, waits for its result and releases join.
+VkResult deferredJoinComplete(DeferredJoin *join, ThreadPool *pool, VkResult started);
+
+#endif
@@ -0,0 +1,38 @@
+#include "deletion_queue.h"
+
+#include <stdint.h>
+
+void createDeletionQueue(Device *device, DeletionQueue *queue) {
+    queue->device = device;
+    queue->entries = DeletionArrayNew(16);
+}
+
+void destroyDeletionQueue(DeletionQueue *queue) {
+    deletionQueueFlush(queue, UINT64_MAX);
+    DeletionArrayDestroy(&queue->entries);
+}
+
+void deletionQueuePush(DeletionQueue *queue, uint64_t value, DeletionCallback destroy, void *userData) {
+    DeletionEntry entry = {
+        .value = value,
+        .destroy = destroy,
+        .userData = userData,
+    };
+    DeletionArrayAddElement(&queue->entries, entry);
+}
+
+void deletionQueueFlush(DeletionQueue *queue, uint64_t completedValue) {
+    size_t kept = 0;
+
+    for(size_t i = 0; i < queue->entries.elementCount; i++) {
+        DeletionEntry entry = queue->entries.elements[i];
+
+        if(entry.value <= completedValue) {
+            entry.destroy(queue->device, entry.userData);
+        } else {
+            queue->entries.elements[kept++] = entry;
+        }
+    }
+
+    queue->entries.elementCount = kept;
+}
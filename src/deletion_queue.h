@@ -0,0 +1,34 @@
+#ifndef DELETION_QUEUE_H_
+#define DELETION_QUEUE_H_
+
+#include <vulkan/vulkan.h>
+
+#include "array.h"
+#include "device_api.h"
+
+typedef void (*DeletionCallback)(Device *device, void *userData);
+
+typedef struct {
+    // Timeline value after which the GPU no longer uses the object
+    uint64_t value;
+    DeletionCallback destroy;
+    void *userData;
+} DeletionEntry;
+
+DEFINE_ARRAY(Deletion, DeletionEntry)
+
+// Objects whose destruction waits for a value on the frame timeline
+typedef struct {
+    Device *device;
+    DeletionArray entries;
+} DeletionQueue;
+
+void createDeletionQueue(Device *device, DeletionQueue *queue);
+// Runs every pending callback, the GPU has to be idle
+void destroyDeletionQueue(DeletionQueue *queue);
+
+void deletionQueuePush(DeletionQueue *queue, uint64_t value, DeletionCallback destroy, void *userData);
+// Runs the callbacks of every entry with value <= completedValue, in push order
+void deletionQueueFlush(DeletionQueue *queue, uint64_t completedValue);
+
+#endif
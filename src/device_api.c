@@ -21,11 +21,11 @@ void retrieveQueue(Device *device, uint32_t familyIndex, VkQueue *queue) {
     vkGetDeviceQueue(device->device, familyIndex, 0, queue);
 }
 
-VkResult createDevice(VkInstance instance, VkSurfaceKHR surface, VkPhysicalDeviceFeatures2 *features, StringArray layers, StringArray extensions, Device *device) {
+VkResult pickDevice(VkInstance instance, VkSurfaceKHR surface, StringArray requiredExtensions, Device *device) {
     uint32_t result;
     result = pickPhysicalDevice(
         instance, surface,
-        extensions, &device->physicalDevice
+        requiredExtensions, &device->physicalDevice
     );
     
     if(result != VK_SUCCESS) {
@@ -37,6 +37,31 @@ VkResult createDevice(VkInstance instance, VkSurfaceKHR surface, VkPhysicalDevic
         return VK_ERROR_UNKNOWN;
     }
 
+    return VK_SUCCESS;
+}
+
+VkBool32 deviceExtensionSupported(Device *device, const char *extension) {
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device->physicalDevice, NULL, &extensionCount, NULL);
+    VkExtensionProperties *extensions = (VkExtensionProperties*)calloc(extensionCount, sizeof(VkExtensionProperties));
+    vkEnumerateDeviceExtensionProperties(device->physicalDevice, NULL, &extensionCount, extensions);
+
+    VkBool32 found = VK_FALSE;
+    for(uint32_t i = 0; i < extensionCount; i++) {
+        if(strcmp(extension, extensions[i].extensionName) == 0) {
+            found = VK_TRUE;
+            break;
+        }
+    }
+
+    free(extensions);
+
+    return found;
+}
+
+VkResult createDevice(Device *device, VkPhysicalDeviceFeatures2 *features, StringArray layers, StringArray extensions) {
+    uint32_t result;
+
     float queuePriority = 1.0;
     uint32_t queueCreateInfoCount = 2;
     VkDeviceQueueCreateInfo queueCreateInfos[] = {
@@ -115,6 +140,36 @@ void destroyPipelineLayout(Device *device, VkPipelineLayout layout) {
     vkDestroyPipelineLayout(device->device, layout, NULL);
 }
 
+VkResult createDescriptorSetLayout(Device *device, VkDescriptorSetLayoutCreateInfo *info, VkDescriptorSetLayout *layout) {
+    return vkCreateDescriptorSetLayout(device->device, info, NULL, layout);
+}
+
+void destroyDescriptorSetLayout(Device *device, VkDescriptorSetLayout layout) {
+    vkDestroyDescriptorSetLayout(device->device, layout, NULL);
+}
+
+VkResult createDescriptorPool(Device *device, VkDescriptorPoolCreateInfo *info, VkDescriptorPool *pool) {
+    return vkCreateDescriptorPool(device->device, info, NULL, pool);
+}
+
+void destroyDescriptorPool(Device *device, VkDescriptorPool pool) {
+    vkDestroyDescriptorPool(device->device, pool, NULL);
+}
+
+VkResult allocateDescriptorSet(Device *device, VkDescriptorPool pool, VkDescriptorSetLayout layout, VkDescriptorSet *set) {
+    VkDescriptorSetAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &layout,
+    };
+    return vkAllocateDescriptorSets(device->device, &allocInfo, set);
+}
+
+void updateDescriptorSets(Device *device, uint32_t writeCount, const VkWriteDescriptorSet *writes) {
+    vkUpdateDescriptorSets(device->device, writeCount, writes, 0, NULL);
+}
+
 VkResult createRenderPass(Device *device, VkRenderPassCreateInfo *info, VkRenderPass *renderPass) {
     return vkCreateRenderPass(device->device, info, NULL, renderPass);
 }
@@ -124,13 +179,35 @@ void destroyRenderPass(Device *device, VkRenderPass renderPass) {
 }
 
 VkResult createGraphicsPipeline(Device *device, VkGraphicsPipelineCreateInfo *info, VkPipeline *pipeline) {
-    return vkCreateGraphicsPipelines(device->device, VK_NULL_HANDLE, 1, info, NULL, pipeline);
+    return vkCreateGraphicsPipelines(device->device, device->pipelineCache, 1, info, NULL, pipeline);
+}
+
+VkResult createComputePipeline(Device *device, VkComputePipelineCreateInfo *info, VkPipeline *pipeline) {
+    return vkCreateComputePipelines(device->device, device->pipelineCache, 1, info, NULL, pipeline);
 }
 
 void destroyPipeline(Device *device, VkPipeline pipeline) {
     vkDestroyPipeline(device->device, pipeline, NULL);
 }
 
+VkResult createPipelineCache(Device *device, const void *initialData, size_t initialDataSize, VkPipelineCache *cache) {
+    VkPipelineCacheCreateInfo info = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .initialDataSize = initialDataSize,
+        .pInitialData = initialData,
+    };
+
+    return vkCreatePipelineCache(device->device, &info, NULL, cache);
+}
+
+void destroyPipelineCache(Device *device, VkPipelineCache cache) {
+    vkDestroyPipelineCache(device->device, cache, NULL);
+}
+
+VkResult getPipelineCacheData(Device *device, VkPipelineCache cache, size_t *dataSize, void *data) {
+    return vkGetPipelineCacheData(device->device, cache, dataSize, data);
+}
+
 VkResult createCommandPool(Device *device, uint32_t queueFamily, VkCommandPoolCreateFlags flags, VkCommandPool *commandPool) {
     VkCommandPoolCreateInfo createInfo = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
@@ -168,6 +245,56 @@ void destroyFence(Device *device, VkFence fence) {
     vkDestroyFence(device->device, fence, NULL);
 }
 
+VkResult createTimelineSemaphore(Device *device, uint64_t initialValue, VkSemaphore *semaphore) {
+    VkSemaphoreTypeCreateInfo typeInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+        .initialValue = initialValue,
+    };
+    VkSemaphoreCreateInfo info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &typeInfo,
+    };
+    return vkCreateSemaphore(device->device, &info, NULL, semaphore);
+}
+
+VkResult waitSemaphore(Device *device, VkSemaphore semaphore, uint64_t value, uint64_t timeout) {
+    VkSemaphoreWaitInfo info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .semaphoreCount = 1,
+        .pSemaphores = &semaphore,
+        .pValues = &value,
+    };
+    return vkWaitSemaphores(device->device, &info, timeout);
+}
+
+VkResult getSemaphoreCounterValue(Device *device, VkSemaphore semaphore, uint64_t *value) {
+    return vkGetSemaphoreCounterValue(device->device, semaphore, value);
+}
+
+VkResult createQueryPool(Device *device, VkQueryType type, uint32_t queryCount, VkQueryPool *pool) {
+    VkQueryPoolCreateInfo info = {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = type,
+        .queryCount = queryCount,
+    };
+    return vkCreateQueryPool(device->device, &info, NULL, pool);
+}
+
+void destroyQueryPool(Device *device, VkQueryPool pool) {
+    vkDestroyQueryPool(device->device, pool, NULL);
+}
+
+VkResult getQueryPoolResults(
+    Device *device,
+    VkQueryPool pool,
+    uint32_t firstQuery, uint32_t queryCount,
+    size_t dataSize, void *data,
+    VkDeviceSize stride, VkQueryResultFlags flags
+) {
+    return vkGetQueryPoolResults(device->device, pool, firstQuery, queryCount, dataSize, data, stride, flags);
+}
+
 VkResult createAccelerationStructureKHR(
     Device *device,
     VkAccelerationStructureCreateInfoKHR *structureInfo,
@@ -185,35 +312,150 @@ void destroyAccelerationStructureKHR(Device *device, VkAccelerationStructureKHR
     VK_DEVICE_FUNC(vkDestroyAccelerationStructureKHR, device->device)(device->device, structure, NULL);
 }
 
-VkResult createRayTracingPipelineKHR(
+void getAccelerationStructureBuildSizesKHR(
     Device *device,
-    VkPipelineLayout layout,
-    VkPipelineDynamicStateCreateInfo *dynamicState,
-    VkRayTracingShaderGroupCreateInfoKHR *groupInfo,
-    PipelineStageArray stages,
-    VkPipeline *pipeline
+    VkAccelerationStructureBuildTypeKHR buildType,
+    VkAccelerationStructureBuildGeometryInfoKHR *buildInfo,
+    const uint32_t *maxPrimitiveCounts,
+    VkAccelerationStructureBuildSizesInfoKHR *sizes
 ) {
-    VkRayTracingPipelineCreateInfoKHR info = {
-        .sType = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR,
-        .layout = layout,
-        .pGroups = groupInfo,
-        .groupCount = 1,
-        .pStages = stages.elements,
-        .stageCount = stages.elementCount,
-        .maxPipelineRayRecursionDepth = 8,
-        .pDynamicState = dynamicState,
+    VK_DEVICE_FUNC(vkGetAccelerationStructureBuildSizesKHR, device->device)(
+        device->device,
+        buildType,
+        buildInfo,
+        maxPrimitiveCounts,
+        sizes
+    );
+}
+
+VkDeviceAddress getAccelerationStructureDeviceAddressKHR(Device *device, VkAccelerationStructureKHR structure) {
+    VkAccelerationStructureDeviceAddressInfoKHR info = {
+        .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR,
+        .accelerationStructure = structure,
     };
+    return VK_DEVICE_FUNC(vkGetAccelerationStructureDeviceAddressKHR, device->device)(device->device, &info);
+}
+
+VkResult buildAccelerationStructuresKHR(
+    Device *device,
+    VkDeferredOperationKHR deferredOperation,
+    uint32_t infoCount,
+    const VkAccelerationStructureBuildGeometryInfoKHR *infos,
+    const VkAccelerationStructureBuildRangeInfoKHR *const *ranges
+) {
+    return VK_DEVICE_FUNC(vkBuildAccelerationStructuresKHR, device->device)(
+        device->device,
+        deferredOperation,
+        infoCount,
+        infos,
+        ranges
+    );
+}
+
+VkResult writeAccelerationStructuresPropertiesKHR(
+    Device *device,
+    uint32_t structureCount,
+    const VkAccelerationStructureKHR *structures,
+    VkQueryType queryType,
+    size_t dataSize,
+    void *data,
+    size_t stride
+) {
+    return VK_DEVICE_FUNC(vkWriteAccelerationStructuresPropertiesKHR, device->device)(
+        device->device,
+        structureCount,
+        structures,
+        queryType,
+        dataSize,
+        data,
+        stride
+    );
+}
 
+VkResult createRayTracingPipelineKHR(
+    Device *device,
+    VkDeferredOperationKHR deferredOperation,
+    VkRayTracingPipelineCreateInfoKHR *info,
+    VkPipeline *pipeline
+) {
     return VK_DEVICE_FUNC(vkCreateRayTracingPipelinesKHR, device->device)(
         device->device,
-        VK_NULL_HANDLE,
-        VK_NULL_HANDLE,
-        1, &info,
+        deferredOperation,
+        device->pipelineCache,
+        1, info,
         NULL,
         pipeline
     );
 }
 
+VkResult getRayTracingShaderGroupHandlesKHR(
+    Device *device,
+    VkPipeline pipeline,
+    uint32_t firstGroup,
+    uint32_t groupCount,
+    size_t dataSize,
+    void *data
+) {
+    return VK_DEVICE_FUNC(vkGetRayTracingShaderGroupHandlesKHR, device->device)(
+        device->device,
+        pipeline,
+        firstGroup,
+        groupCount,
+        dataSize,
+        data
+    );
+}
+
+VkDeviceSize getRayTracingShaderGroupStackSizeKHR(
+    Device *device,
+    VkPipeline pipeline,
+    uint32_t group,
+    VkShaderGroupShaderKHR groupShader
+) {
+    return VK_DEVICE_FUNC(vkGetRayTracingShaderGroupStackSizeKHR, device->device)(
+        device->device,
+        pipeline,
+        group,
+        groupShader
+    );
+}
+
+VkResult createDeferredOperationKHR(Device *device, VkDeferredOperationKHR *operation) {
+    return VK_DEVICE_FUNC(vkCreateDeferredOperationKHR, device->device)(device->device, NULL, operation);
+}
+
+void destroyDeferredOperationKHR(Device *device, VkDeferredOperationKHR operation) {
+    VK_DEVICE_FUNC(vkDestroyDeferredOperationKHR, device->device)(device->device, operation, NULL);
+}
+
+VkResult deferredOperationJoinKHR(Device *device, VkDeferredOperationKHR operation) {
+    return VK_DEVICE_FUNC(vkDeferredOperationJoinKHR, device->device)(device->device, operation);
+}
+
+VkResult getDeferredOperationResultKHR(Device *device, VkDeferredOperationKHR operation) {
+    return VK_DEVICE_FUNC(vkGetDeferredOperationResultKHR, device->device)(device->device, operation);
+}
+
+uint32_t getDeferredOperationMaxConcurrencyKHR(Device *device, VkDeferredOperationKHR operation) {
+    return VK_DEVICE_FUNC(vkGetDeferredOperationMaxConcurrencyKHR, device->device)(device->device, operation);
+}
+
+VkResult createImage(Device *device, VkImageCreateInfo *imageInfo, VkImage *image) {
+    return vkCreateImage(device->device, imageInfo, NULL, image);
+}
+
+void destroyImage(Device *device, VkImage image) {
+    vkDestroyImage(device->device, image, NULL);
+}
+
+VkResult createImageView(Device *device, VkImageViewCreateInfo *viewInfo, VkImageView *view) {
+    return vkCreateImageView(device->device, viewInfo, NULL, view);
+}
+
+void destroyImageView(Device *device, VkImageView view) {
+    vkDestroyImageView(device->device, view, NULL);
+}
+
 VkResult createBuffer(Device *device, VkBufferCreateInfo *bufferInfo, VkBuffer *buffer) {
     return vkCreateBuffer(device->device, bufferInfo, NULL, buffer);
 }
@@ -360,6 +602,89 @@ void cmdCopyBuffer(VkCommandBuffer buffer, VkBuffer src, VkBuffer dst, uint32_t
     vkCmdCopyBuffer(buffer, src, dst, regionCount, regions);
 }
 
+void cmdCopyImageToBuffer(
+    VkCommandBuffer buffer,
+    VkImage src, VkImageLayout srcLayout,
+    VkBuffer dst,
+    uint32_t regionCount, VkBufferImageCopy *regions
+) {
+    vkCmdCopyImageToBuffer(buffer, src, srcLayout, dst, regionCount, regions);
+}
+
+void cmdCopyBufferToImage(
+    VkCommandBuffer buffer,
+    VkBuffer src,
+    VkImage dst, VkImageLayout dstLayout,
+    uint32_t regionCount, VkBufferImageCopy *regions
+) {
+    vkCmdCopyBufferToImage(buffer, src, dst, dstLayout, regionCount, regions);
+}
+
+void cmdFillBuffer(VkCommandBuffer buffer, VkBuffer dst, VkDeviceSize offset, VkDeviceSize size, uint32_t data) {
+    vkCmdFillBuffer(buffer, dst, offset, size, data);
+}
+
+void cmdUpdateBuffer(VkCommandBuffer buffer, VkBuffer dst, VkDeviceSize offset, VkDeviceSize size, const void *data) {
+    vkCmdUpdateBuffer(buffer, dst, offset, size, data);
+}
+
+void cmdBlitImage(
+    VkCommandBuffer buffer,
+    VkImage src, VkImageLayout srcLayout,
+    VkImage dst, VkImageLayout dstLayout,
+    uint32_t regionCount, VkImageBlit *regions,
+    VkFilter filter
+) {
+    vkCmdBlitImage(buffer, src, srcLayout, dst, dstLayout, regionCount, regions, filter);
+}
+
+void cmdDispatch(VkCommandBuffer buffer, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) {
+    vkCmdDispatch(buffer, groupCountX, groupCountY, groupCountZ);
+}
+
+void cmdResetQueryPool(VkCommandBuffer buffer, VkQueryPool pool, uint32_t firstQuery, uint32_t queryCount) {
+    vkCmdResetQueryPool(buffer, pool, firstQuery, queryCount);
+}
+
+void cmdWriteTimestamp(VkCommandBuffer buffer, VkPipelineStageFlagBits stage, VkQueryPool pool, uint32_t query) {
+    vkCmdWriteTimestamp(buffer, stage, pool, query);
+}
+
+void cmdBindDescriptorSet(
+    VkCommandBuffer buffer,
+    VkPipelineBindPoint bindPoint,
+    VkPipelineLayout layout,
+    uint32_t set,
+    VkDescriptorSet descriptorSet
+) {
+    vkCmdBindDescriptorSets(buffer, bindPoint, layout, set, 1, &descriptorSet, 0, NULL);
+}
+
+void cmdPushConstants(
+    VkCommandBuffer buffer,
+    VkPipelineLayout layout,
+    VkShaderStageFlags stages,
+    uint32_t offset,
+    uint32_t size,
+    const void *values
+) {
+    vkCmdPushConstants(buffer, layout, stages, offset, size, values);
+}
+
+void cmdDrawIndexedIndirectCount(
+    VkCommandBuffer buffer,
+    VkBuffer drawBuffer, VkDeviceSize drawOffset,
+    VkBuffer countBuffer, VkDeviceSize countOffset,
+    uint32_t maxDrawCount, uint32_t stride
+) {
+    vkCmdDrawIndexedIndirectCount(
+        buffer,
+        drawBuffer, drawOffset,
+        countBuffer, countOffset,
+        maxDrawCount, stride
+    );
+}
+
 VkMemoryRequirements getBufferMemoryRequirements(Device *device, VkBuffer buffer) {
     VkMemoryRequirements reqs;
     vkGetBufferMemoryRequirements(device->device, buffer, &reqs);
@@ -372,6 +697,46 @@ VkPhysicalDeviceMemoryProperties getPhysicalDeviceMemoryProperties(Device *devic
     return props;
 }
 
+VkPhysicalDeviceProperties getPhysicalDeviceProperties(Device *device) {
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(device->physicalDevice, &props);
+    return props;
+}
+
+void getPhysicalDeviceProperties2(Device *device, VkPhysicalDeviceProperties2 *properties) {
+    vkGetPhysicalDeviceProperties2(device->physicalDevice, properties);
+}
+
+void getPhysicalDeviceFeatures2(Device *device, VkPhysicalDeviceFeatures2 *features) {
+    vkGetPhysicalDeviceFeatures2(device->physicalDevice, features);
+}
+
+VkQueueFamilyProperties getQueueFamilyProperties(Device *device, uint32_t familyIndex) {
+    uint32_t count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(device->physicalDevice, &count, NULL);
+
+    VkQueueFamilyProperties *properties = (VkQueueFamilyProperties*)calloc(count, sizeof(VkQueueFamilyProperties));
+    vkGetPhysicalDeviceQueueFamilyProperties(device->physicalDevice, &count, properties);
+
+    VkQueueFamilyProperties result = {0};
+    if(familyIndex < count) {
+        result = properties[familyIndex];
+    }
+    free(properties);
+
+    return result;
+}
+
+VkMemoryRequirements getImageMemoryRequirements(Device *device, VkImage image) {
+    VkMemoryRequirements reqs;
+    vkGetImageMemoryRequirements(device->device, image, &reqs);
+    return reqs;
+}
+
+VkResult bindImageMemory(Device *device, VkImage image, VkDeviceMemory memory, VkDeviceSize offset) {
+    return vkBindImageMemory(device->device, image, memory, offset);
+}
+
 VkResult bindBufferMemory(Device *device, VkBuffer buffer, VkDeviceMemory memory, VkDeviceSize offset) {
     return vkBindBufferMemory(device->device, buffer, memory, offset);
 }
@@ -404,6 +769,63 @@ void cmdEndRenderingKHR(Device *device, VkCommandBuffer buffer) {
     VK_DEVICE_FUNC(vkCmdEndRenderingKHR, device->device)(buffer);
 }
 
+void cmdPipelineBarrier2KHR(Device *device, VkCommandBuffer buffer, VkDependencyInfoKHR *info) {
+    VK_DEVICE_FUNC(vkCmdPipelineBarrier2KHR, device->device)(buffer, info);
+}
+
+void cmdBuildAccelerationStructuresKHR(
+    Device *device,
+    VkCommandBuffer buffer,
+    uint32_t infoCount,
+    const VkAccelerationStructureBuildGeometryInfoKHR *infos,
+    const VkAccelerationStructureBuildRangeInfoKHR *const *ranges
+) {
+    VK_DEVICE_FUNC(vkCmdBuildAccelerationStructuresKHR, device->device)(buffer, infoCount, infos, ranges);
+}
+
+void cmdWriteAccelerationStructuresPropertiesKHR(
+    Device *device,
+    VkCommandBuffer buffer,
+    uint32_t structureCount,
+    const VkAccelerationStructureKHR *structures,
+    VkQueryType queryType,
+    VkQueryPool pool,
+    uint32_t firstQuery
+) {
+    VK_DEVICE_FUNC(vkCmdWriteAccelerationStructuresPropertiesKHR, device->device)(
+        buffer,
+        structureCount,
+        structures,
+        queryType,
+        pool,
+        firstQuery
+    );
+}
+
+void cmdCopyAccelerationStructureKHR(Device *device, VkCommandBuffer buffer, VkCopyAccelerationStructureInfoKHR *info) {
+    VK_DEVICE_FUNC(vkCmdCopyAccelerationStructureKHR, device->device)(buffer, info);
+}
+
+void cmdSetRayTracingPipelineStackSizeKHR(Device *device, VkCommandBuffer buffer, uint32_t stackSize) {
+    VK_DEVICE_FUNC(vkCmdSetRayTracingPipelineStackSizeKHR, device->device)(buffer, stackSize);
+}
+
+void cmdTraceRaysKHR(
+    Device *device,
+    VkCommandBuffer buffer,
+    const VkStridedDeviceAddressRegionKHR *raygen,
+    const VkStridedDeviceAddressRegionKHR *miss,
+    const VkStridedDeviceAddressRegionKHR *hit,
+    const VkStridedDeviceAddressRegionKHR *callable,
+    uint32_t width, uint32_t height, uint32_t depth
+) {
+    VK_DEVICE_FUNC(vkCmdTraceRaysKHR, device->device)(
+        buffer,
+        raygen, miss, hit, callable,
+        width, height, depth
+    );
+}
+
 VkBool32 getQueueFamilies(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, QueueFamilyIndices *queueFamilies) {
     VkBool32 graphicsFound = VK_FALSE, presentFound = VK_FALSE;
     uint32_t graphics = UINT32_MAX, present = UINT32_MAX;
@@ -419,12 +841,20 @@ VkBool32 getQueueFamilies(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface,
             graphicsFound = VK_TRUE;
         }
 
-        vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentFound);
-
-        if(presentFound) {
-            present = i;
+        if(surface == VK_NULL_HANDLE) {
+            // Headless: nothing is presented, the graphics queue stands in
+            if(graphicsFound) {
+                present = graphics;
+                presentFound = VK_TRUE;
+            }
         } else {
-            printf("Queue doesn't support present\n");
+            vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentFound);
+
+            if(presentFound) {
+                present = i;
+            } else {
+                printf("Queue doesn't support present\n");
+            }
         }
 
         if(graphicsFound && presentFound) {
@@ -488,7 +918,7 @@ VkResult pickPhysicalDevice(VkInstance instance, VkSurfaceKHR surface, StringArr
         for(size_t j = 0; j < requiredExtensions.elementCount; j++) {
             VkBool32 found = VK_FALSE;
             for(uint32_t k = 0; k < extensionCount; k++) {
-                if(strcmp(requiredExtensions.elements[j], extensions[k].extensionName)) {
+                if(strcmp(requiredExtensions.elements[j], extensions[k].extensionName) == 0) {
                     found = VK_TRUE;
                     break;
                 }
@@ -524,13 +954,15 @@ VkResult pickPhysicalDevice(VkInstance instance, VkSurfaceKHR surface, StringArr
             break;
         }
 
-        SwapChainSupport support;
-        querySwapChainSupport(device, surface, &support);
+        if(surface != VK_NULL_HANDLE) {
+            SwapChainSupport support;
+            querySwapChainSupport(device, surface, &support);
 
-        deviceSuitable &= support.formatCount != 0 && support.presentModeCount != 0;
+            deviceSuitable &= support.formatCount != 0 && support.presentModeCount != 0;
 
-        free(support.presentModes);
-        free(support.formats);
+            free(support.presentModes);
+            free(support.formats);
+        }
 
         if(deviceSuitable) {
             if(highscore < score) {
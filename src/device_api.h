@@ -12,23 +12,46 @@ typedef struct {
     uint32_t present;
 } QueueFamilyIndices;
 
+// Optional features, set before createDevice for what was actually enabled
+typedef struct {
+    VkBool32 synchronization2;
+    // VK_KHR_present_id and VK_KHR_present_wait
+    VkBool32 presentWait;
+    // Acceleration structures, ray tracing pipelines and deferred host operations
+    VkBool32 rayTracing;
+    // VK_EXT_graphics_pipeline_library with VK_KHR_pipeline_library
+    VkBool32 graphicsPipelineLibrary;
+    // Acceleration structure builds and queries on the host, only enabled when asked for
+    VkBool32 accelerationStructureHostCommands;
+} EnabledFeatures;
+
 typedef struct {
     VkDevice device;
     VkPhysicalDevice physicalDevice;
     QueueFamilyIndices queueFamilies;
+    EnabledFeatures enabled;
+    // Used for every pipeline created through this device, may be VK_NULL_HANDLE
+    VkPipelineCache pipelineCache;
 } Device;
 
 typedef struct {
     uint32_t min, max;
 } UInt32Range;
 
-VkResult createDevice(
+// Chooses the physical device and its queue families. Without a surface (headless)
+// present support is not required and present uses the graphics queue.
+VkResult pickDevice(
     VkInstance instance,
     VkSurfaceKHR surface,
+    StringArray requiredExtensions,
+    Device *device
+);
+VkBool32 deviceExtensionSupported(Device *device, const char *extension);
+VkResult createDevice(
+    Device *device,
     VkPhysicalDeviceFeatures2 *features,
     StringArray layers,
-    StringArray extensions,
-    Device *device
+    StringArray extensions
 );
 void destroyDevice(Device *device);
 
@@ -44,17 +67,43 @@ VkResult createShaderModule(Device *device, const uint32_t *code, size_t codeSiz
 void destroyShaderModule(Device *device, VkShaderModule module);
 VkResult createPipelineLayout(Device *device, VkPipelineLayoutCreateInfo *info, VkPipelineLayout *layout);
 void destroyPipelineLayout(Device *device, VkPipelineLayout layout);
+VkResult createDescriptorSetLayout(Device *device, VkDescriptorSetLayoutCreateInfo *info, VkDescriptorSetLayout *layout);
+void destroyDescriptorSetLayout(Device *device, VkDescriptorSetLayout layout);
+VkResult createDescriptorPool(Device *device, VkDescriptorPoolCreateInfo *info, VkDescriptorPool *pool);
+void destroyDescriptorPool(Device *device, VkDescriptorPool pool);
+VkResult allocateDescriptorSet(Device *device, VkDescriptorPool pool, VkDescriptorSetLayout layout, VkDescriptorSet *set);
+void updateDescriptorSets(Device *device, uint32_t writeCount, const VkWriteDescriptorSet *writes);
 VkResult createRenderPass(Device *device, VkRenderPassCreateInfo *info, VkRenderPass *renderPass);
 void destroyRenderPass(Device *device, VkRenderPass renderPass);
 VkResult createGraphicsPipeline(Device *device, VkGraphicsPipelineCreateInfo *info, VkPipeline *pipeline);
+VkResult createComputePipeline(Device *device, VkComputePipelineCreateInfo *info, VkPipeline *pipeline);
 void destroyPipeline(Device *device, VkPipeline pipeline);
+VkResult createPipelineCache(Device *device, const void *initialData, size_t initialDataSize, VkPipelineCache *cache);
+void destroyPipelineCache(Device *device, VkPipelineCache cache);
+VkResult getPipelineCacheData(Device *device, VkPipelineCache cache, size_t *dataSize, void *data);
 VkResult createCommandPool(Device *device, uint32_t queueFamily, VkCommandPoolCreateFlags flags, VkCommandPool *commandPool);
 void destroyCommandPool(Device *device, VkCommandPool commandPool);
 VkResult createSemaphore(Device *device, VkSemaphore *semaphore);
 void destroySemaphore(Device *device, VkSemaphore semaphore);
 VkResult createFence(Device *device, VkBool32 signaled, VkFence *fence);
 void destroyFence(Device *device, VkFence fence);
+VkResult createTimelineSemaphore(Device *device, uint64_t initialValue, VkSemaphore *semaphore);
+VkResult waitSemaphore(Device *device, VkSemaphore semaphore, uint64_t value, uint64_t timeout);
+VkResult getSemaphoreCounterValue(Device *device, VkSemaphore semaphore, uint64_t *value);
+VkResult createQueryPool(Device *device, VkQueryType type, uint32_t queryCount, VkQueryPool *pool);
+void destroyQueryPool(Device *device, VkQueryPool pool);
+VkResult getQueryPoolResults(
+    Device *device,
+    VkQueryPool pool,
+    uint32_t firstQuery, uint32_t queryCount,
+    size_t dataSize, void *data,
+    VkDeviceSize stride, VkQueryResultFlags flags
+);
 
+VkResult createImage(Device *device, VkImageCreateInfo *imageInfo, VkImage *image);
+void destroyImage(Device *device, VkImage image);
+VkResult createImageView(Device *device, VkImageViewCreateInfo *viewInfo, VkImageView *view);
+void destroyImageView(Device *device, VkImageView view);
 VkResult createBuffer(Device *device, VkBufferCreateInfo *bufferInfo, VkBuffer *buffer);
 void destroyBuffer(Device *device, VkBuffer buffer);
 
@@ -84,9 +133,61 @@ void cmdDrawIndexed(VkCommandBuffer buffer, UInt32Range indexRange, UInt32Range
 void cmdBindVertexBuffers(VkCommandBuffer buffer, UInt32Range bindings, VkBuffer *vertexBuffers, VkDeviceSize *offsets);
 void cmdBindIndexBuffer(VkCommandBuffer buffer, VkBuffer indexBuffer, VkDeviceSize offset, VkIndexType indexType);
 void cmdCopyBuffer(VkCommandBuffer buffer, VkBuffer src, VkBuffer dst, uint32_t regionCount, VkBufferCopy *regions);
+void cmdCopyImageToBuffer(
+    VkCommandBuffer buffer,
+    VkImage src, VkImageLayout srcLayout,
+    VkBuffer dst,
+    uint32_t regionCount, VkBufferImageCopy *regions
+);
+void cmdCopyBufferToImage(
+    VkCommandBuffer buffer,
+    VkBuffer src,
+    VkImage dst, VkImageLayout dstLayout,
+    uint32_t regionCount, VkBufferImageCopy *regions
+);
+void cmdFillBuffer(VkCommandBuffer buffer, VkBuffer dst, VkDeviceSize offset, VkDeviceSize size, uint32_t data);
+// At most 65536 bytes, offset and size multiples of 4
+void cmdUpdateBuffer(VkCommandBuffer buffer, VkBuffer dst, VkDeviceSize offset, VkDeviceSize size, const void *data);
+void cmdBlitImage(
+    VkCommandBuffer buffer,
+    VkImage src, VkImageLayout srcLayout,
+    VkImage dst, VkImageLayout dstLayout,
+    uint32_t regionCount, VkImageBlit *regions,
+    VkFilter filter
+);
+void cmdDispatch(VkCommandBuffer buffer, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ);
+void cmdResetQueryPool(VkCommandBuffer buffer, VkQueryPool pool, uint32_t firstQuery, uint32_t queryCount);
+void cmdWriteTimestamp(VkCommandBuffer buffer, VkPipelineStageFlagBits stage, VkQueryPool pool, uint32_t query);
+void cmdBindDescriptorSet(
+    VkCommandBuffer buffer,
+    VkPipelineBindPoint bindPoint,
+    VkPipelineLayout layout,
+    uint32_t set,
+    VkDescriptorSet descriptorSet
+);
+void cmdPushConstants(
+    VkCommandBuffer buffer,
+    VkPipelineLayout layout,
+    VkShaderStageFlags stages,
+    uint32_t offset,
+    uint32_t size,
+    const void *values
+);
+void cmdDrawIndexedIndirectCount(
+    VkCommandBuffer buffer,
+    VkBuffer drawBuffer, VkDeviceSize drawOffset,
+    VkBuffer countBuffer, VkDeviceSize countOffset,
+    uint32_t maxDrawCount, uint32_t stride
+);
 
 VkMemoryRequirements getBufferMemoryRequirements(Device *device, VkBuffer buffer);
 VkPhysicalDeviceMemoryProperties getPhysicalDeviceMemoryProperties(Device *device);
+VkPhysicalDeviceProperties getPhysicalDeviceProperties(Device *device);
+void getPhysicalDeviceProperties2(Device *device, VkPhysicalDeviceProperties2 *properties);
+void getPhysicalDeviceFeatures2(Device *device, VkPhysicalDeviceFeatures2 *features);
+VkQueueFamilyProperties getQueueFamilyProperties(Device *device, uint32_t familyIndex);
+VkMemoryRequirements getImageMemoryRequirements(Device *device, VkImage image);
+VkResult bindImageMemory(Device *device, VkImage image, VkDeviceMemory memory, VkDeviceSize offset);
 VkResult bindBufferMemory(Device *device, VkBuffer buffer, VkDeviceMemory memory, VkDeviceSize offset);
 VkResult mapMemory(Device *device, VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize size, void **ptr);
 void unmapMemory(Device *device, VkDeviceMemory memory);
@@ -102,17 +203,88 @@ VkResult createAccelerationStructureKHR(
     VkAccelerationStructureKHR *accelerationStructure
 );
 void destroyAccelerationStructureKHR(Device *device, VkAccelerationStructureKHR structure);
+void getAccelerationStructureBuildSizesKHR(
+    Device *device,
+    VkAccelerationStructureBuildTypeKHR buildType,
+    VkAccelerationStructureBuildGeometryInfoKHR *buildInfo,
+    const uint32_t *maxPrimitiveCounts,
+    VkAccelerationStructureBuildSizesInfoKHR *sizes
+);
+VkDeviceAddress getAccelerationStructureDeviceAddressKHR(Device *device, VkAccelerationStructureKHR structure);
+// Host commands, pointers in infos and ranges must stay valid until a deferred operation has completed
+VkResult buildAccelerationStructuresKHR(
+    Device *device,
+    VkDeferredOperationKHR deferredOperation,
+    uint32_t infoCount,
+    const VkAccelerationStructureBuildGeometryInfoKHR *infos,
+    const VkAccelerationStructureBuildRangeInfoKHR *const *ranges
+);
+VkResult writeAccelerationStructuresPropertiesKHR(
+    Device *device,
+    uint32_t structureCount,
+    const VkAccelerationStructureKHR *structures,
+    VkQueryType queryType,
+    size_t dataSize,
+    void *data,
+    size_t stride
+);
+// Pointers in info must stay valid until a deferred operation has completed
 VkResult createRayTracingPipelineKHR(
     Device *device,
-    VkPipelineLayout layout,
-    VkPipelineDynamicStateCreateInfo *dynamicState,
-    VkRayTracingShaderGroupCreateInfoKHR *groupInfo,
-    PipelineStageArray stages,
+    VkDeferredOperationKHR deferredOperation,
+    VkRayTracingPipelineCreateInfoKHR *info,
     VkPipeline *pipeline
 );
+VkResult getRayTracingShaderGroupHandlesKHR(
+    Device *device,
+    VkPipeline pipeline,
+    uint32_t firstGroup,
+    uint32_t groupCount,
+    size_t dataSize,
+    void *data
+);
+VkDeviceSize getRayTracingShaderGroupStackSizeKHR(
+    Device *device,
+    VkPipeline pipeline,
+    uint32_t group,
+    VkShaderGroupShaderKHR groupShader
+);
+VkResult createDeferredOperationKHR(Device *device, VkDeferredOperationKHR *operation);
+void destroyDeferredOperationKHR(Device *device, VkDeferredOperationKHR operation);
+VkResult deferredOperationJoinKHR(Device *device, VkDeferredOperationKHR operation);
+VkResult getDeferredOperationResultKHR(Device *device, VkDeferredOperationKHR operation);
+uint32_t getDeferredOperationMaxConcurrencyKHR(Device *device, VkDeferredOperationKHR operation);
 
 void cmdBeginRenderingKHR(Device *device, VkCommandBuffer buffer, VkRenderingInfoKHR *info);
+void cmdPipelineBarrier2KHR(Device *device, VkCommandBuffer buffer, VkDependencyInfoKHR *info);
 void cmdEndRenderingKHR(Device *device, VkCommandBuffer buffer);
+void cmdBuildAccelerationStructuresKHR(
+    Device *device,
+    VkCommandBuffer buffer,
+    uint32_t infoCount,
+    const VkAccelerationStructureBuildGeometryInfoKHR *infos,
+    const VkAccelerationStructureBuildRangeInfoKHR *const *ranges
+);
+void cmdWriteAccelerationStructuresPropertiesKHR(
+    Device *device,
+    VkCommandBuffer buffer,
+    uint32_t structureCount,
+    const VkAccelerationStructureKHR *structures,
+    VkQueryType queryType,
+    VkQueryPool pool,
+    uint32_t firstQuery
+);
+void cmdCopyAccelerationStructureKHR(Device *device, VkCommandBuffer buffer, VkCopyAccelerationStructureInfoKHR *info);
+void cmdSetRayTracingPipelineStackSizeKHR(Device *device, VkCommandBuffer buffer, uint32_t stackSize);
+void cmdTraceRaysKHR(
+    Device *device,
+    VkCommandBuffer buffer,
+    const VkStridedDeviceAddressRegionKHR *raygen,
+    const VkStridedDeviceAddressRegionKHR *miss,
+    const VkStridedDeviceAddressRegionKHR *hit,
+    const VkStridedDeviceAddressRegionKHR *callable,
+    uint32_t width, uint32_t height, uint32_t depth
+);
 
 #pragma endregion
 
@@ -0,0 +1,154 @@
+#include "frame_pacer.h"
+#include "device_api.h"
+
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+#include <vulkan/vulkan_core.h>
+
+double framePacerNow(void);
+void readTimestamps(FramePacer *pacer, uint32_t slot);
+
+VkResult createFramePacer(Device *device, uint32_t queueFamily, uint32_t framesInFlight, FramePacer *pacer) {
+    assert(framesInFlight > 0 && framesInFlight <= FRAME_PACER_MAX_FRAMES);
+
+    memset(pacer, 0, sizeof(FramePacer));
+    pacer->device = device;
+    pacer->framesInFlight = framesInFlight;
+
+    VkResult result = createTimelineSemaphore(device, 0, &pacer->timeline);
+    if(result != VK_SUCCESS) {
+        return result;
+    }
+
+    VkPhysicalDeviceProperties properties = getPhysicalDeviceProperties(device);
+    uint32_t validBits = getQueueFamilyProperties(device, queueFamily).timestampValidBits;
+
+    // Timing is optional, pacing works without it
+    if(validBits == 0 || properties.limits.timestampPeriod == 0.0f) {
+        return VK_SUCCESS;
+    }
+
+    result = createQueryPool(device, VK_QUERY_TYPE_TIMESTAMP, 2 * framesInFlight, &pacer->timestamps);
+    if(result != VK_SUCCESS) {
+        destroySemaphore(device, pacer->timeline);
+        return result;
+    }
+
+    pacer->timestampPeriodMs = properties.limits.timestampPeriod / 1e6;
+    pacer->timestampMask = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+
+    return VK_SUCCESS;
+}
+
+void destroyFramePacer(FramePacer *pacer) {
+    if(pacer->timestamps != VK_NULL_HANDLE) {
+        destroyQueryPool(pacer->device, pacer->timestamps);
+    }
+    destroySemaphore(pacer->device, pacer->timeline);
+}
+
+uint32_t framePacerBeginFrame(FramePacer *pacer) {
+    uint32_t slot = (uint32_t)(pacer->frame % pacer->framesInFlight);
+
+    double start = framePacerNow();
+    if(pacer->frame >= pacer->framesInFlight) {
+        uint64_t value = pacer->frame + 1 - pacer->framesInFlight;
+        assert(waitSemaphore(pacer->device, pacer->timeline, value, UINT64_MAX) == VK_SUCCESS);
+    }
+    pacer->stats.cpuWaitMs = (framePacerNow() - start) * 1e3;
+
+    readTimestamps(pacer, slot);
+
+    return slot;
+}
+
+void framePacerCmdBegin(FramePacer *pacer, VkCommandBuffer cmdBuffer) {
+    if(pacer->timestamps == VK_NULL_HANDLE) {
+        return;
+    }
+
+    uint32_t slot = (uint32_t)(pacer->frame % pacer->framesInFlight);
+    cmdResetQueryPool(cmdBuffer, pacer->timestamps, 2 * slot, 2);
+    cmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, pacer->timestamps, 2 * slot);
+}
+
+void framePacerCmdEnd(FramePacer *pacer, VkCommandBuffer cmdBuffer) {
+    if(pacer->timestamps == VK_NULL_HANDLE) {
+        return;
+    }
+
+    uint32_t slot = (uint32_t)(pacer->frame % pacer->framesInFlight);
+    cmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, pacer->timestamps, 2 * slot + 1);
+}
+
+uint64_t framePacerSignalValue(FramePacer *pacer) {
+    return pacer->frame + 1;
+}
+
+void framePacerEndFrame(FramePacer *pacer) {
+    if(pacer->timestamps != VK_NULL_HANDLE) {
+        pacer->timestampsWritten[pacer->frame % pacer->framesInFlight] = VK_TRUE;
+    }
+    pacer->frame++;
+}
+
+uint64_t framePacerSubmittedValue(FramePacer *pacer) {
+    return pacer->frame;
+}
+
+uint64_t framePacerCompletedValue(FramePacer *pacer) {
+    uint64_t value = 0;
+    assert(getSemaphoreCounterValue(pacer->device, pacer->timeline, &value) == VK_SUCCESS);
+    return value;
+}
+
+VkResult framePacerWaitIdle(FramePacer *pacer) {
+    return waitSemaphore(pacer->device, pacer->timeline, pacer->frame, UINT64_MAX);
+}
+
+FramePacerStats framePacerStats(FramePacer *pacer) {
+    return pacer->stats;
+}
+
+double framePacerNow(void) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+// The slot's previous frame is known to be finished here, so results are available
+void readTimestamps(FramePacer *pacer, uint32_t slot) {
+    if(!pacer->timestampsWritten[slot]) {
+        return;
+    }
+    pacer->timestampsWritten[slot] = VK_FALSE;
+
+    uint64_t values[2];
+    VkResult result = getQueryPoolResults(
+        pacer->device,
+        pacer->timestamps,
+        2 * slot, 2,
+        sizeof(values), values,
+        sizeof(uint64_t), VK_QUERY_RESULT_64_BIT
+    );
+    if(result != VK_SUCCESS) {
+        return;
+    }
+
+    uint64_t begin = values[0] & pacer->timestampMask;
+    uint64_t end = values[1] & pacer->timestampMask;
+
+    pacer->stats.frame = pacer->frame - pacer->framesInFlight;
+    pacer->stats.gpuFrameMs = (double)((end - begin) & pacer->timestampMask) * pacer->timestampPeriodMs;
+    pacer->stats.gpuWaitMs = 0.0;
+    // Frames complete in order, so the last read frame is the one right before
+    if(pacer->lastGpuEnd != 0) {
+        uint64_t gap = (begin - pacer->lastGpuEnd) & pacer->timestampMask;
+        // A frame that started before the previous one ended left the GPU busy
+        if(gap < (pacer->timestampMask >> 1)) {
+            pacer->stats.gpuWaitMs = (double)gap * pacer->timestampPeriodMs;
+        }
+    }
+    pacer->lastGpuEnd = end;
+}
@@ -0,0 +1,62 @@
+#ifndef FRAME_PACER_H_
+#define FRAME_PACER_H_
+
+#include <vulkan/vulkan.h>
+
+#include "device_api.h"
+
+#define FRAME_PACER_MAX_FRAMES 4
+
+typedef struct {
+    // Frame the numbers below belong to
+    uint64_t frame;
+    // Time the CPU blocked before it could start recording the frame
+    double cpuWaitMs;
+    // GPU time between the first and last command of the frame
+    double gpuFrameMs;
+    // GPU idle time between the end of the previous frame and the start of this one
+    double gpuWaitMs;
+} FramePacerStats;
+
+// Paces frames on a single timeline semaphore, frame n signals n + 1 when done.
+// Recording frame n waits for frame n - framesInFlight to finish on the GPU.
+typedef struct {
+    Device *device;
+    uint32_t framesInFlight;
+
+    VkSemaphore timeline;
+    uint64_t frame;
+
+    // Two timestamps per slot, VK_NULL_HANDLE if the queue can't write them
+    VkQueryPool timestamps;
+    VkBool32 timestampsWritten[FRAME_PACER_MAX_FRAMES];
+    double timestampPeriodMs;
+    uint64_t timestampMask;
+    uint64_t lastGpuEnd;
+
+    FramePacerStats stats;
+} FramePacer;
+
+VkResult createFramePacer(Device *device, uint32_t queueFamily, uint32_t framesInFlight, FramePacer *pacer);
+void destroyFramePacer(FramePacer *pacer);
+
+// Blocks until the next frame's slot is free and returns the slot index
+uint32_t framePacerBeginFrame(FramePacer *pacer);
+// Record at the very start and end of the frame's command buffer
+void framePacerCmdBegin(FramePacer *pacer, VkCommandBuffer cmdBuffer);
+void framePacerCmdEnd(FramePacer *pacer, VkCommandBuffer cmdBuffer);
+// Value the frame's submission has to signal on pacer->timeline
+uint64_t framePacerSignalValue(FramePacer *pacer);
+// Called once the frame was submitted, frames that were never submitted are reused
+void framePacerEndFrame(FramePacer *pacer);
+// Last value signaled by a submitted frame, objects used up to now are free after it
+uint64_t framePacerSubmittedValue(FramePacer *pacer);
+// Highest value the GPU has signaled so far
+uint64_t framePacerCompletedValue(FramePacer *pacer);
+// Waits for every submitted frame
+VkResult framePacerWaitIdle(FramePacer *pacer);
+
+// GPU numbers lag framesInFlight frames behind, they are read once the frame finished
+FramePacerStats framePacerStats(FramePacer *pacer);
+
+#endif
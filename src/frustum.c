@@ -0,0 +1,64 @@
+#include "frustum.h"
+#include "mesh.h"
+
+#include <math.h>
+
+Vector4f matrixRow(Matrix4f *matrix, int row);
+Vector4f normalizePlane(Vector4f plane);
+
+Frustum frustumFromMatrix(Matrix4f viewProjection) {
+    Vector4f r0 = matrixRow(&viewProjection, 0);
+    Vector4f r1 = matrixRow(&viewProjection, 1);
+    Vector4f r2 = matrixRow(&viewProjection, 2);
+    Vector4f r3 = matrixRow(&viewProjection, 3);
+
+    Frustum frustum = {
+        .planes = {
+            // left, right
+            {r3.x + r0.x, r3.y + r0.y, r3.z + r0.z, r3.w + r0.w},
+            {r3.x - r0.x, r3.y - r0.y, r3.z - r0.z, r3.w - r0.w},
+            // bottom, top
+            {r3.x + r1.x, r3.y + r1.y, r3.z + r1.z, r3.w + r1.w},
+            {r3.x - r1.x, r3.y - r1.y, r3.z - r1.z, r3.w - r1.w},
+            // near (z >= 0), far
+            {r2.x, r2.y, r2.z, r2.w},
+            {r3.x - r2.x, r3.y - r2.y, r3.z - r2.z, r3.w - r2.w},
+        },
+    };
+
+    for(int i = 0; i < FRUSTUM_PLANE_COUNT; i++) {
+        frustum.planes[i] = normalizePlane(frustum.planes[i]);
+    }
+
+    return frustum;
+}
+
+VkBool32 frustumTestSphere(const Frustum *frustum, Vector3f center, float radius) {
+    for(int i = 0; i < FRUSTUM_PLANE_COUNT; i++) {
+        const Vector4f *plane = &frustum->planes[i];
+        float distance = plane->x * center.x + plane->y * center.y + plane->z * center.z + plane->w;
+        if(distance < -radius) {
+            return VK_FALSE;
+        }
+    }
+
+    return VK_TRUE;
+}
+
+Vector4f matrixRow(Matrix4f *matrix, int row) {
+    const float *c0 = &matrix->columns[0].x;
+    const float *c1 = &matrix->columns[1].x;
+    const float *c2 = &matrix->columns[2].x;
+    const float *c3 = &matrix->columns[3].x;
+
+    return (Vector4f){c0[row], c1[row], c2[row], c3[row]};
+}
+
+Vector4f normalizePlane(Vector4f plane) {
+    float length = sqrtf(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+    if(length == 0.0f) {
+        return plane;
+    }
+
+    return (Vector4f){plane.x / length, plane.y / length, plane.z / length, plane.w / length};
+}
@@ -0,0 +1,17 @@
+#ifndef FRUSTUM_H_
+#define FRUSTUM_H_
+
+#include "mesh.h"
+
+#define FRUSTUM_PLANE_COUNT 6
+
+// Planes as (normal, distance), normals point inside and are normalized
+typedef struct {
+    Vector4f planes[FRUSTUM_PLANE_COUNT];
+} Frustum;
+
+// Extracts planes from a view-projection matrix using Vulkan clip space (z in [0, 1])
+Frustum frustumFromMatrix(Matrix4f viewProjection);
+VkBool32 frustumTestSphere(const Frustum *frustum, Vector3f center, float radius);
+
+#endif
@@ -0,0 +1,319 @@
+#include "gpu_scene.h"
+#include "device_api.h"
+#include "frustum.h"
+#include "vkalloc.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vulkan/vk_enum_string_helper.h>
+#include <vulkan/vulkan_core.h>
+
+VkResult createSceneBuffer(
+    VkAlloc *alloc,
+    VkDeviceSize size,
+    VkBufferUsageFlags usage,
+    VkMemoryPropertyFlags memoryFlags,
+    Buffer *buffer
+);
+VkResult createCullPipeline(GpuScene *scene, const uint32_t *code, size_t codeSize);
+
+VkResult createGpuScene(
+    Device *device,
+    VkAlloc *alloc,
+    const uint32_t *cullShaderCode,
+    size_t cullShaderSize,
+    uint32_t maxObjects,
+    GpuScene *scene
+) {
+    VkResult result;
+
+    *scene = (GpuScene){
+        .device = device,
+        .allocator = alloc,
+        .objectCapacity = maxObjects,
+    };
+
+    result = createCullPipeline(scene, cullShaderCode, cullShaderSize);
+    if(result != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create culling pipeline: %s.\n", string_VkResult(result));
+        return result;
+    }
+
+    result = createSceneBuffer(
+        alloc,
+        maxObjects * sizeof(GpuObject),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &scene->objectBuffer
+    );
+    if(result != VK_SUCCESS) return result;
+
+    result = createSceneBuffer(
+        alloc,
+        maxObjects * sizeof(InstanceData),
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &scene->instanceBuffer
+    );
+    if(result != VK_SUCCESS) return result;
+
+    result = createSceneBuffer(
+        alloc,
+        maxObjects * sizeof(VkDrawIndexedIndirectCommand),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        &scene->drawBuffer
+    );
+    if(result != VK_SUCCESS) return result;
+
+    result = createSceneBuffer(
+        alloc,
+        GPU_SCENE_MAX_BUCKETS * sizeof(uint32_t),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        &scene->countBuffer
+    );
+    if(result != VK_SUCCESS) return result;
+
+    scene->objects = (GpuObject*)mapBufferMemory(alloc, &scene->objectBuffer);
+    scene->instances = (InstanceData*)mapBufferMemory(alloc, &scene->instanceBuffer);
+    if(scene->objects == NULL || scene->instances == NULL) {
+        return VK_ERROR_MEMORY_MAP_FAILED;
+    }
+
+    return VK_SUCCESS;
+}
+
+void destroyGpuScene(GpuScene *scene) {
+    unmapBufferMemory(scene->allocator, &scene->objectBuffer);
+    unmapBufferMemory(scene->allocator, &scene->instanceBuffer);
+
+    destroyDeallocateBuffer(scene->allocator, &scene->objectBuffer);
+    destroyDeallocateBuffer(scene->allocator, &scene->instanceBuffer);
+    destroyDeallocateBuffer(scene->allocator, &scene->drawBuffer);
+    destroyDeallocateBuffer(scene->allocator, &scene->countBuffer);
+
+    destroyPipeline(scene->device, scene->cullPipeline);
+    destroyPipelineLayout(scene->device, scene->cullLayout);
+}
+
+uint32_t gpuSceneAddBucket(GpuScene *scene, VkPipeline pipeline, Mesh *mesh) {
+    for(uint32_t i = 0; i < scene->bucketCount; i++) {
+        if(scene->buckets[i].pipeline == pipeline && scene->buckets[i].mesh == mesh) {
+            return i;
+        }
+    }
+
+    assert(scene->bucketCount < GPU_SCENE_MAX_BUCKETS);
+
+    scene->buckets[scene->bucketCount] = (GpuBucket){
+        .pipeline = pipeline,
+        .mesh = mesh,
+    };
+
+    return scene->bucketCount++;
+}
+
+void gpuSceneReplacePipeline(GpuScene *scene, VkPipeline oldPipeline, VkPipeline newPipeline) {
+    for(uint32_t i = 0; i < scene->bucketCount; i++) {
+        if(scene->buckets[i].pipeline == oldPipeline) {
+            scene->buckets[i].pipeline = newPipeline;
+        }
+    }
+}
+
+uint32_t gpuSceneAddObject(GpuScene *scene, uint32_t bucket, Vector4f sphere, Matrix4f transform) {
+    assert(bucket < scene->bucketCount);
+    assert(scene->objectCount < scene->objectCapacity);
+
+    uint32_t index = scene->objectCount++;
+    Mesh *mesh = scene->buckets[bucket].mesh;
+
+    scene->objects[index] = (GpuObject){
+        .sphere = sphere,
+        .bucket = bucket,
+        .indexCount = mesh->indexCount,
+        .firstIndex = 0,
+        .vertexOffset = 0,
+    };
+    scene->instances[index].transform = transform;
+
+    scene->buckets[bucket].objectCount++;
+
+    return index;
+}
+
+void gpuSceneCommit(GpuScene *scene) {
+    // Every bucket gets a contiguous slot range large enough for all of its objects
+    uint32_t slot = 0;
+    for(uint32_t i = 0; i < scene->bucketCount; i++) {
+        scene->buckets[i].firstSlot = slot;
+        slot += scene->buckets[i].objectCount;
+    }
+
+    for(uint32_t i = 0; i < scene->objectCount; i++) {
+        scene->objects[i].slotBase = scene->buckets[scene->objects[i].bucket].firstSlot;
+    }
+}
+
+void gpuSceneCull(GpuScene *scene, VkCommandBuffer cmdBuffer, const Frustum *frustum) {
+    if(scene->objectCount == 0) {
+        return;
+    }
+
+    cmdFillBuffer(cmdBuffer, scene->countBuffer.buffer, 0, scene->countBuffer.memorySize, 0);
+
+    VkMemoryBarrier fillBarrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+    };
+    cmdPipelineBarrier(
+        cmdBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 1, &fillBarrier, 0, NULL, 0, NULL
+    );
+
+    CullPushConstants constants = {
+        .objects = getBufferAddress(scene->device, &scene->objectBuffer),
+        .draws = getBufferAddress(scene->device, &scene->drawBuffer),
+        .counts = getBufferAddress(scene->device, &scene->countBuffer),
+        .objectCount = scene->objectCount,
+    };
+    memcpy(constants.planes, frustum->planes, sizeof(constants.planes));
+
+    cmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, scene->cullPipeline);
+    cmdPushConstants(
+        cmdBuffer,
+        scene->cullLayout,
+        VK_SHADER_STAGE_COMPUTE_BIT,
+        0, sizeof(CullPushConstants),
+        &constants
+    );
+    cmdDispatch(
+        cmdBuffer,
+        (scene->objectCount + scene->cullGroupSize - 1) / scene->cullGroupSize,
+        1, 1
+    );
+}
+
+void gpuSceneDraw(GpuScene *scene, VkCommandBuffer cmdBuffer) {
+    VkPipeline boundPipeline = VK_NULL_HANDLE;
+
+    VkBuffer instanceBuffers[] = {scene->instanceBuffer.buffer};
+    VkDeviceSize instanceOffsets[] = {0};
+    cmdBindVertexBuffers(
+        cmdBuffer,
+        (UInt32Range){VERTEX_BINDING_INSTANCE, VERTEX_BINDING_INSTANCE + 1},
+        instanceBuffers,
+        instanceOffsets
+    );
+
+    for(uint32_t i = 0; i < scene->bucketCount; i++) {
+        GpuBucket *bucket = &scene->buckets[i];
+        if(bucket->objectCount == 0) continue;
+
+        if(bucket->pipeline != boundPipeline) {
+            cmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, bucket->pipeline);
+            boundPipeline = bucket->pipeline;
+        }
+
+        VkBuffer vertexBuffers[] = {bucket->mesh->vertexBuffer.buffer};
+        VkDeviceSize offsets[] = {0};
+        cmdBindVertexBuffers(
+            cmdBuffer,
+            (UInt32Range){VERTEX_BINDING_VERTEX, VERTEX_BINDING_VERTEX + 1},
+            vertexBuffers,
+            offsets
+        );
+        cmdBindIndexBuffer(cmdBuffer, bucket->mesh->indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+        cmdDrawIndexedIndirectCount(
+            cmdBuffer,
+            scene->drawBuffer.buffer, bucket->firstSlot * sizeof(VkDrawIndexedIndirectCommand),
+            scene->countBuffer.buffer, i * sizeof(uint32_t),
+            bucket->objectCount, sizeof(VkDrawIndexedIndirectCommand)
+        );
+    }
+}
+
+VkResult createSceneBuffer(
+    VkAlloc *alloc,
+    VkDeviceSize size,
+    VkBufferUsageFlags usage,
+    VkMemoryPropertyFlags memoryFlags,
+    Buffer *buffer
+) {
+    VkBufferCreateInfo bufferInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pQueueFamilyIndices = &alloc->device->queueFamilies.graphics,
+        .queueFamilyIndexCount = 1,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .size = size,
+        .usage = usage,
+    };
+
+    return createAllocateBuffer(alloc, &bufferInfo, memoryFlags, buffer);
+}
+
+VkResult createCullPipeline(GpuScene *scene, const uint32_t *code, size_t codeSize) {
+    VkResult result;
+
+    VkPushConstantRange pushConstantRange = {
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = sizeof(CullPushConstants),
+    };
+
+    VkPipelineLayoutCreateInfo layoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 0,
+        .pPushConstantRanges = &pushConstantRange,
+        .pushConstantRangeCount = 1,
+    };
+
+    result = createPipelineLayout(scene->device, &layoutInfo, &scene->cullLayout);
+    if(result != VK_SUCCESS) return result;
+
+    VkShaderModule module;
+    result = createShaderModule(scene->device, code, codeSize, &module);
+    if(result != VK_SUCCESS) return result;
+
+    // Clamped to what the device runs in one workgroup
+    VkPhysicalDeviceProperties props = getPhysicalDeviceProperties(scene->device);
+    scene->cullGroupSize = GPU_SCENE_CULL_GROUP_SIZE;
+    if(scene->cullGroupSize > props.limits.maxComputeWorkGroupSize[0]) {
+        scene->cullGroupSize = props.limits.maxComputeWorkGroupSize[0];
+    }
+    if(scene->cullGroupSize > props.limits.maxComputeWorkGroupInvocations) {
+        scene->cullGroupSize = props.limits.maxComputeWorkGroupInvocations;
+    }
+
+    ShaderVariant variant = {0};
+    shaderVariantSet(&variant, CULL_CONSTANT_GROUP_SIZE, scene->cullGroupSize);
+    ShaderSpecialization specialization;
+
+    VkComputePipelineCreateInfo pipelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = module,
+            .pName = "main",
+            .pSpecializationInfo = shaderVariantInfo(&variant, &specialization),
+        },
+        .layout = scene->cullLayout,
+        .basePipelineHandle = VK_NULL_HANDLE,
+        .basePipelineIndex = -1,
+    };
+
+    result = createComputePipeline(scene->device, &pipelineInfo, &scene->cullPipeline);
+    destroyShaderModule(scene->device, module);
+
+    return result;
+}
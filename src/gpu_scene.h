@@ -0,0 +1,95 @@
+#ifndef GPU_SCENE_H_
+#define GPU_SCENE_H_
+
+#include <vulkan/vulkan.h>
+
+#include "device_api.h"
+#include "frustum.h"
+#include "mesh.h"
+#include "shader_variant.h"
+#include "vkalloc.h"
+
+#define GPU_SCENE_MAX_BUCKETS 256
+#define GPU_SCENE_CULL_GROUP_SIZE 64
+
+// Specialization constant ids in cull.comp
+#define CULL_CONSTANT_GROUP_SIZE 0
+
+// std430 layout, mirrors ObjectData in cull.comp
+typedef struct {
+    Vector4f sphere;
+    uint32_t bucket;
+    uint32_t slotBase;
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    uint32_t pad[3];
+} GpuObject;
+
+// Mirrors CullConstants in cull.comp
+typedef struct {
+    Vector4f planes[FRUSTUM_PLANE_COUNT];
+    VkDeviceAddress objects;
+    VkDeviceAddress draws;
+    VkDeviceAddress counts;
+    uint32_t objectCount;
+} CullPushConstants;
+
+// Objects drawn with the same pipeline and mesh, issued as one indirect count draw
+typedef struct {
+    VkPipeline pipeline;
+    Mesh *mesh;
+    uint32_t objectCount;
+    uint32_t firstSlot;
+} GpuBucket;
+
+typedef struct {
+    Device *device;
+    VkAlloc *allocator;
+
+    VkPipelineLayout cullLayout;
+    VkPipeline cullPipeline;
+    // Workgroup size the culling shader was specialized for
+    uint32_t cullGroupSize;
+
+    // Host visible, written at load time and read by the culling shader
+    Buffer objectBuffer;
+    GpuObject *objects;
+    // Per object transforms, bound as the instance vertex buffer
+    Buffer instanceBuffer;
+    InstanceData *instances;
+    // Written by the culling shader
+    Buffer drawBuffer;
+    Buffer countBuffer;
+
+    uint32_t objectCount;
+    uint32_t objectCapacity;
+
+    GpuBucket buckets[GPU_SCENE_MAX_BUCKETS];
+    uint32_t bucketCount;
+} GpuScene;
+
+VkResult createGpuScene(
+    Device *device,
+    VkAlloc *alloc,
+    const uint32_t *cullShaderCode,
+    size_t cullShaderSize,
+    uint32_t maxObjects,
+    GpuScene *scene
+);
+void destroyGpuScene(GpuScene *scene);
+
+// Scene edits are only valid while the GPU is not using the scene, followed by gpuSceneCommit
+uint32_t gpuSceneAddBucket(GpuScene *scene, VkPipeline pipeline, Mesh *mesh);
+// Points every bucket drawn with oldPipeline at newPipeline, takes effect with the next recording
+void gpuSceneReplacePipeline(GpuScene *scene, VkPipeline oldPipeline, VkPipeline newPipeline);
+uint32_t gpuSceneAddObject(GpuScene *scene, uint32_t bucket, Vector4f sphere, Matrix4f transform);
+void gpuSceneCommit(GpuScene *scene);
+
+// Records the count clear and culling dispatch, must be outside of rendering.
+// Barriers against the draws reading drawBuffer and countBuffer are left to the caller.
+void gpuSceneCull(GpuScene *scene, VkCommandBuffer cmdBuffer, const Frustum *frustum);
+// Records one indirect count draw per bucket, must be inside rendering
+void gpuSceneDraw(GpuScene *scene, VkCommandBuffer cmdBuffer);
+
+#endif
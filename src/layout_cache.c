@@ -0,0 +1,217 @@
+#include "layout_cache.h"
+#include "device_api.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+
+VkResult mergeReflection(LayoutKey *key, const ShaderReflection *reflection);
+VkBool32 layoutKeyEqual(const LayoutKey *a, const LayoutKey *b);
+VkResult createCachedLayout(Device *device, CachedLayout *cached);
+void destroyCachedLayout(Device *device, CachedLayout *cached);
+
+void createLayoutCache(Device *device, LayoutCache *cache) {
+    memset(cache, 0, sizeof(LayoutCache));
+    cache->device = device;
+}
+
+void destroyLayoutCache(LayoutCache *cache) {
+    for(uint32_t i = 0; i < cache->layoutCount; i++) {
+        destroyCachedLayout(cache->device, &cache->layouts[i]);
+    }
+}
+
+VkResult layoutCacheGet(
+    LayoutCache *cache,
+    const ShaderReflection *const *reflections,
+    uint32_t reflectionCount,
+    VkPipelineLayout *layout
+) {
+    VkResult result;
+    cache->stats.requests++;
+
+    LayoutKey key = {0};
+    for(uint32_t i = 0; i < reflectionCount; i++) {
+        result = mergeReflection(&key, reflections[i]);
+        if(result != VK_SUCCESS) {
+            return result;
+        }
+    }
+
+    for(uint32_t i = 0; i < cache->layoutCount; i++) {
+        if(layoutKeyEqual(&cache->layouts[i].key, &key)) {
+            cache->stats.hits++;
+            *layout = cache->layouts[i].layout;
+            return VK_SUCCESS;
+        }
+    }
+
+    if(cache->layoutCount == LAYOUT_CACHE_MAX_LAYOUTS) {
+        return VK_ERROR_TOO_MANY_OBJECTS;
+    }
+
+    CachedLayout *cached = &cache->layouts[cache->layoutCount];
+    cached->key = key;
+    result = createCachedLayout(cache->device, cached);
+    if(result != VK_SUCCESS) {
+        return result;
+    }
+
+    cache->layoutCount++;
+    cache->stats.layouts++;
+    *layout = cached->layout;
+
+    return VK_SUCCESS;
+}
+
+VkDescriptorSetLayout layoutCacheSetLayout(LayoutCache *cache, VkPipelineLayout layout, uint32_t set) {
+    for(uint32_t i = 0; i < cache->layoutCount; i++) {
+        CachedLayout *cached = &cache->layouts[i];
+        if(cached->layout == layout) {
+            return set < cached->setCount ? cached->setLayouts[set] : VK_NULL_HANDLE;
+        }
+    }
+    return VK_NULL_HANDLE;
+}
+
+LayoutCacheStats layoutCacheStats(LayoutCache *cache) {
+    return cache->stats;
+}
+
+// Adds a stage's bindings to key, keeping it sorted
+VkResult mergeReflection(LayoutKey *key, const ShaderReflection *reflection) {
+    for(uint32_t i = 0; i < reflection->bindingCount; i++) {
+        const ReflectedBinding *binding = &reflection->bindings[i];
+        if(binding->set >= LAYOUT_CACHE_MAX_SETS) {
+            fprintf(stderr, "Descriptor set %u is above the limit of %u.\n", binding->set, LAYOUT_CACHE_MAX_SETS);
+            return VK_ERROR_TOO_MANY_OBJECTS;
+        }
+
+        uint32_t j = 0;
+        while(j < key->bindingCount &&
+            (key->bindings[j].set < binding->set ||
+            (key->bindings[j].set == binding->set && key->bindings[j].binding < binding->binding)))
+        {
+            j++;
+        }
+
+        LayoutBinding *existing = &key->bindings[j];
+        if(j < key->bindingCount && existing->set == binding->set && existing->binding == binding->binding) {
+            if(existing->type != binding->type || existing->count != binding->count) {
+                fprintf(stderr, "Shader stages disagree about set %u binding %u.\n", binding->set, binding->binding);
+                return VK_ERROR_INITIALIZATION_FAILED;
+            }
+            existing->stages |= reflection->stage;
+            continue;
+        }
+
+        if(key->bindingCount == LAYOUT_CACHE_MAX_BINDINGS) {
+            return VK_ERROR_TOO_MANY_OBJECTS;
+        }
+        memmove(&key->bindings[j + 1], &key->bindings[j], (key->bindingCount - j) * sizeof(LayoutBinding));
+        key->bindings[j] = (LayoutBinding){
+            .set = binding->set,
+            .binding = binding->binding,
+            .type = binding->type,
+            .count = binding->count,
+            .stages = reflection->stage,
+        };
+        key->bindingCount++;
+    }
+
+    if(reflection->pushConstantSize > 0) {
+        if(reflection->pushConstantSize > key->pushConstantSize) {
+            key->pushConstantSize = reflection->pushConstantSize;
+        }
+        key->pushConstantStages |= reflection->stage;
+    }
+
+    return VK_SUCCESS;
+}
+
+VkBool32 layoutKeyEqual(const LayoutKey *a, const LayoutKey *b) {
+    if(a->bindingCount != b->bindingCount ||
+        a->pushConstantSize != b->pushConstantSize ||
+        a->pushConstantStages != b->pushConstantStages)
+    {
+        return VK_FALSE;
+    }
+
+    for(uint32_t i = 0; i < a->bindingCount; i++) {
+        const LayoutBinding *x = &a->bindings[i], *y = &b->bindings[i];
+        if(x->set != y->set || x->binding != y->binding || x->type != y->type ||
+            x->count != y->count || x->stages != y->stages)
+        {
+            return VK_FALSE;
+        }
+    }
+
+    return VK_TRUE;
+}
+
+// Sets below the highest one in use get empty layouts, set indices have to be contiguous
+VkResult createCachedLayout(Device *device, CachedLayout *cached) {
+    VkResult result;
+    const LayoutKey *key = &cached->key;
+
+    cached->setCount = key->bindingCount > 0 ? key->bindings[key->bindingCount - 1].set + 1 : 0;
+    uint32_t first = 0;
+    for(uint32_t set = 0; set < cached->setCount; set++) {
+        VkDescriptorSetLayoutBinding bindings[LAYOUT_CACHE_MAX_BINDINGS];
+        uint32_t bindingCount = 0;
+        for(; first < key->bindingCount && key->bindings[first].set == set; first++) {
+            const LayoutBinding *binding = &key->bindings[first];
+            bindings[bindingCount++] = (VkDescriptorSetLayoutBinding){
+                .binding = binding->binding,
+                .descriptorType = binding->type,
+                .descriptorCount = binding->count,
+                .stageFlags = binding->stages,
+                .pImmutableSamplers = NULL,
+            };
+        }
+
+        VkDescriptorSetLayoutCreateInfo setInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+            .bindingCount = bindingCount,
+            .pBindings = bindings,
+        };
+        result = createDescriptorSetLayout(device, &setInfo, &cached->setLayouts[set]);
+        if(result != VK_SUCCESS) {
+            for(uint32_t i = 0; i < set; i++) {
+                destroyDescriptorSetLayout(device, cached->setLayouts[i]);
+            }
+            return result;
+        }
+    }
+
+    VkPushConstantRange pushConstantRange = {
+        .stageFlags = key->pushConstantStages,
+        .offset = 0,
+        .size = key->pushConstantSize,
+    };
+
+    VkPipelineLayoutCreateInfo layoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = cached->setCount,
+        .pSetLayouts = cached->setLayouts,
+        .pushConstantRangeCount = key->pushConstantSize > 0 ? 1 : 0,
+        .pPushConstantRanges = &pushConstantRange,
+    };
+
+    result = createPipelineLayout(device, &layoutInfo, &cached->layout);
+    if(result != VK_SUCCESS) {
+        for(uint32_t i = 0; i < cached->setCount; i++) {
+            destroyDescriptorSetLayout(device, cached->setLayouts[i]);
+        }
+    }
+
+    return result;
+}
+
+void destroyCachedLayout(Device *device, CachedLayout *cached) {
+    destroyPipelineLayout(device, cached->layout);
+    for(uint32_t i = 0; i < cached->setCount; i++) {
+        destroyDescriptorSetLayout(device, cached->setLayouts[i]);
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef LAYOUT_CACHE_H_
+#define LAYOUT_CACHE_H_
+
+#include <vulkan/vulkan.h>
+
+#include "device_api.h"
+#include "spirv_reflect.h"
+
+#define LAYOUT_CACHE_MAX_LAYOUTS 32
+#define LAYOUT_CACHE_MAX_SETS 4
+#define LAYOUT_CACHE_MAX_BINDINGS 32
+
+typedef struct {
+    uint32_t set;
+    uint32_t binding;
+    VkDescriptorType type;
+    uint32_t count;
+    VkShaderStageFlags stages;
+} LayoutBinding;
+
+// Merged interface of the stages sharing a pipeline layout, sorted by set and binding
+// so stages with equal interfaces end up with the same key
+typedef struct {
+    LayoutBinding bindings[LAYOUT_CACHE_MAX_BINDINGS];
+    uint32_t bindingCount;
+    // One range from offset 0, visible to every stage that declares a block
+    uint32_t pushConstantSize;
+    VkShaderStageFlags pushConstantStages;
+} LayoutKey;
+
+typedef struct {
+    LayoutKey key;
+    VkDescriptorSetLayout setLayouts[LAYOUT_CACHE_MAX_SETS];
+    uint32_t setCount;
+    VkPipelineLayout layout;
+} CachedLayout;
+
+typedef struct {
+    uint32_t requests;
+    // Requests answered with an existing layout
+    uint32_t hits;
+    uint32_t layouts;
+} LayoutCacheStats;
+
+// Pipeline layouts derived from shader reflection, shared by every pipeline with the same interface
+typedef struct {
+    Device *device;
+    CachedLayout layouts[LAYOUT_CACHE_MAX_LAYOUTS];
+    uint32_t layoutCount;
+    LayoutCacheStats stats;
+} LayoutCache;
+
+void createLayoutCache(Device *device, LayoutCache *cache);
+// Destroys every layout handed out
+void destroyLayoutCache(LayoutCache *cache);
+
+// The layout covering every stage in reflections, owned by the cache. Fails when two stages
+// disagree about a binding. Not thread safe.
+VkResult layoutCacheGet(
+    LayoutCache *cache,
+    const ShaderReflection *const *reflections,
+    uint32_t reflectionCount,
+    VkPipelineLayout *layout
+);
+// Layout of set in a pipeline layout handed out by the cache, VK_NULL_HANDLE for others
+VkDescriptorSetLayout layoutCacheSetLayout(LayoutCache *cache, VkPipelineLayout layout, uint32_t set);
+LayoutCacheStats layoutCacheStats(LayoutCache *cache);
+
+#endif
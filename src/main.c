@@ -1,15 +1,30 @@
 #include "app.h"
+#include "bench.h"
+#include "frame_pacer.h"
 #include "window.h"
 
 #include <GLFW/glfw3.h>
 #include <vulkan/vulkan_core.h>
 #include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <vulkan/vk_enum_string_helper.h>
 
+// Frames between two frame stat reports
+#define FRAME_STATS_INTERVAL 120
+#define HEADLESS_DEFAULT_FRAMES 300
+#define HEADLESS_WIDTH 1280
+#define HEADLESS_HEIGHT 720
+
 static Window window;
 static VulkanState *state;
+static VkBool32 printFrameStats = VK_FALSE;
+static uint64_t frameCount = 0;
 
 void drawFrame(void);
+int runHeadless(const AppConfig *config, uint32_t frames);
 void onResize(GLFWwindow *w, int width, int height);
 void onKeyEvent(GLFWwindow *w, int key, int scancode, int action, int mode);
 
@@ -22,6 +37,14 @@ void drawFrame(void) {
     recordCommandBuffer(state, imageIndex);
 
     renderAndPresent(state, &window, imageIndex);
+
+    if(printFrameStats && ++frameCount % FRAME_STATS_INTERVAL == 0) {
+        FramePacerStats stats = getFrameStats(state);
+        printf(
+            "frame %llu: cpu wait %.3f ms, gpu frame %.3f ms, gpu wait %.3f ms\n",
+            (unsigned long long)stats.frame, stats.cpuWaitMs, stats.gpuFrameMs, stats.gpuWaitMs
+        );
+    }
 }
 
 void onResize(GLFWwindow *w, int width, int height) {
@@ -38,16 +61,92 @@ void onKeyEvent(GLFWwindow *w, int key, int scancode, int action, int mode) {
     
     if(key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
         glfwSetWindowShouldClose(w, GLFW_TRUE);
+    } else if(key == GLFW_KEY_G && action == GLFW_PRESS) {
+        toggleGpuDriven(state);
+    } else if(key == GLFW_KEY_R && action == GLFW_PRESS) {
+        toggleRayTraced(state);
     }
 }
 
-int main(void) {
-    window = createWindow();
+int main(int argc, char **argv) {
+    if(argc > 1 && strcmp(argv[1], "--bench-cull") == 0) {
+        uint32_t objectCount = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : 1000000;
+        return benchCulling(objectCount);
+    }
+    if(argc > 1 && strcmp(argv[1], "--bench-bvh") == 0) {
+        uint32_t triangleCount = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : 1000000;
+        return benchBvh(triangleCount);
+    }
+
+    AppConfig config = {
 #ifndef RELEASE
-    state = initVulkanState(&window, VK_TRUE);
+        .debugging = VK_TRUE,
 #else
-    state = initVulkanState(&window, VK_FALSE);
+        .debugging = VK_FALSE,
 #endif
+        .framesInFlight = APP_DEFAULT_FRAMES_IN_FLIGHT,
+        .presentPolicy = PRESENT_POLICY_LATENCY_FIRST,
+        .headless = VK_FALSE,
+        .headlessExtent = {HEADLESS_WIDTH, HEADLESS_HEIGHT},
+        .capturePath = NULL,
+        .captureFormat = READBACK_FORMAT_PPM,
+        .pipelineCachePath = APP_DEFAULT_PIPELINE_CACHE,
+        .workerThreads = 0,
+        .shaderSourceDir = NULL,
+        .rayTraced = VK_FALSE,
+        .hostBlasBuilds = VK_FALSE,
+    };
+    uint32_t headlessFrames = HEADLESS_DEFAULT_FRAMES;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc) {
+            config.framesInFlight = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--present-policy") == 0 && i + 1 < argc) {
+            const char *policy = argv[++i];
+            if(strcmp(policy, "latency") == 0) {
+                config.presentPolicy = PRESENT_POLICY_LATENCY_FIRST;
+            } else if(strcmp(policy, "power") == 0) {
+                config.presentPolicy = PRESENT_POLICY_POWER_FIRST;
+            } else if(strcmp(policy, "throughput") == 0) {
+                config.presentPolicy = PRESENT_POLICY_THROUGHPUT_FIRST;
+            } else {
+                fprintf(stderr, "Unknown present policy: %s.\n", policy);
+                return 1;
+            }
+        } else if(strcmp(argv[i], "--frame-stats") == 0) {
+            printFrameStats = VK_TRUE;
+        } else if(strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            config.capturePath = argv[++i];
+        } else if(strcmp(argv[i], "--capture-raw") == 0) {
+            config.captureFormat = READBACK_FORMAT_RAW;
+        } else if(strcmp(argv[i], "--pipeline-cache") == 0 && i + 1 < argc) {
+            config.pipelineCachePath = argv[++i];
+        } else if(strcmp(argv[i], "--no-pipeline-cache") == 0) {
+            config.pipelineCachePath = NULL;
+        } else if(strcmp(argv[i], "--worker-threads") == 0 && i + 1 < argc) {
+            config.workerThreads = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--watch-shaders") == 0 && i + 1 < argc) {
+            config.shaderSourceDir = argv[++i];
+        } else if(strcmp(argv[i], "--ray-trace") == 0) {
+            config.rayTraced = VK_TRUE;
+        } else if(strcmp(argv[i], "--host-blas") == 0) {
+            config.hostBlasBuilds = VK_TRUE;
+        } else if(strcmp(argv[i], "--headless") == 0) {
+            config.headless = VK_TRUE;
+        } else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            headlessFrames = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "Unknown argument: %s.\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if(config.headless) {
+        return runHeadless(&config, headlessFrames);
+    }
+
+    window = createWindow();
+    state = initVulkanState(&window, &config);
 
     glfwSetWindowSizeCallback(window.window, onResize);
     glfwSetKeyCallback(window.window, onKeyEvent);
@@ -65,4 +164,66 @@ int main(void) {
     return 0;
 }
 
+// Renders a fixed number of frames without GLFW and reports the average frame time
+int runHeadless(const AppConfig *config, uint32_t frames) {
+    state = initVulkanState(NULL, config);
+
+    struct timespec start, end;
+    timespec_get(&start, TIME_UTC);
+
+    for(uint32_t i = 0; i < frames; i++) {
+        drawFrame();
+    }
+    finishFrames(state);
+
+    timespec_get(&end, TIME_UTC);
+
+    PipelineRegistryStats pipelines = getPipelineStats(state);
+    printf(
+        "%u pipelines for %u requests, %u shared\n",
+        pipelines.pipelines, pipelines.requests, pipelines.hits
+    );
+    LayoutCacheStats layouts = getLayoutStats(state);
+    printf("%u pipeline layouts for %u requests\n", layouts.layouts, layouts.requests);
+    if(pipelines.libraries > 0) {
+        printf(
+            "%u pipeline libraries, %u reused, %u pipelines optimized\n",
+            pipelines.libraries, pipelines.libraryHits, pipelines.promoted
+        );
+    }
+
+    RenderQueueStats queue = getRenderQueueStats(state);
+    if(queue.items > 0) {
+        printf(
+            "%u render items in %u draws, %u pipeline, %u vertex and %u index binds, %u binds saved\n",
+            queue.items, queue.drawCalls, queue.pipelineBinds, queue.vertexBufferBinds,
+            queue.indexBufferBinds, queue.stateChangesSaved
+        );
+    }
+
+    TlasStats tlas = getTlasStats(state);
+    if(tlas.rebuilds > 0) {
+        printf(
+            "TLAS rebuilt %u times, refitted %u times, %u instances written\n",
+            tlas.rebuilds, tlas.refits, tlas.instancesWritten
+        );
+    }
 
+    if(config->capturePath != NULL) {
+        ReadbackStats capture = getCaptureStats(state);
+        printf(
+            "captured %llu frames, dropped %llu\n",
+            (unsigned long long)capture.captured, (unsigned long long)capture.dropped
+        );
+    }
+
+    destroyVulkanState(state);
+
+    double elapsedMs = (double)(end.tv_sec - start.tv_sec) * 1e3 + (double)(end.tv_nsec - start.tv_nsec) * 1e-6;
+    printf(
+        "%u headless frames in %.3f ms, %.3f ms per frame\n",
+        frames, elapsedMs, frames > 0 ? elapsedMs / frames : 0.0
+    );
+
+    return 0;
+}
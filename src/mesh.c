@@ -7,26 +7,82 @@ VertexInputDescription vertexDescription(void) {
     VertexInputDescription desc = {
         .attributes = {
             (VkVertexInputAttributeDescription){
-                .binding = 0,
+                .binding = VERTEX_BINDING_VERTEX,
                 .location = 0,
                 .format = VK_FORMAT_R32G32B32_SFLOAT,
                 .offset = offsetof(Vertex, position),
             },
             (VkVertexInputAttributeDescription){
-                .binding = 0,
+                .binding = VERTEX_BINDING_VERTEX,
                 .location = 1,
                 .format = VK_FORMAT_R32G32B32_SFLOAT,
                 .offset = offsetof(Vertex, color),
             },
+            // mat4 takes one location per column
+            (VkVertexInputAttributeDescription){
+                .binding = VERTEX_BINDING_INSTANCE,
+                .location = 2,
+                .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+                .offset = offsetof(InstanceData, transform) + 0 * sizeof(Vector4f),
+            },
+            (VkVertexInputAttributeDescription){
+                .binding = VERTEX_BINDING_INSTANCE,
+                .location = 3,
+                .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+                .offset = offsetof(InstanceData, transform) + 1 * sizeof(Vector4f),
+            },
+            (VkVertexInputAttributeDescription){
+                .binding = VERTEX_BINDING_INSTANCE,
+                .location = 4,
+                .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+                .offset = offsetof(InstanceData, transform) + 2 * sizeof(Vector4f),
+            },
+            (VkVertexInputAttributeDescription){
+                .binding = VERTEX_BINDING_INSTANCE,
+                .location = 5,
+                .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+                .offset = offsetof(InstanceData, transform) + 3 * sizeof(Vector4f),
+            },
         },
         .bindings = {
             (VkVertexInputBindingDescription){
-                .binding = 0,
+                .binding = VERTEX_BINDING_VERTEX,
                 .stride = sizeof(Vertex),
                 .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
             },
+            (VkVertexInputBindingDescription){
+                .binding = VERTEX_BINDING_INSTANCE,
+                .stride = sizeof(InstanceData),
+                .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE,
+            },
         }
     };
 
     return desc;
 }
+
+Matrix4f matrix4fIdentity(void) {
+    Matrix4f matrix = {
+        .columns = {
+            {1.0f, 0.0f, 0.0f, 0.0f},
+            {0.0f, 1.0f, 0.0f, 0.0f},
+            {0.0f, 0.0f, 1.0f, 0.0f},
+            {0.0f, 0.0f, 0.0f, 1.0f},
+        },
+    };
+
+    return matrix;
+}
+
+Matrix4f matrix4fTranslateScale(Vector3f translation, float scale) {
+    Matrix4f matrix = {
+        .columns = {
+            {scale, 0.0f, 0.0f, 0.0f},
+            {0.0f, scale, 0.0f, 0.0f},
+            {0.0f, 0.0f, scale, 0.0f},
+            {translation.x, translation.y, translation.z, 1.0f},
+        },
+    };
+
+    return matrix;
+}
@@ -18,22 +18,38 @@ typedef struct {
     float x, y, z, w;
 } Vector4f;
 
+// Column-major, matches GLSL mat4 layout
+typedef struct {
+    Vector4f columns[4];
+} Matrix4f;
+
 typedef struct {
     Vector3f position;
     Vector3f color;
 } Vertex;
 
+// Per-instance data, bound at VERTEX_BINDING_INSTANCE
+typedef struct {
+    Matrix4f transform;
+} InstanceData;
+
+#define VERTEX_BINDING_VERTEX 0
+#define VERTEX_BINDING_INSTANCE 1
+
 typedef struct {
-    VkVertexInputAttributeDescription attributes[2];
-    VkVertexInputBindingDescription bindings[1];
+    VkVertexInputAttributeDescription attributes[6];
+    VkVertexInputBindingDescription bindings[2];
 } VertexInputDescription;
 
 typedef struct {
     Buffer vertexBuffer;
     Buffer indexBuffer;
+    uint32_t vertexCount;
     uint32_t indexCount;
 } Mesh;
 
 VertexInputDescription vertexDescription(void);
+Matrix4f matrix4fIdentity(void);
+Matrix4f matrix4fTranslateScale(Vector3f translation, float scale);
 
 #endif
@@ -0,0 +1,155 @@
+// fsync and fileno
+#define _POSIX_C_SOURCE 200809L
+
+#include "pipeline_cache.h"
+#include "device_api.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vulkan/vulkan_core.h>
+
+// headerSize, headerVersion, vendorID, deviceID, then the UUID
+#define PIPELINE_CACHE_HEADER_SIZE (4 * sizeof(uint32_t) + VK_UUID_SIZE)
+#define PIPELINE_CACHE_PATH_MAX 4096
+
+void *readCacheFile(const char *path, size_t *size);
+VkBool32 validateCacheHeader(Device *device, const uint8_t *data, size_t size);
+
+VkResult loadPipelineCache(Device *device, const char *path, PipelineCacheStats *stats) {
+    memset(stats, 0, sizeof(PipelineCacheStats));
+
+    size_t size = 0;
+    void *data = readCacheFile(path, &size);
+    if(data != NULL && !validateCacheHeader(device, data, size)) {
+        free(data);
+        data = NULL;
+        size = 0;
+    }
+
+    VkResult result = createPipelineCache(device, data, size, &device->pipelineCache);
+    if(result != VK_SUCCESS && data != NULL) {
+        // Header checks passed but the driver still refused the blob, start cold
+        result = createPipelineCache(device, NULL, 0, &device->pipelineCache);
+        size = 0;
+    }
+    free(data);
+
+    if(result != VK_SUCCESS) {
+        device->pipelineCache = VK_NULL_HANDLE;
+        return result;
+    }
+
+    stats->loadedSize = size;
+
+    return VK_SUCCESS;
+}
+
+VkResult savePipelineCache(Device *device, const char *path, PipelineCacheStats *stats) {
+    if(device->pipelineCache == VK_NULL_HANDLE) {
+        return VK_SUCCESS;
+    }
+
+    size_t size = 0;
+    VkResult result = getPipelineCacheData(device, device->pipelineCache, &size, NULL);
+    if(result != VK_SUCCESS) {
+        return result;
+    }
+
+    void *data = malloc(size);
+    if(data == NULL) {
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+    // The cache may have grown in between, VK_INCOMPLETE still gives a valid prefix
+    result = getPipelineCacheData(device, device->pipelineCache, &size, data);
+    if(result != VK_SUCCESS && result != VK_INCOMPLETE) {
+        free(data);
+        return result;
+    }
+
+    char tmpPath[PIPELINE_CACHE_PATH_MAX];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+
+    FILE *file = fopen(tmpPath, "wb");
+    if(file == NULL) {
+        fprintf(stderr, "Failed to open pipeline cache %s for writing.\n", tmpPath);
+        free(data);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    VkBool32 written = fwrite(data, 1, size, file) == size;
+    written = written && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    fclose(file);
+    free(data);
+
+    if(!written || rename(tmpPath, path) != 0) {
+        fprintf(stderr, "Failed to write pipeline cache %s.\n", path);
+        remove(tmpPath);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    stats->savedSize = size;
+
+    return VK_SUCCESS;
+}
+
+void unloadPipelineCache(Device *device) {
+    if(device->pipelineCache != VK_NULL_HANDLE) {
+        destroyPipelineCache(device, device->pipelineCache);
+        device->pipelineCache = VK_NULL_HANDLE;
+    }
+}
+
+// Returns NULL when the file does not exist, cannot be read or does not fit in memory
+void *readCacheFile(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    if(file == NULL) {
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if(length <= 0) {
+        fclose(file);
+        return NULL;
+    }
+
+    void *data = malloc((size_t)length);
+    if(data == NULL) {
+        fclose(file);
+        return NULL;
+    }
+    if(fread(data, 1, (size_t)length, file) != (size_t)length) {
+        free(data);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+
+    *size = (size_t)length;
+    return data;
+}
+
+// Drivers are supposed to reject foreign data themselves, not all of them do
+VkBool32 validateCacheHeader(Device *device, const uint8_t *data, size_t size) {
+    if(size < PIPELINE_CACHE_HEADER_SIZE) {
+        return VK_FALSE;
+    }
+
+    uint32_t header[4];
+    memcpy(header, data, sizeof(header));
+    uint32_t headerSize = header[0], headerVersion = header[1];
+    uint32_t vendorID = header[2], deviceID = header[3];
+
+    VkPhysicalDeviceProperties properties = getPhysicalDeviceProperties(device);
+
+    return headerSize >= PIPELINE_CACHE_HEADER_SIZE
+        && headerSize <= size
+        && headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+        && vendorID == properties.vendorID
+        && deviceID == properties.deviceID
+        && memcmp(data + 4 * sizeof(uint32_t), properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
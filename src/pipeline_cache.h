@@ -0,0 +1,22 @@
+#ifndef PIPELINE_CACHE_H_
+#define PIPELINE_CACHE_H_
+
+#include <vulkan/vulkan.h>
+
+#include "device_api.h"
+
+typedef struct {
+    // Bytes accepted from the cache file, 0 on a cold start
+    size_t loadedSize;
+    size_t savedSize;
+} PipelineCacheStats;
+
+// Creates device->pipelineCache, seeded from path when the file was written for the
+// same vendor, device and driver (pipelineCacheUUID). Any other file is ignored.
+VkResult loadPipelineCache(Device *device, const char *path, PipelineCacheStats *stats);
+// Writes the cache to a temporary file and renames it over path,
+// an interrupted save leaves the previous file intact
+VkResult savePipelineCache(Device *device, const char *path, PipelineCacheStats *stats);
+void unloadPipelineCache(Device *device);
+
+#endif
@@ -0,0 +1,853 @@
+#include "pipeline_registry.h"
+#include "deletion_queue.h"
+#include "device_api.h"
+#include "pipeline_service.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vulkan/vk_enum_string_helper.h>
+#include <vulkan/vulkan_core.h>
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+#define PART_BIT(P) (1u << (P))
+#define ALL_PARTS (PART_BIT(REGISTRY_PART_COUNT) - 1)
+
+// Everything a graphics pipeline create info points at, so one fill covers
+// monolithic pipelines and every library part
+typedef struct {
+    VkPipelineShaderStageCreateInfo stages[2];
+    ShaderSpecialization specializations[2];
+    VkDynamicState dynamicStates[2];
+    VkPipelineDynamicStateCreateInfo dynamicState;
+    VkPipelineVertexInputStateCreateInfo vertexInput;
+    VkPipelineInputAssemblyStateCreateInfo assembly;
+    VkPipelineViewportStateCreateInfo viewport;
+    VkPipelineRasterizationStateCreateInfo rasterization;
+    VkPipelineMultisampleStateCreateInfo multisample;
+    VkPipelineDepthStencilStateCreateInfo depthStencil;
+    VkPipelineColorBlendAttachmentState blendAttachment;
+    VkPipelineColorBlendStateCreateInfo colorBlend;
+    VkPipelineRenderingCreateInfoKHR rendering;
+    VkGraphicsPipelineLibraryCreateInfoEXT library;
+    VkGraphicsPipelineCreateInfo info;
+} GraphicsPipelineState;
+
+static const VkGraphicsPipelineLibraryFlagsEXT partFlags[REGISTRY_PART_COUNT] = {
+    VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+    VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+    VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+    VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT,
+};
+
+static const char *partNames[REGISTRY_PART_COUNT] = {
+    "vertex input",
+    "pre-rasterization",
+    "fragment shader",
+    "fragment output",
+};
+
+RegistryShader *findShader(PipelineRegistry *registry, const char *name);
+VkBool32 vertexInputMatches(const VertexInputDescription *vertexInput, const ShaderReflection *reflection, const char *name);
+VkBool32 shaderInterfaceMatches(const ShaderReflection *current, const ShaderReflection *reloaded, const char *name);
+RegistryLibrary *requestLibrary(
+    PipelineRegistry *registry,
+    RegistryPart part,
+    const GraphicsPipelineDesc *desc,
+    VkShaderModule module
+);
+uint64_t hashDescParts(const GraphicsPipelineDesc *desc, uint32_t parts);
+VkBool32 descPartsEqual(const GraphicsPipelineDesc *a, const GraphicsPipelineDesc *b, uint32_t parts);
+void fillGraphicsState(
+    GraphicsPipelineState *state,
+    const GraphicsPipelineDesc *desc,
+    uint32_t parts,
+    VkShaderModule vertexModule,
+    VkShaderModule fragmentModule
+);
+VkResult buildRegistryPipeline(PipelineService *service, void *userData, VkPipeline *pipeline);
+VkResult buildRegistryLibrary(PipelineService *service, void *userData, VkPipeline *pipeline);
+VkResult buildFastLinkedPipeline(PipelineService *service, void *userData, VkPipeline *pipeline);
+VkResult buildOptimizedPipeline(PipelineService *service, void *userData, VkPipeline *pipeline);
+VkResult linkRegistryPipeline(RegistryPipeline *entry, VkPipelineCreateFlags flags, VkPipeline *pipeline);
+void retirePipeline(DeletionQueue *queue, uint64_t retireValue, VkPipeline pipeline);
+void destroyRetiredPipeline(Device *device, void *userData);
+uint64_t hashBytes(uint64_t hash, const void *data, size_t size);
+uint64_t hashString(uint64_t hash, const char *string);
+
+void createPipelineRegistry(
+    Device *device,
+    PipelineService *service,
+    LayoutCache *layouts,
+    PipelineRegistry *registry
+) {
+    memset(registry, 0, sizeof(PipelineRegistry));
+    registry->device = device;
+    registry->service = service;
+    registry->layouts = layouts;
+    registry->useLibraries = device->enabled.graphicsPipelineLibrary;
+}
+
+void destroyPipelineRegistry(PipelineRegistry *registry) {
+    pipelineServiceWaitIdle(registry->service);
+
+    for(uint32_t i = 0; i < registry->pipelineCount; i++) {
+        RegistryPipeline *entry = &registry->pipelines[i];
+        if(entry->pipeline.pipeline != VK_NULL_HANDLE) {
+            destroyPipeline(registry->device, entry->pipeline.pipeline);
+        }
+        if(entry->optimized.pipeline != VK_NULL_HANDLE) {
+            destroyPipeline(registry->device, entry->optimized.pipeline);
+        }
+    }
+    for(uint32_t i = 0; i < registry->libraryCount; i++) {
+        if(registry->libraries[i].library.pipeline != VK_NULL_HANDLE) {
+            destroyPipeline(registry->device, registry->libraries[i].library.pipeline);
+        }
+    }
+    for(uint32_t i = 0; i < registry->shaderCount; i++) {
+        destroyShaderModule(registry->device, registry->shaders[i].module);
+        free(registry->shaders[i].ownedCode);
+    }
+}
+
+VkResult pipelineRegistryAddShader(
+    PipelineRegistry *registry,
+    const char *name,
+    VkShaderStageFlagBits stage,
+    const uint32_t *code,
+    size_t codeSize
+) {
+    assert(findShader(registry, name) == NULL);
+    if(registry->shaderCount == PIPELINE_REGISTRY_MAX_SHADERS) {
+        return VK_ERROR_TOO_MANY_OBJECTS;
+    }
+
+    RegistryShader *shader = &registry->shaders[registry->shaderCount];
+    VkResult result = reflectShader(code, codeSize, &shader->reflection);
+    if(result != VK_SUCCESS) {
+        fprintf(stderr, "Failed to reflect shader %s.\n", name);
+        return result;
+    }
+    if(shader->reflection.stage != stage) {
+        fprintf(stderr, "Shader %s is not a %s shader.\n", name, string_VkShaderStageFlagBits(stage));
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    result = createShaderModule(registry->device, code, codeSize, &shader->module);
+    if(result != VK_SUCCESS) {
+        return result;
+    }
+
+    shader->name = name;
+    shader->stage = stage;
+    shader->code = code;
+    shader->codeSize = codeSize;
+    registry->shaderCount++;
+    registry->stats.shaderModules++;
+
+    return VK_SUCCESS;
+}
+
+uint32_t pipelineRegistryRequest(PipelineRegistry *registry, const GraphicsPipelineDesc *desc) {
+    registry->stats.requests++;
+
+    RegistryShader *vertex = findShader(registry, desc->vertexShader);
+    RegistryShader *fragment = findShader(registry, desc->fragmentShader);
+    if(vertex == NULL || fragment == NULL) {
+        fprintf(stderr, "Pipeline requested with unknown shaders %s, %s.\n", desc->vertexShader, desc->fragmentShader);
+        return PIPELINE_REGISTRY_INVALID;
+    }
+
+    // Resolved before hashing, a derived layout matches the same layout passed explicitly
+    GraphicsPipelineDesc resolved = *desc;
+    if(resolved.layout == VK_NULL_HANDLE) {
+        const ShaderReflection *reflections[] = {&vertex->reflection, &fragment->reflection};
+        VkResult result = layoutCacheGet(registry->layouts, reflections, 2, &resolved.layout);
+        if(result != VK_SUCCESS) {
+            fprintf(stderr, "Failed to derive pipeline layout for %s, %s: %s.\n",
+                desc->vertexShader, desc->fragmentShader, string_VkResult(result));
+            return PIPELINE_REGISTRY_INVALID;
+        }
+    }
+
+    uint64_t hash = hashGraphicsPipelineDesc(&resolved);
+    for(uint32_t i = 0; i < registry->pipelineCount; i++) {
+        RegistryPipeline *entry = &registry->pipelines[i];
+        if(entry->hash == hash && descPartsEqual(&entry->desc, &resolved, ALL_PARTS)) {
+            registry->stats.hits++;
+            return i;
+        }
+    }
+
+    if(!vertexInputMatches(&resolved.vertexInput, &vertex->reflection, vertex->name)) {
+        return PIPELINE_REGISTRY_INVALID;
+    }
+    if(registry->pipelineCount == PIPELINE_REGISTRY_MAX_PIPELINES) {
+        return PIPELINE_REGISTRY_INVALID;
+    }
+
+    uint32_t id = registry->pipelineCount++;
+    RegistryPipeline *entry = &registry->pipelines[id];
+    entry->hash = hash;
+    entry->desc = resolved;
+    // The registry's copies of the names outlive the caller's
+    entry->desc.vertexShader = vertex->name;
+    entry->desc.fragmentShader = fragment->name;
+    entry->vertexModule = vertex->module;
+    entry->fragmentModule = fragment->module;
+    entry->device = registry->device;
+    registry->stats.pipelines++;
+
+    if(!registry->useLibraries) {
+        pipelineServiceSubmit(registry->service, vertex->name, buildRegistryPipeline, entry, &entry->pipeline);
+        return id;
+    }
+
+    for(uint32_t part = 0; part < REGISTRY_PART_COUNT; part++) {
+        VkShaderModule module = VK_NULL_HANDLE;
+        if(part == REGISTRY_PART_PRE_RASTERIZATION) {
+            module = vertex->module;
+        } else if(part == REGISTRY_PART_FRAGMENT_SHADER) {
+            module = fragment->module;
+        }
+        entry->libraries[part] = requestLibrary(registry, (RegistryPart)part, &entry->desc, module);
+    }
+
+    // The pool runs jobs in order, so both links start after the library builds they wait on
+    pipelineServiceSubmit(registry->service, vertex->name, buildFastLinkedPipeline, entry, &entry->pipeline);
+    pipelineServiceSubmit(registry->service, vertex->name, buildOptimizedPipeline, entry, &entry->optimized);
+
+    return id;
+}
+
+VkPipeline pipelineRegistryPipeline(PipelineRegistry *registry, uint32_t id) {
+    assert(id < registry->pipelineCount);
+
+    RegistryPipeline *entry = &registry->pipelines[id];
+    if(entry->promoted) {
+        return entry->optimized.pipeline;
+    }
+    return asyncPipelineReady(&entry->pipeline) ? entry->pipeline.pipeline : VK_NULL_HANDLE;
+}
+
+VkResult pipelineRegistryWait(PipelineRegistry *registry, uint32_t id) {
+    assert(id < registry->pipelineCount);
+
+    RegistryPipeline *entry = &registry->pipelines[id];
+    return entry->promoted ? VK_SUCCESS : asyncPipelineWait(&entry->pipeline);
+}
+
+uint32_t pipelineRegistryPromote(
+    PipelineRegistry *registry,
+    DeletionQueue *queue,
+    uint64_t retireValue,
+    PipelineSwapCallback onSwap,
+    void *userData
+) {
+    uint32_t promoted = 0;
+
+    for(uint32_t i = 0; i < registry->pipelineCount; i++) {
+        RegistryPipeline *entry = &registry->pipelines[i];
+        if(entry->libraries[0] == NULL || entry->promoted || !asyncPipelineReady(&entry->optimized)) {
+            continue;
+        }
+
+        // The fast link was queued first and waits on the same libraries, it's done by now.
+        // It failing is fine, the optimized pipeline simply becomes the first one.
+        asyncPipelineWait(&entry->pipeline);
+        VkPipeline old = entry->pipeline.pipeline;
+        entry->pipeline.pipeline = VK_NULL_HANDLE;
+        entry->promoted = VK_TRUE;
+
+        if(onSwap != NULL) {
+            onSwap(old, entry->optimized.pipeline, userData);
+        }
+        retirePipeline(queue, retireValue, old);
+
+        registry->stats.promoted++;
+        promoted++;
+    }
+
+    return promoted;
+}
+
+uint32_t pipelineRegistryReloadShader(
+    PipelineRegistry *registry,
+    const char *name,
+    uint32_t *code,
+    size_t codeSize,
+    DeletionQueue *queue,
+    uint64_t retireValue,
+    PipelineSwapCallback onSwap,
+    void *userData
+) {
+    RegistryShader *shader = findShader(registry, name);
+    if(shader == NULL) {
+        free(code);
+        return 0;
+    }
+
+    // Layouts and vertex input of existing pipelines stay as they are, only the code changes
+    ShaderReflection reflection;
+    VkResult result = reflectShader(code, codeSize, &reflection);
+    if(result == VK_SUCCESS && reflection.stage != shader->stage) {
+        result = VK_ERROR_INITIALIZATION_FAILED;
+    }
+    if(result == VK_SUCCESS && !shaderInterfaceMatches(&shader->reflection, &reflection, name)) {
+        result = VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    VkShaderModule module;
+    if(result == VK_SUCCESS) {
+        result = createShaderModule(registry->device, code, codeSize, &module);
+    }
+    if(result != VK_SUCCESS) {
+        fprintf(stderr, "Failed to reload shader %s: %s.\n", name, string_VkResult(result));
+        free(code);
+        return 0;
+    }
+
+    // Nothing in flight may still read the old module or the handles replaced below
+    pipelineServiceWaitIdle(registry->service);
+
+    VkShaderModule oldModule = shader->module;
+    shader->module = module;
+    shader->reflection = reflection;
+    shader->code = code;
+    shader->codeSize = codeSize;
+    free(shader->ownedCode);
+    shader->ownedCode = code;
+
+    // Links made from the old libraries don't need them anymore
+    for(uint32_t i = 0; i < registry->libraryCount; i++) {
+        RegistryLibrary *library = &registry->libraries[i];
+        if(library->module != oldModule) {
+            continue;
+        }
+
+        retirePipeline(queue, retireValue, library->library.pipeline);
+        library->module = module;
+        pipelineServiceSubmit(registry->service, partNames[library->part], buildRegistryLibrary, library, &library->library);
+    }
+
+    // Built next to the entries, so a failed build leaves the running pipeline alone
+    AsyncPipeline rebuilds[PIPELINE_REGISTRY_MAX_PIPELINES];
+    uint32_t rebuildIds[PIPELINE_REGISTRY_MAX_PIPELINES];
+    uint32_t rebuildCount = 0;
+    for(uint32_t i = 0; i < registry->pipelineCount; i++) {
+        RegistryPipeline *entry = &registry->pipelines[i];
+        if(entry->vertexModule != oldModule && entry->fragmentModule != oldModule) {
+            continue;
+        }
+
+        if(entry->vertexModule == oldModule) {
+            entry->vertexModule = module;
+        }
+        if(entry->fragmentModule == oldModule) {
+            entry->fragmentModule = module;
+        }
+
+        PipelineBuildFn build = entry->libraries[0] != NULL ? buildFastLinkedPipeline : buildRegistryPipeline;
+        pipelineServiceSubmit(registry->service, name, build, entry, &rebuilds[rebuildCount]);
+        rebuildIds[rebuildCount++] = i;
+    }
+
+    uint32_t swapped = 0;
+    for(uint32_t i = 0; i < rebuildCount; i++) {
+        if(asyncPipelineWait(&rebuilds[i]) != VK_SUCCESS) {
+            continue;
+        }
+
+        RegistryPipeline *entry = &registry->pipelines[rebuildIds[i]];
+        VkPipeline old = pipelineRegistryPipeline(registry, rebuildIds[i]);
+        retirePipeline(queue, retireValue, entry->pipeline.pipeline);
+        retirePipeline(queue, retireValue, entry->optimized.pipeline);
+        entry->optimized.pipeline = VK_NULL_HANDLE;
+
+        entry->pipeline = rebuilds[i];
+        entry->promoted = VK_FALSE;
+        if(onSwap != NULL) {
+            onSwap(old, entry->pipeline.pipeline, userData);
+        }
+
+        if(entry->libraries[0] != NULL) {
+            pipelineServiceSubmit(registry->service, name, buildOptimizedPipeline, entry, &entry->optimized);
+        }
+
+        registry->stats.reloaded++;
+        swapped++;
+    }
+
+    destroyShaderModule(registry->device, oldModule);
+
+    return swapped;
+}
+
+PipelineRegistryStats pipelineRegistryStats(PipelineRegistry *registry) {
+    return registry->stats;
+}
+
+uint64_t hashGraphicsPipelineDesc(const GraphicsPipelineDesc *desc) {
+    return hashDescParts(desc, ALL_PARTS);
+}
+
+RegistryShader *findShader(PipelineRegistry *registry, const char *name) {
+    for(uint32_t i = 0; i < registry->shaderCount; i++) {
+        if(strcmp(registry->shaders[i].name, name) == 0) {
+            return &registry->shaders[i];
+        }
+    }
+
+    return NULL;
+}
+
+// The reloaded code has to fit the layouts and vertex input built from the current one:
+// the same inputs, the same bindings in any order and the same push constant size
+VkBool32 shaderInterfaceMatches(const ShaderReflection *current, const ShaderReflection *reloaded, const char *name) {
+    VkBool32 inputsMatch = current->inputCount == reloaded->inputCount;
+    for(uint32_t i = 0; i < current->inputCount && inputsMatch; i++) {
+        inputsMatch = current->inputs[i].location == reloaded->inputs[i].location &&
+            current->inputs[i].format == reloaded->inputs[i].format;
+    }
+    if(!inputsMatch) {
+        fprintf(stderr, "%s changed its vertex inputs.\n", name);
+        return VK_FALSE;
+    }
+
+    VkBool32 bindingsMatch = current->bindingCount == reloaded->bindingCount;
+    for(uint32_t i = 0; i < current->bindingCount && bindingsMatch; i++) {
+        const ReflectedBinding *binding = &current->bindings[i];
+
+        bindingsMatch = VK_FALSE;
+        for(uint32_t j = 0; j < reloaded->bindingCount && !bindingsMatch; j++) {
+            const ReflectedBinding *other = &reloaded->bindings[j];
+            bindingsMatch = binding->set == other->set && binding->binding == other->binding &&
+                binding->type == other->type && binding->count == other->count;
+        }
+    }
+    if(!bindingsMatch || current->pushConstantSize != reloaded->pushConstantSize) {
+        fprintf(stderr, "%s changed its descriptor bindings or push constants.\n", name);
+        return VK_FALSE;
+    }
+
+    return VK_TRUE;
+}
+
+// Every location the shader reads needs an attribute of the same format, extra attributes are fine
+VkBool32 vertexInputMatches(const VertexInputDescription *vertexInput, const ShaderReflection *reflection, const char *name) {
+    size_t attributeCount = sizeof(vertexInput->attributes) / sizeof(VkVertexInputAttributeDescription);
+
+    for(uint32_t i = 0; i < reflection->inputCount; i++) {
+        const ReflectedInput *input = &reflection->inputs[i];
+
+        const VkVertexInputAttributeDescription *attribute = NULL;
+        for(size_t j = 0; j < attributeCount && attribute == NULL; j++) {
+            if(vertexInput->attributes[j].location == input->location) {
+                attribute = &vertexInput->attributes[j];
+            }
+        }
+
+        if(attribute == NULL) {
+            fprintf(stderr, "%s reads location %u, which has no vertex attribute.\n", name, input->location);
+            return VK_FALSE;
+        }
+        if(attribute->format != input->format) {
+            fprintf(stderr, "%s reads location %u as %s, the vertex attribute is %s.\n",
+                name, input->location, string_VkFormat(input->format), string_VkFormat(attribute->format));
+            return VK_FALSE;
+        }
+    }
+
+    return VK_TRUE;
+}
+
+// Returns the library every pipeline agreeing on the part's fields shares, queues its build if new
+RegistryLibrary *requestLibrary(
+    PipelineRegistry *registry,
+    RegistryPart part,
+    const GraphicsPipelineDesc *desc,
+    VkShaderModule module
+) {
+    uint64_t hash = hashDescParts(desc, PART_BIT(part));
+    for(uint32_t i = 0; i < registry->libraryCount; i++) {
+        RegistryLibrary *library = &registry->libraries[i];
+        if(library->part == part && library->hash == hash && descPartsEqual(&library->desc, desc, PART_BIT(part))) {
+            registry->stats.libraryHits++;
+            return library;
+        }
+    }
+
+    // At most one library per part and pipeline, so this can't run out before the pipelines do
+    assert(registry->libraryCount < PIPELINE_REGISTRY_MAX_LIBRARIES);
+    RegistryLibrary *library = &registry->libraries[registry->libraryCount++];
+    library->part = part;
+    library->hash = hash;
+    library->desc = *desc;
+    library->module = module;
+    library->device = registry->device;
+    registry->stats.libraries++;
+
+    pipelineServiceSubmit(registry->service, partNames[part], buildRegistryLibrary, library, &library->library);
+
+    return library;
+}
+
+// Field by field, padding inside the structs never reaches the hash.
+// Depth format and layout belong to more than one part.
+uint64_t hashDescParts(const GraphicsPipelineDesc *desc, uint32_t parts) {
+    uint64_t hash = FNV_OFFSET_BASIS;
+
+    if(parts & PART_BIT(REGISTRY_PART_VERTEX_INPUT)) {
+        size_t attributeCount = sizeof(desc->vertexInput.attributes) / sizeof(VkVertexInputAttributeDescription);
+        for(size_t i = 0; i < attributeCount; i++) {
+            const VkVertexInputAttributeDescription *attribute = &desc->vertexInput.attributes[i];
+            hash = hashBytes(hash, &attribute->location, sizeof(attribute->location));
+            hash = hashBytes(hash, &attribute->binding, sizeof(attribute->binding));
+            hash = hashBytes(hash, &attribute->format, sizeof(attribute->format));
+            hash = hashBytes(hash, &attribute->offset, sizeof(attribute->offset));
+        }
+        size_t bindingCount = sizeof(desc->vertexInput.bindings) / sizeof(VkVertexInputBindingDescription);
+        for(size_t i = 0; i < bindingCount; i++) {
+            const VkVertexInputBindingDescription *binding = &desc->vertexInput.bindings[i];
+            hash = hashBytes(hash, &binding->binding, sizeof(binding->binding));
+            hash = hashBytes(hash, &binding->stride, sizeof(binding->stride));
+            hash = hashBytes(hash, &binding->inputRate, sizeof(binding->inputRate));
+        }
+        hash = hashBytes(hash, &desc->topology, sizeof(desc->topology));
+    }
+    if(parts & PART_BIT(REGISTRY_PART_PRE_RASTERIZATION)) {
+        hash = hashString(hash, desc->vertexShader);
+        hash = hashShaderVariant(hash, &desc->vertexVariant);
+        hash = hashBytes(hash, &desc->polygonMode, sizeof(desc->polygonMode));
+        hash = hashBytes(hash, &desc->cullMode, sizeof(desc->cullMode));
+        hash = hashBytes(hash, &desc->frontFace, sizeof(desc->frontFace));
+    }
+    if(parts & PART_BIT(REGISTRY_PART_FRAGMENT_SHADER)) {
+        hash = hashString(hash, desc->fragmentShader);
+        hash = hashShaderVariant(hash, &desc->fragmentVariant);
+        hash = hashBytes(hash, &desc->depthTest, sizeof(desc->depthTest));
+        hash = hashBytes(hash, &desc->depthWrite, sizeof(desc->depthWrite));
+        hash = hashBytes(hash, &desc->depthCompare, sizeof(desc->depthCompare));
+    }
+    if(parts & PART_BIT(REGISTRY_PART_FRAGMENT_OUTPUT)) {
+        hash = hashBytes(hash, &desc->blendEnable, sizeof(desc->blendEnable));
+        hash = hashBytes(hash, &desc->colorFormat, sizeof(desc->colorFormat));
+    }
+    if(parts & (PART_BIT(REGISTRY_PART_FRAGMENT_SHADER) | PART_BIT(REGISTRY_PART_FRAGMENT_OUTPUT))) {
+        hash = hashBytes(hash, &desc->depthFormat, sizeof(desc->depthFormat));
+    }
+    if(parts & (PART_BIT(REGISTRY_PART_PRE_RASTERIZATION) | PART_BIT(REGISTRY_PART_FRAGMENT_SHADER))) {
+        hash = hashBytes(hash, &desc->layout, sizeof(desc->layout));
+    }
+
+    return hash;
+}
+
+// Hash matches are confirmed so a collision can't hand out the wrong pipeline
+VkBool32 descPartsEqual(const GraphicsPipelineDesc *a, const GraphicsPipelineDesc *b, uint32_t parts) {
+    if(parts & PART_BIT(REGISTRY_PART_VERTEX_INPUT)) {
+        size_t attributeCount = sizeof(a->vertexInput.attributes) / sizeof(VkVertexInputAttributeDescription);
+        for(size_t i = 0; i < attributeCount; i++) {
+            const VkVertexInputAttributeDescription *x = &a->vertexInput.attributes[i], *y = &b->vertexInput.attributes[i];
+            if(x->location != y->location || x->binding != y->binding || x->format != y->format || x->offset != y->offset) {
+                return VK_FALSE;
+            }
+        }
+        size_t bindingCount = sizeof(a->vertexInput.bindings) / sizeof(VkVertexInputBindingDescription);
+        for(size_t i = 0; i < bindingCount; i++) {
+            const VkVertexInputBindingDescription *x = &a->vertexInput.bindings[i], *y = &b->vertexInput.bindings[i];
+            if(x->binding != y->binding || x->stride != y->stride || x->inputRate != y->inputRate) {
+                return VK_FALSE;
+            }
+        }
+        if(a->topology != b->topology) {
+            return VK_FALSE;
+        }
+    }
+    if(parts & PART_BIT(REGISTRY_PART_PRE_RASTERIZATION)) {
+        if(strcmp(a->vertexShader, b->vertexShader) != 0
+            || !shaderVariantEqual(&a->vertexVariant, &b->vertexVariant)
+            || a->polygonMode != b->polygonMode
+            || a->cullMode != b->cullMode
+            || a->frontFace != b->frontFace) {
+            return VK_FALSE;
+        }
+    }
+    if(parts & PART_BIT(REGISTRY_PART_FRAGMENT_SHADER)) {
+        if(strcmp(a->fragmentShader, b->fragmentShader) != 0
+            || !shaderVariantEqual(&a->fragmentVariant, &b->fragmentVariant)
+            || a->depthTest != b->depthTest
+            || a->depthWrite != b->depthWrite
+            || a->depthCompare != b->depthCompare) {
+            return VK_FALSE;
+        }
+    }
+    if(parts & PART_BIT(REGISTRY_PART_FRAGMENT_OUTPUT)) {
+        if(a->blendEnable != b->blendEnable || a->colorFormat != b->colorFormat) {
+            return VK_FALSE;
+        }
+    }
+    if(parts & (PART_BIT(REGISTRY_PART_FRAGMENT_SHADER) | PART_BIT(REGISTRY_PART_FRAGMENT_OUTPUT))) {
+        if(a->depthFormat != b->depthFormat) {
+            return VK_FALSE;
+        }
+    }
+    if(parts & (PART_BIT(REGISTRY_PART_PRE_RASTERIZATION) | PART_BIT(REGISTRY_PART_FRAGMENT_SHADER))) {
+        if(a->layout != b->layout) {
+            return VK_FALSE;
+        }
+    }
+
+    return VK_TRUE;
+}
+
+// Only the state of the given parts is filled in, ALL_PARTS for a monolithic pipeline
+void fillGraphicsState(
+    GraphicsPipelineState *state,
+    const GraphicsPipelineDesc *desc,
+    uint32_t parts,
+    VkShaderModule vertexModule,
+    VkShaderModule fragmentModule
+) {
+    memset(state, 0, sizeof(GraphicsPipelineState));
+
+    state->rendering = (VkPipelineRenderingCreateInfoKHR){
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR,
+        .colorAttachmentCount = 1,
+        .pColorAttachmentFormats = &desc->colorFormat,
+        .stencilAttachmentFormat = VK_FORMAT_UNDEFINED,
+        .depthAttachmentFormat = desc->depthFormat,
+        .viewMask = 0,
+    };
+
+    VkGraphicsPipelineCreateInfo *info = &state->info;
+    *info = (VkGraphicsPipelineCreateInfo){
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pStages = state->stages,
+        .stageCount = 0,
+        .renderPass = VK_NULL_HANDLE,
+        .subpass = 0,
+        .basePipelineHandle = VK_NULL_HANDLE,
+        .basePipelineIndex = -1,
+        .pNext = &state->rendering
+    };
+
+    if(parts & PART_BIT(REGISTRY_PART_VERTEX_INPUT)) {
+        state->vertexInput = (VkPipelineVertexInputStateCreateInfo){
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+            .pVertexBindingDescriptions = desc->vertexInput.bindings,
+            .vertexBindingDescriptionCount = sizeof(desc->vertexInput.bindings) / sizeof(VkVertexInputBindingDescription),
+            .pVertexAttributeDescriptions = desc->vertexInput.attributes,
+            .vertexAttributeDescriptionCount = sizeof(desc->vertexInput.attributes) / sizeof(VkVertexInputAttributeDescription),
+        };
+        state->assembly = (VkPipelineInputAssemblyStateCreateInfo){
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+            .topology = desc->topology,
+            .primitiveRestartEnable = VK_FALSE,
+        };
+        info->pVertexInputState = &state->vertexInput;
+        info->pInputAssemblyState = &state->assembly;
+    }
+
+    if(parts & PART_BIT(REGISTRY_PART_PRE_RASTERIZATION)) {
+        state->stages[info->stageCount++] = (VkPipelineShaderStageCreateInfo){
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_VERTEX_BIT,
+            .module = vertexModule,
+            .pName = "main",
+            .pSpecializationInfo = shaderVariantInfo(&desc->vertexVariant, &state->specializations[0]),
+        };
+
+        state->dynamicStates[0] = VK_DYNAMIC_STATE_VIEWPORT;
+        state->dynamicStates[1] = VK_DYNAMIC_STATE_SCISSOR;
+        state->dynamicState = (VkPipelineDynamicStateCreateInfo){
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+            .pDynamicStates = state->dynamicStates,
+            .dynamicStateCount = sizeof(state->dynamicStates) / sizeof(VkDynamicState),
+        };
+        state->viewport = (VkPipelineViewportStateCreateInfo){
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+            .viewportCount = 1,
+            .scissorCount = 1,
+        };
+        state->rasterization = (VkPipelineRasterizationStateCreateInfo){
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+            .depthClampEnable = VK_FALSE,
+            .rasterizerDiscardEnable = VK_FALSE,
+            .polygonMode = desc->polygonMode,
+            .lineWidth = 1.0f,
+            .cullMode = desc->cullMode,
+            .frontFace = desc->frontFace,
+            .depthBiasEnable = VK_FALSE,
+        };
+        info->pDynamicState = &state->dynamicState;
+        info->pViewportState = &state->viewport;
+        info->pRasterizationState = &state->rasterization;
+    }
+
+    // Multisample state is part of both fragment parts
+    if(parts & (PART_BIT(REGISTRY_PART_FRAGMENT_SHADER) | PART_BIT(REGISTRY_PART_FRAGMENT_OUTPUT))) {
+        state->multisample = (VkPipelineMultisampleStateCreateInfo){
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+            .sampleShadingEnable = VK_FALSE,
+            .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+        };
+        info->pMultisampleState = &state->multisample;
+    }
+
+    if(parts & PART_BIT(REGISTRY_PART_FRAGMENT_SHADER)) {
+        state->stages[info->stageCount++] = (VkPipelineShaderStageCreateInfo){
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+            .module = fragmentModule,
+            .pName = "main",
+            .pSpecializationInfo = shaderVariantInfo(&desc->fragmentVariant, &state->specializations[1]),
+        };
+
+        state->depthStencil = (VkPipelineDepthStencilStateCreateInfo){
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+            .depthTestEnable = desc->depthTest,
+            .depthWriteEnable = desc->depthWrite,
+            .depthCompareOp = desc->depthCompare,
+            .depthBoundsTestEnable = VK_FALSE,
+            .stencilTestEnable = VK_FALSE,
+        };
+        info->pDepthStencilState = desc->depthFormat != VK_FORMAT_UNDEFINED ? &state->depthStencil : NULL;
+    }
+
+    if(parts & PART_BIT(REGISTRY_PART_FRAGMENT_OUTPUT)) {
+        // Standard alpha blending when enabled
+        state->blendAttachment = (VkPipelineColorBlendAttachmentState){
+            .colorWriteMask = VK_COLOR_COMPONENT_A_BIT |
+                VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_G_BIT |
+                VK_COLOR_COMPONENT_R_BIT,
+            .blendEnable = desc->blendEnable,
+            .srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
+            .dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+            .colorBlendOp = VK_BLEND_OP_ADD,
+            .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+            .dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+            .alphaBlendOp = VK_BLEND_OP_ADD,
+        };
+        state->colorBlend = (VkPipelineColorBlendStateCreateInfo){
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+            .logicOpEnable = VK_FALSE,
+            .pAttachments = &state->blendAttachment,
+            .attachmentCount = 1,
+        };
+        info->pColorBlendState = &state->colorBlend;
+    }
+
+    // The interface parts don't use a layout
+    if(parts & (PART_BIT(REGISTRY_PART_PRE_RASTERIZATION) | PART_BIT(REGISTRY_PART_FRAGMENT_SHADER))) {
+        info->layout = desc->layout;
+    }
+}
+
+// Worker thread, only reads its own entry
+VkResult buildRegistryPipeline(PipelineService *service, void *userData, VkPipeline *pipeline) {
+    (void)service;
+    RegistryPipeline *entry = (RegistryPipeline*)userData;
+
+    GraphicsPipelineState state;
+    fillGraphicsState(&state, &entry->desc, ALL_PARTS, entry->vertexModule, entry->fragmentModule);
+
+    return createGraphicsPipeline(entry->device, &state.info, pipeline);
+}
+
+// Worker thread, keeps what the optimized link needs to redo the part's work
+VkResult buildRegistryLibrary(PipelineService *service, void *userData, VkPipeline *pipeline) {
+    (void)service;
+    RegistryLibrary *library = (RegistryLibrary*)userData;
+
+    GraphicsPipelineState state;
+    fillGraphicsState(&state, &library->desc, PART_BIT(library->part), library->module, library->module);
+
+    state.library = (VkGraphicsPipelineLibraryCreateInfoEXT){
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT,
+        .flags = partFlags[library->part],
+        .pNext = &state.rendering,
+    };
+    state.info.pNext = &state.library;
+    state.info.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+
+    return createGraphicsPipeline(library->device, &state.info, pipeline);
+}
+
+VkResult buildFastLinkedPipeline(PipelineService *service, void *userData, VkPipeline *pipeline) {
+    (void)service;
+    return linkRegistryPipeline((RegistryPipeline*)userData, 0, pipeline);
+}
+
+VkResult buildOptimizedPipeline(PipelineService *service, void *userData, VkPipeline *pipeline) {
+    (void)service;
+    return linkRegistryPipeline((RegistryPipeline*)userData, VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT, pipeline);
+}
+
+// Worker thread, blocks until the entry's libraries are built
+VkResult linkRegistryPipeline(RegistryPipeline *entry, VkPipelineCreateFlags flags, VkPipeline *pipeline) {
+    VkPipeline libraries[REGISTRY_PART_COUNT];
+    for(uint32_t part = 0; part < REGISTRY_PART_COUNT; part++) {
+        VkResult result = asyncPipelineWait(&entry->libraries[part]->library);
+        if(result != VK_SUCCESS) {
+            return result;
+        }
+        libraries[part] = entry->libraries[part]->library.pipeline;
+    }
+
+    VkPipelineLibraryCreateInfoKHR libraryInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR,
+        .libraryCount = REGISTRY_PART_COUNT,
+        .pLibraries = libraries,
+    };
+
+    VkGraphicsPipelineCreateInfo pipelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .flags = flags,
+        .layout = entry->desc.layout,
+        .renderPass = VK_NULL_HANDLE,
+        .basePipelineHandle = VK_NULL_HANDLE,
+        .basePipelineIndex = -1,
+        .pNext = &libraryInfo
+    };
+
+    return createGraphicsPipeline(entry->device, &pipelineInfo, pipeline);
+}
+
+// Destroys pipeline once the frame timeline reaches retireValue
+void retirePipeline(DeletionQueue *queue, uint64_t retireValue, VkPipeline pipeline) {
+    if(pipeline == VK_NULL_HANDLE) {
+        return;
+    }
+
+    VkPipeline *retired = (VkPipeline*)malloc(sizeof(VkPipeline));
+    assert(retired != NULL);
+    *retired = pipeline;
+    deletionQueuePush(queue, retireValue, destroyRetiredPipeline, retired);
+}
+
+void destroyRetiredPipeline(Device *device, void *userData) {
+    VkPipeline *pipeline = (VkPipeline*)userData;
+
+    destroyPipeline(device, *pipeline);
+    free(pipeline);
+}
+
+uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+    const uint8_t *bytes = (const uint8_t*)data;
+    for(size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+// The terminator is hashed too, "ab" + "c" and "a" + "bc" stay distinct
+uint64_t hashString(uint64_t hash, const char *string) {
+    return hashBytes(hash, string, strlen(string) + 1);
+}
@@ -0,0 +1,185 @@
+#ifndef PIPELINE_REGISTRY_H_
+#define PIPELINE_REGISTRY_H_
+
+#include <vulkan/vulkan.h>
+
+#include "deletion_queue.h"
+#include "device_api.h"
+#include "layout_cache.h"
+#include "mesh.h"
+#include "pipeline_service.h"
+#include "shader_variant.h"
+#include "spirv_reflect.h"
+
+#define PIPELINE_REGISTRY_MAX_SHADERS 32
+#define PIPELINE_REGISTRY_MAX_PIPELINES 64
+#define PIPELINE_REGISTRY_MAX_LIBRARIES (4 * PIPELINE_REGISTRY_MAX_PIPELINES)
+#define PIPELINE_REGISTRY_INVALID UINT32_MAX
+
+// SPIR-V module shared by every pipeline that names it
+typedef struct {
+    const char *name;
+    VkShaderStageFlagBits stage;
+    const uint32_t *code;
+    size_t codeSize;
+    VkShaderModule module;
+    ShaderReflection reflection;
+    // Code handed over by pipelineRegistryReloadShader, freed with the registry
+    uint32_t *ownedCode;
+} RegistryShader;
+
+// Everything a graphics pipeline is built from, the rest is fixed:
+// dynamic viewport and scissor, one sample, one color attachment
+typedef struct {
+    const char *vertexShader;
+    const char *fragmentShader;
+    // Specialization constants, each combination is its own pipeline
+    ShaderVariant vertexVariant;
+    ShaderVariant fragmentVariant;
+    VertexInputDescription vertexInput;
+    VkPrimitiveTopology topology;
+    VkPolygonMode polygonMode;
+    VkCullModeFlags cullMode;
+    VkFrontFace frontFace;
+    VkBool32 blendEnable;
+    VkBool32 depthTest;
+    VkBool32 depthWrite;
+    VkCompareOp depthCompare;
+    VkFormat colorFormat;
+    // VK_FORMAT_UNDEFINED without a depth attachment
+    VkFormat depthFormat;
+    // VK_NULL_HANDLE derives the layout from the shaders
+    VkPipelineLayout layout;
+} GraphicsPipelineDesc;
+
+// The four graphics pipeline library parts, each covers a subset of GraphicsPipelineDesc
+typedef enum {
+    REGISTRY_PART_VERTEX_INPUT,
+    REGISTRY_PART_PRE_RASTERIZATION,
+    REGISTRY_PART_FRAGMENT_SHADER,
+    REGISTRY_PART_FRAGMENT_OUTPUT,
+    REGISTRY_PART_COUNT,
+} RegistryPart;
+
+// A pipeline library shared by every pipeline whose desc agrees on the part's fields
+typedef struct {
+    RegistryPart part;
+    uint64_t hash;
+    GraphicsPipelineDesc desc;
+    VkShaderModule module;
+    AsyncPipeline library;
+    Device *device;
+} RegistryLibrary;
+
+typedef struct {
+    uint64_t hash;
+    GraphicsPipelineDesc desc;
+    // Resolved at request time, the worker never reads the shader table
+    VkShaderModule vertexModule;
+    VkShaderModule fragmentModule;
+    Device *device;
+
+    // Monolithic build, or the fast link of libraries when those are used
+    AsyncPipeline pipeline;
+    // Only with libraries: link time optimized build that replaces the fast link
+    RegistryLibrary *libraries[REGISTRY_PART_COUNT];
+    AsyncPipeline optimized;
+    VkBool32 promoted;
+} RegistryPipeline;
+
+typedef struct {
+    // Calls to pipelineRegistryRequest
+    uint32_t requests;
+    // Requests answered with an existing pipeline
+    uint32_t hits;
+    uint32_t pipelines;
+    uint32_t shaderModules;
+    uint32_t libraries;
+    // Library parts reused by a new pipeline
+    uint32_t libraryHits;
+    // Fast linked pipelines replaced by their optimized build
+    uint32_t promoted;
+    // Pipelines rebuilt because one of their shaders was reloaded
+    uint32_t reloaded;
+} PipelineRegistryStats;
+
+// Called for every pipeline handle pipelineRegistryPromote replaces
+typedef void (*PipelineSwapCallback)(VkPipeline oldPipeline, VkPipeline newPipeline, void *userData);
+
+typedef struct {
+    Device *device;
+    PipelineService *service;
+    LayoutCache *layouts;
+    // Build through graphics pipeline libraries instead of monolithic pipelines
+    VkBool32 useLibraries;
+
+    RegistryShader shaders[PIPELINE_REGISTRY_MAX_SHADERS];
+    uint32_t shaderCount;
+    // Fixed storage, builds in flight point into it
+    RegistryPipeline pipelines[PIPELINE_REGISTRY_MAX_PIPELINES];
+    uint32_t pipelineCount;
+    RegistryLibrary libraries[PIPELINE_REGISTRY_MAX_LIBRARIES];
+    uint32_t libraryCount;
+
+    PipelineRegistryStats stats;
+} PipelineRegistry;
+
+// Uses graphics pipeline libraries when device->enabled.graphicsPipelineLibrary is set.
+// Derived layouts come from layouts, which has to outlive the registry.
+void createPipelineRegistry(
+    Device *device,
+    PipelineService *service,
+    LayoutCache *layouts,
+    PipelineRegistry *registry
+);
+// Waits for builds in flight, then destroys every pipeline, library and shader module
+void destroyPipelineRegistry(PipelineRegistry *registry);
+
+// code has to outlive the registry, names are compared by content.
+// Fails when the code isn't a shader of the given stage.
+VkResult pipelineRegistryAddShader(
+    PipelineRegistry *registry,
+    const char *name,
+    VkShaderStageFlagBits stage,
+    const uint32_t *code,
+    size_t codeSize
+);
+// Returns the id of an identical pipeline if there is one, otherwise queues a build,
+// so shader variants are only compiled once something asks for them.
+// With libraries only the missing parts are built, then fast linked, then optimized.
+// Returns PIPELINE_REGISTRY_INVALID when a shader is unknown, the vertex input doesn't match
+// what the vertex shader reads or the registry is full.
+uint32_t pipelineRegistryRequest(PipelineRegistry *registry, const GraphicsPipelineDesc *desc);
+// The best pipeline built so far, VK_NULL_HANDLE until the first build finished
+VkPipeline pipelineRegistryPipeline(PipelineRegistry *registry, uint32_t id);
+// Waits for the first usable pipeline, not for the optimized one
+VkResult pipelineRegistryWait(PipelineRegistry *registry, uint32_t id);
+// Swaps finished optimized builds in, once per frame before recording. The replaced
+// handles are destroyed through queue after retireValue.
+uint32_t pipelineRegistryPromote(
+    PipelineRegistry *registry,
+    DeletionQueue *queue,
+    uint64_t retireValue,
+    PipelineSwapCallback onSwap,
+    void *userData
+);
+// Replaces a shader's code and rebuilds every pipeline and library using it, blocking until
+// the first build of each is done. Takes ownership of code, which was allocated with malloc.
+// A pipeline that fails to build keeps its old handle. Code that changes the vertex inputs,
+// descriptor bindings or push constants of the shader is rejected and every pipeline stays.
+// Returns the number of pipelines swapped.
+uint32_t pipelineRegistryReloadShader(
+    PipelineRegistry *registry,
+    const char *name,
+    uint32_t *code,
+    size_t codeSize,
+    DeletionQueue *queue,
+    uint64_t retireValue,
+    PipelineSwapCallback onSwap,
+    void *userData
+);
+PipelineRegistryStats pipelineRegistryStats(PipelineRegistry *registry);
+
+uint64_t hashGraphicsPipelineDesc(const GraphicsPipelineDesc *desc);
+
+#endif
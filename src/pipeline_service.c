@@ -0,0 +1,205 @@
+#include "pipeline_service.h"
+#include "deferred_join.h"
+#include "device_api.h"
+#include "thread_pool.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <vulkan/vk_enum_string_helper.h>
+#include <vulkan/vulkan_core.h>
+
+void pipelineBuildJob(void *userData);
+double pipelineServiceNow(void);
+
+void createPipelineService(Device *device, ThreadPool *pool, PipelineService *service) {
+    memset(service, 0, sizeof(PipelineService));
+    service->device = device;
+    service->pool = pool;
+
+    pthread_mutex_init(&service->mutex, NULL);
+    pthread_cond_init(&service->done, NULL);
+}
+
+void destroyPipelineService(PipelineService *service) {
+    pipelineServiceWaitIdle(service);
+
+    pthread_cond_destroy(&service->done);
+    pthread_mutex_destroy(&service->mutex);
+}
+
+void pipelineServiceSubmit(
+    PipelineService *service,
+    const char *name,
+    PipelineBuildFn build,
+    void *userData,
+    AsyncPipeline *pipeline
+) {
+    pipeline->name = name;
+    atomic_store(&pipeline->status, PIPELINE_STATUS_PENDING);
+    pipeline->pipeline = VK_NULL_HANDLE;
+    pipeline->result = VK_NOT_READY;
+    pipeline->buildMs = 0.0;
+    pipeline->service = service;
+    pipeline->build = build;
+    pipeline->userData = userData;
+
+    pthread_mutex_lock(&service->mutex);
+    service->pending++;
+    service->stats.submitted++;
+    pthread_mutex_unlock(&service->mutex);
+
+    if(!threadPoolSubmit(service->pool, pipelineBuildJob, pipeline)) {
+        pipelineBuildJob(pipeline);
+    }
+}
+
+VkResult pipelineServiceCreateRayTracing(
+    PipelineService *service,
+    VkRayTracingPipelineCreateInfoKHR *info,
+    VkPipeline *pipeline
+) {
+    Device *device = service->device;
+
+    DeferredJoin *join;
+    if(createDeferredJoin(device, &join) != VK_SUCCESS) {
+        return createRayTracingPipelineKHR(device, VK_NULL_HANDLE, info, pipeline);
+    }
+
+    VkResult result = createRayTracingPipelineKHR(device, join->operation, info, pipeline);
+    if(result == VK_OPERATION_DEFERRED_KHR) {
+        pthread_mutex_lock(&service->mutex);
+        service->stats.deferred++;
+        pthread_mutex_unlock(&service->mutex);
+    }
+
+    return deferredJoinComplete(join, service->pool, result);
+}
+
+// The default stack size from the spec, with the recursion and callable depths actually used
+uint32_t rayTracingPipelineStackSize(
+    Device *device,
+    VkPipeline pipeline,
+    const VkRayTracingPipelineCreateInfoKHR *info,
+    uint32_t callableDepth
+) {
+    VkDeviceSize raygen = 0, miss = 0, closestHit = 0, anyHit = 0, intersection = 0, callable = 0;
+
+    for(uint32_t i = 0; i < info->groupCount; i++) {
+        const VkRayTracingShaderGroupCreateInfoKHR *group = &info->pGroups[i];
+
+        if(group->type == VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR) {
+            VkDeviceSize size = getRayTracingShaderGroupStackSizeKHR(device, pipeline, i, VK_SHADER_GROUP_SHADER_GENERAL_KHR);
+            VkDeviceSize *max = NULL;
+            switch(info->pStages[group->generalShader].stage) {
+                case VK_SHADER_STAGE_RAYGEN_BIT_KHR: max = &raygen; break;
+                case VK_SHADER_STAGE_MISS_BIT_KHR: max = &miss; break;
+                case VK_SHADER_STAGE_CALLABLE_BIT_KHR: max = &callable; break;
+                default: break;
+            }
+            if(max != NULL && size > *max) {
+                *max = size;
+            }
+            continue;
+        }
+
+        // Hit groups, only the shaders they have
+        VkDeviceSize size;
+        if(group->closestHitShader != VK_SHADER_UNUSED_KHR) {
+            size = getRayTracingShaderGroupStackSizeKHR(device, pipeline, i, VK_SHADER_GROUP_SHADER_CLOSEST_HIT_KHR);
+            closestHit = size > closestHit ? size : closestHit;
+        }
+        if(group->anyHitShader != VK_SHADER_UNUSED_KHR) {
+            size = getRayTracingShaderGroupStackSizeKHR(device, pipeline, i, VK_SHADER_GROUP_SHADER_ANY_HIT_KHR);
+            anyHit = size > anyHit ? size : anyHit;
+        }
+        if(group->intersectionShader != VK_SHADER_UNUSED_KHR) {
+            size = getRayTracingShaderGroupStackSizeKHR(device, pipeline, i, VK_SHADER_GROUP_SHADER_INTERSECTION_KHR);
+            intersection = size > intersection ? size : intersection;
+        }
+    }
+
+    // The first level may run any hit shader, deeper levels only closest hit or miss shaders
+    // tracing further. Any hit and intersection shaders can't trace.
+    uint32_t depth = info->maxPipelineRayRecursionDepth;
+    VkDeviceSize firstLevel = closestHit > miss ? closestHit : miss;
+    if(intersection + anyHit > firstLevel) {
+        firstLevel = intersection + anyHit;
+    }
+    VkDeviceSize deeperLevels = closestHit > miss ? closestHit : miss;
+
+    VkDeviceSize stackSize = raygen +
+        (depth > 0 ? firstLevel : 0) +
+        (depth > 1 ? (depth - 1) * deeperLevels : 0) +
+        callableDepth * callable;
+
+    return (uint32_t)stackSize;
+}
+
+void pipelineServiceWaitIdle(PipelineService *service) {
+    pthread_mutex_lock(&service->mutex);
+    while(service->pending > 0) {
+        pthread_cond_wait(&service->done, &service->mutex);
+    }
+    pthread_mutex_unlock(&service->mutex);
+}
+
+PipelineServiceStats pipelineServiceStats(PipelineService *service) {
+    pthread_mutex_lock(&service->mutex);
+    PipelineServiceStats stats = service->stats;
+    pthread_mutex_unlock(&service->mutex);
+
+    return stats;
+}
+
+VkBool32 asyncPipelineReady(AsyncPipeline *pipeline) {
+    return atomic_load(&pipeline->status) == PIPELINE_STATUS_READY;
+}
+
+VkResult asyncPipelineWait(AsyncPipeline *pipeline) {
+    PipelineService *service = pipeline->service;
+
+    pthread_mutex_lock(&service->mutex);
+    while(atomic_load(&pipeline->status) == PIPELINE_STATUS_PENDING) {
+        pthread_cond_wait(&service->done, &service->mutex);
+    }
+    pthread_mutex_unlock(&service->mutex);
+
+    return pipeline->result;
+}
+
+void pipelineBuildJob(void *userData) {
+    AsyncPipeline *pipeline = (AsyncPipeline*)userData;
+    PipelineService *service = pipeline->service;
+
+    double start = pipelineServiceNow();
+    VkPipeline handle = VK_NULL_HANDLE;
+    VkResult result = pipeline->build(service, pipeline->userData, &handle);
+    double buildMs = (pipelineServiceNow() - start) * 1e3;
+
+    if(result != VK_SUCCESS) {
+        fprintf(stderr, "Failed to build pipeline %s: %s.\n", pipeline->name, string_VkResult(result));
+    }
+
+    pthread_mutex_lock(&service->mutex);
+    pipeline->pipeline = handle;
+    pipeline->result = result;
+    pipeline->buildMs = buildMs;
+    atomic_store(&pipeline->status, result == VK_SUCCESS ? PIPELINE_STATUS_READY : PIPELINE_STATUS_FAILED);
+
+    if(result == VK_SUCCESS) {
+        service->stats.built++;
+    } else {
+        service->stats.failed++;
+    }
+    service->stats.buildMs += buildMs;
+    service->pending--;
+    pthread_cond_broadcast(&service->done);
+    pthread_mutex_unlock(&service->mutex);
+}
+
+double pipelineServiceNow(void) {
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
@@ -0,0 +1,91 @@
+#ifndef PIPELINE_SERVICE_H_
+#define PIPELINE_SERVICE_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <vulkan/vulkan.h>
+
+#include "device_api.h"
+#include "thread_pool.h"
+
+typedef enum {
+    PIPELINE_STATUS_PENDING,
+    PIPELINE_STATUS_READY,
+    PIPELINE_STATUS_FAILED,
+} PipelineStatus;
+
+typedef struct PIPELINESERVICE PipelineService;
+
+// Runs on a worker thread, everything info structs point to has to live inside the call
+typedef VkResult (*PipelineBuildFn)(PipelineService *service, void *userData, VkPipeline *pipeline);
+
+// Filled in by a worker, pipeline is only valid once status is PIPELINE_STATUS_READY
+typedef struct {
+    const char *name;
+    _Atomic uint32_t status;
+    VkPipeline pipeline;
+    VkResult result;
+    double buildMs;
+
+    PipelineService *service;
+    PipelineBuildFn build;
+    void *userData;
+} AsyncPipeline;
+
+typedef struct {
+    uint32_t submitted;
+    uint32_t built;
+    uint32_t failed;
+    // Ray tracing builds that were split over several workers
+    uint32_t deferred;
+    double buildMs;
+} PipelineServiceStats;
+
+typedef struct PIPELINESERVICE {
+    Device *device;
+    ThreadPool *pool;
+
+    // Guards pending and stats, done is signaled whenever a build finishes
+    pthread_mutex_t mutex;
+    pthread_cond_t done;
+    uint32_t pending;
+    PipelineServiceStats stats;
+} PipelineService;
+
+void createPipelineService(Device *device, ThreadPool *pool, PipelineService *service);
+// Waits for every submitted build, finished pipelines stay owned by the caller
+void destroyPipelineService(PipelineService *service);
+
+// Queues build for a worker, runs it on the calling thread if the pool is full.
+// pipeline and userData have to stay valid until the build finished.
+void pipelineServiceSubmit(
+    PipelineService *service,
+    const char *name,
+    PipelineBuildFn build,
+    void *userData,
+    AsyncPipeline *pipeline
+);
+// Creates a ray tracing pipeline as a deferred operation that idle workers help with,
+// only valid inside a PipelineBuildFn
+VkResult pipelineServiceCreateRayTracing(
+    PipelineService *service,
+    VkRayTracingPipelineCreateInfoKHR *info,
+    VkPipeline *pipeline
+);
+// Smallest stack a pipeline created from info needs at its maxPipelineRayRecursionDepth,
+// with callable shaders calling each other callableDepth deep. Only valid with the dynamic
+// stack size state, set with vkCmdSetRayTracingPipelineStackSizeKHR.
+uint32_t rayTracingPipelineStackSize(
+    Device *device,
+    VkPipeline pipeline,
+    const VkRayTracingPipelineCreateInfoKHR *info,
+    uint32_t callableDepth
+);
+void pipelineServiceWaitIdle(PipelineService *service);
+PipelineServiceStats pipelineServiceStats(PipelineService *service);
+
+VkBool32 asyncPipelineReady(AsyncPipeline *pipeline);
+// Blocks until the build finished and returns its result
+VkResult asyncPipelineWait(AsyncPipeline *pipeline);
+
+#endif
@@ -0,0 +1,281 @@
+#include "readback.h"
+#include "device_api.h"
+#include "vkalloc.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+
+#define READBACK_PATH_MAX 4096
+
+void *readbackWriter(void *userData);
+VkBool32 writeFrame(Readback *readback, ReadbackJob *job);
+
+VkResult createReadback(
+    VkAlloc *alloc,
+    uint32_t slotCount,
+    VkExtent2D extent,
+    VkFormat format,
+    const char *path,
+    ReadbackFormat fileFormat,
+    Readback *readback
+) {
+    assert(slotCount > 0 && slotCount <= READBACK_MAX_SLOTS);
+
+    switch(format) {
+        case VK_FORMAT_B8G8R8A8_SRGB:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        break;
+        default:
+        fprintf(stderr, "Unsupported readback format %d.\n", format);
+        return VK_ERROR_FORMAT_NOT_SUPPORTED;
+    }
+
+    memset(readback, 0, sizeof(Readback));
+    readback->allocator = alloc;
+    readback->extent = extent;
+    readback->format = format;
+    readback->frameSize = (VkDeviceSize)extent.width * extent.height * 4;
+    readback->slotCount = slotCount;
+    readback->fileFormat = fileFormat;
+    readback->path = path;
+
+    if(fileFormat == READBACK_FORMAT_RAW) {
+        readback->stream = fopen(path, "wb");
+        if(readback->stream == NULL) {
+            fprintf(stderr, "Failed to open capture stream %s.\n", path);
+            return VK_ERROR_INITIALIZATION_FAILED;
+        }
+    }
+
+    VkResult result;
+    for(uint32_t i = 0; i < slotCount; i++) {
+        VkBufferCreateInfo bufferInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = readback->frameSize,
+            .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        };
+
+        // Coherent so the mapping never needs an invalidate
+        result = createAllocateBuffer(
+            alloc,
+            &bufferInfo,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            &readback->slots[i].buffer
+        );
+        if(result != VK_SUCCESS) {
+            return result;
+        }
+
+        readback->slots[i].mapped = mapBufferMemory(alloc, &readback->slots[i].buffer);
+        if(readback->slots[i].mapped == NULL) {
+            return VK_ERROR_MEMORY_MAP_FAILED;
+        }
+    }
+
+    pthread_mutex_init(&readback->mutex, NULL);
+    pthread_cond_init(&readback->cond, NULL);
+    if(pthread_create(&readback->thread, NULL, readbackWriter, readback) != 0) {
+        fprintf(stderr, "Failed to start capture writer thread.\n");
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    return VK_SUCCESS;
+}
+
+void destroyReadback(Readback *readback) {
+    pthread_mutex_lock(&readback->mutex);
+    readback->stopping = VK_TRUE;
+    pthread_cond_signal(&readback->cond);
+    pthread_mutex_unlock(&readback->mutex);
+
+    pthread_join(readback->thread, NULL);
+    pthread_cond_destroy(&readback->cond);
+    pthread_mutex_destroy(&readback->mutex);
+
+    for(uint32_t i = 0; i < readback->slotCount; i++) {
+        unmapBufferMemory(readback->allocator, &readback->slots[i].buffer);
+        destroyDeallocateBuffer(readback->allocator, &readback->slots[i].buffer);
+    }
+
+    if(readback->stream != NULL) {
+        fclose(readback->stream);
+    }
+}
+
+VkBuffer readbackSlotBuffer(Readback *readback, uint32_t slot) {
+    assert(slot < readback->slotCount);
+    return readback->slots[slot].buffer.buffer;
+}
+
+VkBool32 readbackRecord(
+    Readback *readback,
+    VkCommandBuffer cmdBuffer,
+    uint32_t slot,
+    VkImage image,
+    VkExtent2D extent,
+    uint64_t frame
+) {
+    assert(slot < readback->slotCount);
+
+    if(extent.width != readback->extent.width || extent.height != readback->extent.height) {
+        pthread_mutex_lock(&readback->mutex);
+        readback->stats.dropped++;
+        pthread_mutex_unlock(&readback->mutex);
+        return VK_FALSE;
+    }
+
+    VkBufferImageCopy region = {
+        .bufferOffset = 0,
+        .bufferRowLength = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevel = 0,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+        },
+        .imageOffset = {0, 0, 0},
+        .imageExtent = {extent.width, extent.height, 1},
+    };
+    cmdCopyImageToBuffer(
+        cmdBuffer,
+        image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        readback->slots[slot].buffer.buffer,
+        1, &region
+    );
+
+    readback->slots[slot].frame = frame;
+    readback->slots[slot].pending = VK_TRUE;
+
+    return VK_TRUE;
+}
+
+void readbackCollect(Readback *readback, uint32_t slot) {
+    assert(slot < readback->slotCount);
+
+    ReadbackSlot *readbackSlot = &readback->slots[slot];
+    if(!readbackSlot->pending) {
+        return;
+    }
+    readbackSlot->pending = VK_FALSE;
+
+    pthread_mutex_lock(&readback->mutex);
+    if(readback->queueCount == READBACK_QUEUE_SIZE) {
+        readback->stats.dropped++;
+        pthread_mutex_unlock(&readback->mutex);
+        return;
+    }
+    pthread_mutex_unlock(&readback->mutex);
+
+    // The copy out of mapped memory happens here so the slot can be reused right away
+    ReadbackJob job = {
+        .pixels = (uint8_t*)malloc(readback->frameSize),
+        .frame = readbackSlot->frame,
+    };
+    if(job.pixels == NULL) {
+        pthread_mutex_lock(&readback->mutex);
+        readback->stats.dropped++;
+        pthread_mutex_unlock(&readback->mutex);
+        return;
+    }
+    memcpy(job.pixels, readbackSlot->mapped, readback->frameSize);
+
+    // Only this thread adds jobs, the writer can only have made room since the check
+    pthread_mutex_lock(&readback->mutex);
+    uint32_t tail = (readback->queueHead + readback->queueCount) % READBACK_QUEUE_SIZE;
+    readback->queue[tail] = job;
+    readback->queueCount++;
+    readback->stats.captured++;
+    pthread_cond_signal(&readback->cond);
+    pthread_mutex_unlock(&readback->mutex);
+}
+
+ReadbackStats readbackStats(Readback *readback) {
+    pthread_mutex_lock(&readback->mutex);
+    ReadbackStats stats = readback->stats;
+    pthread_mutex_unlock(&readback->mutex);
+
+    return stats;
+}
+
+// Drains the queue until stopped, writing outside of the lock
+void *readbackWriter(void *userData) {
+    Readback *readback = (Readback*)userData;
+
+    pthread_mutex_lock(&readback->mutex);
+    for(;;) {
+        while(readback->queueCount == 0 && !readback->stopping) {
+            pthread_cond_wait(&readback->cond, &readback->mutex);
+        }
+        if(readback->queueCount == 0) {
+            break;
+        }
+
+        ReadbackJob job = readback->queue[readback->queueHead];
+        readback->queueHead = (readback->queueHead + 1) % READBACK_QUEUE_SIZE;
+        readback->queueCount--;
+        pthread_mutex_unlock(&readback->mutex);
+
+        VkBool32 written = writeFrame(readback, &job);
+        free(job.pixels);
+
+        pthread_mutex_lock(&readback->mutex);
+        if(written) {
+            readback->stats.written++;
+        } else {
+            // Queued but never written, it is not counted as captured after all
+            readback->stats.captured--;
+            readback->stats.dropped++;
+        }
+    }
+    pthread_mutex_unlock(&readback->mutex);
+
+    return NULL;
+}
+
+// Returns whether the frame made it into the output
+VkBool32 writeFrame(Readback *readback, ReadbackJob *job) {
+    if(readback->fileFormat == READBACK_FORMAT_RAW) {
+        return fwrite(job->pixels, 1, readback->frameSize, readback->stream) == readback->frameSize;
+    }
+
+    char path[READBACK_PATH_MAX];
+    snprintf(path, sizeof(path), "%s_%06llu.ppm", readback->path, (unsigned long long)job->frame);
+
+    FILE *file = fopen(path, "wb");
+    if(file == NULL) {
+        fprintf(stderr, "Failed to open capture file %s.\n", path);
+        return VK_FALSE;
+    }
+
+    uint32_t width = readback->extent.width, height = readback->extent.height;
+    VkBool32 bgr = readback->format == VK_FORMAT_B8G8R8A8_SRGB || readback->format == VK_FORMAT_B8G8R8A8_UNORM;
+
+    fprintf(file, "P6\n%u %u\n255\n", width, height);
+
+    // Drop alpha and swizzle to RGB a row at a time
+    uint8_t *row = (uint8_t*)malloc((size_t)width * 3);
+    if(row == NULL) {
+        fclose(file);
+        remove(path);
+        return VK_FALSE;
+    }
+    for(uint32_t y = 0; y < height; y++) {
+        const uint8_t *src = job->pixels + (size_t)y * width * 4;
+        for(uint32_t x = 0; x < width; x++) {
+            row[x * 3 + 0] = src[x * 4 + (bgr ? 2 : 0)];
+            row[x * 3 + 1] = src[x * 4 + 1];
+            row[x * 3 + 2] = src[x * 4 + (bgr ? 0 : 2)];
+        }
+        fwrite(row, 1, (size_t)width * 3, file);
+    }
+    free(row);
+
+    fclose(file);
+    return VK_TRUE;
+}
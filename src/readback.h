@@ -0,0 +1,96 @@
+#ifndef READBACK_H_
+#define READBACK_H_
+
+#include <pthread.h>
+#include <stdio.h>
+#include <vulkan/vulkan.h>
+
+#include "vkalloc.h"
+
+#define READBACK_MAX_SLOTS 4
+// Frames waiting for the writer thread, captures are dropped beyond this
+#define READBACK_QUEUE_SIZE 16
+
+typedef enum {
+    // One binary PPM per frame, path is used as a prefix
+    READBACK_FORMAT_PPM,
+    // Every frame's pixels appended to a single file at path
+    READBACK_FORMAT_RAW,
+} ReadbackFormat;
+
+// Host visible copy target, one per frame in flight
+typedef struct {
+    Buffer buffer;
+    void *mapped;
+    uint64_t frame;
+    VkBool32 pending;
+} ReadbackSlot;
+
+typedef struct {
+    uint8_t *pixels;
+    uint64_t frame;
+} ReadbackJob;
+
+typedef struct {
+    uint64_t captured;
+    uint64_t written;
+    // Frames skipped because the writer fell behind, memory ran out or the image changed size
+    uint64_t dropped;
+} ReadbackStats;
+
+typedef struct {
+    VkAlloc *allocator;
+
+    VkExtent2D extent;
+    VkFormat format;
+    VkDeviceSize frameSize;
+
+    ReadbackSlot slots[READBACK_MAX_SLOTS];
+    uint32_t slotCount;
+
+    ReadbackFormat fileFormat;
+    const char *path;
+    FILE *stream;
+
+    // Writer thread state, guarded by mutex
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    ReadbackJob queue[READBACK_QUEUE_SIZE];
+    uint32_t queueHead;
+    uint32_t queueCount;
+    VkBool32 stopping;
+
+    ReadbackStats stats;
+} Readback;
+
+// Only 4 byte RGBA and BGRA formats are supported
+VkResult createReadback(
+    VkAlloc *alloc,
+    uint32_t slotCount,
+    VkExtent2D extent,
+    VkFormat format,
+    const char *path,
+    ReadbackFormat fileFormat,
+    Readback *readback
+);
+// Writes every queued frame before returning, pending slots must be collected first
+void destroyReadback(Readback *readback);
+
+// Buffer the copy for the given slot goes to, has to be used through readbackRecord
+VkBuffer readbackSlotBuffer(Readback *readback, uint32_t slot);
+// Records the copy of image (in TRANSFER_SRC_OPTIMAL) into the slot.
+// Returns VK_FALSE without recording if the image does not match the readback size.
+VkBool32 readbackRecord(
+    Readback *readback,
+    VkCommandBuffer cmdBuffer,
+    uint32_t slot,
+    VkImage image,
+    VkExtent2D extent,
+    uint64_t frame
+);
+// Hands the slot's frame to the writer thread, only once the frame finished on the GPU
+void readbackCollect(Readback *readback, uint32_t slot);
+ReadbackStats readbackStats(Readback *readback);
+
+#endif
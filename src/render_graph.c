@@ -0,0 +1,424 @@
+#include "render_graph.h"
+#include "device_api.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+
+typedef struct {
+    VkPipelineStageFlags2 stages;
+    VkAccessFlags2 access;
+    VkImageLayout layout;
+    VkBool32 write;
+} AccessInfo;
+
+// Only stage and access bits that also exist in the legacy flags are used,
+// so the same values work with and without synchronization2.
+static const AccessInfo accessInfos[RESOURCE_ACCESS_COUNT] = {
+    [RESOURCE_ACCESS_NONE] = {
+        0, 0, VK_IMAGE_LAYOUT_UNDEFINED, VK_FALSE,
+    },
+    [RESOURCE_ACCESS_COLOR_ATTACHMENT_WRITE] = {
+        VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+        VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        VK_TRUE,
+    },
+    [RESOURCE_ACCESS_FRAGMENT_SAMPLED_READ] = {
+        VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+        VK_ACCESS_2_SHADER_READ_BIT,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_FALSE,
+    },
+    [RESOURCE_ACCESS_COMPUTE_STORAGE_READ] = {
+        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+        VK_ACCESS_2_SHADER_READ_BIT,
+        VK_IMAGE_LAYOUT_GENERAL,
+        VK_FALSE,
+    },
+    [RESOURCE_ACCESS_COMPUTE_STORAGE_WRITE] = {
+        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+        VK_ACCESS_2_SHADER_WRITE_BIT,
+        VK_IMAGE_LAYOUT_GENERAL,
+        VK_TRUE,
+    },
+    [RESOURCE_ACCESS_INDIRECT_READ] = {
+        VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+        VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_FALSE,
+    },
+    [RESOURCE_ACCESS_TRANSFER_READ] = {
+        VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+        VK_ACCESS_2_TRANSFER_READ_BIT,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        VK_FALSE,
+    },
+    [RESOURCE_ACCESS_TRANSFER_WRITE] = {
+        VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+        VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_TRUE,
+    },
+    [RESOURCE_ACCESS_HOST_READ] = {
+        VK_PIPELINE_STAGE_2_HOST_BIT,
+        VK_ACCESS_2_HOST_READ_BIT,
+        VK_IMAGE_LAYOUT_GENERAL,
+        VK_FALSE,
+    },
+    [RESOURCE_ACCESS_ACCELERATION_STRUCTURE_BUILD] = {
+        VK_PIPELINE_STAGE_2_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+        VK_ACCESS_2_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_2_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_TRUE,
+    },
+    [RESOURCE_ACCESS_RAY_TRACING_READ] = {
+        VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR,
+        VK_ACCESS_2_ACCELERATION_STRUCTURE_READ_BIT_KHR,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_FALSE,
+    },
+    [RESOURCE_ACCESS_RAY_TRACING_STORAGE_WRITE] = {
+        VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR,
+        VK_ACCESS_2_SHADER_WRITE_BIT,
+        VK_IMAGE_LAYOUT_GENERAL,
+        VK_TRUE,
+    },
+    // The dedicated access bit needs VK_KHR_ray_tracing_maintenance1, shader reads cover it without
+    [RESOURCE_ACCESS_SHADER_BINDING_TABLE_READ] = {
+        VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR,
+        VK_ACCESS_2_SHADER_READ_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_FALSE,
+    },
+    [RESOURCE_ACCESS_PRESENT] = {
+        0, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_FALSE,
+    },
+};
+
+typedef struct {
+    VkImageMemoryBarrier2 images[RENDER_GRAPH_MAX_RESOURCES];
+    uint32_t imageCount;
+    VkBufferMemoryBarrier2 buffers[RENDER_GRAPH_MAX_RESOURCES];
+    uint32_t bufferCount;
+} BarrierBatch;
+
+void cullPasses(RenderGraph *graph);
+void transitionResource(RenderGraphResource *resource, RenderGraphUse *use, BarrierBatch *batch);
+void flushBarriers(RenderGraph *graph, VkCommandBuffer cmdBuffer, BarrierBatch *batch);
+
+void createRenderGraph(Device *device, RenderGraph *graph) {
+    memset(graph, 0, sizeof(RenderGraph));
+    graph->device = device;
+}
+
+void renderGraphReset(RenderGraph *graph) {
+    graph->resourceCount = 0;
+    graph->passCount = 0;
+    graph->stats = (RenderGraphStats){0};
+}
+
+uint32_t renderGraphImportImage(
+    RenderGraph *graph,
+    VkImage image,
+    VkImageAspectFlags aspect,
+    VkImageLayout initialLayout,
+    VkPipelineStageFlags2 initialStages
+) {
+    assert(graph->resourceCount < RENDER_GRAPH_MAX_RESOURCES);
+
+    graph->resources[graph->resourceCount] = (RenderGraphResource){
+        .type = RENDER_GRAPH_RESOURCE_IMAGE,
+        .image = image,
+        .aspect = aspect,
+        .layout = initialLayout,
+        .writeStages = initialStages,
+    };
+
+    return graph->resourceCount++;
+}
+
+uint32_t renderGraphImportBuffer(RenderGraph *graph, VkBuffer buffer, VkPipelineStageFlags2 initialStages) {
+    assert(graph->resourceCount < RENDER_GRAPH_MAX_RESOURCES);
+
+    graph->resources[graph->resourceCount] = (RenderGraphResource){
+        .type = RENDER_GRAPH_RESOURCE_BUFFER,
+        .buffer = buffer,
+        .layout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .writeStages = initialStages,
+    };
+
+    return graph->resourceCount++;
+}
+
+void renderGraphSetOutput(RenderGraph *graph, uint32_t resource, ResourceAccess finalAccess) {
+    assert(resource < graph->resourceCount);
+
+    graph->resources[resource].output = VK_TRUE;
+    graph->resources[resource].finalAccess = finalAccess;
+}
+
+uint32_t renderGraphAddPass(
+    RenderGraph *graph,
+    const char *name,
+    RenderGraphQueue queue,
+    RenderGraphExecute execute,
+    void *userData
+) {
+    assert(graph->passCount < RENDER_GRAPH_MAX_PASSES);
+
+    graph->passes[graph->passCount] = (RenderGraphPass){
+        .name = name,
+        .queue = queue,
+        .execute = execute,
+        .userData = userData,
+    };
+
+    return graph->passCount++;
+}
+
+void renderGraphUse(RenderGraph *graph, uint32_t pass, uint32_t resource, ResourceAccess access) {
+    assert(pass < graph->passCount);
+    assert(resource < graph->resourceCount);
+    assert(access > RESOURCE_ACCESS_NONE && access < RESOURCE_ACCESS_COUNT);
+
+    RenderGraphPass *graphPass = &graph->passes[pass];
+    const AccessInfo *info = &accessInfos[access];
+
+    // Several uses of one resource in a pass are merged into a single barrier
+    for(uint32_t i = 0; i < graphPass->useCount; i++) {
+        RenderGraphUse *use = &graphPass->uses[i];
+        if(use->resource != resource) continue;
+
+        assert(graph->resources[resource].type == RENDER_GRAPH_RESOURCE_BUFFER || use->layout == info->layout);
+        use->stages |= info->stages;
+        use->access |= info->access;
+        use->write |= info->write;
+        return;
+    }
+
+    assert(graphPass->useCount < RENDER_GRAPH_MAX_USES);
+    graphPass->uses[graphPass->useCount++] = (RenderGraphUse){
+        .resource = resource,
+        .stages = info->stages,
+        .access = info->access,
+        .layout = info->layout,
+        .write = info->write,
+    };
+}
+
+void renderGraphExecute(RenderGraph *graph, VkCommandBuffer cmdBuffer) {
+    cullPasses(graph);
+
+    for(uint32_t p = 0; p < graph->passCount; p++) {
+        RenderGraphPass *pass = &graph->passes[p];
+        if(pass->culled) {
+            graph->stats.culledPasses++;
+            continue;
+        }
+
+        BarrierBatch batch = {0};
+        for(uint32_t u = 0; u < pass->useCount; u++) {
+            RenderGraphUse *use = &pass->uses[u];
+            transitionResource(&graph->resources[use->resource], use, &batch);
+        }
+        flushBarriers(graph, cmdBuffer, &batch);
+
+        pass->execute(cmdBuffer, pass->userData);
+        graph->stats.passes++;
+    }
+
+    BarrierBatch finalBatch = {0};
+    for(uint32_t r = 0; r < graph->resourceCount; r++) {
+        RenderGraphResource *resource = &graph->resources[r];
+        if(!resource->output || resource->finalAccess == RESOURCE_ACCESS_NONE) continue;
+
+        const AccessInfo *info = &accessInfos[resource->finalAccess];
+        RenderGraphUse use = {
+            .resource = r,
+            .stages = info->stages,
+            .access = info->access,
+            .layout = info->layout,
+            .write = info->write,
+        };
+        transitionResource(resource, &use, &finalBatch);
+    }
+    flushBarriers(graph, cmdBuffer, &finalBatch);
+}
+
+void cullPasses(RenderGraph *graph) {
+    VkBool32 needed[RENDER_GRAPH_MAX_RESOURCES];
+    for(uint32_t r = 0; r < graph->resourceCount; r++) {
+        needed[r] = graph->resources[r].output;
+    }
+
+    // A pass lives if it writes something a later live pass or an output needs
+    for(uint32_t p = graph->passCount; p-- > 0;) {
+        RenderGraphPass *pass = &graph->passes[p];
+
+        pass->culled = VK_TRUE;
+        for(uint32_t u = 0; u < pass->useCount; u++) {
+            if(pass->uses[u].write && needed[pass->uses[u].resource]) {
+                pass->culled = VK_FALSE;
+                break;
+            }
+        }
+
+        if(pass->culled) continue;
+
+        for(uint32_t u = 0; u < pass->useCount; u++) {
+            needed[pass->uses[u].resource] = VK_TRUE;
+        }
+    }
+}
+
+void transitionResource(RenderGraphResource *resource, RenderGraphUse *use, BarrierBatch *batch) {
+    VkBool32 isImage = resource->type == RENDER_GRAPH_RESOURCE_IMAGE;
+    VkBool32 layoutChange = isImage && resource->layout != use->layout;
+
+    VkPipelineStageFlags2 srcStages = 0;
+    VkAccessFlags2 srcAccess = 0;
+    VkBool32 barrier = VK_FALSE;
+
+    if(layoutChange) {
+        // The transition itself is a write, it has to wait for every earlier use
+        srcStages = resource->writeStages | resource->readStages;
+        srcAccess = resource->writeAccess;
+        barrier = VK_TRUE;
+    } else if(use->write) {
+        // Write after read only needs an execution dependency
+        srcStages = resource->writeStages | resource->readStages;
+        srcAccess = resource->writeAccess;
+        barrier = srcStages != 0;
+    } else {
+        // Read after write, skipped when these stages already see the write
+        VkBool32 unseen = (use->stages & ~resource->readStages) != 0 ||
+            (use->access & ~resource->readAccess) != 0;
+        srcStages = resource->writeStages;
+        srcAccess = resource->writeAccess;
+        barrier = unseen && (resource->writeStages != 0 || resource->writeAccess != 0);
+    }
+
+    if(barrier) {
+        if(isImage) {
+            batch->images[batch->imageCount++] = (VkImageMemoryBarrier2){
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+                .srcStageMask = srcStages,
+                .srcAccessMask = srcAccess,
+                .dstStageMask = use->stages,
+                .dstAccessMask = use->access,
+                .oldLayout = resource->layout,
+                .newLayout = use->layout,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .image = resource->image,
+                .subresourceRange = {
+                    .aspectMask = resource->aspect,
+                    .baseMipLevel = 0,
+                    .levelCount = VK_REMAINING_MIP_LEVELS,
+                    .baseArrayLayer = 0,
+                    .layerCount = VK_REMAINING_ARRAY_LAYERS,
+                },
+            };
+        } else {
+            batch->buffers[batch->bufferCount++] = (VkBufferMemoryBarrier2){
+                .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+                .srcStageMask = srcStages,
+                .srcAccessMask = srcAccess,
+                .dstStageMask = use->stages,
+                .dstAccessMask = use->access,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .buffer = resource->buffer,
+                .offset = 0,
+                .size = VK_WHOLE_SIZE,
+            };
+        }
+    }
+
+    if(isImage) {
+        resource->layout = use->layout;
+    }
+
+    if(use->write || layoutChange) {
+        resource->writeStages = use->stages;
+        resource->writeAccess = use->write ? use->access : 0;
+        resource->readStages = use->write ? 0 : use->stages;
+        resource->readAccess = use->write ? 0 : use->access;
+    } else {
+        resource->readStages |= use->stages;
+        resource->readAccess |= use->access;
+    }
+}
+
+void flushBarriers(RenderGraph *graph, VkCommandBuffer cmdBuffer, BarrierBatch *batch) {
+    if(batch->imageCount == 0 && batch->bufferCount == 0) {
+        return;
+    }
+
+    graph->stats.barrierBatches++;
+    graph->stats.imageBarriers += batch->imageCount;
+    graph->stats.bufferBarriers += batch->bufferCount;
+
+    if(graph->device->enabled.synchronization2) {
+        VkDependencyInfoKHR dependency = {
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .pImageMemoryBarriers = batch->images,
+            .imageMemoryBarrierCount = batch->imageCount,
+            .pBufferMemoryBarriers = batch->buffers,
+            .bufferMemoryBarrierCount = batch->bufferCount,
+        };
+        cmdPipelineBarrier2KHR(graph->device, cmdBuffer, &dependency);
+        return;
+    }
+
+    // Legacy barriers share one stage mask pair for the whole batch
+    VkPipelineStageFlags srcStages = 0, dstStages = 0;
+    VkImageMemoryBarrier images[RENDER_GRAPH_MAX_RESOURCES];
+    VkBufferMemoryBarrier buffers[RENDER_GRAPH_MAX_RESOURCES];
+
+    for(uint32_t i = 0; i < batch->imageCount; i++) {
+        VkImageMemoryBarrier2 *barrier = &batch->images[i];
+        srcStages |= (VkPipelineStageFlags)barrier->srcStageMask;
+        dstStages |= (VkPipelineStageFlags)barrier->dstStageMask;
+
+        images[i] = (VkImageMemoryBarrier){
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = (VkAccessFlags)barrier->srcAccessMask,
+            .dstAccessMask = (VkAccessFlags)barrier->dstAccessMask,
+            .oldLayout = barrier->oldLayout,
+            .newLayout = barrier->newLayout,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = barrier->image,
+            .subresourceRange = barrier->subresourceRange,
+        };
+    }
+
+    for(uint32_t i = 0; i < batch->bufferCount; i++) {
+        VkBufferMemoryBarrier2 *barrier = &batch->buffers[i];
+        srcStages |= (VkPipelineStageFlags)barrier->srcStageMask;
+        dstStages |= (VkPipelineStageFlags)barrier->dstStageMask;
+
+        buffers[i] = (VkBufferMemoryBarrier){
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .srcAccessMask = (VkAccessFlags)barrier->srcAccessMask,
+            .dstAccessMask = (VkAccessFlags)barrier->dstAccessMask,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .buffer = barrier->buffer,
+            .offset = barrier->offset,
+            .size = barrier->size,
+        };
+    }
+
+    cmdPipelineBarrier(
+        cmdBuffer,
+        srcStages != 0 ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        dstStages != 0 ? dstStages : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        0, 0, NULL,
+        batch->bufferCount, buffers,
+        batch->imageCount, images
+    );
+}
@@ -0,0 +1,136 @@
+#ifndef RENDER_GRAPH_H_
+#define RENDER_GRAPH_H_
+
+#include <vulkan/vulkan.h>
+
+#include "device_api.h"
+
+#define RENDER_GRAPH_MAX_PASSES 32
+#define RENDER_GRAPH_MAX_RESOURCES 32
+#define RENDER_GRAPH_MAX_USES 8
+
+// How a pass touches a resource. Each maps to a stage, access and image layout.
+typedef enum {
+    RESOURCE_ACCESS_NONE = 0,
+    RESOURCE_ACCESS_COLOR_ATTACHMENT_WRITE,
+    RESOURCE_ACCESS_FRAGMENT_SAMPLED_READ,
+    RESOURCE_ACCESS_COMPUTE_STORAGE_READ,
+    RESOURCE_ACCESS_COMPUTE_STORAGE_WRITE,
+    RESOURCE_ACCESS_INDIRECT_READ,
+    RESOURCE_ACCESS_TRANSFER_READ,
+    RESOURCE_ACCESS_TRANSFER_WRITE,
+    // Mapped memory read by the CPU once the frame finished
+    RESOURCE_ACCESS_HOST_READ,
+    // Build or update of an acceleration structure, or its scratch. Updates read the old contents.
+    RESOURCE_ACCESS_ACCELERATION_STRUCTURE_BUILD,
+    RESOURCE_ACCESS_RAY_TRACING_READ,
+    RESOURCE_ACCESS_RAY_TRACING_STORAGE_WRITE,
+    // Shader records fetched by trace rays commands
+    RESOURCE_ACCESS_SHADER_BINDING_TABLE_READ,
+    RESOURCE_ACCESS_PRESENT,
+    RESOURCE_ACCESS_COUNT,
+} ResourceAccess;
+
+typedef enum {
+    RENDER_GRAPH_RESOURCE_IMAGE,
+    RENDER_GRAPH_RESOURCE_BUFFER,
+} RenderGraphResourceType;
+
+// Queue a pass wants to run on. Everything is recorded on the graphics queue for
+// now, compute passes are kept apart so they can be moved to an async queue.
+typedef enum {
+    RENDER_GRAPH_QUEUE_GRAPHICS,
+    RENDER_GRAPH_QUEUE_COMPUTE,
+} RenderGraphQueue;
+
+typedef void (*RenderGraphExecute)(VkCommandBuffer cmdBuffer, void *userData);
+
+typedef struct {
+    RenderGraphResourceType type;
+    VkImage image;
+    VkImageAspectFlags aspect;
+    VkBuffer buffer;
+
+    // State after the last recorded use
+    VkImageLayout layout;
+    VkPipelineStageFlags2 writeStages;
+    VkAccessFlags2 writeAccess;
+    // Stages and accesses that already saw the last write
+    VkPipelineStageFlags2 readStages;
+    VkAccessFlags2 readAccess;
+
+    // Access the resource is left in after the graph, only set on outputs
+    ResourceAccess finalAccess;
+    VkBool32 output;
+} RenderGraphResource;
+
+typedef struct {
+    uint32_t resource;
+    VkPipelineStageFlags2 stages;
+    VkAccessFlags2 access;
+    VkImageLayout layout;
+    VkBool32 write;
+} RenderGraphUse;
+
+typedef struct {
+    const char *name;
+    RenderGraphQueue queue;
+    RenderGraphExecute execute;
+    void *userData;
+
+    RenderGraphUse uses[RENDER_GRAPH_MAX_USES];
+    uint32_t useCount;
+
+    VkBool32 culled;
+} RenderGraphPass;
+
+typedef struct {
+    uint32_t passes;
+    uint32_t culledPasses;
+    uint32_t barrierBatches;
+    uint32_t imageBarriers;
+    uint32_t bufferBarriers;
+} RenderGraphStats;
+
+typedef struct {
+    Device *device;
+
+    RenderGraphResource resources[RENDER_GRAPH_MAX_RESOURCES];
+    uint32_t resourceCount;
+    RenderGraphPass passes[RENDER_GRAPH_MAX_PASSES];
+    uint32_t passCount;
+
+    RenderGraphStats stats;
+} RenderGraph;
+
+void createRenderGraph(Device *device, RenderGraph *graph);
+// Forgets every pass and resource, called at the start of each frame
+void renderGraphReset(RenderGraph *graph);
+
+// initialStages are the stages earlier work may still use the resource in, the first
+// use waits on them. For swapchain images that is the acquire semaphore wait stage.
+uint32_t renderGraphImportImage(
+    RenderGraph *graph,
+    VkImage image,
+    VkImageAspectFlags aspect,
+    VkImageLayout initialLayout,
+    VkPipelineStageFlags2 initialStages
+);
+uint32_t renderGraphImportBuffer(RenderGraph *graph, VkBuffer buffer, VkPipelineStageFlags2 initialStages);
+// Keeps passes writing the resource alive and transitions it to finalAccess at the end
+void renderGraphSetOutput(RenderGraph *graph, uint32_t resource, ResourceAccess finalAccess);
+
+uint32_t renderGraphAddPass(
+    RenderGraph *graph,
+    const char *name,
+    RenderGraphQueue queue,
+    RenderGraphExecute execute,
+    void *userData
+);
+void renderGraphUse(RenderGraph *graph, uint32_t pass, uint32_t resource, ResourceAccess access);
+
+// Culls passes not contributing to an output, then records the remaining passes
+// with the minimal barriers between them, one batch per pass.
+void renderGraphExecute(RenderGraph *graph, VkCommandBuffer cmdBuffer);
+
+#endif
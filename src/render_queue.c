@@ -0,0 +1,404 @@
+#include "render_queue.h"
+#include "device_api.h"
+#include "mesh.h"
+#include "vkalloc.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vulkan/vk_enum_string_helper.h>
+#include <vulkan/vulkan_core.h>
+
+#define HANDLE_TABLE_INITIAL_CAPACITY 64
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+// Submission index bits are already in order, a stable sort can skip them
+#define RADIX_PASSES ((64 - RENDER_QUEUE_INDEX_BITS) / RADIX_BITS)
+
+#define KEY_INDEX_MASK ((1ull << RENDER_QUEUE_INDEX_BITS) - 1)
+#define KEY_STATE(KEY) ((KEY) >> RENDER_QUEUE_INDEX_BITS)
+#define KEY_MESH_SHIFT RENDER_QUEUE_INDEX_BITS
+#define KEY_MATERIAL_SHIFT (KEY_MESH_SHIFT + RENDER_QUEUE_MESH_BITS)
+#define KEY_PIPELINE_SHIFT (KEY_MATERIAL_SHIFT + RENDER_QUEUE_MATERIAL_BITS)
+
+VkResult handleTableInit(HandleTable *table, uint32_t capacity);
+void handleTableDestroy(HandleTable *table);
+void handleTableClear(HandleTable *table);
+uint32_t handleTableIntern(HandleTable *table, uint64_t handle);
+uint64_t hashHandle(uint64_t handle);
+VkResult createInstanceBuffer(VkAlloc *alloc, uint32_t capacity, InstanceBuffer *instanceBuffer);
+void destroyInstanceBuffer(VkAlloc *alloc, InstanceBuffer *instanceBuffer);
+
+VkResult createRenderQueue(
+    VkAlloc *alloc,
+    uint32_t framesInFlight,
+    size_t initialCapacity,
+    RenderQueue *queue
+) {
+    if(initialCapacity == 0) initialCapacity = 1;
+
+    *queue = (RenderQueue){
+        .allocator = alloc,
+        .items = (RenderItem*)malloc(initialCapacity * sizeof(RenderItem)),
+        .keys = (uint64_t*)malloc(initialCapacity * sizeof(uint64_t)),
+        .sortScratch = (uint64_t*)malloc(initialCapacity * sizeof(uint64_t)),
+        .itemCount = 0,
+        .capacity = initialCapacity,
+    };
+
+    if(queue->items == NULL || queue->keys == NULL || queue->sortScratch == NULL) {
+        destroyRenderQueue(queue);
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+
+    if(handleTableInit(&queue->pipelineIds, HANDLE_TABLE_INITIAL_CAPACITY) != VK_SUCCESS ||
+        handleTableInit(&queue->meshIds, HANDLE_TABLE_INITIAL_CAPACITY) != VK_SUCCESS)
+    {
+        destroyRenderQueue(queue);
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+
+    queue->instanceBuffers = (InstanceBuffer*)calloc(framesInFlight, sizeof(InstanceBuffer));
+    if(queue->instanceBuffers == NULL) {
+        destroyRenderQueue(queue);
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+
+    for(uint32_t i = 0; i < framesInFlight; i++) {
+        VkResult result = createInstanceBuffer(
+            alloc,
+            RENDER_QUEUE_DEFAULT_INSTANCE_CAPACITY,
+            &queue->instanceBuffers[i]
+        );
+        if(result != VK_SUCCESS) {
+            destroyRenderQueue(queue);
+            return result;
+        }
+        queue->instanceBufferCount++;
+    }
+
+    return VK_SUCCESS;
+}
+
+void destroyRenderQueue(RenderQueue *queue) {
+    free(queue->items);
+    free(queue->keys);
+    free(queue->sortScratch);
+    handleTableDestroy(&queue->pipelineIds);
+    handleTableDestroy(&queue->meshIds);
+
+    for(uint32_t i = 0; i < queue->instanceBufferCount; i++) {
+        destroyInstanceBuffer(queue->allocator, &queue->instanceBuffers[i]);
+    }
+    free(queue->instanceBuffers);
+
+    *queue = (RenderQueue){0};
+}
+
+void renderQueueReset(RenderQueue *queue) {
+    queue->itemCount = 0;
+    queue->stats = (RenderQueueStats){0};
+    handleTableClear(&queue->pipelineIds);
+    handleTableClear(&queue->meshIds);
+}
+
+VkResult renderQueueSubmit(RenderQueue *queue, const RenderItem *item) {
+    assert(queue->itemCount < RENDER_QUEUE_MAX_ITEMS);
+    assert(item->material < RENDER_QUEUE_MAX_MATERIALS);
+
+    if(queue->itemCount + 1 > queue->capacity) {
+        size_t capacity = queue->capacity * 2;
+
+        // Arrays that already grew are kept, the capacity only moves once all of them did
+        RenderItem *items = (RenderItem*)realloc(queue->items, capacity * sizeof(RenderItem));
+        if(items == NULL) {
+            return VK_ERROR_OUT_OF_HOST_MEMORY;
+        }
+        queue->items = items;
+
+        uint64_t *keys = (uint64_t*)realloc(queue->keys, capacity * sizeof(uint64_t));
+        if(keys == NULL) {
+            return VK_ERROR_OUT_OF_HOST_MEMORY;
+        }
+        queue->keys = keys;
+
+        uint64_t *sortScratch = (uint64_t*)realloc(queue->sortScratch, capacity * sizeof(uint64_t));
+        if(sortScratch == NULL) {
+            return VK_ERROR_OUT_OF_HOST_MEMORY;
+        }
+        queue->sortScratch = sortScratch;
+
+        queue->capacity = capacity;
+    }
+
+    uint64_t pipelineId = handleTableIntern(&queue->pipelineIds, (uint64_t)item->pipeline);
+    uint64_t meshId = handleTableIntern(&queue->meshIds, (uint64_t)(uintptr_t)item->mesh);
+    assert(pipelineId < RENDER_QUEUE_MAX_PIPELINES);
+    assert(meshId < RENDER_QUEUE_MAX_MESHES);
+
+    size_t index = queue->itemCount++;
+    queue->items[index] = *item;
+    queue->keys[index] = (pipelineId << KEY_PIPELINE_SHIFT) |
+        ((uint64_t)item->material << KEY_MATERIAL_SHIFT) |
+        (meshId << KEY_MESH_SHIFT) |
+        (uint64_t)index;
+
+    return VK_SUCCESS;
+}
+
+void renderQueueSort(RenderQueue *queue) {
+    if(queue->itemCount == 0) {
+        return;
+    }
+
+    size_t counts[RADIX_PASSES][RADIX_BUCKETS];
+    memset(counts, 0, sizeof(counts));
+
+    for(size_t i = 0; i < queue->itemCount; i++) {
+        uint64_t key = queue->keys[i];
+        for(int pass = 0; pass < RADIX_PASSES; pass++) {
+            int shift = RENDER_QUEUE_INDEX_BITS + pass * RADIX_BITS;
+            counts[pass][(key >> shift) & (RADIX_BUCKETS - 1)]++;
+        }
+    }
+
+    uint64_t *src = queue->keys;
+    uint64_t *dst = queue->sortScratch;
+
+    for(int pass = 0; pass < RADIX_PASSES; pass++) {
+        int shift = RENDER_QUEUE_INDEX_BITS + pass * RADIX_BITS;
+
+        // All keys share this digit, nothing to reorder
+        if(counts[pass][(src[0] >> shift) & (RADIX_BUCKETS - 1)] == queue->itemCount) {
+            continue;
+        }
+
+        size_t offset = 0;
+        for(int bucket = 0; bucket < RADIX_BUCKETS; bucket++) {
+            size_t count = counts[pass][bucket];
+            counts[pass][bucket] = offset;
+            offset += count;
+        }
+
+        for(size_t i = 0; i < queue->itemCount; i++) {
+            uint64_t key = src[i];
+            dst[counts[pass][(key >> shift) & (RADIX_BUCKETS - 1)]++] = key;
+        }
+
+        uint64_t *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    queue->keys = src;
+    queue->sortScratch = dst;
+}
+
+void renderQueueFlush(RenderQueue *queue, VkCommandBuffer cmdBuffer, uint32_t frame) {
+    if(queue->itemCount == 0) {
+        return;
+    }
+
+    assert(frame < queue->instanceBufferCount);
+    InstanceBuffer *instances = &queue->instanceBuffers[frame];
+
+    // The slot is only reused once its frame fence was waited on, so it can be replaced
+    if(queue->itemCount > instances->capacity) {
+        uint32_t capacity = instances->capacity;
+        while(capacity < queue->itemCount) capacity *= 2;
+
+        destroyInstanceBuffer(queue->allocator, instances);
+        VkResult result = createInstanceBuffer(queue->allocator, capacity, instances);
+        if(result != VK_SUCCESS) {
+            fprintf(stderr, "Failed to grow instance buffer: %s.\n", string_VkResult(result));
+            exit(1);
+        }
+    }
+
+    renderQueueSort(queue);
+
+    VkPipeline boundPipeline = VK_NULL_HANDLE;
+    VkBuffer boundVertexBuffer = VK_NULL_HANDLE;
+    VkBuffer boundIndexBuffer = VK_NULL_HANDLE;
+
+    RenderQueueStats stats = {
+        .items = (uint32_t)queue->itemCount,
+    };
+
+    VkBuffer instanceBuffers[] = {instances->buffer.buffer};
+    VkDeviceSize instanceOffsets[] = {0};
+    cmdBindVertexBuffers(
+        cmdBuffer,
+        (UInt32Range){VERTEX_BINDING_INSTANCE, VERTEX_BINDING_INSTANCE + 1},
+        instanceBuffers,
+        instanceOffsets
+    );
+
+    size_t i = 0;
+    while(i < queue->itemCount) {
+        RenderItem *item = &queue->items[queue->keys[i] & KEY_INDEX_MASK];
+
+        // Sorting put every item with the same state next to each other
+        uint32_t firstInstance = (uint32_t)i;
+        uint64_t state = KEY_STATE(queue->keys[i]);
+        while(i < queue->itemCount && KEY_STATE(queue->keys[i]) == state) {
+            instances->mapped[i].transform = queue->items[queue->keys[i] & KEY_INDEX_MASK].transform;
+            i++;
+        }
+        uint32_t lastInstance = (uint32_t)i;
+
+        if(item->pipeline != boundPipeline) {
+            cmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, item->pipeline);
+            boundPipeline = item->pipeline;
+            stats.pipelineBinds++;
+        }
+
+        if(item->mesh->vertexBuffer.buffer != boundVertexBuffer) {
+            VkBuffer vertexBuffers[] = {item->mesh->vertexBuffer.buffer};
+            VkDeviceSize offsets[] = {0};
+            cmdBindVertexBuffers(
+                cmdBuffer,
+                (UInt32Range){VERTEX_BINDING_VERTEX, VERTEX_BINDING_VERTEX + 1},
+                vertexBuffers,
+                offsets
+            );
+            boundVertexBuffer = item->mesh->vertexBuffer.buffer;
+            stats.vertexBufferBinds++;
+        }
+
+        if(item->mesh->indexBuffer.buffer != boundIndexBuffer) {
+            cmdBindIndexBuffer(cmdBuffer, item->mesh->indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+            boundIndexBuffer = item->mesh->indexBuffer.buffer;
+            stats.indexBufferBinds++;
+        }
+
+        cmdDrawIndexed(
+            cmdBuffer,
+            (UInt32Range){0, item->mesh->indexCount},
+            (UInt32Range){firstInstance, lastInstance},
+            0
+        );
+        stats.drawCalls++;
+        stats.instances += lastInstance - firstInstance;
+    }
+
+    stats.stateChangesSaved = 3 * stats.items -
+        (stats.pipelineBinds + stats.vertexBufferBinds + stats.indexBufferBinds);
+
+    queue->stats = stats;
+}
+
+RenderQueueStats renderQueueStats(RenderQueue *queue) {
+    return queue->stats;
+}
+
+VkResult handleTableInit(HandleTable *table, uint32_t capacity) {
+    *table = (HandleTable){
+        .keys = (uint64_t*)calloc(capacity, sizeof(uint64_t)),
+        .values = (uint32_t*)calloc(capacity, sizeof(uint32_t)),
+        .capacity = capacity,
+        .count = 0,
+    };
+
+    if(table->keys == NULL || table->values == NULL) {
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+
+    return VK_SUCCESS;
+}
+
+void handleTableDestroy(HandleTable *table) {
+    free(table->keys);
+    free(table->values);
+    *table = (HandleTable){0};
+}
+
+void handleTableClear(HandleTable *table) {
+    memset(table->keys, 0, table->capacity * sizeof(uint64_t));
+    table->count = 0;
+}
+
+uint32_t handleTableIntern(HandleTable *table, uint64_t handle) {
+    assert(handle != 0);
+
+    // Keep load factor under 1/2
+    if((table->count + 1) * 2 > table->capacity) {
+        HandleTable grown;
+        assert(handleTableInit(&grown, table->capacity * 2) == VK_SUCCESS);
+
+        for(uint32_t i = 0; i < table->capacity; i++) {
+            if(table->keys[i] == 0) continue;
+
+            uint32_t slot = hashHandle(table->keys[i]) & (grown.capacity - 1);
+            while(grown.keys[slot] != 0) {
+                slot = (slot + 1) & (grown.capacity - 1);
+            }
+            grown.keys[slot] = table->keys[i];
+            grown.values[slot] = table->values[i];
+        }
+        grown.count = table->count;
+
+        handleTableDestroy(table);
+        *table = grown;
+    }
+
+    uint32_t slot = hashHandle(handle) & (table->capacity - 1);
+    while(table->keys[slot] != 0) {
+        if(table->keys[slot] == handle) {
+            return table->values[slot];
+        }
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+
+    table->keys[slot] = handle;
+    table->values[slot] = table->count;
+
+    return table->count++;
+}
+
+uint64_t hashHandle(uint64_t handle) {
+    handle ^= handle >> 33;
+    handle *= 0xff51afd7ed558ccdull;
+    handle ^= handle >> 33;
+    return handle;
+}
+
+VkResult createInstanceBuffer(VkAlloc *alloc, uint32_t capacity, InstanceBuffer *instanceBuffer) {
+    VkBufferCreateInfo bufferInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pQueueFamilyIndices = &alloc->device->queueFamilies.graphics,
+        .queueFamilyIndexCount = 1,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .size = capacity * sizeof(InstanceData),
+        .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+    };
+
+    VkResult result = createAllocateBuffer(
+        alloc,
+        &bufferInfo,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &instanceBuffer->buffer
+    );
+    if(result != VK_SUCCESS) {
+        return result;
+    }
+
+    // Stays mapped for the lifetime of the buffer
+    instanceBuffer->mapped = (InstanceData*)mapBufferMemory(alloc, &instanceBuffer->buffer);
+    if(instanceBuffer->mapped == NULL) {
+        destroyDeallocateBuffer(alloc, &instanceBuffer->buffer);
+        return VK_ERROR_MEMORY_MAP_FAILED;
+    }
+
+    instanceBuffer->capacity = capacity;
+
+    return VK_SUCCESS;
+}
+
+void destroyInstanceBuffer(VkAlloc *alloc, InstanceBuffer *instanceBuffer) {
+    unmapBufferMemory(alloc, &instanceBuffer->buffer);
+    destroyDeallocateBuffer(alloc, &instanceBuffer->buffer);
+    *instanceBuffer = (InstanceBuffer){0};
+}
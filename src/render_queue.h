@@ -0,0 +1,92 @@
+#ifndef RENDER_QUEUE_H_
+#define RENDER_QUEUE_H_
+
+#include <vulkan/vulkan.h>
+
+#include "mesh.h"
+#include "vkalloc.h"
+
+// Sort key layout (most significant first):
+// [63:54] pipeline id, [53:40] material id, [39:24] mesh id, [23:0] submission index
+#define RENDER_QUEUE_PIPELINE_BITS 10
+#define RENDER_QUEUE_MATERIAL_BITS 14
+#define RENDER_QUEUE_MESH_BITS 16
+#define RENDER_QUEUE_INDEX_BITS 24
+
+#define RENDER_QUEUE_MAX_PIPELINES (1u << RENDER_QUEUE_PIPELINE_BITS)
+#define RENDER_QUEUE_MAX_MATERIALS (1u << RENDER_QUEUE_MATERIAL_BITS)
+#define RENDER_QUEUE_MAX_MESHES (1u << RENDER_QUEUE_MESH_BITS)
+#define RENDER_QUEUE_MAX_ITEMS (1u << RENDER_QUEUE_INDEX_BITS)
+
+#define RENDER_QUEUE_DEFAULT_INSTANCE_CAPACITY 4096
+
+typedef struct {
+    Mesh *mesh;
+    VkPipeline pipeline;
+    // Opaque id, only used to group items. Must be below RENDER_QUEUE_MAX_MATERIALS.
+    uint32_t material;
+    Matrix4f transform;
+} RenderItem;
+
+typedef struct {
+    uint32_t items;
+    uint32_t drawCalls;
+    uint32_t instances;
+    uint32_t pipelineBinds;
+    uint32_t vertexBufferBinds;
+    uint32_t indexBufferBinds;
+    // Binds that would have been issued by drawing every item unsorted
+    uint32_t stateChangesSaved;
+} RenderQueueStats;
+
+// Handle -> small id map, cleared every frame
+typedef struct {
+    uint64_t *keys;
+    uint32_t *values;
+    uint32_t capacity;
+    uint32_t count;
+} HandleTable;
+
+// Host visible ring slot, one per frame in flight
+typedef struct {
+    Buffer buffer;
+    InstanceData *mapped;
+    uint32_t capacity;
+} InstanceBuffer;
+
+typedef struct {
+    VkAlloc *allocator;
+
+    RenderItem *items;
+    uint64_t *keys;
+    uint64_t *sortScratch;
+    size_t itemCount;
+    size_t capacity;
+
+    HandleTable pipelineIds;
+    HandleTable meshIds;
+
+    InstanceBuffer *instanceBuffers;
+    uint32_t instanceBufferCount;
+
+    RenderQueueStats stats;
+} RenderQueue;
+
+VkResult createRenderQueue(
+    VkAlloc *alloc,
+    uint32_t framesInFlight,
+    size_t initialCapacity,
+    RenderQueue *queue
+);
+void destroyRenderQueue(RenderQueue *queue);
+
+void renderQueueReset(RenderQueue *queue);
+// Fails with VK_ERROR_OUT_OF_HOST_MEMORY when the queue cannot grow, the item is not queued
+VkResult renderQueueSubmit(RenderQueue *queue, const RenderItem *item);
+void renderQueueSort(RenderQueue *queue);
+// Items sharing pipeline, material and mesh are merged into one instanced draw
+// using the instance buffer of the given frame slot.
+void renderQueueFlush(RenderQueue *queue, VkCommandBuffer cmdBuffer, uint32_t frame);
+RenderQueueStats renderQueueStats(RenderQueue *queue);
+
+#endif
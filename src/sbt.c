@@ -0,0 +1,252 @@
+#include "sbt.h"
+#include "device_api.h"
+#include "vkalloc.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vulkan/vk_enum_string_helper.h>
+#include <vulkan/vulkan_core.h>
+
+// vkCmdUpdateBuffer limit
+#define SBT_MAX_UPDATE_SIZE 65536
+
+VkDeviceSize sbtAlign(VkDeviceSize value, VkDeviceSize alignment);
+void sbtWriteRecord(ShaderBindingTable *sbt, SbtRegion region, uint32_t index, const uint8_t *record);
+uint8_t *sbtRecordContents(ShaderBindingTable *sbt, SbtRegion region, uint32_t index);
+
+VkResult createShaderBindingTable(
+    Device *device,
+    VkAlloc *alloc,
+    const SbtRegionLayout layouts[SBT_REGION_COUNT],
+    ShaderBindingTable *sbt
+) {
+    memset(sbt, 0, sizeof(ShaderBindingTable));
+    sbt->device = device;
+    sbt->alloc = alloc;
+
+    VkPhysicalDeviceRayTracingPipelinePropertiesKHR rayProps = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR,
+    };
+    VkPhysicalDeviceProperties2 props = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &rayProps,
+    };
+    getPhysicalDeviceProperties2(device, &props);
+    if(rayProps.shaderGroupHandleSize > SBT_MAX_HANDLE_SIZE) {
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+    sbt->handleSize = rayProps.shaderGroupHandleSize;
+
+    // Updates are written in multiples of 4 bytes
+    VkDeviceSize handleAlignment = rayProps.shaderGroupHandleAlignment > 4 ? rayProps.shaderGroupHandleAlignment : 4;
+    VkDeviceSize baseAlignment = rayProps.shaderGroupBaseAlignment;
+
+    uint32_t recordCount = 0;
+    for(uint32_t region = 0; region < SBT_REGION_COUNT; region++) {
+        const SbtRegionLayout *layout = &layouts[region];
+        if(layout->dataSize > SBT_MAX_RECORD_DATA || layout->dataSize % 4 != 0) {
+            return VK_ERROR_INITIALIZATION_FAILED;
+        }
+
+        VkDeviceSize stride = sbtAlign(sbt->handleSize + layout->dataSize, handleAlignment);
+        if(stride > rayProps.maxShaderGroupStride) {
+            return VK_ERROR_INITIALIZATION_FAILED;
+        }
+
+        sbt->layouts[region] = *layout;
+        sbt->strides[region] = stride;
+        sbt->offsets[region] = sbtAlign(sbt->size, baseAlignment);
+        sbt->firstRecords[region] = recordCount;
+        sbt->size = sbt->offsets[region] + stride * layout->recordCount;
+        recordCount += layout->recordCount;
+    }
+    if(recordCount > SBT_MAX_RECORDS) {
+        return VK_ERROR_TOO_MANY_OBJECTS;
+    }
+
+    // The whole table is written by the first upload, unset records as zeros
+    sbt->contents = (uint8_t*)calloc(sbt->size, 1);
+    assert(sbt->contents != NULL);
+    for(uint32_t i = 0; i < recordCount; i++) {
+        sbt->groups[i] = UINT32_MAX;
+        sbt->dirty[i] = VK_TRUE;
+    }
+    sbt->changed = VK_TRUE;
+
+    // Buffer alignment does not cover the base alignment, the table is placed at an aligned offset
+    VkBufferCreateInfo bufferInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pQueueFamilyIndices = &device->queueFamilies.graphics,
+        .queueFamilyIndexCount = 1,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .size = sbt->size + baseAlignment,
+        .usage = VK_BUFFER_USAGE_SHADER_BINDING_TABLE_BIT_KHR |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+    };
+    VkResult result = createAllocateBuffer(alloc, &bufferInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &sbt->buffer);
+    if(result != VK_SUCCESS) {
+        fprintf(stderr, "Failed to allocate shader binding table: %s.\n", string_VkResult(result));
+        free(sbt->contents);
+        return result;
+    }
+
+    VkDeviceAddress bufferAddress = getBufferAddress(device, &sbt->buffer);
+    sbt->address = (VkDeviceAddress)sbtAlign(bufferAddress, baseAlignment);
+    sbt->bufferOffset = sbt->address - bufferAddress;
+    sbt->stats.size = sbt->size;
+
+    return VK_SUCCESS;
+}
+
+void destroyShaderBindingTable(ShaderBindingTable *sbt) {
+    destroyDeallocateBuffer(sbt->alloc, &sbt->buffer);
+    free(sbt->contents);
+}
+
+VkResult sbtSetPipeline(ShaderBindingTable *sbt, VkPipeline pipeline, uint32_t groupCount) {
+    if(groupCount > SBT_MAX_GROUPS) {
+        return VK_ERROR_TOO_MANY_OBJECTS;
+    }
+
+    VkResult result = getRayTracingShaderGroupHandlesKHR(
+        sbt->device,
+        pipeline,
+        0, groupCount,
+        groupCount * sbt->handleSize, sbt->handles
+    );
+    if(result != VK_SUCCESS) {
+        return result;
+    }
+    sbt->pipeline = pipeline;
+    sbt->groupCount = groupCount;
+
+    for(uint32_t region = 0; region < SBT_REGION_COUNT; region++) {
+        for(uint32_t i = 0; i < sbt->layouts[region].recordCount; i++) {
+            uint32_t group = sbt->groups[sbt->firstRecords[region] + i];
+
+            uint8_t record[SBT_MAX_HANDLE_SIZE + SBT_MAX_RECORD_DATA];
+            memcpy(record, sbtRecordContents(sbt, region, i), sbt->handleSize + sbt->layouts[region].dataSize);
+            if(group < groupCount) {
+                memcpy(record, &sbt->handles[group * sbt->handleSize], sbt->handleSize);
+            }
+            sbtWriteRecord(sbt, region, i, record);
+        }
+    }
+
+    return VK_SUCCESS;
+}
+
+VkResult sbtSetRecord(
+    ShaderBindingTable *sbt,
+    SbtRegion region,
+    uint32_t index,
+    uint32_t group,
+    const void *data,
+    uint32_t dataSize
+) {
+    const SbtRegionLayout *layout = &sbt->layouts[region];
+    if(index >= layout->recordCount || group >= SBT_MAX_GROUPS) {
+        return VK_ERROR_TOO_MANY_OBJECTS;
+    }
+    if(dataSize > layout->dataSize) {
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    sbt->groups[sbt->firstRecords[region] + index] = group;
+
+    // Records set before the pipeline exists get their handle from sbtSetPipeline
+    uint8_t record[SBT_MAX_HANDLE_SIZE + SBT_MAX_RECORD_DATA] = {0};
+    if(group < sbt->groupCount) {
+        memcpy(record, &sbt->handles[group * sbt->handleSize], sbt->handleSize);
+    }
+    if(dataSize > 0) {
+        memcpy(&record[sbt->handleSize], data, dataSize);
+    }
+    sbtWriteRecord(sbt, region, index, record);
+
+    return VK_SUCCESS;
+}
+
+VkBool32 sbtChanged(ShaderBindingTable *sbt) {
+    return sbt->changed;
+}
+
+void cmdSbtUpload(ShaderBindingTable *sbt, VkCommandBuffer buffer) {
+    for(uint32_t region = 0; region < SBT_REGION_COUNT; region++) {
+        VkDeviceSize stride = sbt->strides[region];
+        uint32_t first = sbt->firstRecords[region];
+        uint32_t count = sbt->layouts[region].recordCount;
+
+        // Adjacent changed records of a region are contiguous in the table
+        uint32_t i = 0;
+        while(i < count) {
+            if(!sbt->dirty[first + i]) {
+                i++;
+                continue;
+            }
+
+            uint32_t end = i;
+            while(end < count && sbt->dirty[first + end] && (end - i + 1) * stride <= SBT_MAX_UPDATE_SIZE) {
+                sbt->dirty[first + end] = VK_FALSE;
+                end++;
+            }
+
+            VkDeviceSize offset = sbt->offsets[region] + i * stride;
+            cmdUpdateBuffer(
+                buffer,
+                sbt->buffer.buffer,
+                sbt->bufferOffset + offset,
+                (end - i) * stride,
+                &sbt->contents[offset]
+            );
+            sbt->stats.updates++;
+            sbt->stats.recordsWritten += end - i;
+            i = end;
+        }
+    }
+
+    sbt->changed = VK_FALSE;
+}
+
+VkStridedDeviceAddressRegionKHR sbtRegion(ShaderBindingTable *sbt, SbtRegion region) {
+    uint32_t count = sbt->layouts[region].recordCount;
+    if(count == 0) {
+        return (VkStridedDeviceAddressRegionKHR){0};
+    }
+
+    // The raygen region's size has to equal its stride
+    VkDeviceSize stride = sbt->strides[region];
+    return (VkStridedDeviceAddressRegionKHR){
+        .deviceAddress = sbt->address + sbt->offsets[region],
+        .stride = stride,
+        .size = region == SBT_REGION_RAYGEN ? stride : stride * count,
+    };
+}
+
+SbtStats sbtStats(ShaderBindingTable *sbt) {
+    return sbt->stats;
+}
+
+VkDeviceSize sbtAlign(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Copies the handle and data part of record in, marking it only when that changes anything
+void sbtWriteRecord(ShaderBindingTable *sbt, SbtRegion region, uint32_t index, const uint8_t *record) {
+    uint8_t *contents = sbtRecordContents(sbt, region, index);
+    size_t size = sbt->handleSize + sbt->layouts[region].dataSize;
+    if(memcmp(contents, record, size) == 0) {
+        return;
+    }
+
+    memcpy(contents, record, size);
+    sbt->dirty[sbt->firstRecords[region] + index] = VK_TRUE;
+    sbt->changed = VK_TRUE;
+}
+
+uint8_t *sbtRecordContents(ShaderBindingTable *sbt, SbtRegion region, uint32_t index) {
+    return &sbt->contents[sbt->offsets[region] + index * sbt->strides[region]];
+}
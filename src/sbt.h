@@ -0,0 +1,100 @@
+#ifndef SBT_H_
+#define SBT_H_
+
+#include <vulkan/vulkan.h>
+
+#include "device_api.h"
+#include "vkalloc.h"
+
+#define SBT_MAX_RECORDS 2048
+#define SBT_MAX_GROUPS 64
+// shaderGroupHandleSize is exactly this on every implementation
+#define SBT_MAX_HANDLE_SIZE 32
+// Shader record data after the handle, read as shaderRecordEXT
+#define SBT_MAX_RECORD_DATA 64
+
+typedef enum {
+    SBT_REGION_RAYGEN,
+    SBT_REGION_MISS,
+    SBT_REGION_HIT,
+    SBT_REGION_CALLABLE,
+    SBT_REGION_COUNT,
+} SbtRegion;
+
+typedef struct {
+    uint32_t recordCount;
+    // Bytes of record data every record of the region has room for, a multiple of 4
+    uint32_t dataSize;
+} SbtRegionLayout;
+
+typedef struct {
+    // vkCmdUpdateBuffer calls, one per run of adjacent changed records
+    uint32_t updates;
+    uint32_t recordsWritten;
+    VkDeviceSize size;
+} SbtStats;
+
+// Shader binding table in device local memory. Records are kept on the CPU and only the
+// ones that changed are written into the table, ordered with the traces reading it.
+typedef struct {
+    Device *device;
+    VkAlloc *alloc;
+    uint32_t handleSize;
+
+    SbtRegionLayout layouts[SBT_REGION_COUNT];
+    // Regions start at shaderGroupBaseAlignment, records are shaderGroupHandleAlignment apart
+    VkDeviceSize offsets[SBT_REGION_COUNT];
+    VkDeviceSize strides[SBT_REGION_COUNT];
+    uint32_t firstRecords[SBT_REGION_COUNT];
+
+    // CPU copy of the whole table and the group each record was set to
+    uint8_t *contents;
+    VkDeviceSize size;
+    uint32_t groups[SBT_MAX_RECORDS];
+    VkBool32 dirty[SBT_MAX_RECORDS];
+    VkBool32 changed;
+
+    // Handles of the pipeline the records point into, zero until one is set
+    VkPipeline pipeline;
+    uint8_t handles[SBT_MAX_GROUPS * SBT_MAX_HANDLE_SIZE];
+    uint32_t groupCount;
+
+    Buffer buffer;
+    // Offset of the aligned table in buffer and its address
+    VkDeviceSize bufferOffset;
+    VkDeviceAddress address;
+
+    SbtStats stats;
+} ShaderBindingTable;
+
+VkResult createShaderBindingTable(
+    Device *device,
+    VkAlloc *alloc,
+    const SbtRegionLayout layouts[SBT_REGION_COUNT],
+    ShaderBindingTable *sbt
+);
+// The GPU has to be done with the table
+void destroyShaderBindingTable(ShaderBindingTable *sbt);
+
+// Takes the handles of groupCount groups of pipeline, records keep their group index
+// and only the ones whose handle moved are written again
+VkResult sbtSetPipeline(ShaderBindingTable *sbt, VkPipeline pipeline, uint32_t groupCount);
+// Points record index of region at group with dataSize bytes of data, the rest of the
+// record's data is zeroed. Marks it changed only if it differs from what is there.
+VkResult sbtSetRecord(
+    ShaderBindingTable *sbt,
+    SbtRegion region,
+    uint32_t index,
+    uint32_t group,
+    const void *data,
+    uint32_t dataSize
+);
+// Whether records changed since the last upload, a frame only has to upload then
+VkBool32 sbtChanged(ShaderBindingTable *sbt);
+// Writes the changed records with transfer commands, outside of rendering
+void cmdSbtUpload(ShaderBindingTable *sbt, VkCommandBuffer buffer);
+// Address range of a region for vkCmdTraceRaysKHR, raygen covers its first record only
+VkStridedDeviceAddressRegionKHR sbtRegion(ShaderBindingTable *sbt, SbtRegion region);
+SbtStats sbtStats(ShaderBindingTable *sbt);
+
+#endif
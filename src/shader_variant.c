@@ -0,0 +1,91 @@
+#include "shader_variant.h"
+
+#include <assert.h>
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+
+#define FNV_PRIME 0x100000001b3ull
+
+uint64_t hashWord(uint64_t hash, uint32_t word);
+
+void shaderVariantSet(ShaderVariant *variant, uint32_t constantId, uint32_t value) {
+    uint32_t i = 0;
+    while(i < variant->constantCount && variant->ids[i] < constantId) {
+        i++;
+    }
+    if(i < variant->constantCount && variant->ids[i] == constantId) {
+        variant->values[i] = value;
+        return;
+    }
+
+    assert(variant->constantCount < SHADER_VARIANT_MAX_CONSTANTS);
+    uint32_t tail = variant->constantCount - i;
+    memmove(&variant->ids[i + 1], &variant->ids[i], tail * sizeof(uint32_t));
+    memmove(&variant->values[i + 1], &variant->values[i], tail * sizeof(uint32_t));
+    variant->ids[i] = constantId;
+    variant->values[i] = value;
+    variant->constantCount++;
+}
+
+void shaderVariantSetFloat(ShaderVariant *variant, uint32_t constantId, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    shaderVariantSet(variant, constantId, bits);
+}
+
+const VkSpecializationInfo *shaderVariantInfo(const ShaderVariant *variant, ShaderSpecialization *specialization) {
+    if(variant->constantCount == 0) {
+        return NULL;
+    }
+
+    for(uint32_t i = 0; i < variant->constantCount; i++) {
+        specialization->entries[i] = (VkSpecializationMapEntry){
+            .constantID = variant->ids[i],
+            .offset = i * sizeof(uint32_t),
+            .size = sizeof(uint32_t),
+        };
+    }
+
+    specialization->info = (VkSpecializationInfo){
+        .mapEntryCount = variant->constantCount,
+        .pMapEntries = specialization->entries,
+        .dataSize = variant->constantCount * sizeof(uint32_t),
+        .pData = variant->values,
+    };
+
+    return &specialization->info;
+}
+
+VkBool32 shaderVariantEqual(const ShaderVariant *a, const ShaderVariant *b) {
+    if(a->constantCount != b->constantCount) {
+        return VK_FALSE;
+    }
+
+    for(uint32_t i = 0; i < a->constantCount; i++) {
+        if(a->ids[i] != b->ids[i] || a->values[i] != b->values[i]) {
+            return VK_FALSE;
+        }
+    }
+
+    return VK_TRUE;
+}
+
+// Only the used constants, slots past constantCount may hold anything
+uint64_t hashShaderVariant(uint64_t hash, const ShaderVariant *variant) {
+    hash = hashWord(hash, variant->constantCount);
+    for(uint32_t i = 0; i < variant->constantCount; i++) {
+        hash = hashWord(hash, variant->ids[i]);
+        hash = hashWord(hash, variant->values[i]);
+    }
+
+    return hash;
+}
+
+uint64_t hashWord(uint64_t hash, uint32_t word) {
+    for(uint32_t i = 0; i < sizeof(word); i++) {
+        hash ^= (word >> (i * 8)) & 0xff;
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
@@ -0,0 +1,35 @@
+#ifndef SHADER_VARIANT_H_
+#define SHADER_VARIANT_H_
+
+#include <vulkan/vulkan.h>
+
+#define SHADER_VARIANT_MAX_CONSTANTS 8
+
+// Specialization constant values for one shader stage. Every constant is 32 bits:
+// bool constants take a VkBool32, float ones their bit pattern.
+// Constants are kept sorted by id so equal variants compare and hash equal.
+typedef struct {
+    uint32_t constantCount;
+    uint32_t ids[SHADER_VARIANT_MAX_CONSTANTS];
+    uint32_t values[SHADER_VARIANT_MAX_CONSTANTS];
+} ShaderVariant;
+
+// What a stage's pSpecializationInfo points at
+typedef struct {
+    VkSpecializationMapEntry entries[SHADER_VARIANT_MAX_CONSTANTS];
+    VkSpecializationInfo info;
+} ShaderSpecialization;
+
+// Adds or replaces constant_id = constantId, a zero initialized variant is empty
+void shaderVariantSet(ShaderVariant *variant, uint32_t constantId, uint32_t value);
+void shaderVariantSetFloat(ShaderVariant *variant, uint32_t constantId, float value);
+
+// Points into variant and specialization, both have to outlive the pipeline creation.
+// Returns NULL for an empty variant, so it can go straight into pSpecializationInfo.
+const VkSpecializationInfo *shaderVariantInfo(const ShaderVariant *variant, ShaderSpecialization *specialization);
+
+VkBool32 shaderVariantEqual(const ShaderVariant *a, const ShaderVariant *b);
+// Continues an FNV-1a hash over the constants
+uint64_t hashShaderVariant(uint64_t hash, const ShaderVariant *variant);
+
+#endif
@@ -0,0 +1,276 @@
+// poll, mkstemp, posix_spawnp
+#define _POSIX_C_SOURCE 200809L
+
+#include "shader_watcher.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vulkan/vulkan_core.h>
+
+// How often the thread checks whether it should stop
+#define SHADER_WATCHER_POLL_MS 100
+// Files changed by one batch of events, the rest wait for the next change
+#define SHADER_WATCHER_MAX_BATCH 16
+
+extern char **environ;
+
+// File extensions glslc derives a shader stage from
+static const char *shaderExtensions[] = {
+    ".vert", ".frag", ".comp", ".rgen", ".rmiss", ".rchit", ".rahit", ".rint",
+};
+
+void *shaderWatcherThread(void *userData);
+VkBool32 isShaderSource(const char *name);
+void recompileShader(ShaderWatcher *watcher, const char *name);
+uint32_t *readSpirv(const char *path, size_t *size);
+void postReload(ShaderWatcher *watcher, const char *name, uint32_t *code, size_t codeSize);
+
+VkResult createShaderWatcher(const char *sourceDir, ShaderWatcher *watcher) {
+    memset(watcher, 0, sizeof(ShaderWatcher));
+
+    if(strlen(sourceDir) >= SHADER_WATCHER_MAX_PATH) {
+        fprintf(stderr, "Unsupported shader directory %s.\n", sourceDir);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+    strcpy(watcher->sourceDir, sourceDir);
+
+    watcher->compiler = getenv("GLSLC");
+    if(watcher->compiler == NULL) {
+        watcher->compiler = "glslc";
+    }
+
+    watcher->inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(watcher->inotifyFd < 0) {
+        fprintf(stderr, "Failed to start inotify: %s.\n", strerror(errno));
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    // Editors either write in place or rename a temporary file over the source
+    if(inotify_add_watch(watcher->inotifyFd, sourceDir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        fprintf(stderr, "Failed to watch %s: %s.\n", sourceDir, strerror(errno));
+        close(watcher->inotifyFd);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    pthread_mutex_init(&watcher->mutex, NULL);
+    atomic_init(&watcher->stopping, VK_FALSE);
+    if(pthread_create(&watcher->thread, NULL, shaderWatcherThread, watcher) != 0) {
+        fprintf(stderr, "Failed to start shader watcher thread.\n");
+        pthread_mutex_destroy(&watcher->mutex);
+        close(watcher->inotifyFd);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    return VK_SUCCESS;
+}
+
+void destroyShaderWatcher(ShaderWatcher *watcher) {
+    atomic_store(&watcher->stopping, VK_TRUE);
+    pthread_join(watcher->thread, NULL);
+    close(watcher->inotifyFd);
+
+    for(uint32_t i = 0; i < watcher->readyCount; i++) {
+        free(watcher->ready[i].code);
+    }
+    pthread_mutex_destroy(&watcher->mutex);
+}
+
+uint32_t shaderWatcherPoll(ShaderWatcher *watcher, ShaderReloadFn reload, void *userData) {
+    ShaderReload ready[SHADER_WATCHER_MAX_READY];
+
+    // Reloads rebuild pipelines, the thread shouldn't wait on that
+    pthread_mutex_lock(&watcher->mutex);
+    uint32_t readyCount = watcher->readyCount;
+    memcpy(ready, watcher->ready, readyCount * sizeof(ShaderReload));
+    watcher->readyCount = 0;
+    pthread_mutex_unlock(&watcher->mutex);
+
+    for(uint32_t i = 0; i < readyCount; i++) {
+        reload(ready[i].name, ready[i].code, ready[i].codeSize, userData);
+    }
+
+    return readyCount;
+}
+
+void *shaderWatcherThread(void *userData) {
+    ShaderWatcher *watcher = (ShaderWatcher*)userData;
+    _Alignas(struct inotify_event) char buffer[4096];
+
+    while(!atomic_load(&watcher->stopping)) {
+        struct pollfd pollFd = {
+            .fd = watcher->inotifyFd,
+            .events = POLLIN,
+        };
+        if(poll(&pollFd, 1, SHADER_WATCHER_POLL_MS) <= 0) {
+            continue;
+        }
+
+        // A save usually shows up as several events, each file is compiled once per batch
+        char batch[SHADER_WATCHER_MAX_BATCH][SHADER_WATCHER_MAX_NAME];
+        uint32_t batchCount = 0;
+
+        ssize_t length;
+        while((length = read(watcher->inotifyFd, buffer, sizeof(buffer))) > 0) {
+            for(char *p = buffer; p < buffer + length;) {
+                const struct inotify_event *event = (const struct inotify_event*)p;
+                p += sizeof(struct inotify_event) + event->len;
+
+                if(event->len == 0 || !isShaderSource(event->name)) {
+                    continue;
+                }
+                if(strlen(event->name) >= SHADER_WATCHER_MAX_NAME) {
+                    continue;
+                }
+
+                VkBool32 known = VK_FALSE;
+                for(uint32_t i = 0; i < batchCount && !known; i++) {
+                    known = strcmp(batch[i], event->name) == 0;
+                }
+                if(!known && batchCount < SHADER_WATCHER_MAX_BATCH) {
+                    strcpy(batch[batchCount++], event->name);
+                }
+            }
+        }
+
+        for(uint32_t i = 0; i < batchCount; i++) {
+            recompileShader(watcher, batch[i]);
+        }
+    }
+
+    return NULL;
+}
+
+VkBool32 isShaderSource(const char *name) {
+    const char *extension = strrchr(name, '.');
+    if(extension == NULL) {
+        return VK_FALSE;
+    }
+
+    for(size_t i = 0; i < sizeof(shaderExtensions) / sizeof(shaderExtensions[0]); i++) {
+        if(strcmp(extension, shaderExtensions[i]) == 0) {
+            return VK_TRUE;
+        }
+    }
+
+    return VK_FALSE;
+}
+
+// Compiler errors go to stderr as they are, the running pipelines stay in place. The
+// compiler runs without a shell, names reach it as single arguments whatever they contain.
+void recompileShader(ShaderWatcher *watcher, const char *name) {
+    char source[2 * SHADER_WATCHER_MAX_PATH];
+    if(snprintf(source, sizeof(source), "%s/%s", watcher->sourceDir, name) >= (int)sizeof(source)) {
+        fprintf(stderr, "Shader path too long: %s.\n", name);
+        return;
+    }
+
+    // Created here with a random name only this process knows, the compiler overwrites it
+    const char *tmpDir = getenv("TMPDIR");
+    char output[SHADER_WATCHER_MAX_PATH];
+    if(snprintf(output, sizeof(output), "%s/shader-XXXXXX", tmpDir != NULL ? tmpDir : "/tmp") >= (int)sizeof(output)) {
+        fprintf(stderr, "Temporary directory path too long.\n");
+        return;
+    }
+    int outputFd = mkstemp(output);
+    if(outputFd < 0) {
+        fprintf(stderr, "Failed to create temporary file: %s.\n", strerror(errno));
+        return;
+    }
+    close(outputFd);
+
+    char *argv[] = {
+        (char*)watcher->compiler,
+        "--target-env=vulkan1.2",
+        source,
+        "-o", output,
+        NULL,
+    };
+    pid_t pid;
+    int error = posix_spawnp(&pid, watcher->compiler, NULL, NULL, argv, environ);
+    int status = 0;
+    if(error == 0) {
+        while(waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    } else {
+        fprintf(stderr, "Failed to run %s: %s.\n", watcher->compiler, strerror(error));
+    }
+
+    if(error != 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "Failed to recompile %s.\n", name);
+        remove(output);
+        return;
+    }
+
+    size_t codeSize;
+    uint32_t *code = readSpirv(output, &codeSize);
+    remove(output);
+    if(code == NULL) {
+        fprintf(stderr, "Failed to read recompiled %s.\n", name);
+        return;
+    }
+
+    fprintf(stderr, "Recompiled %s.\n", name);
+    postReload(watcher, name, code, codeSize);
+}
+
+// Returns NULL when the file cannot be read, is not whole words or does not fit in memory
+uint32_t *readSpirv(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    if(file == NULL) {
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if(length <= 0 || length % sizeof(uint32_t) != 0) {
+        fclose(file);
+        return NULL;
+    }
+
+    uint32_t *code = (uint32_t*)malloc((size_t)length);
+    if(code == NULL) {
+        fclose(file);
+        return NULL;
+    }
+    if(fread(code, 1, (size_t)length, file) != (size_t)length) {
+        free(code);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+
+    *size = (size_t)length;
+    return code;
+}
+
+void postReload(ShaderWatcher *watcher, const char *name, uint32_t *code, size_t codeSize) {
+    pthread_mutex_lock(&watcher->mutex);
+
+    ShaderReload *reload = NULL;
+    for(uint32_t i = 0; i < watcher->readyCount; i++) {
+        if(strcmp(watcher->ready[i].name, name) == 0) {
+            reload = &watcher->ready[i];
+            free(reload->code);
+        }
+    }
+    if(reload == NULL && watcher->readyCount < SHADER_WATCHER_MAX_READY) {
+        reload = &watcher->ready[watcher->readyCount++];
+    }
+
+    if(reload != NULL) {
+        strcpy(reload->name, name);
+        reload->code = code;
+        reload->codeSize = codeSize;
+    } else {
+        free(code);
+    }
+
+    pthread_mutex_unlock(&watcher->mutex);
+}
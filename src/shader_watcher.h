@@ -0,0 +1,47 @@
+#ifndef SHADER_WATCHER_H_
+#define SHADER_WATCHER_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <vulkan/vulkan.h>
+
+// Recompiled shaders waiting for shaderWatcherPoll, older versions of the same file are replaced
+#define SHADER_WATCHER_MAX_READY 16
+#define SHADER_WATCHER_MAX_NAME 64
+#define SHADER_WATCHER_MAX_PATH 512
+
+// A recompiled shader, name is the source file name without its directory
+typedef struct {
+    char name[SHADER_WATCHER_MAX_NAME];
+    uint32_t *code;
+    size_t codeSize;
+} ShaderReload;
+
+// Receives ownership of code, which was allocated with malloc
+typedef void (*ShaderReloadFn)(const char *name, uint32_t *code, size_t codeSize, void *userData);
+
+// Watches a directory of GLSL sources with inotify and recompiles changed files with
+// glslc on its own thread. Linux only, $GLSLC names another compiler executable.
+typedef struct {
+    char sourceDir[SHADER_WATCHER_MAX_PATH];
+    const char *compiler;
+    int inotifyFd;
+
+    pthread_t thread;
+    _Atomic VkBool32 stopping;
+
+    // Guards ready
+    pthread_mutex_t mutex;
+    ShaderReload ready[SHADER_WATCHER_MAX_READY];
+    uint32_t readyCount;
+} ShaderWatcher;
+
+VkResult createShaderWatcher(const char *sourceDir, ShaderWatcher *watcher);
+// Stops the thread, recompiled shaders nobody polled are freed
+void destroyShaderWatcher(ShaderWatcher *watcher);
+
+// Hands every shader recompiled since the last poll to reload, on the calling thread.
+// Returns the number of shaders handed out.
+uint32_t shaderWatcherPoll(ShaderWatcher *watcher, ShaderReloadFn reload, void *userData);
+
+#endif
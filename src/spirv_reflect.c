@@ -0,0 +1,470 @@
+#include "spirv_reflect.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vulkan/vulkan_core.h>
+
+#define SPIRV_MAGIC 0x07230203
+#define SPIRV_HEADER_WORDS 5
+
+// Opcodes, decorations and enums from the SPIR-V specification, only the ones used below
+#define OP_ENTRY_POINT 15
+#define OP_TYPE_BOOL 20
+#define OP_TYPE_INT 21
+#define OP_TYPE_FLOAT 22
+#define OP_TYPE_VECTOR 23
+#define OP_TYPE_MATRIX 24
+#define OP_TYPE_IMAGE 25
+#define OP_TYPE_SAMPLER 26
+#define OP_TYPE_SAMPLED_IMAGE 27
+#define OP_TYPE_ARRAY 28
+#define OP_TYPE_RUNTIME_ARRAY 29
+#define OP_TYPE_STRUCT 30
+#define OP_TYPE_POINTER 32
+#define OP_CONSTANT 43
+#define OP_VARIABLE 59
+#define OP_DECORATE 71
+#define OP_MEMBER_DECORATE 72
+#define OP_TYPE_ACCELERATION_STRUCTURE 5341
+
+#define DECORATION_BUFFER_BLOCK 3
+#define DECORATION_ARRAY_STRIDE 6
+#define DECORATION_MATRIX_STRIDE 7
+#define DECORATION_BUILT_IN 11
+#define DECORATION_LOCATION 30
+#define DECORATION_BINDING 33
+#define DECORATION_DESCRIPTOR_SET 34
+#define DECORATION_OFFSET 35
+
+#define STORAGE_UNIFORM_CONSTANT 0
+#define STORAGE_INPUT 1
+#define STORAGE_UNIFORM 2
+#define STORAGE_PUSH_CONSTANT 9
+#define STORAGE_STORAGE_BUFFER 12
+
+#define DIM_BUFFER 5
+#define DIM_SUBPASS_DATA 6
+
+// Decorations seen on an id
+#define DECORATED_LOCATION (1u << 0)
+#define DECORATED_BINDING (1u << 1)
+#define DECORATED_SET (1u << 2)
+#define DECORATED_BUILT_IN (1u << 3)
+#define DECORATED_BUFFER_BLOCK (1u << 4)
+#define DECORATED_ARRAY_STRIDE (1u << 5)
+
+typedef struct {
+    // Defining instruction, NULL for ids that aren't types, constants or variables
+    const uint32_t *words;
+    uint32_t decorated;
+    uint32_t location;
+    uint32_t binding;
+    uint32_t set;
+    uint32_t arrayStride;
+} SpirvId;
+
+typedef struct {
+    const uint32_t *code;
+    uint32_t wordCount;
+    SpirvId *ids;
+    uint32_t bound;
+} SpirvModule;
+
+VkResult parseModule(SpirvModule *module, VkShaderStageFlagBits *stage);
+const uint32_t *defining(SpirvModule *module, uint32_t id, uint32_t opcode);
+VkResult reflectInput(SpirvModule *module, uint32_t location, uint32_t typeId, ShaderReflection *reflection);
+VkResult reflectBinding(SpirvModule *module, const SpirvId *variable, uint32_t storageClass, uint32_t typeId, ShaderReflection *reflection);
+VkFormat scalarFormat(SpirvModule *module, uint32_t typeId, uint32_t components);
+uint32_t arrayLength(SpirvModule *module, const uint32_t *array);
+uint32_t typeSize(SpirvModule *module, uint32_t typeId);
+VkBool32 memberDecoration(SpirvModule *module, uint32_t structId, uint32_t member, uint32_t decoration, uint32_t *value);
+
+VkResult reflectShader(const uint32_t *code, size_t codeSize, ShaderReflection *reflection) {
+    memset(reflection, 0, sizeof(ShaderReflection));
+
+    if(codeSize % sizeof(uint32_t) != 0 || codeSize < SPIRV_HEADER_WORDS * sizeof(uint32_t) || code[0] != SPIRV_MAGIC) {
+        fprintf(stderr, "Not a SPIR-V module.\n");
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    SpirvModule module = {
+        .code = code,
+        .wordCount = (uint32_t)(codeSize / sizeof(uint32_t)),
+        .bound = code[3],
+    };
+    module.ids = (SpirvId*)calloc(module.bound, sizeof(SpirvId));
+    assert(module.ids != NULL);
+
+    VkResult result = parseModule(&module, &reflection->stage);
+
+    // Variables are only looked at once every decoration is known
+    for(uint32_t i = 0; i < module.bound && result == VK_SUCCESS; i++) {
+        const uint32_t *variable = module.ids[i].words;
+        if(variable == NULL || (variable[0] & 0xffff) != OP_VARIABLE) {
+            continue;
+        }
+
+        const uint32_t *pointer = defining(&module, variable[1], OP_TYPE_POINTER);
+        if(pointer == NULL) {
+            result = VK_ERROR_INITIALIZATION_FAILED;
+            break;
+        }
+        uint32_t storageClass = variable[3];
+        uint32_t typeId = pointer[3];
+
+        switch(storageClass) {
+            case STORAGE_INPUT:
+            // Builtins and the inputs of later stages don't come from vertex buffers
+            if(reflection->stage == VK_SHADER_STAGE_VERTEX_BIT &&
+                (module.ids[i].decorated & DECORATED_LOCATION) &&
+                !(module.ids[i].decorated & DECORATED_BUILT_IN))
+            {
+                result = reflectInput(&module, module.ids[i].location, typeId, reflection);
+            }
+            break;
+            case STORAGE_UNIFORM_CONSTANT:
+            case STORAGE_UNIFORM:
+            case STORAGE_STORAGE_BUFFER:
+            result = reflectBinding(&module, &module.ids[i], storageClass, typeId, reflection);
+            break;
+            case STORAGE_PUSH_CONSTANT:
+            reflection->pushConstantSize = typeSize(&module, typeId);
+            break;
+            default:
+            break;
+        }
+    }
+
+    free(module.ids);
+    if(result != VK_SUCCESS) {
+        return result;
+    }
+
+    // Sorted so reflections of equal interfaces compare equal
+    for(uint32_t i = 1; i < reflection->inputCount; i++) {
+        ReflectedInput input = reflection->inputs[i];
+        uint32_t j = i;
+        for(; j > 0 && reflection->inputs[j - 1].location > input.location; j--) {
+            reflection->inputs[j] = reflection->inputs[j - 1];
+        }
+        reflection->inputs[j] = input;
+    }
+
+    return VK_SUCCESS;
+}
+
+// Records every definition and decoration
+VkResult parseModule(SpirvModule *module, VkShaderStageFlagBits *stage) {
+    VkBool32 foundEntryPoint = VK_FALSE;
+
+    for(uint32_t i = SPIRV_HEADER_WORDS; i < module->wordCount;) {
+        const uint32_t *words = &module->code[i];
+        uint32_t wordCount = words[0] >> 16;
+        uint32_t opcode = words[0] & 0xffff;
+        if(wordCount == 0 || i + wordCount > module->wordCount) {
+            fprintf(stderr, "Truncated SPIR-V instruction at word %u.\n", i);
+            return VK_ERROR_INITIALIZATION_FAILED;
+        }
+        i += wordCount;
+
+        uint32_t resultId = UINT32_MAX;
+        switch(opcode) {
+            case OP_ENTRY_POINT:
+            if(foundEntryPoint) {
+                break;
+            }
+            foundEntryPoint = VK_TRUE;
+            switch(words[1]) {
+                case 0: *stage = VK_SHADER_STAGE_VERTEX_BIT; break;
+                case 4: *stage = VK_SHADER_STAGE_FRAGMENT_BIT; break;
+                case 5: *stage = VK_SHADER_STAGE_COMPUTE_BIT; break;
+                case 5313: *stage = VK_SHADER_STAGE_RAYGEN_BIT_KHR; break;
+                case 5314: *stage = VK_SHADER_STAGE_INTERSECTION_BIT_KHR; break;
+                case 5315: *stage = VK_SHADER_STAGE_ANY_HIT_BIT_KHR; break;
+                case 5316: *stage = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR; break;
+                case 5317: *stage = VK_SHADER_STAGE_MISS_BIT_KHR; break;
+                case 5318: *stage = VK_SHADER_STAGE_CALLABLE_BIT_KHR; break;
+                default:
+                fprintf(stderr, "Unsupported SPIR-V execution model %u.\n", words[1]);
+                return VK_ERROR_INITIALIZATION_FAILED;
+            }
+            break;
+            case OP_DECORATE:
+            if(wordCount < 3 || words[1] >= module->bound) {
+                break;
+            }
+            SpirvId *target = &module->ids[words[1]];
+            uint32_t value = wordCount > 3 ? words[3] : 0;
+            switch(words[2]) {
+                case DECORATION_LOCATION: target->decorated |= DECORATED_LOCATION; target->location = value; break;
+                case DECORATION_BINDING: target->decorated |= DECORATED_BINDING; target->binding = value; break;
+                case DECORATION_DESCRIPTOR_SET: target->decorated |= DECORATED_SET; target->set = value; break;
+                case DECORATION_BUILT_IN: target->decorated |= DECORATED_BUILT_IN; break;
+                case DECORATION_BUFFER_BLOCK: target->decorated |= DECORATED_BUFFER_BLOCK; break;
+                case DECORATION_ARRAY_STRIDE: target->decorated |= DECORATED_ARRAY_STRIDE; target->arrayStride = value; break;
+                default: break;
+            }
+            break;
+            // Input blocks made of builtins, gl_PerVertex and the like
+            case OP_MEMBER_DECORATE:
+            if(wordCount >= 4 && words[3] == DECORATION_BUILT_IN && words[1] < module->bound) {
+                module->ids[words[1]].decorated |= DECORATED_BUILT_IN;
+            }
+            break;
+            case OP_TYPE_BOOL:
+            case OP_TYPE_INT:
+            case OP_TYPE_FLOAT:
+            case OP_TYPE_VECTOR:
+            case OP_TYPE_MATRIX:
+            case OP_TYPE_IMAGE:
+            case OP_TYPE_SAMPLER:
+            case OP_TYPE_SAMPLED_IMAGE:
+            case OP_TYPE_ARRAY:
+            case OP_TYPE_RUNTIME_ARRAY:
+            case OP_TYPE_STRUCT:
+            case OP_TYPE_POINTER:
+            case OP_TYPE_ACCELERATION_STRUCTURE:
+            resultId = words[1];
+            break;
+            case OP_CONSTANT:
+            case OP_VARIABLE:
+            resultId = words[2];
+            break;
+            default:
+            break;
+        }
+
+        if(resultId != UINT32_MAX) {
+            if(resultId >= module->bound) {
+                fprintf(stderr, "SPIR-V id %u out of bounds.\n", resultId);
+                return VK_ERROR_INITIALIZATION_FAILED;
+            }
+            module->ids[resultId].words = words;
+        }
+    }
+
+    if(!foundEntryPoint) {
+        fprintf(stderr, "SPIR-V module has no entry point.\n");
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    return VK_SUCCESS;
+}
+
+// The instruction defining id if it has the given opcode, NULL otherwise
+const uint32_t *defining(SpirvModule *module, uint32_t id, uint32_t opcode) {
+    if(id >= module->bound || module->ids[id].words == NULL) {
+        return NULL;
+    }
+
+    const uint32_t *words = module->ids[id].words;
+    return (words[0] & 0xffff) == opcode ? words : NULL;
+}
+
+VkResult reflectInput(SpirvModule *module, uint32_t location, uint32_t typeId, ShaderReflection *reflection) {
+    const uint32_t *matrix = defining(module, typeId, OP_TYPE_MATRIX);
+    const uint32_t *array = defining(module, typeId, OP_TYPE_ARRAY);
+
+    uint32_t locations = 1;
+    uint32_t elementType = typeId;
+    if(matrix != NULL) {
+        elementType = matrix[2];
+        locations = matrix[3];
+    } else if(array != NULL) {
+        elementType = array[2];
+        locations = arrayLength(module, array);
+    }
+
+    const uint32_t *vector = defining(module, elementType, OP_TYPE_VECTOR);
+    VkFormat format = vector != NULL
+        ? scalarFormat(module, vector[2], vector[3])
+        : scalarFormat(module, elementType, 1);
+    if(format == VK_FORMAT_UNDEFINED || locations == 0) {
+        fprintf(stderr, "Unsupported vertex input type at location %u.\n", location);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    for(uint32_t i = 0; i < locations; i++) {
+        if(reflection->inputCount == SPIRV_REFLECT_MAX_INPUTS) {
+            return VK_ERROR_TOO_MANY_OBJECTS;
+        }
+        reflection->inputs[reflection->inputCount++] = (ReflectedInput){
+            .location = location + i,
+            .format = format,
+        };
+    }
+
+    return VK_SUCCESS;
+}
+
+VkResult reflectBinding(SpirvModule *module, const SpirvId *variable, uint32_t storageClass, uint32_t typeId, ShaderReflection *reflection) {
+    if(!(variable->decorated & DECORATED_BINDING)) {
+        return VK_SUCCESS;
+    }
+
+    // Runtime arrays count as one descriptor, descriptor indexing isn't enabled
+    uint32_t count = 1;
+    const uint32_t *array = defining(module, typeId, OP_TYPE_ARRAY);
+    const uint32_t *runtimeArray = defining(module, typeId, OP_TYPE_RUNTIME_ARRAY);
+    if(array != NULL) {
+        count = arrayLength(module, array);
+        typeId = array[2];
+    } else if(runtimeArray != NULL) {
+        typeId = runtimeArray[2];
+    }
+
+    VkDescriptorType type;
+    const uint32_t *image = defining(module, typeId, OP_TYPE_IMAGE);
+    if(storageClass == STORAGE_STORAGE_BUFFER) {
+        type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    } else if(storageClass == STORAGE_UNIFORM) {
+        // Old style storage buffers are uniform blocks decorated BufferBlock
+        type = (module->ids[typeId].decorated & DECORATED_BUFFER_BLOCK)
+            ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+            : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    } else if(defining(module, typeId, OP_TYPE_SAMPLER) != NULL) {
+        type = VK_DESCRIPTOR_TYPE_SAMPLER;
+    } else if(defining(module, typeId, OP_TYPE_SAMPLED_IMAGE) != NULL) {
+        const uint32_t *sampledImage = defining(module, typeId, OP_TYPE_SAMPLED_IMAGE);
+        const uint32_t *inner = defining(module, sampledImage[2], OP_TYPE_IMAGE);
+        type = inner != NULL && inner[3] == DIM_BUFFER
+            ? VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER
+            : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    } else if(image != NULL) {
+        // Sampled is 1 for images used with a sampler, 2 for storage images
+        uint32_t dim = image[3];
+        uint32_t sampled = image[7];
+        if(dim == DIM_SUBPASS_DATA) {
+            type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+        } else if(dim == DIM_BUFFER) {
+            type = sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+        } else {
+            type = sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        }
+    } else if(defining(module, typeId, OP_TYPE_ACCELERATION_STRUCTURE) != NULL) {
+        type = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+    } else {
+        fprintf(stderr, "Unsupported descriptor type at binding %u.\n", variable->binding);
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    if(reflection->bindingCount == SPIRV_REFLECT_MAX_BINDINGS) {
+        return VK_ERROR_TOO_MANY_OBJECTS;
+    }
+    reflection->bindings[reflection->bindingCount++] = (ReflectedBinding){
+        .set = (variable->decorated & DECORATED_SET) ? variable->set : 0,
+        .binding = variable->binding,
+        .type = type,
+        .count = count,
+    };
+
+    return VK_SUCCESS;
+}
+
+// 32 bit scalars and vectors of them, VK_FORMAT_UNDEFINED for anything else
+VkFormat scalarFormat(SpirvModule *module, uint32_t typeId, uint32_t components) {
+    static const VkFormat floatFormats[] = {
+        VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT,
+    };
+    static const VkFormat sintFormats[] = {
+        VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT,
+    };
+    static const VkFormat uintFormats[] = {
+        VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT,
+    };
+
+    if(components == 0 || components > 4) {
+        return VK_FORMAT_UNDEFINED;
+    }
+
+    const uint32_t *floatType = defining(module, typeId, OP_TYPE_FLOAT);
+    if(floatType != NULL && floatType[2] == 32) {
+        return floatFormats[components - 1];
+    }
+    const uint32_t *intType = defining(module, typeId, OP_TYPE_INT);
+    if(intType != NULL && intType[2] == 32) {
+        return intType[3] ? sintFormats[components - 1] : uintFormats[components - 1];
+    }
+
+    return VK_FORMAT_UNDEFINED;
+}
+
+// 0 if the length isn't a plain 32 bit constant, specialization constants included
+uint32_t arrayLength(SpirvModule *module, const uint32_t *array) {
+    const uint32_t *length = defining(module, array[3], OP_CONSTANT);
+    return length != NULL ? length[3] : 0;
+}
+
+// Bytes the type takes in an explicitly laid out block
+uint32_t typeSize(SpirvModule *module, uint32_t typeId) {
+    if(typeId >= module->bound || module->ids[typeId].words == NULL) {
+        return 0;
+    }
+
+    const uint32_t *words = module->ids[typeId].words;
+    switch(words[0] & 0xffff) {
+        case OP_TYPE_BOOL:
+        return 4;
+        case OP_TYPE_INT:
+        case OP_TYPE_FLOAT:
+        return words[2] / 8;
+        case OP_TYPE_VECTOR:
+        return words[3] * typeSize(module, words[2]);
+        // Column strides come from the member decoration, see below
+        case OP_TYPE_MATRIX:
+        return words[3] * typeSize(module, words[2]);
+        case OP_TYPE_ARRAY: {
+            uint32_t stride = (module->ids[typeId].decorated & DECORATED_ARRAY_STRIDE)
+                ? module->ids[typeId].arrayStride
+                : typeSize(module, words[2]);
+            return arrayLength(module, words) * stride;
+        }
+        // Buffer references, the only pointers allowed in a block
+        case OP_TYPE_POINTER:
+        return 8;
+        case OP_TYPE_STRUCT: {
+            uint32_t memberCount = (words[0] >> 16) - 2;
+            uint32_t size = 0;
+            for(uint32_t i = 0; i < memberCount; i++) {
+                uint32_t memberType = words[2 + i];
+                uint32_t offset = 0;
+                memberDecoration(module, typeId, i, DECORATION_OFFSET, &offset);
+
+                uint32_t memberSize;
+                uint32_t matrixStride;
+                const uint32_t *matrix = defining(module, memberType, OP_TYPE_MATRIX);
+                if(matrix != NULL && memberDecoration(module, typeId, i, DECORATION_MATRIX_STRIDE, &matrixStride)) {
+                    memberSize = matrix[3] * matrixStride;
+                } else {
+                    memberSize = typeSize(module, memberType);
+                }
+
+                if(offset + memberSize > size) {
+                    size = offset + memberSize;
+                }
+            }
+            return size;
+        }
+        default:
+        return 0;
+    }
+}
+
+VkBool32 memberDecoration(SpirvModule *module, uint32_t structId, uint32_t member, uint32_t decoration, uint32_t *value) {
+    for(uint32_t i = SPIRV_HEADER_WORDS; i < module->wordCount;) {
+        const uint32_t *words = &module->code[i];
+        uint32_t wordCount = words[0] >> 16;
+        i += wordCount;
+
+        if((words[0] & 0xffff) == OP_MEMBER_DECORATE && wordCount >= 5 &&
+            words[1] == structId && words[2] == member && words[3] == decoration)
+        {
+            *value = words[4];
+            return VK_TRUE;
+        }
+    }
+
+    return VK_FALSE;
+}
@@ -0,0 +1,37 @@
+#ifndef SPIRV_REFLECT_H_
+#define SPIRV_REFLECT_H_
+
+#include <vulkan/vulkan.h>
+
+#define SPIRV_REFLECT_MAX_INPUTS 16
+#define SPIRV_REFLECT_MAX_BINDINGS 32
+
+// One vertex input location, matrices and arrays take one per column or element
+typedef struct {
+    uint32_t location;
+    VkFormat format;
+} ReflectedInput;
+
+typedef struct {
+    uint32_t set;
+    uint32_t binding;
+    VkDescriptorType type;
+    uint32_t count;
+} ReflectedBinding;
+
+// Interface of a shader module's first entry point
+typedef struct {
+    VkShaderStageFlagBits stage;
+    // Sorted by location, only filled for vertex shaders
+    ReflectedInput inputs[SPIRV_REFLECT_MAX_INPUTS];
+    uint32_t inputCount;
+    ReflectedBinding bindings[SPIRV_REFLECT_MAX_BINDINGS];
+    uint32_t bindingCount;
+    // 0 without a push constant block
+    uint32_t pushConstantSize;
+} ShaderReflection;
+
+// Parses the module without creating anything, codeSize in bytes
+VkResult reflectShader(const uint32_t *code, size_t codeSize, ShaderReflection *reflection);
+
+#endif
@@ -1,20 +1,29 @@
 #include "swapchain.h"
 #include "macros.h"
 #include "device_utils.h"
+#include "engine.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <vulkan/vulkan_core.h>
 
 VkSurfaceFormatKHR chooseSurfaceFormat(VkSurfaceFormatKHR *formats, size_t formatCount);
-VkPresentModeKHR choosePresentMode(VkPresentModeKHR *presentModes, size_t presentModeCount);
+VkPresentModeKHR choosePresentMode(VkPresentModeKHR *presentModes, size_t presentModeCount, PresentPolicy policy);
+uint32_t chooseImageCount(VkSurfaceCapabilitiesKHR *caps, VkPresentModeKHR presentMode, PresentPolicy policy);
 VkExtent2D chooseExtent(VkSurfaceCapabilitiesKHR *caps, Window *window);
 uint32_t clamp(uint32_t, uint32_t, uint32_t);
 
 VkResult acquireSwapChainImages(Device *device, VkSwapchainKHR swapchain, uint32_t *imageCount, VkImage **images);
 VkResult createImageViews(Device *device, Swapchain *swapchain);
 
-VkResult createSwapChain(Device *device, Window *window, VkSurfaceKHR surface, Swapchain *swapchain) {
+VkResult createSwapChain(
+    Device *device,
+    Window *window,
+    VkSurfaceKHR surface,
+    PresentPolicy policy,
+    VkSwapchainKHR oldSwapchain,
+    Swapchain *swapchain
+) {
     SwapChainSupport support;
     VkResult result;
 
@@ -22,13 +31,9 @@ VkResult createSwapChain(Device *device, Window *window, VkSurfaceKHR surface, S
     ASSERT_ERR(result, { free(support.presentModes); free(support.formats); }, "Failed to query swap chain support.\n");
 
     VkSurfaceFormatKHR surfaceFormat = chooseSurfaceFormat(support.formats, support.formatCount);
-    VkPresentModeKHR presentMode = choosePresentMode(support.presentModes, support.presentModeCount);
+    VkPresentModeKHR presentMode = choosePresentMode(support.presentModes, support.presentModeCount, policy);
     VkExtent2D extent = chooseExtent(&support.capabilities, window);
-
-    uint32_t imageCount = support.capabilities.minImageCount + 1;
-    if(support.capabilities.maxImageCount > 0 && imageCount > support.capabilities.maxImageCount) {
-        imageCount = support.capabilities.maxImageCount;
-    }
+    uint32_t imageCount = chooseImageCount(&support.capabilities, presentMode, policy);
 
     VkSwapchainCreateInfoKHR createInfo = {
         .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
@@ -41,6 +46,15 @@ VkResult createSwapChain(Device *device, Window *window, VkSurfaceKHR surface, S
         .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
     };
 
+    // Lets frames be copied out for capture where the surface allows it
+    if(support.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) {
+        createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    }
+    // Lets ray traced frames be blitted in
+    if(support.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) {
+        createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    }
+
     if(device->queueFamilies.graphics != device->queueFamilies.present) {
         createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
         uint32_t indices[] = {device->queueFamilies.graphics, device->queueFamilies.present};
@@ -56,7 +70,7 @@ VkResult createSwapChain(Device *device, Window *window, VkSurfaceKHR surface, S
     createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     createInfo.presentMode = presentMode;
     createInfo.clipped = VK_TRUE;
-    createInfo.oldSwapchain = VK_NULL_HANDLE;
+    createInfo.oldSwapchain = oldSwapchain;
 
     free(support.formats);
     free(support.presentModes);
@@ -70,6 +84,11 @@ VkResult createSwapChain(Device *device, Window *window, VkSurfaceKHR surface, S
     swapchain->extent = extent;
     swapchain->format = surfaceFormat.format;
     swapchain->presentMode = presentMode;
+    swapchain->usage = createInfo.imageUsage;
+    swapchain->policy = policy;
+    swapchain->lastPresentId = 0;
+    swapchain->allocator = NULL;
+    swapchain->offscreenImages = NULL;
 
     result = createImageViews(device, swapchain);
     ASSERT_ERR(result, { free(swapchain->images); }, "Failed to create image views.\n");
@@ -77,6 +96,55 @@ VkResult createSwapChain(Device *device, Window *window, VkSurfaceKHR surface, S
     return VK_SUCCESS;
 }
 
+VkResult createOffscreenSwapChain(VkAlloc *alloc, VkExtent2D extent, uint32_t imageCount, Swapchain *swapchain) {
+    VkResult result;
+
+    *swapchain = (Swapchain){
+        .swapchain = VK_NULL_HANDLE,
+        .imageCount = imageCount,
+        .images = (VkImage*)calloc(imageCount, sizeof(VkImage)),
+        .format = VK_FORMAT_B8G8R8A8_SRGB,
+        .extent = extent,
+        .presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR,
+        .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+            VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+        .policy = PRESENT_POLICY_THROUGHPUT_FIRST,
+        .allocator = alloc,
+        .offscreenImages = (Image*)calloc(imageCount, sizeof(Image)),
+    };
+
+    VkImageCreateInfo imageInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = swapchain->format,
+        .extent = {extent.width, extent.height, 1},
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = swapchain->usage,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+
+    for(uint32_t i = 0; i < imageCount; i++) {
+        result = createAllocateImage(
+            alloc,
+            &imageInfo,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            &swapchain->offscreenImages[i]
+        );
+        ASSERT_ERR(result, {}, "Failed to create offscreen image.\n");
+
+        swapchain->images[i] = swapchain->offscreenImages[i].image;
+    }
+
+    result = createImageViews(alloc->device, swapchain);
+    ASSERT_ERR(result, {}, "Failed to create image views.\n");
+
+    return VK_SUCCESS;
+}
+
 void destroySwapChain(Device *device, Swapchain *swapchain) {
     for(uint32_t i = 0; i < swapchain->imageCount; i++) {
         vkDestroyImageView(device->device, swapchain->imageViews[i], NULL);
@@ -84,9 +152,27 @@ void destroySwapChain(Device *device, Swapchain *swapchain) {
 
     free(swapchain->imageViews);
     free(swapchain->images);
+
+    if(swapchain->offscreenImages != NULL) {
+        for(uint32_t i = 0; i < swapchain->imageCount; i++) {
+            destroyDeallocateImage(swapchain->allocator, &swapchain->offscreenImages[i]);
+        }
+        free(swapchain->offscreenImages);
+        return;
+    }
+
     vkDestroySwapchainKHR(device->device, swapchain->swapchain, NULL);
 }
 
+VkResult waitForPresent(Device *device, Swapchain *swapchain, uint64_t presentId, uint64_t timeout) {
+    return VK_DEVICE_FUNC(vkWaitForPresentKHR, device->device)(
+        device->device,
+        swapchain->swapchain,
+        presentId,
+        timeout
+    );
+}
+
 VkResult acquireNextImage(Device *device, Swapchain *swapchain, uint64_t timeout, VkSemaphore semaphore, VkFence fence, uint32_t *image) {
     return vkAcquireNextImageKHR(device->device, swapchain->swapchain, timeout, semaphore, fence, image);
 }
@@ -116,16 +202,63 @@ VkSurfaceFormatKHR chooseSurfaceFormat(VkSurfaceFormatKHR *formats, size_t forma
     return formats[0];
 }
 
-VkPresentModeKHR choosePresentMode(VkPresentModeKHR *presentModes, size_t presentModeCount) {
-    for(size_t i = 0; i < presentModeCount; i++) {
-        if(presentModes[i] == VK_PRESENT_MODE_MAILBOX_KHR) {
-            return presentModes[i];
+VkPresentModeKHR choosePresentMode(VkPresentModeKHR *presentModes, size_t presentModeCount, PresentPolicy policy) {
+    // Late frames tear with relaxed FIFO instead of waiting a whole refresh
+    static const VkPresentModeKHR latencyFirst[] = {
+        VK_PRESENT_MODE_MAILBOX_KHR,
+        VK_PRESENT_MODE_FIFO_RELAXED_KHR,
+    };
+    static const VkPresentModeKHR throughputFirst[] = {
+        VK_PRESENT_MODE_IMMEDIATE_KHR,
+        VK_PRESENT_MODE_MAILBOX_KHR,
+        VK_PRESENT_MODE_FIFO_RELAXED_KHR,
+    };
+
+    const VkPresentModeKHR *preferred = NULL;
+    size_t preferredCount = 0;
+    switch(policy) {
+        case PRESENT_POLICY_LATENCY_FIRST:
+        preferred = latencyFirst;
+        preferredCount = sizeof(latencyFirst) / sizeof(VkPresentModeKHR);
+        break;
+        case PRESENT_POLICY_THROUGHPUT_FIRST:
+        preferred = throughputFirst;
+        preferredCount = sizeof(throughputFirst) / sizeof(VkPresentModeKHR);
+        break;
+        case PRESENT_POLICY_POWER_FIRST:
+        break;
+    }
+
+    for(size_t p = 0; p < preferredCount; p++) {
+        for(size_t i = 0; i < presentModeCount; i++) {
+            if(presentModes[i] == preferred[p]) {
+                return presentModes[i];
+            }
         }
     }
 
+    // Always supported
     return VK_PRESENT_MODE_FIFO_KHR;
 }
 
+uint32_t chooseImageCount(VkSurfaceCapabilitiesKHR *caps, VkPresentModeKHR presentMode, PresentPolicy policy) {
+    uint32_t imageCount = caps->minImageCount;
+
+    // Mailbox needs a spare image to replace queued frames without blocking
+    if(presentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
+        imageCount++;
+    }
+    if(policy == PRESENT_POLICY_THROUGHPUT_FIRST) {
+        imageCount++;
+    }
+
+    if(caps->maxImageCount > 0 && imageCount > caps->maxImageCount) {
+        imageCount = caps->maxImageCount;
+    }
+
+    return imageCount;
+}
+
 VkExtent2D chooseExtent(VkSurfaceCapabilitiesKHR *caps, Window *window) {
     if(caps->currentExtent.width != UINT32_MAX) {
         return caps->currentExtent;
@@ -3,6 +3,17 @@
 
 #include <vulkan/vulkan.h>
 #include "device_api.h"
+#include "vkalloc.h"
+
+// Picks present mode and image count
+typedef enum {
+    // Mailbox or relaxed FIFO with as few images as possible, frames limited by present wait
+    PRESENT_POLICY_LATENCY_FIRST,
+    // Vsynced FIFO with the minimum image count
+    PRESENT_POLICY_POWER_FIRST,
+    // Immediate or mailbox with an extra image so the GPU never waits on the display
+    PRESENT_POLICY_THROUGHPUT_FIRST,
+} PresentPolicy;
 
 typedef struct {
     VkSwapchainKHR swapchain;
@@ -14,10 +25,32 @@ typedef struct {
     VkFormat format;
     VkExtent2D extent;
     VkPresentModeKHR presentMode;
+    VkImageUsageFlags usage;
+    PresentPolicy policy;
+    // Id of the last present on this swapchain when present ids are enabled, 0 before that
+    uint64_t lastPresentId;
+
+    // Headless only: allocator owned images standing in for swapchain images
+    VkAlloc *allocator;
+    Image *offscreenImages;
 } Swapchain;
 
-VkResult createSwapChain(Device *device, Window *window, VkSurfaceKHR surface, Swapchain *swapchain);
+// oldSwapchain is retired by the call but stays valid until destroyed, it may
+// still be presenting images owned by frames in flight.
+VkResult createSwapChain(
+    Device *device,
+    Window *window,
+    VkSurfaceKHR surface,
+    PresentPolicy policy,
+    VkSwapchainKHR oldSwapchain,
+    Swapchain *swapchain
+);
+// Headless stand-in with the same images and views but no VkSwapchainKHR,
+// images are handed out round robin and never presented
+VkResult createOffscreenSwapChain(VkAlloc *alloc, VkExtent2D extent, uint32_t imageCount, Swapchain *swapchain);
 void destroySwapChain(Device *device, Swapchain *swapchain);
+// Waits until the present with the given id was displayed, needs VK_KHR_present_wait
+VkResult waitForPresent(Device *device, Swapchain *swapchain, uint64_t presentId, uint64_t timeout);
 VkResult acquireNextImage(Device *device, Swapchain *swapchain, uint64_t timeout, VkSemaphore semaphore, VkFence fence, uint32_t *image);
 
 #endif
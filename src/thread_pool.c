@@ -0,0 +1,116 @@
+// sysconf
+#define _POSIX_C_SOURCE 200809L
+
+#include "thread_pool.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <vulkan/vulkan_core.h>
+
+void *threadPoolWorker(void *userData);
+
+VkResult createThreadPool(uint32_t workerCount, ThreadPool *pool) {
+    if(workerCount == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        workerCount = cores > 1 ? (uint32_t)(cores - 1) : 1;
+    }
+    if(workerCount > THREAD_POOL_MAX_WORKERS) {
+        workerCount = THREAD_POOL_MAX_WORKERS;
+    }
+
+    memset(pool, 0, sizeof(ThreadPool));
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+
+    for(uint32_t i = 0; i < workerCount; i++) {
+        if(pthread_create(&pool->workers[i], NULL, threadPoolWorker, pool) != 0) {
+            fprintf(stderr, "Failed to start worker thread %u.\n", i);
+            destroyThreadPool(pool);
+            return VK_ERROR_INITIALIZATION_FAILED;
+        }
+        pool->workerCount++;
+    }
+
+    return VK_SUCCESS;
+}
+
+void destroyThreadPool(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->stopping = VK_TRUE;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for(uint32_t i = 0; i < pool->workerCount; i++) {
+        pthread_join(pool->workers[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->idle);
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->mutex);
+}
+
+VkBool32 threadPoolSubmit(ThreadPool *pool, ThreadPoolJob job, void *userData) {
+    pthread_mutex_lock(&pool->mutex);
+    if(pool->queueCount == THREAD_POOL_QUEUE_SIZE || pool->stopping) {
+        pthread_mutex_unlock(&pool->mutex);
+        return VK_FALSE;
+    }
+
+    uint32_t tail = (pool->queueHead + pool->queueCount) % THREAD_POOL_QUEUE_SIZE;
+    pool->queue[tail] = (ThreadPoolTask){
+        .job = job,
+        .userData = userData,
+    };
+    pool->queueCount++;
+    pthread_cond_signal(&pool->wake);
+    pthread_mutex_unlock(&pool->mutex);
+
+    return VK_TRUE;
+}
+
+void threadPoolWaitIdle(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    while(pool->queueCount > 0 || pool->active > 0) {
+        pthread_cond_wait(&pool->idle, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+uint32_t threadPoolWorkerCount(ThreadPool *pool) {
+    return pool->workerCount;
+}
+
+// Runs jobs until stopped, the queue is drained before a worker exits
+void *threadPoolWorker(void *userData) {
+    ThreadPool *pool = (ThreadPool*)userData;
+
+    pthread_mutex_lock(&pool->mutex);
+    for(;;) {
+        while(pool->queueCount == 0 && !pool->stopping) {
+            pthread_cond_wait(&pool->wake, &pool->mutex);
+        }
+        if(pool->queueCount == 0) {
+            break;
+        }
+
+        ThreadPoolTask task = pool->queue[pool->queueHead];
+        pool->queueHead = (pool->queueHead + 1) % THREAD_POOL_QUEUE_SIZE;
+        pool->queueCount--;
+        pool->active++;
+        pthread_mutex_unlock(&pool->mutex);
+
+        task.job(task.userData);
+
+        pthread_mutex_lock(&pool->mutex);
+        pool->active--;
+        if(pool->queueCount == 0 && pool->active == 0) {
+            pthread_cond_broadcast(&pool->idle);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
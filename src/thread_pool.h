@@ -0,0 +1,45 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <pthread.h>
+#include <vulkan/vulkan.h>
+
+#define THREAD_POOL_MAX_WORKERS 16
+// Jobs waiting for a worker, threadPoolSubmit fails beyond this
+#define THREAD_POOL_QUEUE_SIZE 256
+
+typedef void (*ThreadPoolJob)(void *userData);
+
+typedef struct {
+    ThreadPoolJob job;
+    void *userData;
+} ThreadPoolTask;
+
+typedef struct {
+    pthread_t workers[THREAD_POOL_MAX_WORKERS];
+    uint32_t workerCount;
+
+    // Queue state, guarded by mutex
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+    pthread_cond_t idle;
+    ThreadPoolTask queue[THREAD_POOL_QUEUE_SIZE];
+    uint32_t queueHead;
+    uint32_t queueCount;
+    // Jobs currently running on a worker
+    uint32_t active;
+    VkBool32 stopping;
+} ThreadPool;
+
+// A workerCount of 0 uses one worker per core but the calling thread's
+VkResult createThreadPool(uint32_t workerCount, ThreadPool *pool);
+// Runs every queued job before returning
+void destroyThreadPool(ThreadPool *pool);
+
+// Never blocks, returns VK_FALSE when the queue is full and the job was not queued
+VkBool32 threadPoolSubmit(ThreadPool *pool, ThreadPoolJob job, void *userData);
+// Blocks until the queue is empty and no job is running
+void threadPoolWaitIdle(ThreadPool *pool);
+uint32_t threadPoolWorkerCount(ThreadPool *pool);
+
+#endif
@@ -0,0 +1,283 @@
+#include "tlas.h"
+#include "blas.h"
+#include "device_api.h"
+#include "vkalloc.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vulkan/vk_enum_string_helper.h>
+#include <vulkan/vulkan_core.h>
+
+#define TLAS_BUILD_FLAGS (VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | \
+    VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR)
+
+VkAccelerationStructureGeometryKHR tlasGeometry(VkDeviceAddress instances);
+VkBool32 tlasNeedsRebuild(Tlas *tlas);
+void tlasRecordPositions(Tlas *tlas);
+Vector3f instancePosition(const VkAccelerationStructureInstanceKHR *instance);
+
+VkResult createTlas(
+    Device *device,
+    VkAlloc *alloc,
+    uint32_t capacity,
+    uint32_t framesInFlight,
+    TlasPolicy policy,
+    Tlas *tlas
+) {
+    if(capacity == 0 || capacity > TLAS_MAX_INSTANCES || framesInFlight > FRAME_PACER_MAX_FRAMES) {
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
+    memset(tlas, 0, sizeof(Tlas));
+    tlas->device = device;
+    tlas->alloc = alloc;
+    tlas->policy = policy;
+    tlas->capacity = capacity;
+    tlas->framesInFlight = framesInFlight;
+
+    VkResult result;
+    for(uint32_t i = 0; i < framesInFlight; i++) {
+        VkBufferCreateInfo bufferInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .pQueueFamilyIndices = &device->queueFamilies.graphics,
+            .queueFamilyIndexCount = 1,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+            .size = capacity * sizeof(VkAccelerationStructureInstanceKHR),
+            .usage = VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR |
+                VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+        };
+        result = createAllocateBuffer(
+            alloc,
+            &bufferInfo,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            &tlas->instanceBuffers[i]
+        );
+        if(result != VK_SUCCESS) {
+            return result;
+        }
+
+        tlas->mappedInstances[i] = mapBufferMemory(alloc, &tlas->instanceBuffers[i]);
+        if(tlas->mappedInstances[i] == NULL) {
+            return VK_ERROR_MEMORY_MAP_FAILED;
+        }
+    }
+
+    // Sized once for the capacity, instance counts below it fit the same storage
+    VkAccelerationStructureGeometryKHR geometry = tlasGeometry(0);
+    VkAccelerationStructureBuildGeometryInfoKHR buildInfo = {
+        .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+        .type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR,
+        .flags = TLAS_BUILD_FLAGS,
+        .mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+        .geometryCount = 1,
+        .pGeometries = &geometry,
+    };
+    VkAccelerationStructureBuildSizesInfoKHR sizes = {
+        .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR,
+    };
+    getAccelerationStructureBuildSizesKHR(
+        device,
+        VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
+        &buildInfo,
+        &capacity,
+        &sizes
+    );
+
+    result = createAccelerationStructure(
+        alloc,
+        VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR,
+        sizes.accelerationStructureSize,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        &tlas->structure
+    );
+    if(result != VK_SUCCESS) {
+        return result;
+    }
+
+    // Refits and rebuilds share the scratch, the GPU runs them one after the other
+    VkDeviceSize alignment = blasScratchAlignment(device);
+    VkDeviceSize scratchSize = sizes.buildScratchSize > sizes.updateScratchSize ?
+        sizes.buildScratchSize : sizes.updateScratchSize;
+    VkBufferCreateInfo scratchInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pQueueFamilyIndices = &device->queueFamilies.graphics,
+        .queueFamilyIndexCount = 1,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .size = scratchSize + alignment,
+        .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+    };
+    result = createAllocateBuffer(alloc, &scratchInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &tlas->scratch);
+    if(result != VK_SUCCESS) {
+        fprintf(stderr, "Failed to allocate TLAS scratch: %s.\n", string_VkResult(result));
+        return result;
+    }
+    VkDeviceAddress scratchAddress = getBufferAddress(device, &tlas->scratch);
+    tlas->scratchAddress = (scratchAddress + alignment - 1) & ~(alignment - 1);
+
+    return VK_SUCCESS;
+}
+
+void destroyTlas(Tlas *tlas) {
+    destroyDeallocateBuffer(tlas->alloc, &tlas->scratch);
+    destroyAccelerationStructure(tlas->alloc, &tlas->structure);
+    for(uint32_t i = 0; i < tlas->framesInFlight; i++) {
+        unmapBufferMemory(tlas->alloc, &tlas->instanceBuffers[i]);
+        destroyDeallocateBuffer(tlas->alloc, &tlas->instanceBuffers[i]);
+    }
+}
+
+VkResult tlasSetInstance(
+    Tlas *tlas,
+    uint32_t index,
+    const Matrix4f *transform,
+    VkDeviceAddress blas,
+    uint32_t customIndex,
+    uint32_t hitRecord
+) {
+    if(index > tlas->instanceCount || index >= tlas->capacity) {
+        return VK_ERROR_TOO_MANY_OBJECTS;
+    }
+
+    VkAccelerationStructureInstanceKHR instance = {
+        .instanceCustomIndex = customIndex,
+        .mask = 0xFF,
+        .instanceShaderBindingTableRecordOffset = hitRecord,
+        // The demo geometry is flat, both sides are hit
+        .flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR,
+        .accelerationStructureReference = blas,
+    };
+    // Row-major 3x4, the matrix is column-major with an implicit last row
+    for(uint32_t column = 0; column < 4; column++) {
+        const Vector4f *c = &transform->columns[column];
+        instance.transform.matrix[0][column] = c->x;
+        instance.transform.matrix[1][column] = c->y;
+        instance.transform.matrix[2][column] = c->z;
+    }
+
+    if(index == tlas->instanceCount) {
+        tlas->instanceCount++;
+    } else if(memcmp(&tlas->instances[index], &instance, sizeof(instance)) == 0) {
+        return VK_SUCCESS;
+    }
+
+    tlas->instances[index] = instance;
+    tlas->staleSlots[index] = (uint8_t)((1u << tlas->framesInFlight) - 1);
+    tlas->changed = VK_TRUE;
+
+    // Instances added since the last rebuild have nothing to be measured against
+    if(index < tlas->builtCount) {
+        Vector3f built = tlas->builtPositions[index];
+        Vector3f now = instancePosition(&instance);
+        float dx = now.x - built.x, dy = now.y - built.y, dz = now.z - built.z;
+        float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+        if(distance > tlas->motion) {
+            tlas->motion = distance;
+        }
+    }
+
+    return VK_SUCCESS;
+}
+
+VkBool32 tlasChanged(Tlas *tlas) {
+    return tlas->changed;
+}
+
+void cmdTlasBuild(Tlas *tlas, VkCommandBuffer buffer, uint32_t frameSlot) {
+    uint8_t slotBit = (uint8_t)(1u << frameSlot);
+    VkAccelerationStructureInstanceKHR *mapped = tlas->mappedInstances[frameSlot];
+    for(uint32_t i = 0; i < tlas->instanceCount; i++) {
+        if(tlas->staleSlots[i] & slotBit) {
+            mapped[i] = tlas->instances[i];
+            tlas->staleSlots[i] &= (uint8_t)~slotBit;
+            tlas->stats.instancesWritten++;
+        }
+    }
+
+    VkBool32 rebuild = tlasNeedsRebuild(tlas);
+
+    VkAccelerationStructureGeometryKHR geometry = tlasGeometry(
+        getBufferAddress(tlas->device, &tlas->instanceBuffers[frameSlot])
+    );
+    VkAccelerationStructureBuildGeometryInfoKHR buildInfo = {
+        .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+        .type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR,
+        .flags = TLAS_BUILD_FLAGS,
+        .mode = rebuild ? VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR :
+            VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR,
+        .srcAccelerationStructure = rebuild ? VK_NULL_HANDLE : tlas->structure.structure,
+        .dstAccelerationStructure = tlas->structure.structure,
+        .geometryCount = 1,
+        .pGeometries = &geometry,
+        .scratchData.deviceAddress = tlas->scratchAddress,
+    };
+    VkAccelerationStructureBuildRangeInfoKHR range = {
+        .primitiveCount = tlas->instanceCount,
+    };
+    const VkAccelerationStructureBuildRangeInfoKHR *ranges = &range;
+    cmdBuildAccelerationStructuresKHR(tlas->device, buffer, 1, &buildInfo, &ranges);
+
+    if(rebuild) {
+        tlasRecordPositions(tlas);
+        tlas->stats.rebuilds++;
+    } else {
+        tlas->refitsSinceBuild++;
+        tlas->stats.refits++;
+    }
+    tlas->changed = VK_FALSE;
+}
+
+TlasStats tlasStats(Tlas *tlas) {
+    return tlas->stats;
+}
+
+VkAccelerationStructureGeometryKHR tlasGeometry(VkDeviceAddress instances) {
+    return (VkAccelerationStructureGeometryKHR){
+        .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+        .geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR,
+        .geometry.instances = {
+            .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR,
+            .arrayOfPointers = VK_FALSE,
+            .data.deviceAddress = instances,
+        },
+    };
+}
+
+// A refit has to keep the instance count of the build it updates
+VkBool32 tlasNeedsRebuild(Tlas *tlas) {
+    return tlas->builtCount == 0 ||
+        tlas->instanceCount != tlas->builtCount ||
+        tlas->refitsSinceBuild >= tlas->policy.maxRefits ||
+        tlas->motion > tlas->policy.rebuildMotion * tlas->builtExtent;
+}
+
+// Remembers where the instances are and how far apart, the next refits are measured against it
+void tlasRecordPositions(Tlas *tlas) {
+    Vector3f min = {INFINITY, INFINITY, INFINITY};
+    Vector3f max = {-INFINITY, -INFINITY, -INFINITY};
+    for(uint32_t i = 0; i < tlas->instanceCount; i++) {
+        Vector3f position = instancePosition(&tlas->instances[i]);
+        tlas->builtPositions[i] = position;
+
+        min.x = fminf(min.x, position.x);
+        min.y = fminf(min.y, position.y);
+        min.z = fminf(min.z, position.z);
+        max.x = fmaxf(max.x, position.x);
+        max.y = fmaxf(max.y, position.y);
+        max.z = fmaxf(max.z, position.z);
+    }
+
+    float dx = max.x - min.x, dy = max.y - min.y, dz = max.z - min.z;
+    tlas->builtExtent = tlas->instanceCount > 0 ? sqrtf(dx * dx + dy * dy + dz * dz) : 0.0f;
+    tlas->builtCount = tlas->instanceCount;
+    tlas->motion = 0.0f;
+    tlas->refitsSinceBuild = 0;
+}
+
+Vector3f instancePosition(const VkAccelerationStructureInstanceKHR *instance) {
+    return (Vector3f){
+        instance->transform.matrix[0][3],
+        instance->transform.matrix[1][3],
+        instance->transform.matrix[2][3],
+    };
+}
@@ -0,0 +1,93 @@
+#ifndef TLAS_H_
+#define TLAS_H_
+
+#include <vulkan/vulkan.h>
+
+#include "device_api.h"
+#include "frame_pacer.h"
+#include "mesh.h"
+#include "vkalloc.h"
+
+#define TLAS_MAX_INSTANCES 4096
+
+// When an update is refitted in place and when the structure is rebuilt instead. Refits
+// keep the topology of the last rebuild, so the tree loosens the further instances move.
+typedef struct {
+    // Fraction of the extent spanned by the instances at the last rebuild that any
+    // instance may move away from its position then
+    float rebuildMotion;
+    // Refits in a row before a rebuild regardless of motion
+    uint32_t maxRefits;
+} TlasPolicy;
+
+typedef struct {
+    uint32_t refits;
+    uint32_t rebuilds;
+    // Instances copied into a frame's instance buffer
+    uint32_t instancesWritten;
+} TlasStats;
+
+typedef struct {
+    Device *device;
+    VkAlloc *alloc;
+    TlasPolicy policy;
+    uint32_t capacity;
+    uint32_t framesInFlight;
+
+    // CPU copy of every instance, a frame's buffer only gets the ones it hasn't seen yet
+    VkAccelerationStructureInstanceKHR instances[TLAS_MAX_INSTANCES];
+    // One bit per frame slot whose buffer holds a stale copy of the instance
+    uint8_t staleSlots[TLAS_MAX_INSTANCES];
+    uint32_t instanceCount;
+    // Set by instance changes, cleared by the build that picks them up
+    VkBool32 changed;
+
+    // Instance positions at the last rebuild, refits are measured against them
+    Vector3f builtPositions[TLAS_MAX_INSTANCES];
+    uint32_t builtCount;
+    float builtExtent;
+    float motion;
+    uint32_t refitsSinceBuild;
+
+    // Persistently mapped, one per frame in flight so the CPU never writes what the GPU reads
+    Buffer instanceBuffers[FRAME_PACER_MAX_FRAMES];
+    VkAccelerationStructureInstanceKHR *mappedInstances[FRAME_PACER_MAX_FRAMES];
+
+    // Sized for capacity instances, rebuilt and refitted in place
+    AccelerationStructure structure;
+    Buffer scratch;
+    VkDeviceAddress scratchAddress;
+
+    TlasStats stats;
+} Tlas;
+
+VkResult createTlas(
+    Device *device,
+    VkAlloc *alloc,
+    uint32_t capacity,
+    uint32_t framesInFlight,
+    TlasPolicy policy,
+    Tlas *tlas
+);
+// The GPU has to be done with the structure
+void destroyTlas(Tlas *tlas);
+
+// Sets instance index, up to instanceCount which appends one. Marks it changed only if it
+// differs from what is there. customIndex is gl_InstanceCustomIndexEXT and hitRecord the
+// instance's first record in the hit region of the shader binding table, 24 bits each.
+VkResult tlasSetInstance(
+    Tlas *tlas,
+    uint32_t index,
+    const Matrix4f *transform,
+    VkDeviceAddress blas,
+    uint32_t customIndex,
+    uint32_t hitRecord
+);
+// Whether the structure is out of date, a frame only has to build it then
+VkBool32 tlasChanged(Tlas *tlas);
+// Copies the instances the frame's buffer hasn't seen yet and records a refit or rebuild,
+// whichever the policy picks. The structure and scratch are written in the build stage.
+void cmdTlasBuild(Tlas *tlas, VkCommandBuffer buffer, uint32_t frameSlot);
+TlasStats tlasStats(Tlas *tlas);
+
+#endif
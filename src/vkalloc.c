@@ -11,6 +11,7 @@ uint32_t findMemoryType(uint32_t typeFilter, VkPhysicalDeviceMemoryProperties pr
 VkAlloc *createAllocator(Device *device) {
     VkAlloc *allocator = (VkAlloc*)calloc(1, sizeof(VkAlloc));
     allocator->array = DeviceMemoryArrayNew(1000);
+    allocator->freeSlots = MemorySlotArrayNew(64);
     allocator->device = device;
 
     return allocator;
@@ -18,10 +19,13 @@ VkAlloc *createAllocator(Device *device) {
 
 void destroyAllocator(VkAlloc *alloc) {
     for(size_t i = 0; i < alloc->array.elementCount; i++) {
-        vkFreeMemory(alloc->device->device, alloc->array.elements[i], NULL);
+        if(alloc->array.elements[i] != VK_NULL_HANDLE) {
+            vkFreeMemory(alloc->device->device, alloc->array.elements[i], NULL);
+        }
     }
 
     DeviceMemoryArrayDestroy(&alloc->array);
+    MemorySlotArrayDestroy(&alloc->freeSlots);
     free(alloc);
 }
 
@@ -33,24 +37,28 @@ VkDeviceAddress getBufferAddress(Device *device, Buffer *buffer) {
     return vkGetBufferDeviceAddress(device->device, &addressInfo);
 }
 
-VkResult createBlas(
+VkResult createAccelerationStructure(
     VkAlloc *alloc,
+    VkAccelerationStructureTypeKHR type,
     VkDeviceSize size,
+    VkMemoryPropertyFlags flags,
     AccelerationStructure *structure
 ) {
+    VkResult result;
+
     VkBufferCreateInfo bufferInfo = {
         .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
         .pQueueFamilyIndices = &alloc->device->queueFamilies.graphics,
         .queueFamilyIndexCount = 1,
         .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
         .size = size,
-        .usage = VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR
+        .usage = VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
     };
-    VkResult result;
     result = createAllocateBuffer(
         alloc,
         &bufferInfo,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        flags,
         &structure->buffer
     );
     if(result != VK_SUCCESS) {
@@ -66,8 +74,8 @@ VkResult createBlas(
         .sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
         .buffer = structure->buffer.buffer,
         .offset = 0,
-        .type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
-        .size = structure->buffer.memorySize,
+        .type = type,
+        .size = size,
         .deviceAddress = 0,
     };
 
@@ -80,6 +88,7 @@ VkResult createBlas(
         fprintf(stderr, "Failed to create acceleration structure: %s.\n",
             string_VkResult(result)
         );
+        destroyDeallocateBuffer(alloc, &structure->buffer);
         return result;
     }
 
@@ -91,7 +100,14 @@ void destroyAccelerationStructure(VkAlloc *alloc, AccelerationStructure *structu
     destroyDeallocateBuffer(alloc, &structure->buffer);
 }
 
-VkResult allocateDeviceMemory(VkAlloc *alloc, VkMemoryRequirements reqs, VkMemoryPropertyFlags flags, VkDeviceMemory *memory) {
+VkResult allocateDeviceMemory(
+    VkAlloc *alloc,
+    VkMemoryRequirements reqs,
+    VkMemoryPropertyFlags flags,
+    VkMemoryAllocateFlags allocateFlags,
+    VkDeviceMemory *memory,
+    uint32_t *slot
+) {
     uint32_t result;
 
     VkPhysicalDeviceMemoryProperties props;
@@ -103,10 +119,16 @@ VkResult allocateDeviceMemory(VkAlloc *alloc, VkMemoryRequirements reqs, VkMemor
         flags
     );
 
+    VkMemoryAllocateFlagsInfo allocFlagsInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO,
+        .flags = allocateFlags,
+    };
+
     VkMemoryAllocateInfo allocInfo = {
         .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
         .allocationSize = reqs.size,
         .memoryTypeIndex = memoryType,
+        .pNext = allocateFlags != 0 ? &allocFlagsInfo : NULL,
     };
 
     VkDeviceMemory mem;
@@ -117,12 +139,36 @@ VkResult allocateDeviceMemory(VkAlloc *alloc, VkMemoryRequirements reqs, VkMemor
         return result;
     }
 
-    DeviceMemoryArrayAddElement(&alloc->array, mem);
+    if(alloc->freeSlots.elementCount > 0) {
+        *slot = alloc->freeSlots.elements[--alloc->freeSlots.elementCount];
+        alloc->array.elements[*slot] = mem;
+    } else {
+        *slot = (uint32_t)alloc->array.elementCount;
+        DeviceMemoryArrayAddElement(&alloc->array, mem);
+    }
     *memory = mem;
 
     return VK_SUCCESS;
 }
 
+VkResult freeDeviceMemory(VkAlloc *alloc, VkDeviceMemory memory, uint32_t slot) {
+    if(memory == VK_NULL_HANDLE) {
+        return VK_SUCCESS;
+    }
+
+    DeviceMemoryArray *array = &alloc->array;
+    if(slot >= array->elementCount || array->elements[slot] != memory) {
+        fprintf(stderr, "Device memory freed through slot %u does not belong to it.\n", slot);
+        return VK_ERROR_UNKNOWN;
+    }
+
+    array->elements[slot] = VK_NULL_HANDLE;
+    MemorySlotArrayAddElement(&alloc->freeSlots, slot);
+    vkFreeMemory(alloc->device->device, memory, NULL);
+
+    return VK_SUCCESS;
+}
+
 VkResult createAllocateBuffer(VkAlloc *alloc, VkBufferCreateInfo *bufferInfo, VkMemoryPropertyFlags flags, Buffer *buffer) {
     VkBuffer buf;
     VkResult result;
@@ -135,8 +181,15 @@ VkResult createAllocateBuffer(VkAlloc *alloc, VkBufferCreateInfo *bufferInfo, Vk
 
     VkMemoryRequirements reqs = getBufferMemoryRequirements(alloc->device, buf);
     VkDeviceMemory memory;
+    uint32_t slot;
 
-    result = allocateDeviceMemory(alloc, reqs, flags, &memory);
+    // Buffers read through device addresses need memory allocated for it
+    VkMemoryAllocateFlags allocateFlags = 0;
+    if(bufferInfo->usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) {
+        allocateFlags |= VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+    }
+
+    result = allocateDeviceMemory(alloc, reqs, flags, allocateFlags, &memory, &slot);
     if(result != VK_SUCCESS) {
         fprintf(stderr, "Failed to allocate device memory: %s.\n", string_VkResult(result));
         return result;
@@ -151,6 +204,7 @@ VkResult createAllocateBuffer(VkAlloc *alloc, VkBufferCreateInfo *bufferInfo, Vk
     *buffer = (Buffer){
         .buffer = buf,
         .memory = memory,
+        .slot = slot,
         .memorySize = bufferInfo->size,
     };
 
@@ -159,6 +213,47 @@ VkResult createAllocateBuffer(VkAlloc *alloc, VkBufferCreateInfo *bufferInfo, Vk
 
 void destroyDeallocateBuffer(VkAlloc *alloc, Buffer *buffer) {
     destroyBuffer(alloc->device, buffer->buffer);
+    freeDeviceMemory(alloc, buffer->memory, buffer->slot);
+}
+
+VkResult createAllocateImage(VkAlloc *alloc, VkImageCreateInfo *imageInfo, VkMemoryPropertyFlags flags, Image *image) {
+    VkImage img;
+    VkResult result;
+    result = createImage(alloc->device, imageInfo, &img);
+
+    if(result != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create image: %s.\n", string_VkResult(result));
+        return result;
+    }
+
+    VkMemoryRequirements reqs = getImageMemoryRequirements(alloc->device, img);
+    VkDeviceMemory memory;
+    uint32_t slot;
+
+    result = allocateDeviceMemory(alloc, reqs, flags, 0, &memory, &slot);
+    if(result != VK_SUCCESS) {
+        fprintf(stderr, "Failed to allocate device memory: %s.\n", string_VkResult(result));
+        return result;
+    }
+
+    result = bindImageMemory(alloc->device, img, memory, 0);
+    if(result != VK_SUCCESS) {
+        fprintf(stderr, "Failed to bind device memory: %s.\n", string_VkResult(result));
+        return result;
+    }
+
+    *image = (Image){
+        .image = img,
+        .memory = memory,
+        .slot = slot,
+    };
+
+    return VK_SUCCESS;
+}
+
+void destroyDeallocateImage(VkAlloc *alloc, Image *image) {
+    destroyImage(alloc->device, image->image);
+    freeDeviceMemory(alloc, image->memory, image->slot);
 }
 
 void *mapBufferMemory(VkAlloc *alloc, Buffer *buffer) {
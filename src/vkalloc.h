@@ -5,18 +5,30 @@
 #include "device_api.h"
 #include <vulkan/vulkan.h>
 
-// Simple arena allocator: does not deallocate until destroyed (for now)
+// Dedicated allocation per resource. Memory still held when the allocator is destroyed is freed
+// with it.
 typedef struct {
     Device *device;
+    // Indexed by slot, freed slots hold VK_NULL_HANDLE until they are reused
     DeviceMemoryArray array;
+    MemorySlotArray freeSlots;
 } VkAlloc;
 
 typedef struct {
     VkBuffer buffer;
     VkDeviceMemory memory;
+    // Slot of memory in the allocator
+    uint32_t slot;
     VkDeviceSize memorySize;
 } Buffer;
 
+typedef struct {
+    VkImage image;
+    VkDeviceMemory memory;
+    // Slot of memory in the allocator
+    uint32_t slot;
+} Image;
+
 typedef struct {
     Buffer buffer;
     VkAccelerationStructureKHR structure;
@@ -26,16 +38,32 @@ VkAlloc *createAllocator(Device *device);
 void destroyAllocator(VkAlloc *alloc);
 
 VkDeviceAddress getBufferAddress(Device *device, Buffer *buffer);
-VkResult createBlas(
+// An empty structure with dedicated storage of exactly size bytes. Structures built on the
+// host need host visible memory.
+VkResult createAccelerationStructure(
     VkAlloc *alloc,
+    VkAccelerationStructureTypeKHR type,
     VkDeviceSize size,
+    VkMemoryPropertyFlags flags,
     AccelerationStructure *structure
 );
 void destroyAccelerationStructure(VkAlloc *alloc, AccelerationStructure *structure);
 
-VkResult allocateDeviceMemory(VkAlloc *alloc, VkMemoryRequirements reqs, VkMemoryPropertyFlags flags, VkDeviceMemory *memory);
+VkResult allocateDeviceMemory(
+    VkAlloc *alloc,
+    VkMemoryRequirements reqs,
+    VkMemoryPropertyFlags flags,
+    VkMemoryAllocateFlags allocateFlags,
+    VkDeviceMemory *memory,
+    uint32_t *slot
+);
+// Frees memory through the slot it was allocated in. Memory that does not match its slot is
+// reported and left alone.
+VkResult freeDeviceMemory(VkAlloc *alloc, VkDeviceMemory memory, uint32_t slot);
 VkResult createAllocateBuffer(VkAlloc *alloc, VkBufferCreateInfo *bufferInfo, VkMemoryPropertyFlags flags, Buffer *buffer);
 void destroyDeallocateBuffer(VkAlloc *alloc, Buffer *buffer);
+VkResult createAllocateImage(VkAlloc *alloc, VkImageCreateInfo *imageInfo, VkMemoryPropertyFlags flags, Image *image);
+void destroyDeallocateImage(VkAlloc *alloc, Image *image);
 void *mapBufferMemory(VkAlloc *alloc, Buffer *buffer);
 void unmapBufferMemory(VkAlloc *alloc, Buffer *buffer);
 